@@ -18,6 +18,14 @@ class ArenaAllocator {
     offset_ += size;
     return ret;
   }
+  /* Allocate memory aligned to align, which is at most 16 */
+  uint8_t* AllocateAligned(size_t size, size_t align) {
+    if (offset_ < BlockSize) {
+      auto addr = reinterpret_cast<uintptr_t>(ptrs_.back().get()) + offset_;
+      offset_ += (align - addr % align) % align;
+    }
+    return Allocate(size);
+  }
   void Clear() {
     ptrs_.clear();
     offset_ = BlockSize + 1;
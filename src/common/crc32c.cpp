@@ -0,0 +1,129 @@
+#include "common/crc32c.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace wing {
+
+namespace utils {
+
+/* The reversed Castagnoli polynomial */
+static constexpr uint32_t kCrc32cPoly = 0x82f63b78;
+
+/* table[k][b] is the CRC of byte b followed by k zero bytes. */
+static constexpr auto kCrc32cTable = []() {
+  std::array<std::array<uint32_t, 256>, 8> table{};
+  for (uint32_t b = 0; b < 256; b++) {
+    uint32_t crc = b;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPoly : 0);
+    }
+    table[0][b] = crc;
+  }
+  for (uint32_t b = 0; b < 256; b++) {
+    for (int k = 1; k < 8; k++) {
+      uint32_t prev = table[k - 1][b];
+      table[k][b] = (prev >> 8) ^ table[0][prev & 0xff];
+    }
+  }
+  return table;
+}();
+
+/* Slicing-by-8 */
+static uint32_t Crc32cSoftware(const char* data, size_t n, uint32_t crc) {
+  auto p = reinterpret_cast<const uint8_t*>(data);
+  auto& t = kCrc32cTable;
+  while (n >= 8) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    x ^= crc;
+    crc = t[7][x & 0xff] ^ t[6][(x >> 8) & 0xff] ^ t[5][(x >> 16) & 0xff] ^
+          t[4][(x >> 24) & 0xff] ^ t[3][(x >> 32) & 0xff] ^
+          t[2][(x >> 40) & 0xff] ^ t[1][(x >> 48) & 0xff] ^ t[0][x >> 56];
+    p += 8;
+    n -= 8;
+  }
+  while (n > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+    p++;
+    n--;
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) static uint32_t Crc32cHardware(
+    const char* data, size_t n, uint32_t crc) {
+  uint64_t crc64 = crc;
+  while (n >= 8) {
+    uint64_t x;
+    memcpy(&x, data, sizeof(x));
+    crc64 = _mm_crc32_u64(crc64, x);
+    data += 8;
+    n -= 8;
+  }
+  crc = crc64;
+  while (n > 0) {
+    crc = _mm_crc32_u8(crc, *data);
+    data++;
+    n--;
+  }
+  return crc;
+}
+
+static const bool kHasHardwareCrc32c = __builtin_cpu_supports("sse4.2");
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+static uint32_t Crc32cHardware(const char* data, size_t n, uint32_t crc) {
+  while (n >= 8) {
+    uint64_t x;
+    memcpy(&x, data, sizeof(x));
+    crc = __crc32cd(crc, x);
+    data += 8;
+    n -= 8;
+  }
+  while (n > 0) {
+    crc = __crc32cb(crc, *data);
+    data++;
+    n--;
+  }
+  return crc;
+}
+
+static const bool kHasHardwareCrc32c = true;
+
+#else
+
+static uint32_t Crc32cHardware(const char* data, size_t n, uint32_t crc) {
+  return Crc32cSoftware(data, n, crc);
+}
+
+static const bool kHasHardwareCrc32c = false;
+
+#endif
+
+uint32_t Crc32c(const char* data, size_t n, uint32_t crc) {
+  crc = ~crc;
+  if (kHasHardwareCrc32c) {
+    crc = Crc32cHardware(data, n, crc);
+  } else {
+    crc = Crc32cSoftware(data, n, crc);
+  }
+  return ~crc;
+}
+
+uint32_t Crc32c(std::string_view str, uint32_t crc) {
+  return Crc32c(str.data(), str.size(), crc);
+}
+
+}  // namespace utils
+
+}  // namespace wing
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace wing {
+
+namespace utils {
+
+/**
+ * CRC32C (Castagnoli). It uses the CRC32 instructions of SSE4.2 or ARMv8 if
+ * the CPU supports them, and a table-driven implementation otherwise.
+ *
+ * crc is the CRC32C of the preceding data, so that
+ * Crc32c(b, m, Crc32c(a, n)) is the CRC32C of the concatenation of a and b.
+ */
+uint32_t Crc32c(const char* data, size_t n, uint32_t crc = 0);
+
+uint32_t Crc32c(std::string_view str, uint32_t crc = 0);
+
+}  // namespace utils
+
+}  // namespace wing
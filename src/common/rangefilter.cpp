@@ -0,0 +1,92 @@
+#include "common/rangefilter.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "common/bloomfilter.hpp"
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace utils {
+
+/* The maximum number of intervals of the largest size in a range */
+static constexpr uint64_t kRangeFilterMaxIntervals = 64;
+
+static size_t PrefixHash(uint64_t prefix, size_t level) {
+  return Hash8(prefix, 0x202410171500 + level);
+}
+
+/* Probe the interval and its sub-intervals down to level 0. */
+static bool Doubt(uint64_t prefix, size_t level, std::string_view bloom) {
+  if (!BloomFilter::Find(PrefixHash(prefix, level), bloom)) {
+    return false;
+  }
+  if (level == 0) {
+    return true;
+  }
+  return Doubt(prefix << 1, level - 1, bloom) ||
+         Doubt(prefix << 1 | 1, level - 1, bloom);
+}
+
+uint64_t RangeFilter::KeyPrefix(std::string_view key) {
+  uint64_t ret = 0;
+  for (size_t i = 0; i < sizeof(uint64_t); i++) {
+    uint8_t byte = i < key.size() ? key[i] : 0;
+    ret = ret << 8 | byte;
+  }
+  return ret;
+}
+
+void RangeFilter::Build(std::span<const uint64_t> keys, size_t levels,
+    size_t bits_per_key, std::string& filter) {
+  levels = std::clamp<size_t>(levels, 1, 64);
+  std::vector<size_t> hashes;
+  for (size_t l = 0; l < levels; l++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0 && keys[i] >> l == keys[i - 1] >> l) {
+        continue;
+      }
+      hashes.push_back(PrefixHash(keys[i] >> l, l));
+    }
+  }
+  std::string bloom;
+  BloomFilter::Create(hashes.size(), bits_per_key, bloom);
+  for (auto h : hashes) {
+    BloomFilter::Add(h, bloom);
+  }
+  filter.assign(sizeof(uint64_t), 0);
+  Serializer(filter.data()).Write<uint64_t>(levels);
+  filter.append(bloom);
+}
+
+bool RangeFilter::MayContain(
+    uint64_t lo, uint64_t hi, std::string_view filter) {
+  if (lo > hi) {
+    return false;
+  }
+  size_t top = Deserializer(filter.data()).Read<uint64_t>() - 1;
+  auto bloom = filter.substr(sizeof(uint64_t));
+  if ((hi >> top) - (lo >> top) >= kRangeFilterMaxIntervals) {
+    return true;
+  }
+  while (true) {
+    /* The largest dyadic interval that starts at lo and ends before hi */
+    size_t l = lo == 0 ? top : std::min<size_t>(top, __builtin_ctzll(lo));
+    while (l > 0 && hi - lo < (uint64_t(1) << l) - 1) {
+      l -= 1;
+    }
+    if (Doubt(lo >> l, l, bloom)) {
+      return true;
+    }
+    uint64_t end = lo + ((uint64_t(1) << l) - 1);
+    if (end >= hi) {
+      return false;
+    }
+    lo = end + 1;
+  }
+}
+
+}  // namespace utils
+
+}  // namespace wing
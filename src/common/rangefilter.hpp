@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "common/murmurhash.hpp"
+
+namespace wing {
+
+namespace utils {
+
+/**
+ * Rosetta (Luo et al., SIGMOD 2020), a range filter made of bloom filters of
+ * key prefixes. A key is mapped to a 64-bit integer (see KeyPrefix), and for
+ * each level l in [0, levels) the filter stores the integer without its
+ * lowest l bits, i.e., the dyadic interval of size 2^l that contains it.
+ *
+ * A range [lo, hi] is split into dyadic intervals of sizes at most
+ * 2^(levels - 1). An interval that passes its probe is doubted by probing
+ * its two halves recursively down to level 0, so a false positive needs
+ * false positives along a whole path. Ranges that span more than 64
+ * intervals of the largest size are not filtered.
+ */
+class RangeFilter {
+ public:
+  /**
+   * The first 8 bytes of the key in big-endian, padded with zeros. If
+   * a <= b, then KeyPrefix(a) <= KeyPrefix(b).
+   */
+  static uint64_t KeyPrefix(std::string_view key);
+
+  /**
+   * Build the filter of the key prefixes in ascending order. Each distinct
+   * prefix of each level takes bits_per_key bits.
+   */
+  static void Build(std::span<const uint64_t> keys, size_t levels,
+      size_t bits_per_key, std::string& filter);
+
+  /* Check if a key prefix in [lo, hi] may be added */
+  static bool MayContain(uint64_t lo, uint64_t hi, std::string_view filter);
+};
+
+}  // namespace utils
+
+}  // namespace wing
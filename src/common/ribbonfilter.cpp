@@ -0,0 +1,147 @@
+#include "common/ribbonfilter.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace utils {
+
+/* The width of the coefficient rows */
+static constexpr size_t kRibbonWidth = 64;
+
+static constexpr size_t kRibbonHeaderSize = sizeof(uint64_t) * 3;
+
+/* The number of seeds tried before the matrix is enlarged */
+static constexpr size_t kRibbonSeedsPerSize = 4;
+
+/* The row of a key in the band matrix */
+struct RibbonRow {
+  size_t start;
+  uint64_t coeff;
+  uint32_t result;
+};
+
+static RibbonRow GetRow(size_t h, size_t m, size_t r, size_t seed) {
+  RibbonRow row;
+  row.start = Hash8(h, seed) % (m - kRibbonWidth + 1);
+  /* The first coefficient is always 1, which is the pivot of the row. */
+  row.coeff = Hash8(h, seed ^ 0x202410161043) | 1;
+  row.result = Hash8(h, seed ^ 0x202410161044) & ((uint64_t(1) << r) - 1);
+  return row;
+}
+
+/* The number of 64-bit words of a column. It is padded for unaligned reads. */
+static size_t ColumnWords(size_t m) { return m / 64 + 2; }
+
+/* Read 64 bits of the column starting at bit pos. */
+static uint64_t ReadBits(const uint64_t* column, size_t pos) {
+  size_t word = pos / 64, shift = pos % 64;
+  if (shift == 0) {
+    return column[word];
+  }
+  return (column[word] >> shift) | (column[word + 1] << (64 - shift));
+}
+
+/**
+ * Gaussian elimination on the fly. Each row is reduced by the rows whose
+ * pivots it covers until it gets a free pivot. It returns false if the row
+ * is reduced to 0 with a non-zero result, i.e. the system is unsolvable.
+ */
+static bool Band(std::vector<uint64_t>& coeffs,
+    std::vector<uint32_t>& results, RibbonRow row) {
+  size_t i = row.start;
+  uint64_t c = row.coeff;
+  uint32_t r = row.result;
+  while (true) {
+    if (coeffs[i] == 0) {
+      coeffs[i] = c;
+      results[i] = r;
+      return true;
+    }
+    c ^= coeffs[i];
+    r ^= results[i];
+    if (c == 0) {
+      /* A duplicate key is consistent with itself */
+      return r == 0;
+    }
+    size_t tz = __builtin_ctzll(c);
+    i += tz;
+    c >>= tz;
+  }
+}
+
+void RibbonFilter::Build(
+    std::span<const size_t> hashes, size_t bits_per_key, std::string& filter) {
+  /* About 1/16 of the space is the overhead of the band matrix. */
+  size_t r = std::clamp<size_t>(bits_per_key * 15 / 16, 1, 32);
+  size_t m = std::max(kRibbonWidth, hashes.size() + hashes.size() / 16 + 64);
+  size_t seed = 0;
+  std::vector<uint64_t> coeffs;
+  std::vector<uint32_t> results;
+  while (true) {
+    coeffs.assign(m, 0);
+    results.assign(m, 0);
+    bool ok = true;
+    for (auto h : hashes) {
+      if (!Band(coeffs, results, GetRow(h, m, r, seed))) {
+        ok = false;
+        break;
+      }
+    }
+    if (ok) {
+      break;
+    }
+    seed += 1;
+    if (seed % kRibbonSeedsPerSize == 0) {
+      m += m / 32;
+    }
+  }
+  /* Back substitution. The solution is stored column by column. */
+  size_t words = ColumnWords(m);
+  filter.assign(kRibbonHeaderSize + r * words * sizeof(uint64_t), 0);
+  Serializer(filter.data())
+      .Write<uint64_t>(m)
+      .Write<uint64_t>(r)
+      .Write<uint64_t>(seed);
+  auto* columns =
+      reinterpret_cast<uint64_t*>(filter.data() + kRibbonHeaderSize);
+  std::vector<uint32_t> solution(m, 0);
+  for (size_t i = m; i-- > 0;) {
+    if (coeffs[i] == 0) {
+      continue;
+    }
+    uint32_t z = results[i];
+    for (uint64_t c = coeffs[i] >> 1; c != 0; c &= c - 1) {
+      z ^= solution[i + 1 + __builtin_ctzll(c)];
+    }
+    solution[i] = z;
+    for (size_t j = 0; j < r; j++) {
+      columns[j * words + i / 64] |= uint64_t((z >> j) & 1) << (i % 64);
+    }
+  }
+}
+
+bool RibbonFilter::Find(size_t h, std::string_view filter) {
+  auto des = Deserializer(filter.data());
+  size_t m = des.Read<uint64_t>();
+  size_t r = des.Read<uint64_t>();
+  size_t seed = des.Read<uint64_t>();
+  auto* columns =
+      reinterpret_cast<const uint64_t*>(filter.data() + kRibbonHeaderSize);
+  auto row = GetRow(h, m, r, seed);
+  size_t words = ColumnWords(m);
+  for (size_t j = 0; j < r; j++) {
+    uint64_t bits = ReadBits(columns + j * words, row.start) & row.coeff;
+    if ((__builtin_popcountll(bits) & 1) != ((row.result >> j) & 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace utils
+
+}  // namespace wing
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "common/murmurhash.hpp"
+
+namespace wing {
+
+namespace utils {
+
+/**
+ * Standard Ribbon filter (Dillinger and Walzer, 2021). Each key is mapped to
+ * a 64-bit coefficient row starting at a position of an m-row band matrix,
+ * and an r-bit fingerprint. Building solves the linear system over GF(2)
+ * whose rows are the keys, so that the XOR of the solution rows selected by
+ * the coefficients of a key is its fingerprint. The false positive rate is
+ * 2^-r, and it takes r * m bits with m about 1.07 times the number of keys,
+ * so it needs about 30% less memory than a bloom filter with the same false
+ * positive rate. It is built from all the keys at once.
+ */
+class RibbonFilter {
+ public:
+  /**
+   * Build the filter of the key hashes (i.e. BloomFilter::BloomHash(key))
+   * with about bits_per_key bits per key.
+   */
+  static void Build(std::span<const size_t> hashes, size_t bits_per_key,
+      std::string& filter);
+
+  /* Check if a key (i.e. BloomFilter::BloomHash(key)) may be added */
+  static bool Find(size_t hash, std::string_view filter);
+};
+
+}  // namespace utils
+
+}  // namespace wing
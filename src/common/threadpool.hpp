@@ -19,7 +19,7 @@ class ThreadPool {
             std::unique_lock lock(task_queue_mu_);
             if (task_queue_.empty()) {
               // If someone is waiting for all tasks to be completed.
-              if (is_waiting_finish_ &&
+              if (waiting_finish_num_ > 0 &&
                   !active_thread_num_.load(std::memory_order_relaxed)) {
                 cv_wait_finish_.notify_all();
               }
@@ -34,15 +34,24 @@ class ThreadPool {
               // If we need to do work.
               F = std::move(task_queue_.front());
               task_queue_.pop_front();
+              // Count it before the lock is released, so that
+              // WaitForAllTasks() does not return before it finishes.
+              active_thread_num_ += 1;
             } else if (stop_signal_) {
               // If we have to stop.
               return;
             }
           }
-          active_thread_num_ += 1;
           // Do work.
           F();
-          active_thread_num_ -= 1;
+          {
+            std::unique_lock lock(task_queue_mu_);
+            active_thread_num_ -= 1;
+            if (waiting_finish_num_ > 0 && task_queue_.empty() &&
+                !active_thread_num_.load(std::memory_order_relaxed)) {
+              cv_wait_finish_.notify_all();
+            }
+          }
         }
       });
     }
@@ -62,10 +71,10 @@ class ThreadPool {
     if (task_queue_.empty() && !active_thread_num_) {
       return;
     }
-    is_waiting_finish_ = true;
+    waiting_finish_num_ += 1;
     cv_wait_finish_.wait(
         lck, [&]() { return task_queue_.empty() && !active_thread_num_; });
-    is_waiting_finish_ = false;
+    waiting_finish_num_ -= 1;
   }
 
   size_t GetQueueLength() const { return task_queue_.size(); }
@@ -107,8 +116,8 @@ class ThreadPool {
 
   bool stop_signal_{false};
 
-  /* Is someone is waiting in WaitForAllTasks() */
-  bool is_waiting_finish_{false};
+  /* The number of threads waiting in WaitForAllTasks() */
+  size_t waiting_finish_num_{0};
   std::condition_variable cv_wait_finish_;
 };
 }  // namespace wing
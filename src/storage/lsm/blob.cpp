@@ -0,0 +1,144 @@
+#include "storage/lsm/blob.hpp"
+
+#include <charconv>
+#include <filesystem>
+
+#include "common/crc32c.hpp"
+#include "common/exception.hpp"
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+std::string BlobIndex::Encode() const {
+  std::string ret(3 * sizeof(uint64_t), 0);
+  utils::Serializer(ret.data())
+      .Write<uint64_t>(file_id_)
+      .Write<uint64_t>(offset_)
+      .Write<uint64_t>(size_);
+  return ret;
+}
+
+BlobIndex BlobIndex::Decode(Slice data) {
+  if (data.size() != 3 * sizeof(uint64_t)) {
+    throw DBException("Corrupted blob index of size {}", data.size());
+  }
+  utils::Deserializer des(data.data());
+  BlobIndex ret;
+  ret.file_id_ = des.Read<uint64_t>();
+  ret.offset_ = des.Read<uint64_t>();
+  ret.size_ = des.Read<uint64_t>();
+  return ret;
+}
+
+BlobIndex BlobFileBuilder::Add(Slice key, Slice value) {
+  if (writer_ == nullptr) {
+    auto [filename, id] = file_gen_->Generate("blob");
+    id_ = id;
+    writer_ = std::make_unique<FileWriter>(
+        std::make_unique<SeqWriteFile>(filename, false), write_buffer_size_);
+  }
+  writer_->AppendValue<uint32_t>(key.size())
+      .AppendString(key)
+      .AppendValue<uint32_t>(value.size());
+  BlobIndex index{id_, writer_->size(), value.size()};
+  writer_->AppendString(value).AppendValue<uint32_t>(utils::Crc32c(value));
+  count_ += 1;
+  return index;
+}
+
+void BlobFileBuilder::Finish() {
+  if (writer_ != nullptr) {
+    writer_->Flush();
+  }
+}
+
+BlobFile::BlobFile(std::string filename, size_t id, bool verify_checksums)
+  : filename_(std::move(filename)),
+    id_(id),
+    verify_checksums_(verify_checksums),
+    file_(std::make_unique<ReadFile>(filename_, false)) {}
+
+BlobFile::~BlobFile() {
+  if (remove_tag_) {
+    file_.reset();
+    std::filesystem::remove(filename_);
+  }
+}
+
+void BlobFile::Read(const BlobIndex& index, std::string* value) const {
+  value->resize(index.size_ + sizeof(uint32_t));
+  auto len = file_->Read(value->data(), value->size(), index.offset_);
+  if (len != static_cast<ssize_t>(value->size())) {
+    throw DBException("Corrupted blob file {}: short read at offset {}",
+        filename_, index.offset_);
+  }
+  uint32_t checksum =
+      utils::Deserializer(value->data() + index.size_).Read<uint32_t>();
+  value->resize(index.size_);
+  if (verify_checksums_ && utils::Crc32c(*value) != checksum) {
+    throw DBException("Corrupted blob file {}: checksum mismatch at offset {}",
+        filename_, index.offset_);
+  }
+}
+
+void BlobFile::AddReference() {
+  refs_.fetch_add(1);
+  remove_tag_ = false;
+}
+
+void BlobFile::RemoveReference() {
+  if (refs_.fetch_sub(1) == 1) {
+    remove_tag_ = true;
+  }
+}
+
+std::string BlobStore::FileName(size_t id) const {
+  return fmt::format("{}{}.blob", prefix_, id);
+}
+
+std::shared_ptr<BlobFile> BlobStore::GetFile(size_t id) {
+  std::unique_lock lck(mu_);
+  auto& file = files_[id];
+  auto ret = file.lock();
+  if (ret == nullptr) {
+    auto filename = FileName(id);
+    if (!std::filesystem::exists(filename)) {
+      throw DBException("Blob file {} does not exist", filename);
+    }
+    ret = std::make_shared<BlobFile>(filename, id, verify_checksums_);
+    file = ret;
+  }
+  return ret;
+}
+
+void BlobStore::Get(const BlobIndex& index, std::string* value) {
+  GetFile(index.file_id_)->Read(index, value);
+}
+
+size_t BlobStore::RemoveObsoleteFiles(const std::set<size_t>& live) {
+  std::string_view ext = ".blob";
+  size_t ret = 0;
+  auto dir = std::filesystem::path(prefix_).parent_path();
+  for (auto& entry : std::filesystem::directory_iterator(dir)) {
+    auto filename = entry.path().filename().string();
+    if (filename.size() <= ext.size() ||
+        filename.substr(filename.size() - ext.size()) != ext) {
+      continue;
+    }
+    size_t id;
+    auto end = filename.data() + filename.size() - ext.size();
+    auto [ptr, ec] = std::from_chars(filename.data(), end, id);
+    if (ec != std::errc() || ptr != end || live.count(id)) {
+      continue;
+    }
+    std::filesystem::remove(entry.path());
+    ret += 1;
+  }
+  return ret;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "storage/lsm/file.hpp"
+#include "storage/lsm/format.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * Key-value separation. Large values are stored in append-only blob files,
+ * and the SSTables store RecordType::BlobIndex records pointing to them, so
+ * that compactions rewrite the small pointers instead of the values.
+ *
+ * The blob file "<id>.blob" is a sequence of records:
+ * | key size (uint32_t) | key | value size (uint32_t) | value |
+ * | CRC32C of value (uint32_t) |
+ * The key makes the file readable without the SSTables.
+ */
+
+/* The location of a value in a blob file. */
+struct BlobIndex {
+  /* The ID of the blob file */
+  size_t file_id_{0};
+  /* The offset of the value */
+  size_t offset_{0};
+  /* The size of the value */
+  size_t size_{0};
+
+  /* The value of the RecordType::BlobIndex record */
+  std::string Encode() const;
+
+  static BlobIndex Decode(Slice data);
+};
+
+class BlobStore;
+
+/**
+ * It appends values to a new blob file. The file is created on the first
+ * Add, so a builder that adds nothing leaves no file.
+ */
+class BlobFileBuilder {
+ public:
+  BlobFileBuilder(BlobStore* store, FileNameGenerator* gen,
+      size_t write_buffer_size)
+    : store_(store), file_gen_(gen), write_buffer_size_(write_buffer_size) {}
+
+  /* Append the record and return the location of its value. */
+  BlobIndex Add(Slice key, Slice value);
+
+  /* Write the buffered records to the file. */
+  void Finish();
+
+  BlobStore* store() const { return store_; }
+
+  /* The number of records in the file */
+  size_t count() const { return count_; }
+
+ private:
+  BlobStore* store_;
+  /* Generate the file name on the first Add */
+  FileNameGenerator* file_gen_;
+  /* The size of write buffer in FileWriter */
+  size_t write_buffer_size_;
+  /* The ID of the blob file */
+  size_t id_{0};
+  std::unique_ptr<FileWriter> writer_;
+  size_t count_{0};
+};
+
+/**
+ * An immutable blob file. It is shared by the SSTables referring to it.
+ *
+ * A live SSTable holds a reference by AddReference, and drops it by
+ * RemoveReference when it is removed. The file is removed when the last
+ * reference is dropped and the BlobFile is destroyed, i.e., when no SSTable
+ * of any Version refers to it.
+ */
+class BlobFile {
+ public:
+  BlobFile(std::string filename, size_t id, bool verify_checksums);
+
+  ~BlobFile();
+
+  /* Read the value at index. It throws DBException if it is corrupted. */
+  void Read(const BlobIndex& index, std::string* value) const;
+
+  void AddReference();
+
+  void RemoveReference();
+
+  size_t id() const { return id_; }
+
+ private:
+  std::string filename_;
+  size_t id_;
+  bool verify_checksums_;
+  std::unique_ptr<ReadFile> file_;
+  /* The number of live SSTables referring to the file */
+  std::atomic<size_t> refs_{0};
+  std::atomic<bool> remove_tag_{false};
+};
+
+/**
+ * It opens the blob files of a database, and shares each open file among
+ * the SSTables referring to it.
+ */
+class BlobStore {
+ public:
+  /* prefix is the prefix of the file names, i.e., the database path. */
+  BlobStore(std::string prefix, bool verify_checksums,
+      size_t write_buffer_size)
+    : prefix_(std::move(prefix)),
+      verify_checksums_(verify_checksums),
+      write_buffer_size_(write_buffer_size) {}
+
+  /* Create a builder of a new blob file */
+  std::unique_ptr<BlobFileBuilder> NewBuilder(FileNameGenerator* gen) {
+    return std::make_unique<BlobFileBuilder>(this, gen, write_buffer_size_);
+  }
+
+  /* Get the blob file. It is opened if it is not open. */
+  std::shared_ptr<BlobFile> GetFile(size_t id);
+
+  /* Read the value at index. */
+  void Get(const BlobIndex& index, std::string* value);
+
+  /**
+   * Remove the blob files that are not in live, which are left by the
+   * flushes and compactions that did not finish. It returns the number of
+   * files removed.
+   */
+  size_t RemoveObsoleteFiles(const std::set<size_t>& live);
+
+  std::string FileName(size_t id) const;
+
+ private:
+  std::string prefix_;
+  bool verify_checksums_;
+  size_t write_buffer_size_;
+  std::mutex mu_;
+  std::unordered_map<size_t, std::weak_ptr<BlobFile>> files_;
+};
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -1,28 +1,208 @@
 #include "storage/lsm/block.hpp"
 
+#include "common/exception.hpp"
+#include "common/crc32c.hpp"
+#include "common/serializer.hpp"
+
 namespace wing {
 
 namespace lsm {
 
+static void PutVarint32(std::string* dst, uint32_t v) {
+  while (v >= 0x80) {
+    dst->push_back(static_cast<char>(v | 0x80));
+    v >>= 7;
+  }
+  dst->push_back(static_cast<char>(v));
+}
+
+static const char* GetVarint32(const char* p, uint32_t* v) {
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28; shift += 7) {
+    uint32_t byte = static_cast<uint8_t>(*p++);
+    result |= (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  *v = result;
+  return p;
+}
+
 bool BlockBuilder::Append(ParsedKey key, Slice value) {
-  DB_ERR("Not implemented!");
+  InternalKey ikey(key);
+  Slice key_rep = ikey.GetSlice();
+  bool restart = count_ % restart_interval_ == 0;
+  size_t shared = 0;
+  if (!restart) {
+    size_t max_shared = std::min(last_key_.size(), key_rep.size());
+    while (shared < max_shared && last_key_[shared] == key_rep[shared]) {
+      shared++;
+    }
+  }
+  entry_.clear();
+  PutVarint32(&entry_, shared);
+  PutVarint32(&entry_, key_rep.size() - shared);
+  PutVarint32(&entry_, value.size());
+  entry_.append(key_rep.substr(shared));
+  entry_.append(value);
+  size_t new_size =
+      current_size_ + entry_.size() + (restart ? sizeof(offset_t) : 0);
+  if (count_ > 0 && new_size > block_size_) {
+    return false;
+  }
+  if (restart) {
+    restarts_.push_back(offset_);
+  }
+  block_.append(entry_);
+  offset_ += entry_.size();
+  current_size_ = new_size;
+  count_ += 1;
+  last_key_.assign(key_rep);
+  return true;
 }
 
-void BlockBuilder::Finish() { DB_ERR("Not implemented!"); }
+void BlockBuilder::Finish() {
+  for (auto restart : restarts_) {
+    block_.append(reinterpret_cast<const char*>(&restart), sizeof(offset_t));
+  }
+  offset_t num_restarts = restarts_.size();
+  block_.append(
+      reinterpret_cast<const char*>(&num_restarts), sizeof(offset_t));
+  Slice contents = block_;
+  CompressionType type = CompressionType::kNone;
+  if (compression_ != CompressionType::kNone) {
+    compressed_.clear();
+    Compress(compression_, block_, &compressed_);
+    if (compressed_.size() < block_.size() - block_.size() / 8) {
+      contents = compressed_;
+      type = compression_;
+    }
+  }
+  disk_size_ = WriteBlock(file_, contents, type);
+}
+
+size_t WriteBlock(FileWriter* file, Slice contents, CompressionType type) {
+  /* The checksum covers the compression type. */
+  uint32_t checksum = utils::Crc32c(contents);
+  checksum = utils::Crc32c(reinterpret_cast<const char*>(&type),
+      sizeof(CompressionType), checksum);
+  file->AppendString(contents)
+      .AppendValue<CompressionType>(type)
+      .AppendValue<uint32_t>(checksum);
+  return contents.size() + kBlockTrailerSize;
+}
+
+Slice UncompressBlock(Slice block, std::string* buf, bool verify_checksum) {
+  if (block.size() < kBlockTrailerSize) {
+    throw DBException("Corrupted block: size {}", block.size());
+  }
+  size_t size = block.size() - kBlockTrailerSize;
+  if (verify_checksum) {
+    uint32_t checksum =
+        utils::Deserializer(block.data() + size + sizeof(CompressionType))
+            .Read<uint32_t>();
+    if (utils::Crc32c(block.data(), size + sizeof(CompressionType)) !=
+        checksum) {
+      throw DBException("Corrupted block: checksum mismatch");
+    }
+  }
+  auto type = static_cast<CompressionType>(block[size]);
+  if (type == CompressionType::kNone) {
+    return block.substr(0, size);
+  }
+  buf->clear();
+  if (!Decompress(type, block.substr(0, size), buf)) {
+    throw DBException(
+        "Corrupted block: compression type {}", static_cast<int>(type));
+  }
+  return *buf;
+}
+
+BlockIterator::BlockIterator(const char* data, BlockHandle handle)
+  : data_(data) {
+  num_restarts_ = utils::Deserializer(data + handle.size_ - sizeof(offset_t))
+                      .Read<offset_t>();
+  restarts_offset_ =
+      handle.size_ - sizeof(offset_t) * (static_cast<size_t>(num_restarts_) + 1);
+  current_ = next_ = restarts_offset_;
+}
+
+Slice BlockIterator::RestartKey(size_t id) const {
+  offset_t offset = utils::Deserializer(
+      data_ + restarts_offset_ + id * sizeof(offset_t))
+                        .Read<offset_t>();
+  uint32_t shared, non_shared, value_size;
+  const char* p = data_ + offset;
+  p = GetVarint32(p, &shared);
+  p = GetVarint32(p, &non_shared);
+  p = GetVarint32(p, &value_size);
+  return Slice(p, non_shared);
+}
+
+void BlockIterator::SeekToRestartPoint(size_t id) {
+  key_.clear();
+  next_ = utils::Deserializer(data_ + restarts_offset_ + id * sizeof(offset_t))
+              .Read<offset_t>();
+  current_ = next_;
+  ParseEntry();
+}
+
+bool BlockIterator::ParseEntry() {
+  current_ = next_;
+  if (current_ >= restarts_offset_) {
+    current_ = next_ = restarts_offset_;
+    return false;
+  }
+  uint32_t shared, non_shared, value_size;
+  const char* p = data_ + current_;
+  p = GetVarint32(p, &shared);
+  p = GetVarint32(p, &non_shared);
+  p = GetVarint32(p, &value_size);
+  key_.resize(shared);
+  key_.append(p, non_shared);
+  value_ = Slice(p + non_shared, value_size);
+  next_ = value_.data() + value_size - data_;
+  return true;
+}
 
 void BlockIterator::Seek(Slice user_key, seq_t seq) {
-  DB_ERR("Not implemented!");
+  if (num_restarts_ == 0) {
+    current_ = next_ = restarts_offset_;
+    return;
+  }
+  ParsedKey target(user_key, seq, RecordType::Value);
+  /* Find the last restart point whose key < target */
+  size_t left = 0, right = num_restarts_;
+  while (left + 1 < right) {
+    size_t mid = (left + right) / 2;
+    if (ParsedKey(RestartKey(mid)) < target) {
+      left = mid;
+    } else {
+      right = mid;
+    }
+  }
+  SeekToRestartPoint(left);
+  while (Valid() && ParsedKey(Slice(key_)) < target) {
+    Next();
+  }
 }
 
-void BlockIterator::SeekToFirst() { DB_ERR("Not implemented!"); }
+void BlockIterator::SeekToFirst() {
+  if (num_restarts_ == 0) {
+    current_ = next_ = restarts_offset_;
+    return;
+  }
+  SeekToRestartPoint(0);
+}
 
-Slice BlockIterator::key() const { DB_ERR("Not implemented!"); }
+Slice BlockIterator::key() const { return key_; }
 
-Slice BlockIterator::value() const { DB_ERR("Not implemented!"); }
+Slice BlockIterator::value() const { return value_; }
 
-void BlockIterator::Next() { DB_ERR("Not implemented!"); }
+void BlockIterator::Next() { ParseEntry(); }
 
-bool BlockIterator::Valid() { DB_ERR("Not implemented!"); }
+bool BlockIterator::Valid() { return current_ < restarts_offset_; }
 
 }  // namespace lsm
 
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "storage/lsm/compression.hpp"
 #include "storage/lsm/format.hpp"
 #include "storage/lsm/iterator.hpp"
 #include "storage/lsm/options.hpp"
@@ -8,61 +13,140 @@ namespace wing {
 
 namespace lsm {
 
+/**
+ * The format of the contents of a data block:
+ *
+ * | entry 0 | entry 1 | ... | restart[0] | ... | restart[m - 1] | m |
+ *
+ * Each entry is
+ *
+ * | shared | non_shared | value_size | key[shared:] | value |
+ *
+ * where the key is the internal key (see InternalKey), shared is the length
+ * of the common prefix of the key and the previous key, and the three
+ * lengths are varint32. Every restart_interval entries, an entry is stored
+ * with shared = 0, and its offset is recorded in the restart array
+ * (offset_t). The number of restart points m is an offset_t.
+ *
+ * In the file, a data block is
+ *
+ * | contents (possibly compressed) | compression type | checksum |
+ *
+ * The compression type is a CompressionType (uint8_t), and the checksum
+ * (uint32_t) is the CRC32C of the (compressed) contents and the compression
+ * type. The contents are stored uncompressed if compression does not save at
+ * least 1/8 of the size. The index block and the bloom filter of an SSTable
+ * have the same trailer, and they are not compressed.
+ */
+static constexpr size_t kBlockTrailerSize =
+    sizeof(CompressionType) + sizeof(uint32_t);
+
 class BlockBuilder {
  public:
-  BlockBuilder(size_t block_size, FileWriter* file)
-    : block_size_(block_size), file_(file) {}
+  BlockBuilder(size_t block_size, FileWriter* file,
+      size_t restart_interval = kDefaultRestartInterval,
+      CompressionType compression = CompressionType::kNone)
+    : block_size_(block_size),
+      restart_interval_(std::max<size_t>(restart_interval, 1)),
+      compression_(compression),
+      file_(file) {
+    Clear();
+  }
+
+  static constexpr size_t kDefaultRestartInterval = 16;
 
   /**
    * It appends key and value to the end of the block
    *
    * If it appends successfully, return true.
    * Otherwise, return false, and you need to append it to a new block.
+   * An empty block always accepts the record.
    */
   bool Append(ParsedKey key, Slice value);
 
   /**
-   * It writes all the offsets to the end of the block
+   * It appends the restart points to the block, compresses the block,
+   * and writes it with the trailer to the file.
    *
    * It is called when the block is full,
    * or there is no more key value pairs.
-   * It writes all the offsets to the end of the block.
    * */
   void Finish();
 
-  /* The size of the block (including key, value and the offsets)*/
+  /**
+   * The size of the uncompressed contents of the block
+   * (including the entries and the restart points)
+   */
   size_t size() const { return current_size_; }
 
+  /**
+   * The size of the block in the file, including the trailer.
+   * It is valid after Finish().
+   */
+  size_t disk_size() const { return disk_size_; }
+
   /* The number of key-value pairs. */
-  size_t count() const { return offsets_.size(); }
+  size_t count() const { return count_; }
 
   void Clear() {
-    current_size_ = offset_ = 0;
-    offsets_.clear();
+    offset_ = count_ = disk_size_ = 0;
+    block_.clear();
+    restarts_.clear();
+    last_key_.clear();
+    current_size_ = sizeof(offset_t);
   }
 
  private:
   /* The maximum size of a block */
   size_t block_size_{0};
+  /* The number of entries between restart points */
+  size_t restart_interval_{kDefaultRestartInterval};
+  /* The codec of the block */
+  CompressionType compression_{CompressionType::kNone};
   /* The current used size of the block. */
   size_t current_size_{0};
-  /* The current offset of the key value region */
+  /* The current offset of the entry region */
   offset_t offset_{0};
+  /* The number of key-value pairs */
+  size_t count_{0};
   /* The writer. */
   FileWriter* file_{nullptr};
 
-  /* The offsets of the records in the block. */
-  std::vector<offset_t> offsets_;
+  /* The offsets of the restart points in the block. */
+  std::vector<offset_t> restarts_;
+  /* The last internal key appended */
+  std::string last_key_;
+  /* The buffer of the encoded entry */
+  std::string entry_;
+  /* The uncompressed contents of the block */
+  std::string block_;
+  /* The buffer of the compressed block */
+  std::string compressed_;
+  /* The size of the finished block in the file */
+  size_t disk_size_{0};
 };
 
+/**
+ * Append the contents and the trailer of a block to the file.
+ * The contents are compressed with type, or uncompressed if it is kNone.
+ * Return the size of the block in the file.
+ */
+size_t WriteBlock(FileWriter* file, Slice contents, CompressionType type);
+
+/**
+ * Verify the checksum of a block read from the file (if verify_checksum is
+ * true), and decompress it. block includes the trailer. It returns the
+ * contents, which point to block if the block is not compressed, or to buf
+ * otherwise. It throws DBException if the block is corrupted.
+ */
+Slice UncompressBlock(Slice block, std::string* buf, bool verify_checksum = true);
+
 class BlockIterator final : public Iterator {
  public:
   BlockIterator() = default;
 
   /* data is a pointer to the beginning of the block. */
-  BlockIterator(const char* data, BlockHandle handle) : data_(data) {
-    DB_ERR("Not implemented!");
-  }
+  BlockIterator(const char* data, BlockHandle handle);
 
   /* Move the the beginning */
   void SeekToFirst();
@@ -79,7 +163,27 @@ class BlockIterator final : public Iterator {
   bool Valid() override;
 
  private:
+  /* Decode the entry at current_. Return false if it is the end. */
+  bool ParseEntry();
+
+  /* Move to the restart point, and decode the entry */
+  void SeekToRestartPoint(size_t id);
+
+  /* The internal key of the restart point */
+  Slice RestartKey(size_t id) const;
+
   const char* data_{nullptr};
+  /* The offset of the restart array, i.e. the end of the entries */
+  offset_t restarts_offset_{0};
+  /* The number of restart points */
+  offset_t num_restarts_{0};
+  /* The offset of the current entry */
+  offset_t current_{0};
+  /* The offset of the next entry */
+  offset_t next_{0};
+  /* The internal key of the current entry */
+  std::string key_;
+  Slice value_;
 };
 
 }  // namespace lsm
@@ -1,79 +1,130 @@
 #include "storage/lsm/cache.hpp"
 
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <unistd.h>
-
 #include <tuple>
 #include <utility>
 
+#include "common/murmurhash.hpp"
+#include "common/util.hpp"
+
 namespace wing {
 
 namespace lsm {
 
-void Cache::unref_block(CacheKey cache_key) {
-  std::unique_lock<std::mutex> lock(mu_);
-  auto it = cache_.find(cache_key);
-  wing_assert(it != cache_.end());
-  size_t ori = it->second.refcount.fetch_sub(1, std::memory_order_relaxed);
-  if (ori == 1) {
-    auto lru_it = lru_list_.insert(lru_list_.end(), cache_key);
-    auto ret = lru_map_.insert(std::make_pair(cache_key, lru_it));
-    wing_assert(ret.second == true);
+Cache::Cache(const CacheOptions &options) {
+  size_t shard_count = std::max<size_t>(1, options.shard_count);
+  for (size_t i = 0; i < shard_count; i++) {
+    shards_.push_back(std::make_unique<Shard>(
+        options.capacity / shard_count, options.hot_ratio));
   }
 }
 
-void Cache::evict() {
-  wing_assert(size_ >= capacity_);
-  do {
-    wing_assert(lru_list_.empty(), "Cache capacity too small!");
-    auto it = lru_list_.begin();
-    const CacheKey &cache_key = *it;
-    wing_assert(lru_map_.erase(cache_key) == 1);
-    auto it2 = cache_.find(cache_key);
-    wing_assert(it2 != cache_.end());
-    size_t refcount = it2->second.refcount.load(std::memory_order_relaxed);
-    wing_assert_eq(refcount, (size_t)0);
-    size_ -= it2->second.block.size();
-    cache_.erase(it2);
-    lru_list_.erase(it);
-  } while (size_ >= capacity_);
+Cache::Shard &Cache::GetShard(const CacheKey &key) {
+  size_t h = utils::Hash8(CacheKey::Hash()(key), 0x202404031327);
+  return *shards_[h % shards_.size()];
 }
 
 std::optional<Cache::Handle> Cache::get(
     uint64_t sstable_id, BlockHandle block) {
   CacheKey cache_key(sstable_id, block.offset_);
+  return GetShard(cache_key).get(cache_key);
+}
+
+Cache::Handle Cache::insert(uint64_t sstable_id, BlockHandle block,
+    std::string &&content, Priority priority) {
+  CacheKey cache_key(sstable_id, block.offset_);
+  return GetShard(cache_key).insert(cache_key, std::move(content), priority);
+}
+
+size_t Cache::size() {
+  size_t ret = 0;
+  for (auto &shard : shards_) {
+    ret += shard->size();
+  }
+  return ret;
+}
+
+void Cache::Shard::Link(BlockInfo *info) {
+  auto &list = info->access_count >= 2 ? hot_ : cold_;
+  list.push_back(info);
+  list.size += info->block.size();
+  /* Demote the least recently used hot blocks */
+  while (hot_.size > hot_capacity_) {
+    auto demoted = hot_.front();
+    Unlink(demoted);
+    demoted->access_count = 1;
+    cold_.push_back(demoted);
+    cold_.size += demoted->block.size();
+  }
+}
+
+void Cache::Shard::Unlink(BlockInfo *info) {
+  auto &list = info->access_count >= 2 ? hot_ : cold_;
+  List::remove(info);
+  list.size -= info->block.size();
+}
+
+void Cache::Shard::unref_block(CacheKey cache_key) {
+  std::unique_lock<std::mutex> lock(mu_);
+  auto it = cache_.find(cache_key);
+  wing_assert(it != cache_.end());
+  if (--it->second.refcount == 0) {
+    Link(&it->second);
+    if (size_ > capacity_) {
+      evict();
+    }
+  }
+}
+
+void Cache::Shard::evict() {
+  /* Referenced blocks cannot be evicted, so the shard may exceed capacity_ */
+  while (size_ > capacity_ && !(cold_.empty() && hot_.empty())) {
+    auto info = cold_.empty() ? hot_.front() : cold_.front();
+    wing_assert_eq(info->refcount, (size_t)0);
+    Unlink(info);
+    size_ -= info->block.size();
+    wing_assert(cache_.erase(*info->key) == 1);
+  }
+}
+
+std::optional<Cache::Handle> Cache::Shard::get(CacheKey cache_key) {
   std::unique_lock<std::mutex> lock(mu_);
   auto it = cache_.find(cache_key);
   if (it == cache_.end()) {
     return std::nullopt;
   }
-  size_t ori_refcount =
-      it->second.refcount.fetch_add(1, std::memory_order_relaxed);
-  if (ori_refcount == 0) {
-    auto map_it = lru_map_.find(cache_key);
-    wing_assert(map_it != lru_map_.end());
-    lru_list_.erase(map_it->second);
-    lru_map_.erase(map_it);
+  auto &info = it->second;
+  if (info.refcount++ == 0) {
+    Unlink(&info);
   }
-  return Handle(*this, cache_key, it->second.block);
+  info.access_count = std::min(info.access_count + 1, 2);
+  return Handle(this, cache_key, info.block);
 }
 
-Cache::Handle Cache::insert(
-    uint64_t sstable_id, BlockHandle block, std::string &&content) {
-  CacheKey cache_key(sstable_id, block.offset_);
+Cache::Handle Cache::Shard::insert(
+    CacheKey cache_key, std::string &&content, Priority priority) {
   size_t size = content.size();
   std::unique_lock<std::mutex> lock(mu_);
   auto ret =
       cache_.emplace(std::piecewise_construct, std::forward_as_tuple(cache_key),
           std::forward_as_tuple(std::move(content), 1));
+  auto &info = ret.first->second;
   if (ret.second) {
+    info.key = &ret.first->first;
+    if (priority == Priority::kHigh) {
+      info.access_count = 2;
+    }
     size_ += size;
     if (size_ > capacity_) {
       evict();
     }
+  } else {
+    /* Another thread has inserted the block */
+    if (info.refcount++ == 0) {
+      Unlink(&info);
+    }
+    info.access_count = std::min(info.access_count + 1, 2);
   }
-  return Handle(*this, std::move(cache_key), ret.first->second.block);
+  return Handle(this, cache_key, info.block);
 }
 
 }  // namespace lsm
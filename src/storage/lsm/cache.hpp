@@ -2,10 +2,11 @@
 
 #include <atomic>
 #include <functional>
-#include <list>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <unordered_map>
+#include <vector>
 
 #include "storage/lsm/format.hpp"
 
@@ -15,6 +16,18 @@ namespace lsm {
 
 struct CacheOptions {
   size_t capacity = 8 * 1024 * 1024;  // 8MiB
+  /**
+   * The number of shards. Each shard has its own lock and manages
+   * capacity / shard_count bytes.
+   */
+  size_t shard_count = 16;
+  /**
+   * The maximum fraction of a shard used by the blocks that are accessed at
+   * least twice. The other blocks are evicted first, so that a large scan,
+   * which accesses each block once, does not evict the frequently accessed
+   * blocks.
+   */
+  double hot_ratio = 0.8;
 };
 
 class CacheKey {
@@ -37,19 +50,36 @@ class CacheKey {
   offset_t offset_;
 };
 
+/**
+ * The block cache.
+ *
+ * It holds the contents of data blocks after they are verified and
+ * decompressed (see UncompressBlock), so a hit needs no decompression.
+ * It also holds the index and filter partitions of SSTables, which are
+ * inserted with Priority::kHigh.
+ *
+ * Blocks are partitioned into shards by the hash of CacheKey.
+ * Each shard evicts unreferenced blocks with an approximation of LRU-2:
+ * blocks that are accessed only once since they are inserted (cold blocks)
+ * are evicted before blocks that are accessed at least twice (hot blocks).
+ * Both are evicted in LRU order. If hot blocks exceed hot_ratio of the shard,
+ * the least recently used hot blocks become cold.
+ */
 class Cache {
+  class Shard;
+
  public:
   class Handle {
    public:
     Handle(const Handle &) = delete;
     Handle &operator=(const Handle &) = delete;
     Handle(Handle &&rhs)
-      : cache_(rhs.cache_), block_id_(rhs.block_id_), block_(rhs.block_) {
+      : shard_(rhs.shard_), block_id_(rhs.block_id_), block_(rhs.block_) {
       rhs.block_ = std::string_view();
     }
     Handle &operator=(Handle &&rhs) {
       this->~Handle();
-      cache_ = rhs.cache_;
+      shard_ = rhs.shard_;
       block_id_ = rhs.block_id_;
       block_ = rhs.block_;
       rhs.block_ = std::string_view();
@@ -57,49 +87,120 @@ class Cache {
     }
     ~Handle() {
       if (block_.data() != nullptr)
-        cache_.get().unref_block(block_id_);
+        shard_->unref_block(block_id_);
     }
 
     std::string_view block() const { return block_; }
 
    private:
-    Handle(Cache &cache, CacheKey block_id, std::string_view block)
-      : cache_(cache), block_id_(block_id), block_(block) {}
+    Handle(Shard *shard, CacheKey block_id, std::string_view block)
+      : shard_(shard), block_id_(block_id), block_(block) {}
 
-    std::reference_wrapper<Cache> cache_;
+    Shard *shard_;
     CacheKey block_id_;
     std::string_view block_;
 
     friend class Cache;
+    friend class Shard;
+  };
+
+  /**
+   * Blocks of high priority are inserted as hot blocks, so they are evicted
+   * after the blocks of low priority that are accessed only once.
+   */
+  enum class Priority : uint8_t {
+    kLow = 0,
+    kHigh,
   };
 
-  Cache(const CacheOptions &options) : capacity_(options.capacity), size_(0) {}
+  Cache(const CacheOptions &options);
 
   std::optional<Cache::Handle> get(uint64_t sstable_id, BlockHandle block);
-  Handle insert(uint64_t sstable_id, BlockHandle block, std::string &&content);
+  Handle insert(uint64_t sstable_id, BlockHandle block, std::string &&content,
+      Priority priority = Priority::kLow);
+
+  /* The total size of the cached blocks */
+  size_t size();
+
+  /**
+   * A new ID for the blocks of a file. The IDs of the SSTables are only
+   * unique in their database, so the SSTables sharing the cache use these
+   * IDs instead.
+   */
+  uint64_t NewId() { return next_id_.fetch_add(1); }
 
  private:
-  struct BlockInfo {
-    std::string block;
-    std::atomic<size_t> refcount;
+  class Shard {
+   public:
+    Shard(size_t capacity, double hot_ratio)
+      : capacity_(capacity), hot_capacity_(capacity * hot_ratio) {}
 
-    BlockInfo(std::string &&b, size_t rc) : block(std::move(b)), refcount(rc) {}
-  };
+    std::optional<Cache::Handle> get(CacheKey cache_key);
+    Handle insert(
+        CacheKey cache_key, std::string &&content, Priority priority);
+    void unref_block(CacheKey cache_key);
 
-  void unref_block(CacheKey block_id);
-  // REQUIRES: this->mu_ held
-  void evict();
+    size_t size() {
+      std::unique_lock<std::mutex> lock(mu_);
+      return size_;
+    }
 
-  const size_t capacity_;
+   private:
+    struct BlockInfo {
+      std::string block;
+      /* The number of handles referencing the block */
+      size_t refcount;
+      /* The number of accesses, which saturates at 2 */
+      uint8_t access_count{1};
+      /* Unreferenced blocks are linked in the cold list or the hot list */
+      BlockInfo *prev{nullptr}, *next{nullptr};
+      const CacheKey *key{nullptr};
+
+      BlockInfo(std::string &&b, size_t rc)
+        : block(std::move(b)), refcount(rc) {}
+    };
+
+    /* A circular doubly-linked list with a dummy head. */
+    struct List {
+      List() { head.prev = head.next = &head; }
+      bool empty() const { return head.next == &head; }
+      void push_back(BlockInfo *x) {
+        x->prev = head.prev;
+        x->next = &head;
+        head.prev->next = x;
+        head.prev = x;
+      }
+      static void remove(BlockInfo *x) {
+        x->prev->next = x->next;
+        x->next->prev = x->prev;
+        x->prev = x->next = nullptr;
+      }
+      BlockInfo *front() { return head.next; }
+
+      BlockInfo head{std::string(), 0};
+      /* The total size of blocks in the list */
+      size_t size{0};
+    };
+
+    void Link(BlockInfo *info);
+    void Unlink(BlockInfo *info);
+    // REQUIRES: this->mu_ held
+    void evict();
+
+    const size_t capacity_;
+    const size_t hot_capacity_;
+
+    std::mutex mu_;
+    std::unordered_map<CacheKey, BlockInfo, CacheKey::Hash> cache_;
+    size_t size_{0};
+    List cold_;
+    List hot_;
+  };
 
-  std::mutex mu_;
-  std::unordered_map<CacheKey, BlockInfo, CacheKey::Hash> cache_;
-  size_t size_;
-  std::unordered_map<CacheKey, std::list<CacheKey>::iterator, CacheKey::Hash>
-      lru_map_;
-  std::list<CacheKey> lru_list_;
+  Shard &GetShard(const CacheKey &key);
 
-  friend class Block;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> next_id_{0};
 };
 
 }  // namespace lsm
@@ -0,0 +1,197 @@
+#include "storage/lsm/compaction_job.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+namespace wing {
+
+namespace lsm {
+
+CompactionInputIterator::CompactionInputIterator(
+    const Compaction& compaction, std::optional<Slice> lower) {
+  seq_t seq = std::numeric_limits<seq_t>::max();
+  auto add = [&](const auto& input) {
+    auto it = lower ? input->Seek(*lower, seq) : input->Begin();
+    its_.push_back(std::make_unique<decltype(it)>(std::move(it)));
+    it_.Push(its_.back().get());
+  };
+  for (auto& sst : compaction.input_ssts()) {
+    add(sst);
+  }
+  for (auto& run : compaction.input_runs()) {
+    add(run);
+  }
+  if (compaction.target_sorted_run()) {
+    add(compaction.target_sorted_run());
+  }
+  it_.Build();
+}
+
+bool VisibilityFilter::Keep(ParsedKey key) {
+  size_t stripe = GetStripe(key.seq_);
+  bool same_key = has_last_ && key.user_key_ == last_user_key_;
+  if (!same_key) {
+    last_user_key_ = key.user_key_;
+    has_last_ = true;
+  } else if (stripe == last_stripe_ && !last_merge_) {
+    /* A newer record in the same stripe shadows it */
+    return false;
+  }
+  last_stripe_ = stripe;
+  if (range_dels_) {
+    /* The newest tombstone in the same stripe */
+    seq_t upper = stripe < snapshots_.size()
+                      ? snapshots_[stripe]
+                      : std::numeric_limits<seq_t>::max();
+    if (range_dels_->MaxCoveringSeq(key.user_key_, upper) > key.seq_) {
+      last_merge_ = false;
+      return false;
+    }
+  }
+  last_merge_ = key.type_ == RecordType::Merge;
+  return true;
+}
+
+size_t VisibilityFilter::GetStripe(seq_t seq) const {
+  return std::lower_bound(snapshots_.begin(), snapshots_.end(), seq) -
+         snapshots_.begin();
+}
+
+CompactionJob::Output CompactionJob::NewOutput() {
+  Output output;
+  std::tie(output.filename_, output.id_) = file_gen_->Generate();
+  output.builder_ = std::make_unique<SSTableBuilder>(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>(output.filename_, use_direct_io_),
+          write_buffer_size_),
+      block_size_, bloom_bits_per_key_, block_restart_interval_,
+      compression_, filter_type_);
+  output.builder_->SetRangeFilter(range_filter_bits_per_key_);
+  if (blobs_ != nullptr) {
+    output.blob_builder_ = blobs_->NewBuilder(file_gen_);
+    output.builder_->SetBlobBuilder(
+        output.blob_builder_.get(), min_blob_size_, relocate_before_);
+  }
+  return output;
+}
+
+SSTInfo CompactionJob::FinishOutput(Output* output,
+    std::optional<Slice> lower, std::optional<Slice> upper) {
+  auto& builder = *output->builder_;
+  if (range_dels_) {
+    for (auto& tombstone : range_dels_->ToTombstones(lower, upper)) {
+      builder.AddRangeTombstone(std::move(tombstone));
+    }
+  }
+  /* The SSTable is written after the values that it refers to */
+  if (output->blob_builder_) {
+    output->blob_builder_->Finish();
+  }
+  builder.Finish();
+  SSTInfo info;
+  info.count_ = builder.count();
+  info.num_deletions_ = builder.num_deletions();
+  info.size_ = builder.size();
+  info.sst_id_ = output->id_;
+  info.index_offset_ = builder.GetIndexOffset();
+  info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.blob_files_ = builder.GetBlobFiles();
+  info.filename_ = std::move(output->filename_);
+  return info;
+}
+
+std::string CompactionJob::CombineOperands(
+    Slice user_key, std::vector<std::string>* operands) const {
+  std::string ret;
+  if (operands->size() == 1) {
+    ret = std::move(operands->front());
+  } else {
+    /* The oldest operand takes the place of the value, since the operator
+     * is associative */
+    Slice oldest = operands->back();
+    ret = MergeOperands(*merge_operator_, user_key, &oldest,
+        std::span(operands->data(), operands->size() - 1));
+  }
+  operands->clear();
+  return ret;
+}
+
+std::string CompactionJob::MergeWithRecord(ParsedKey key, Slice value,
+    std::vector<std::string>* operands) const {
+  std::string ret;
+  if (key.type_ == RecordType::Deletion) {
+    ret = MergeOperands(*merge_operator_, key.user_key_, nullptr, *operands);
+  } else if (key.type_ == RecordType::BlobIndex) {
+    std::string base;
+    blobs_->Get(BlobIndex::Decode(value), &base);
+    Slice base_slice = base;
+    ret = MergeOperands(
+        *merge_operator_, key.user_key_, &base_slice, *operands);
+  } else {
+    ret = MergeOperands(*merge_operator_, key.user_key_, &value, *operands);
+  }
+  operands->clear();
+  return ret;
+}
+
+std::vector<std::string> CompactionJob::SplitKeyRanges(
+    const Compaction& compaction, size_t max_ranges) const {
+  /**
+   * The largest user key of each index partition, and the size of its data
+   * blocks. The top-level index is in memory, so no partition is read. The
+   * keys are copied, since GetPartitions returns a copy of the index.
+   */
+  std::vector<std::pair<std::string, size_t>> blocks;
+  size_t total_size = 0;
+  auto add_sst = [&](const std::shared_ptr<SSTable>& sst) {
+    for (auto& partition : sst->GetPartitions()) {
+      blocks.emplace_back(partition.key_.user_key(), partition.data_size_);
+    }
+    total_size += sst->GetSSTInfo().size_;
+  };
+  for (auto& sst : compaction.input_ssts()) {
+    add_sst(sst);
+  }
+  for (auto& run : compaction.input_runs()) {
+    for (auto& sst : run->GetSSTs()) {
+      add_sst(sst);
+    }
+  }
+  if (compaction.target_sorted_run()) {
+    for (auto& sst : compaction.target_sorted_run()->GetSSTs()) {
+      add_sst(sst);
+    }
+  }
+  size_t num_ranges =
+      std::min(max_ranges, total_size / std::max<size_t>(sst_size_, 1));
+  std::vector<std::string> boundaries;
+  if (num_ranges <= 1) {
+    return boundaries;
+  }
+  std::sort(blocks.begin(), blocks.end());
+  /**
+   * A range ends after the block at which the accumulated size reaches its
+   * share. The next range starts from the next user key, so that the
+   * records of a user key are never split.
+   */
+  size_t range_size = total_size / num_ranges, current = 0;
+  for (size_t i = 0; i + 1 < blocks.size(); i++) {
+    current += blocks[i].second;
+    if (current >= range_size * (boundaries.size() + 1) &&
+        blocks[i + 1].first != blocks[i].first) {
+      /* The smallest user key larger than blocks[i].first */
+      std::string boundary(blocks[i].first);
+      boundary.push_back('\0');
+      boundaries.push_back(std::move(boundary));
+      if (boundaries.size() + 1 == num_ranges) {
+        break;
+      }
+    }
+  }
+  return boundaries;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
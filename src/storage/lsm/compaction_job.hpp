@@ -1,31 +1,367 @@
 #pragma once
 
+#include <future>
+#include <optional>
+
+#include "common/threadpool.hpp"
+#include "storage/lsm/compaction.hpp"
+#include "storage/lsm/iterator_heap.hpp"
+#include "storage/lsm/merge_operator.hpp"
 #include "storage/lsm/sst.hpp"
 
 namespace wing {
 
 namespace lsm {
 
+/**
+ * It wraps an iterator and stops at the first record whose user key >= upper.
+ * It is used to limit a subcompaction to its key range.
+ */
+template <typename IterT>
+class BoundedIterator {
+ public:
+  BoundedIterator(IterT&& it, std::optional<std::string> upper)
+    : it_(std::move(it)), upper_(std::move(upper)) {}
+
+  bool Valid() {
+    return it_.Valid() && (!upper_ || ParsedKey(it_.key()).user_key_ < *upper_);
+  }
+
+  Slice key() { return it_.key(); }
+
+  Slice value() { return it_.value(); }
+
+  void Next() { it_.Next(); }
+
+ private:
+  IterT it_;
+  std::optional<std::string> upper_;
+};
+
+/**
+ * It merges the input SSTables, the input sorted runs and the target sorted
+ * run of a compaction. It owns the child iterators, so it can be moved (see
+ * CompactionJob::RunParallel). The compaction must outlive it.
+ */
+class CompactionInputIterator final : public Iterator {
+ public:
+  /**
+   * It is positioned at the first record whose user key >= lower, or at the
+   * first record if lower is std::nullopt.
+   */
+  CompactionInputIterator(
+      const Compaction& compaction, std::optional<Slice> lower);
+
+  bool Valid() override { return it_.Valid(); }
+
+  Slice key() const override { return it_.key(); }
+
+  Slice value() const override { return it_.value(); }
+
+  void Next() override { it_.Next(); }
+
+ private:
+  /* The iterators of the inputs */
+  std::vector<std::unique_ptr<Iterator>> its_;
+  IteratorHeap<Iterator> it_;
+};
+
+/**
+ * It decides which records a flush or a compaction writes to its output.
+ * The records are given in the order of the merged iterator, i.e. the
+ * records of a user key are given from the newest to the oldest.
+ *
+ * The snapshots split the sequence numbers into stripes: the records with
+ * sequence numbers in (snapshots[i - 1], snapshots[i]] are in stripe i, and
+ * those newer than all snapshots are in the last stripe. A reader at any
+ * snapshot sees at most one record of a user key in each stripe, so only the
+ * newest record of a user key in each stripe is kept. A merge operand does
+ * not hide the older records, since a reader combines them with it. A
+ * record is also dropped if it is covered by a newer range tombstone in the
+ * same stripe.
+ */
+class VisibilityFilter {
+ public:
+  VisibilityFilter(std::vector<seq_t> snapshots,
+      std::shared_ptr<const RangeTombstoneList> range_dels)
+    : snapshots_(std::move(snapshots)), range_dels_(std::move(range_dels)) {}
+
+  /* Return true if the record should be written to the output. */
+  bool Keep(ParsedKey key);
+
+  /* The stripe of the records with the sequence number seq */
+  size_t GetStripe(seq_t seq) const;
+
+ private:
+  /* The ascending sequence numbers of the live snapshots */
+  std::vector<seq_t> snapshots_;
+  /* The range tombstones of the inputs. It may be null. */
+  std::shared_ptr<const RangeTombstoneList> range_dels_;
+  /* The user key of the previous record, and its stripe */
+  std::string last_user_key_;
+  size_t last_stripe_{0};
+  bool has_last_{false};
+  /* If the previous record kept is a merge operand */
+  bool last_merge_{false};
+};
+
 class CompactionJob {
  public:
   CompactionJob(FileNameGenerator* gen, size_t block_size, size_t sst_size,
-      size_t write_buffer_size, size_t bloom_bits_per_key, bool use_direct_io)
+      size_t write_buffer_size, size_t bloom_bits_per_key, bool use_direct_io,
+      size_t block_restart_interval = BlockBuilder::kDefaultRestartInterval,
+      CompressionType compression = CompressionType::kNone,
+      FilterType filter_type = FilterType::kBloom)
     : file_gen_(gen),
       block_size_(block_size),
       sst_size_(sst_size),
       write_buffer_size_(write_buffer_size),
       bloom_bits_per_key_(bloom_bits_per_key),
-      use_direct_io_(use_direct_io) {}
+      use_direct_io_(use_direct_io),
+      block_restart_interval_(block_restart_interval),
+      compression_(compression),
+      filter_type_(filter_type) {}
+
+  /**
+   * The range tombstones of the inputs. Run drops the records covered by them
+   * (see VisibilityFilter), and adds them to the output
+   * SSTables with SSTableBuilder::AddRangeTombstone, truncated to the key
+   * range between the first key of an output and the first key of the next
+   * output. So the outputs do not overlap, and no range is lost.
+   */
+  void SetRangeTombstones(
+      std::shared_ptr<const RangeTombstoneList> range_dels) {
+    range_dels_ = std::move(range_dels);
+  }
+
+  /**
+   * The sequence numbers of the live snapshots in ascending order. Run keeps
+   * the records that the snapshots can read, with the filter returned by
+   * MakeFilter().
+   */
+  void SetSnapshots(std::vector<seq_t> snapshots) {
+    snapshots_ = std::move(snapshots);
+  }
+
+  /**
+   * The blob files of the outputs. Each output gets a builder created with
+   * blobs->NewBuilder(file_gen_), which is given to its SSTableBuilder with
+   * SSTableBuilder::SetBlobBuilder(builder, min_blob_size, relocate_before),
+   * so that the large values are separated and the values in old blob files
+   * are relocated. The blob file is finished before the SSTable, and the
+   * output records SSTableBuilder::GetBlobFiles() in SSTInfo::blob_files_.
+   * An old blob file is removed once the input SSTables referring to it
+   * are removed.
+   */
+  void SetBlobs(
+      BlobStore* blobs, size_t min_blob_size, size_t relocate_before = 0) {
+    blobs_ = blobs;
+    min_blob_size_ = min_blob_size;
+    relocate_before_ = relocate_before;
+  }
+
+  /**
+   * The merge operator of the database. It may be null. Run combines the
+   * merge operands of a key that no snapshot separates: they are merged with
+   * the older value into a value if the value (or a deletion) is in the
+   * same snapshot stripe, or otherwise into one merge operand, since the
+   * older records may be in other sorted runs.
+   */
+  void SetMergeOperator(const MergeOperator* merge_operator) {
+    merge_operator_ = merge_operator;
+  }
+
+  /**
+   * Run builds the range filters of the outputs with
+   * SSTableBuilder::SetRangeFilter(bits_per_key). 0 disables them.
+   */
+  void SetRangeFilter(size_t bits_per_key) {
+    range_filter_bits_per_key_ = bits_per_key;
+  }
+
+  /* The filter of the records of Run. See VisibilityFilter. */
+  VisibilityFilter MakeFilter() const {
+    return VisibilityFilter(snapshots_, range_dels_);
+  }
 
   /**
    * It receives an iterator and returns a list of SSTable
+   * The SSTInfo of each output records SSTableBuilder::num_deletions(), which
+   * compaction pickers use to weigh the deletions.
+   * The outputs are built with bloom_bits_per_key_ and filter_type_.
+   *
+   * The records kept by MakeFilter() are written in order. A new output is
+   * started when the current one reaches sst_size_, but never between two
+   * records of the same user key, so that a sorted run has all the records
+   * of a user key in one SSTable. The merge operands of a user key in a
+   * stripe are combined if there is a merge operator (see
+   * SetMergeOperator).
    */
   template <typename IterT>
   std::vector<SSTInfo> Run(IterT&& it) {
-    DB_ERR("Not implemented!");
+    std::vector<SSTInfo> ret;
+    auto filter = MakeFilter();
+    std::optional<Output> output;
+    /* The first user key of the current output */
+    std::optional<std::string> lower;
+    auto append = [&](ParsedKey key, Slice value) {
+      if (output && output->builder_->size() >= sst_size_ &&
+          key.user_key_ != output->builder_->GetLargestKey().user_key_) {
+        std::string upper(key.user_key_);
+        ret.push_back(FinishOutput(&*output, lower, upper));
+        lower = std::move(upper);
+        output.reset();
+      }
+      if (!output) {
+        output = NewOutput();
+      }
+      output->builder_->Append(key, value);
+    };
+    /* The newest merge operand of a user key, and the operands of its
+     * stripe from the newest to the oldest */
+    InternalKey merge_key;
+    std::vector<std::string> operands;
+    for (; it.Valid(); it.Next()) {
+      ParsedKey key(it.key());
+      if (!filter.Keep(key)) {
+        continue;
+      }
+      if (merge_operator_ == nullptr) {
+        append(key, it.value());
+        continue;
+      }
+      if (!operands.empty()) {
+        ParsedKey newest(merge_key);
+        if (key.user_key_ != newest.user_key_ ||
+            filter.GetStripe(key.seq_) != filter.GetStripe(newest.seq_)) {
+          append(newest, CombineOperands(newest.user_key_, &operands));
+        }
+      }
+      if (key.type_ == RecordType::Merge) {
+        if (operands.empty()) {
+          merge_key = InternalKey(key);
+        }
+        operands.emplace_back(it.value());
+      } else if (operands.empty()) {
+        append(key, it.value());
+      } else {
+        /* The older record is the base of the operands in its stripe */
+        ParsedKey newest(merge_key);
+        append(ParsedKey(newest.user_key_, newest.seq_, RecordType::Value),
+            MergeWithRecord(key, it.value(), &operands));
+      }
+    }
+    if (!operands.empty()) {
+      ParsedKey newest(merge_key);
+      append(newest, CombineOperands(newest.user_key_, &operands));
+    }
+    /* The range tombstones are kept even if no record is left */
+    if (!output && range_dels_ && !range_dels_->empty()) {
+      output = NewOutput();
+    }
+    if (output) {
+      ret.push_back(FinishOutput(&*output, lower, std::nullopt));
+    }
+    return ret;
+  }
+
+  /**
+   * Split the key space of the compaction into at most max_ranges disjoint
+   * ranges with similar sizes, using the index of the input SSTables.
+   * Each range has at least sst_size bytes of input.
+   *
+   * It returns the user keys separating the ranges in ascending order, i.e.
+   * range i is [boundaries[i - 1], boundaries[i]). All the records of a user
+   * key are in the same range.
+   */
+  std::vector<std::string> SplitKeyRanges(
+      const Compaction& compaction, size_t max_ranges) const;
+
+  /**
+   * It merges the key ranges separated by boundaries in parallel on pool,
+   * and returns the SSTables of all the ranges in key order, which form a
+   * sorted run.
+   *
+   * make_iterator(lower) returns an iterator over the inputs which owns its
+   * child iterators, and is positioned at the first record whose user key
+   * >= lower (or at the first record if lower is std::nullopt). It is called
+   * concurrently by the workers.
+   */
+  template <typename MakeIterator>
+  std::vector<SSTInfo> RunParallel(const std::vector<std::string>& boundaries,
+      MakeIterator&& make_iterator, ThreadPool* pool) {
+    using IterT = decltype(make_iterator(std::optional<Slice>()));
+    std::vector<std::future<std::vector<SSTInfo>>> futures;
+    for (size_t i = 0; i <= boundaries.size(); i++) {
+      std::optional<std::string> lower, upper;
+      if (i > 0) {
+        lower = boundaries[i - 1];
+      }
+      if (i < boundaries.size()) {
+        upper = boundaries[i];
+      }
+      /* Each range keeps the range tombstones within it */
+      auto job = *this;
+      if (range_dels_) {
+        job.range_dels_ = std::make_shared<const RangeTombstoneList>(
+            range_dels_->ToTombstones(lower, upper));
+      }
+      auto task =
+          std::make_shared<std::packaged_task<std::vector<SSTInfo>()>>(
+              [job = std::move(job), &make_iterator, lower = std::move(lower),
+                  upper = std::move(upper)]() mutable {
+                BoundedIterator<IterT> it(
+                    make_iterator(lower ? std::optional<Slice>(*lower)
+                                        : std::nullopt),
+                    std::move(upper));
+                return job.Run(it);
+              });
+      futures.push_back(task->get_future());
+      pool->Push([task]() { (*task)(); });
+    }
+    std::vector<SSTInfo> ret;
+    for (auto& future : futures) {
+      auto ssts = future.get();
+      ret.insert(ret.end(), std::make_move_iterator(ssts.begin()),
+          std::make_move_iterator(ssts.end()));
+    }
+    return ret;
   }
 
  private:
+  /* An output SSTable of Run */
+  struct Output {
+    std::string filename_;
+    size_t id_;
+    std::unique_ptr<SSTableBuilder> builder_;
+    /* The blob file of the output. It is null if blobs_ is null. */
+    std::unique_ptr<BlobFileBuilder> blob_builder_;
+  };
+
+  /* Create a new output SSTable. */
+  Output NewOutput();
+
+  /**
+   * Combine the merge operands (from the newest to the oldest) into one
+   * operand, and clear them.
+   */
+  std::string CombineOperands(
+      Slice user_key, std::vector<std::string>* operands) const;
+
+  /**
+   * Combine the merge operands with the older record, which is a value, a
+   * blob index or a deletion, into a value, and clear them.
+   */
+  std::string MergeWithRecord(ParsedKey key, Slice value,
+      std::vector<std::string>* operands) const;
+
+  /**
+   * Add the range tombstones in [lower, upper) to the output and finish it.
+   * A missing bound means that the range is unbounded on that side.
+   */
+  SSTInfo FinishOutput(Output* output, std::optional<Slice> lower,
+      std::optional<Slice> upper);
+
   /* Generate new SSTable file name */
   FileNameGenerator* file_gen_;
   /* The target block size */
@@ -38,6 +374,26 @@ class CompactionJob {
   size_t bloom_bits_per_key_;
   /* Use O_DIRECT or not */
   bool use_direct_io_;
+  /* The number of keys between restart points in data blocks */
+  size_t block_restart_interval_;
+  /* The codec of data blocks */
+  CompressionType compression_;
+  /* The type of the filters */
+  FilterType filter_type_;
+  /* The range tombstones of the inputs. It may be null. */
+  std::shared_ptr<const RangeTombstoneList> range_dels_;
+  /* The sequence numbers of the live snapshots */
+  std::vector<seq_t> snapshots_;
+  /* The blob files of the outputs. It may be null. */
+  BlobStore* blobs_{nullptr};
+  /* The minimum size of the separated values */
+  size_t min_blob_size_{0};
+  /* The values in the blob files whose IDs are smaller are relocated */
+  size_t relocate_before_{0};
+  /* It may be null. */
+  const MergeOperator* merge_operator_{nullptr};
+  /* The number of bits per key prefix of the range filters */
+  size_t range_filter_bits_per_key_{0};
 };
 
 }  // namespace lsm
@@ -1,5 +1,8 @@
 #include "storage/lsm/compaction_pick.hpp"
 
+#include <algorithm>
+#include <limits>
+
 namespace wing {
 
 namespace lsm {
@@ -21,6 +24,190 @@ std::unique_ptr<Compaction> LazyLevelingCompactionPicker::Get(
   DB_ERR("Not implemented!");
 }
 
+static constexpr size_t kDeletionWeight = 2;
+
+size_t CompensatedSize(const SSTInfo& info) {
+  size_t average = info.size_ / std::max<size_t>(info.count_, 1);
+  return info.size_ + info.num_deletions_ * kDeletionWeight * average;
+}
+
+static size_t CompensatedSize(const Level& level) {
+  size_t size = 0;
+  for (auto& run : level.GetRuns()) {
+    for (auto& sst : run->GetSSTs()) {
+      size += CompensatedSize(sst->GetSSTInfo());
+    }
+  }
+  return size;
+}
+
+std::vector<size_t> DynamicLeveledCompactionPicker::GetTargetSizes(
+    const Version& version) const {
+  auto& levels = version.GetLevels();
+  size_t last = std::max(num_levels_, levels.size()) - 1;
+  std::vector<size_t> targets(last + 1, 0);
+  targets[last] = std::numeric_limits<size_t>::max();
+  double ratio = std::max<size_t>(ratio_, 2);
+  double size = last < levels.size() ? levels[last].size() : 0;
+  for (size_t i = last; i > 1 && size / ratio >= base_level_size_; i--) {
+    size /= ratio;
+    targets[i - 1] = size;
+  }
+  return targets;
+}
+
+std::unique_ptr<Compaction> DynamicLeveledCompactionPicker::Get(
+    Version* version) {
+  auto& levels = version->GetLevels();
+  auto targets = GetTargetSizes(*version);
+  std::vector<std::pair<double, size_t>> scores;
+  /* The last level is never compacted */
+  for (size_t i = 0; i < levels.size() && i + 1 < targets.size(); i++) {
+    double score;
+    if (i == 0) {
+      score = static_cast<double>(levels[0].GetRuns().size()) /
+              std::max<size_t>(level0_compaction_trigger_, 1);
+    } else {
+      size_t size = CompensatedSize(levels[i]);
+      if (size == 0) {
+        continue;
+      }
+      /* A level above the base level should be empty */
+      score = targets[i] == 0
+                  ? 1 + static_cast<double>(size) /
+                            std::max<size_t>(base_level_size_, 1)
+                  : static_cast<double>(size) / targets[i];
+    }
+    if (score >= 1) {
+      scores.emplace_back(score, i);
+    }
+  }
+  std::sort(scores.begin(), scores.end(), std::greater<>());
+  for (auto [score, level] : scores) {
+    if (auto compaction = PickLevel(*version, targets, level)) {
+      return compaction;
+    }
+  }
+  return nullptr;
+}
+
+std::unique_ptr<Compaction> DynamicLeveledCompactionPicker::PickLevel(
+    const Version& version, const std::vector<size_t>& targets,
+    size_t level) const {
+  auto& levels = version.GetLevels();
+  size_t target = level + 1;
+  while (targets[target] == 0) {
+    target += 1;
+  }
+  /* The sorted run or one of its SSTables is being compacted */
+  auto busy = [](const SortedRun& run) {
+    if (run.GetCompactionInProcess()) {
+      return true;
+    }
+    for (auto& sst : run.GetSSTs()) {
+      if (sst->GetCompactionInProcess()) {
+        return true;
+      }
+    }
+    return false;
+  };
+  /**
+   * Find the sorted run in the target level that overlaps [smallest,
+   * largest]. It fails if more than one run overlaps, or the run is being
+   * compacted.
+   */
+  auto find_target = [&](Slice smallest, Slice largest,
+                         std::shared_ptr<SortedRun>* target_run) {
+    *target_run = nullptr;
+    if (target >= levels.size()) {
+      return true;
+    }
+    for (auto& run : levels[target].GetRuns()) {
+      if (run->GetSmallestKey().user_key_ > largest ||
+          run->GetLargestKey().user_key_ < smallest) {
+        continue;
+      }
+      if (*target_run || busy(*run)) {
+        return false;
+      }
+      *target_run = run;
+    }
+    return true;
+  };
+  auto& runs = levels[level].GetRuns();
+  std::shared_ptr<SortedRun> target_run;
+  if (level == 0 || targets[level] == 0) {
+    /* Merge the whole level into the target level */
+    if (runs.empty()) {
+      return nullptr;
+    }
+    Slice smallest = runs[0]->GetSmallestKey().user_key_;
+    Slice largest = runs[0]->GetLargestKey().user_key_;
+    for (auto& run : runs) {
+      if (busy(*run)) {
+        return nullptr;
+      }
+      smallest = std::min(smallest, run->GetSmallestKey().user_key_);
+      largest = std::max(largest, run->GetLargestKey().user_key_);
+    }
+    if (!find_target(smallest, largest, &target_run)) {
+      return nullptr;
+    }
+    return std::make_unique<Compaction>(std::vector<std::shared_ptr<SSTable>>(),
+        runs, level, target, target_run, false);
+  }
+  /* The SSTables with the most deletions per byte first */
+  std::vector<std::pair<const SortedRun*, size_t>> candidates;
+  for (auto& run : runs) {
+    /* The run is the target of a compaction from the upper level */
+    if (run->GetCompactionInProcess()) {
+      continue;
+    }
+    for (size_t i = 0; i < run->SSTCount(); i++) {
+      if (!run->GetSSTs()[i]->GetCompactionInProcess()) {
+        candidates.emplace_back(run.get(), i);
+      }
+    }
+  }
+  auto density = [](const std::pair<const SortedRun*, size_t>& candidate) {
+    auto& info = candidate.first->GetSSTs()[candidate.second]->GetSSTInfo();
+    return static_cast<double>(CompensatedSize(info)) /
+           std::max<size_t>(info.size_, 1);
+  };
+  std::stable_sort(candidates.begin(), candidates.end(),
+      [&](auto& a, auto& b) { return density(a) > density(b); });
+  for (auto [run, i] : candidates) {
+    /**
+     * The records of a user key kept for snapshots may span adjacent
+     * SSTables. They are compacted together, otherwise an older record left
+     * in this level would shadow the newer one in the target level.
+     */
+    auto& ssts = run->GetSSTs();
+    size_t begin = i, end = i + 1;
+    while (begin > 0 && ssts[begin - 1]->GetLargestKey().user_key_ ==
+                            ssts[begin]->GetSmallestKey().user_key_) {
+      begin -= 1;
+    }
+    while (end < ssts.size() && ssts[end]->GetSmallestKey().user_key_ ==
+                                    ssts[end - 1]->GetLargestKey().user_key_) {
+      end += 1;
+    }
+    std::vector<std::shared_ptr<SSTable>> inputs(
+        ssts.begin() + begin, ssts.begin() + end);
+    if (std::any_of(inputs.begin(), inputs.end(),
+            [](auto& sst) { return sst->GetCompactionInProcess(); }) ||
+        !find_target(inputs.front()->GetSmallestKey().user_key_,
+            inputs.back()->GetLargestKey().user_key_, &target_run)) {
+      continue;
+    }
+    /* The SSTables can be moved if no sorted run in the target overlaps. */
+    return std::make_unique<Compaction>(std::move(inputs),
+        std::vector<std::shared_ptr<SortedRun>>(), level, target, target_run,
+        target_run == nullptr);
+  }
+  return nullptr;
+}
+
 }  // namespace lsm
 
 }  // namespace wing
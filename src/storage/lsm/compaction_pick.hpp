@@ -10,11 +10,24 @@ namespace lsm {
 
 class CompactionPicker {
  public:
+  /**
+   * Pick a compaction. Several compactions can run at the same time, so the
+   * picker must skip the SSTables and sorted runs whose
+   * GetCompactionInProcess() is true. Return nullptr if there is nothing
+   * to compact.
+   */
   virtual std::unique_ptr<Compaction> Get(Version* version) = 0;
 
   virtual ~CompactionPicker() = default;
 };
 
+/**
+ * The size of the SSTable in which each deletion (or range tombstone) weighs
+ * kDeletionWeight average records, since compacting a deletion also drops
+ * the older records it deletes.
+ */
+size_t CompensatedSize(const SSTInfo& info);
+
 class LeveledCompactionPicker final : public CompactionPicker {
  public:
   LeveledCompactionPicker(
@@ -94,6 +107,54 @@ class FluidCompactionPicker final : public CompactionPicker {
   size_t level0_compaction_trigger_{0};
 };
 
+/**
+ * Leveled compaction with dynamic level sizing (like
+ * level_compaction_dynamic_level_bytes in RocksDB).
+ *
+ * The last level (num_levels - 1) has no target size. The target size of
+ * level i above it is size(last level) / ratio^(last - i), and the levels
+ * whose targets would be smaller than base_level_size have no target and
+ * are kept empty. L0 is compacted to the first level with a target, the base
+ * level. So adjacent levels keep the size ratio as the data grows by orders
+ * of magnitude, and a small database has few levels.
+ *
+ * The level with the largest score is compacted first. The score of L0 is
+ * its number of sorted runs / level0_compaction_trigger, and the score of
+ * another level is its compensated size (see CompensatedSize) / its target
+ * size. In a level, the SSTable with the most deletions per byte is picked.
+ */
+class DynamicLeveledCompactionPicker final : public CompactionPicker {
+ public:
+  DynamicLeveledCompactionPicker(size_t ratio, size_t base_level_size,
+      size_t level0_compaction_trigger, size_t num_levels)
+    : ratio_(ratio),
+      base_level_size_(base_level_size),
+      level0_compaction_trigger_(level0_compaction_trigger),
+      num_levels_(std::max<size_t>(num_levels, 2)) {}
+
+  std::unique_ptr<Compaction> Get(Version* version) override;
+
+  /**
+   * The target sizes of the levels from L0 to the last level. It is 0 for L0
+   * and the levels above the base level, and SIZE_MAX for the last level.
+   */
+  std::vector<size_t> GetTargetSizes(const Version& version) const;
+
+ private:
+  /* Compact the level to the next level with a target size. */
+  std::unique_ptr<Compaction> PickLevel(const Version& version,
+      const std::vector<size_t>& targets, size_t level) const;
+
+  /* The target size ratio */
+  size_t ratio_{10};
+  /* The minimum target size of a level */
+  size_t base_level_size_{0};
+  /* The maximum amount of sorted runs in Level 0 */
+  size_t level0_compaction_trigger_{0};
+  /* The number of levels, including L0 */
+  size_t num_levels_{7};
+};
+
 }  // namespace lsm
 
 }  // namespace wing
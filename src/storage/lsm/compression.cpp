@@ -0,0 +1,227 @@
+#include "storage/lsm/compression.hpp"
+
+#include <cstring>
+#include <vector>
+
+#include "common/exception.hpp"
+#include "common/logging.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+CompressionType ParseCompressionType(std::string_view name) {
+  if (name == "none") {
+    return CompressionType::kNone;
+  } else if (name == "lz4") {
+    return CompressionType::kLZ4;
+  } else if (name == "lz4hc") {
+    return CompressionType::kLZ4HC;
+  }
+  throw DBException("Unknown compression type `{}'", name);
+}
+
+/* The LZ4 block format. */
+static constexpr size_t kMinMatch = 4;
+/* The last match must start at least kMFLimit bytes before the end */
+static constexpr size_t kMFLimit = 12;
+/* The last kLastLiterals bytes are always literals */
+static constexpr size_t kLastLiterals = 5;
+static constexpr size_t kMaxOffset = 65535;
+static constexpr int kHashLog = 12;
+/* The number of candidates checked by kLZ4HC */
+static constexpr int kHCMaxAttempts = 64;
+
+static inline uint32_t Read32(const char* p) {
+  uint32_t x;
+  memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+static inline uint32_t Hash4(const char* p) {
+  return (Read32(p) * 2654435761u) >> (32 - kHashLog);
+}
+
+static void PutLength(std::string* output, size_t len) {
+  while (len >= 255) {
+    output->push_back(static_cast<char>(255));
+    len -= 255;
+  }
+  output->push_back(static_cast<char>(len));
+}
+
+/* Emit literals and a match. The last sequence has match_len = 0. */
+static void EmitSequence(std::string* output, const char* literals,
+    size_t literal_len, size_t offset, size_t match_len) {
+  size_t match_code = match_len > 0 ? match_len - kMinMatch : 0;
+  uint8_t token = (std::min<size_t>(literal_len, 15) << 4) |
+                  std::min<size_t>(match_code, 15);
+  output->push_back(static_cast<char>(token));
+  if (literal_len >= 15) {
+    PutLength(output, literal_len - 15);
+  }
+  output->append(literals, literal_len);
+  if (match_len == 0) {
+    return;
+  }
+  output->push_back(static_cast<char>(offset & 0xff));
+  output->push_back(static_cast<char>(offset >> 8));
+  if (match_code >= 15) {
+    PutLength(output, match_code - 15);
+  }
+}
+
+/**
+ * Greedy LZ77 over a hash table of 4-byte prefixes. If max_attempts > 1,
+ * every position is linked into a hash chain, and up to max_attempts earlier
+ * positions are compared to find the longest match.
+ */
+static void CompressLZ4(
+    std::string_view input, std::string* output, int max_attempts) {
+  const char* in = input.data();
+  size_t n = input.size();
+  size_t anchor = 0;
+  if (n >= kMFLimit + 1) {
+    std::vector<int32_t> head(1 << kHashLog, -1);
+    std::vector<int32_t> chain(max_attempts > 1 ? n : 0, -1);
+    size_t limit = n - kMFLimit;
+    size_t match_limit = n - kLastLiterals;
+    auto insert = [&](size_t pos) {
+      uint32_t h = Hash4(in + pos);
+      if (!chain.empty()) {
+        chain[pos] = head[h];
+      }
+      head[h] = pos;
+    };
+    size_t ip = 0;
+    while (ip < limit) {
+      size_t best_len = 0, best_ref = 0;
+      int32_t ref = head[Hash4(in + ip)];
+      for (int i = 0;
+           ref >= 0 && ip - ref <= kMaxOffset && i < max_attempts; i++) {
+        if (Read32(in + ref) == Read32(in + ip)) {
+          size_t len = kMinMatch;
+          while (ip + len < match_limit && in[ref + len] == in[ip + len]) {
+            len++;
+          }
+          if (len > best_len) {
+            best_len = len;
+            best_ref = ref;
+          }
+        }
+        if (chain.empty()) {
+          break;
+        }
+        ref = chain[ref];
+      }
+      insert(ip);
+      if (best_len < kMinMatch) {
+        ip++;
+        continue;
+      }
+      EmitSequence(
+          output, in + anchor, ip - anchor, ip - best_ref, best_len);
+      if (!chain.empty()) {
+        for (size_t pos = ip + 1; pos < ip + best_len && pos < limit; pos++) {
+          insert(pos);
+        }
+      }
+      ip += best_len;
+      anchor = ip;
+    }
+  }
+  EmitSequence(output, in + anchor, n - anchor, 0, 0);
+}
+
+static bool DecompressLZ4(
+    const char* in, size_t n, char* out, size_t out_size) {
+  size_t ip = 0, op = 0;
+  auto get_length = [&](size_t* len) {
+    uint8_t b;
+    do {
+      if (ip >= n) {
+        return false;
+      }
+      b = in[ip++];
+      *len += b;
+    } while (b == 255);
+    return true;
+  };
+  while (true) {
+    if (ip >= n) {
+      return false;
+    }
+    uint8_t token = in[ip++];
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && !get_length(&literal_len)) {
+      return false;
+    }
+    if (literal_len > n - ip || literal_len > out_size - op) {
+      return false;
+    }
+    memcpy(out + op, in + ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+    if (ip == n) {
+      return op == out_size;
+    }
+    if (n - ip < 2) {
+      return false;
+    }
+    size_t offset = static_cast<uint8_t>(in[ip]) |
+                    (static_cast<size_t>(static_cast<uint8_t>(in[ip + 1])) << 8);
+    ip += 2;
+    size_t match_len = token & 15;
+    if (match_len == 15 && !get_length(&match_len)) {
+      return false;
+    }
+    match_len += kMinMatch;
+    if (offset == 0 || offset > op || match_len > out_size - op) {
+      return false;
+    }
+    /* The match may overlap the output */
+    for (size_t i = 0; i < match_len; i++) {
+      out[op + i] = out[op - offset + i];
+    }
+    op += match_len;
+  }
+}
+
+void Compress(
+    CompressionType type, std::string_view input, std::string* output) {
+  uint32_t size = input.size();
+  output->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  switch (type) {
+    case CompressionType::kLZ4:
+      CompressLZ4(input, output, 1);
+      break;
+    case CompressionType::kLZ4HC:
+      CompressLZ4(input, output, kHCMaxAttempts);
+      break;
+    default:
+      DB_ERR("Invalid compression type {}", static_cast<int>(type));
+  }
+}
+
+bool Decompress(
+    CompressionType type, std::string_view input, std::string* output) {
+  if (type != CompressionType::kLZ4 && type != CompressionType::kLZ4HC) {
+    return false;
+  }
+  if (input.size() < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t size = Read32(input.data());
+  /* A byte of LZ4 data is decoded into at most 255 bytes */
+  if (size > (input.size() - sizeof(uint32_t)) * 255) {
+    return false;
+  }
+  size_t old_size = output->size();
+  output->resize(old_size + size);
+  return DecompressLZ4(input.data() + sizeof(uint32_t),
+      input.size() - sizeof(uint32_t), output->data() + old_size, size);
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * The codecs of data blocks. Both LZ4 codecs produce the LZ4 block format,
+ * and are decoded by the same decompressor. kLZ4HC searches longer match
+ * chains, so it compresses better but slower.
+ */
+enum class CompressionType : uint8_t {
+  kNone = 0,
+  kLZ4 = 1,
+  kLZ4HC = 2,
+};
+
+/* "none", "lz4" or "lz4hc". It throws DBException for other names. */
+CompressionType ParseCompressionType(std::string_view name);
+
+/**
+ * Compress input and append the result to output.
+ * The result is | uncompressed size (uint32_t) | compressed data |.
+ * REQUIRES: type != CompressionType::kNone
+ */
+void Compress(CompressionType type, std::string_view input, std::string* output);
+
+/**
+ * Decompress input produced by Compress and append the result to output.
+ * Return false if input is corrupted.
+ */
+bool Decompress(
+    CompressionType type, std::string_view input, std::string* output);
+
+}  // namespace lsm
+
+}  // namespace wing
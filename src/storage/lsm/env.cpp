@@ -0,0 +1,82 @@
+#include "storage/lsm/env.hpp"
+
+#include "storage/lsm/lsm.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+Env::Env(const Options& options)
+  : cache_(options.cache),
+    table_cache_(options.max_open_files, options.table_cache_capacity),
+    reader_(AsyncReader::Create(options.async_io_backend,
+        options.async_io_queue_depth, options.async_io_threads)),
+    write_buffer_budget_(options.db_write_buffer_size),
+    scheduler_(options.max_background_jobs) {
+  if (options.max_subcompactions > 1) {
+    subcompaction_pool_ =
+        std::make_unique<ThreadPool>(options.max_subcompactions);
+  }
+}
+
+void Env::Register(DBImpl* db) {
+  std::unique_lock lck(mu_);
+  dbs_.insert(db);
+}
+
+void Env::Unregister(DBImpl* db) {
+  std::unique_lock lck(mu_);
+  dbs_.erase(db);
+  if (flushing_db_ == db) {
+    flushing_db_ = nullptr;
+  }
+}
+
+void Env::UpdateMemoryUsage(ssize_t mutable_delta, ssize_t delta) {
+  mutable_memory_usage_.fetch_add(mutable_delta);
+  memory_usage_.fetch_add(delta);
+}
+
+bool Env::ShouldFlush() const {
+  if (write_buffer_budget_ == 0) {
+    return false;
+  }
+  size_t mutable_usage = GetMutableMemoryUsage();
+  if (mutable_usage >= write_buffer_budget_ / 8 * 7) {
+    return true;
+  }
+  return GetMemoryUsage() >= write_buffer_budget_ &&
+         mutable_usage >= write_buffer_budget_ / 2;
+}
+
+void Env::MaybeFlush() {
+  if (!ShouldFlush()) {
+    return;
+  }
+  std::unique_lock lck(mu_);
+  if (flushing_db_ != nullptr) {
+    return;
+  }
+  size_t largest = 0;
+  for (auto db : dbs_) {
+    size_t usage = db->GetMutableMemoryUsage();
+    if (usage > largest) {
+      largest = usage;
+      flushing_db_ = db;
+    }
+  }
+  if (flushing_db_ != nullptr) {
+    flushing_db_->RequestFlush();
+  }
+}
+
+void Env::FlushDone(DBImpl* db) {
+  std::unique_lock lck(mu_);
+  if (flushing_db_ == db) {
+    flushing_db_ = nullptr;
+  }
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+
+#include "common/threadpool.hpp"
+#include "storage/lsm/cache.hpp"
+#include "storage/lsm/file.hpp"
+#include "storage/lsm/options.hpp"
+#include "storage/lsm/scheduler.hpp"
+#include "storage/lsm/table_cache.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+class DBImpl;
+
+/**
+ * The resources shared by the DBImpls of a database, e.g. the tables of an
+ * LSMStorage. They share one block cache, one table cache, so the limit of
+ * open files is per process, one pool of background threads
+ * for flushes and compactions, and one budget of MemTable memory, so that the
+ * memory and the threads follow the workload instead of the number of
+ * DBImpls.
+ *
+ * When the MemTables of all the DBImpls exceed the budget, the DBImpl with
+ * the largest active MemTable is asked to flush it.
+ */
+class Env {
+ public:
+  /**
+   * The resources are created with the options of the DBImpls: cache,
+   * max_open_files, table_cache_capacity, max_background_jobs,
+   * max_subcompactions, async_io_* and db_write_buffer_size.
+   */
+  explicit Env(const Options& options);
+
+  Cache* GetCache() { return &cache_; }
+
+  TableCache* GetTableCache() { return &table_cache_; }
+
+  BackgroundScheduler* GetScheduler() { return &scheduler_; }
+
+  /* It is null if options.max_subcompactions <= 1. */
+  ThreadPool* GetSubcompactionPool() { return subcompaction_pool_.get(); }
+
+  /* It is null if the reads are issued one by one. */
+  AsyncReader* GetReader() { return reader_.get(); }
+
+  void Register(DBImpl* db);
+
+  /* After it returns, db is not asked to flush. */
+  void Unregister(DBImpl* db);
+
+  /**
+   * Add the changes of the MemTable memory of a DBImpl. mutable_delta is the
+   * change of the active MemTables, and delta is the change of all the
+   * MemTables, including the immutable ones being flushed.
+   */
+  void UpdateMemoryUsage(ssize_t mutable_delta, ssize_t delta);
+
+  /* The memory of all the MemTables */
+  size_t GetMemoryUsage() const { return memory_usage_.load(); }
+
+  /* The memory of the active MemTables */
+  size_t GetMutableMemoryUsage() const { return mutable_memory_usage_.load(); }
+
+  /**
+   * If the MemTables exceed the budget, ask the DBImpl with the largest
+   * active MemTable to flush it (see DBImpl::RequestFlush). There is at most
+   * one request in flight.
+   */
+  void MaybeFlush();
+
+  /* db has switched its MemTable for the request of MaybeFlush. */
+  void FlushDone(DBImpl* db);
+
+ private:
+  /**
+   * Flush if the active MemTables use 7/8 of the budget, or all the
+   * MemTables exceed the budget and the active ones use half of it. The
+   * MemTables being flushed are not counted in the first condition, since
+   * flushing more does not reduce them.
+   */
+  bool ShouldFlush() const;
+
+  Cache cache_;
+  TableCache table_cache_;
+  std::unique_ptr<ThreadPool> subcompaction_pool_;
+  std::unique_ptr<AsyncReader> reader_;
+  /* The budget of MemTable memory. It is disabled if it is 0. */
+  size_t write_buffer_budget_;
+  std::atomic<size_t> memory_usage_{0};
+  std::atomic<size_t> mutable_memory_usage_{0};
+  std::mutex mu_;
+  std::set<DBImpl*> dbs_;
+  /* The DBImpl asked to flush. It is null if there is no request. */
+  DBImpl* flushing_db_{nullptr};
+  /* It is destroyed first, so that the jobs finish before the others. */
+  BackgroundScheduler scheduler_;
+};
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -2,8 +2,20 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#elif defined(__MINGW64__)
+#include <io.h>
+#endif
+
+#include <cstring>
+#include <future>
 
 #include "common/exception.hpp"
+#include "common/threadpool.hpp"
 #include "storage/lsm/stats.hpp"
 
 namespace wing {
@@ -69,6 +81,17 @@ ssize_t SeqWriteFile::Write(const char* data, size_t n) {
   return ret;
 }
 
+void SeqWriteFile::Sync() {
+#if defined(__linux__)
+  int ret = ::fdatasync(fd_);
+#elif defined(__MINGW64__)
+  int ret = ::_commit(fd_);
+#endif
+  if (ret < 0) {
+    throw DBException("::fdatasync Error! Error: {}", errno);
+  }
+}
+
 void FileWriter::Append(const char* data, size_t n) {
   size_t len = std::min(buffer_size_ - offset_, n);
   memcpy(buffer_.data() + offset_, data, len);
@@ -87,12 +110,233 @@ void FileWriter::Flush() {
   offset_ = 0;
 }
 
+void FileWriter::Sync() {
+  Flush();
+  file_->Sync();
+}
+
 FileWriter::~FileWriter() {
   if (offset_ > 0) {
     Flush();
   }
 }
 
+#if defined(__linux__)
+
+/**
+ * An io_uring set up with the raw system calls. It is used by one thread at a
+ * time.
+ */
+class IoUring {
+ public:
+  explicit IoUring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = ::syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ < 0) {
+      throw DBException("io_uring_setup Error! Error: {}", errno);
+    }
+    entries_ = params.sq_entries;
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = Map(sq_size_, IORING_OFF_SQ_RING);
+    cq_ptr_ = single_mmap ? sq_ptr_ : Map(cq_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = reinterpret_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ptr_ + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq_ptr_ + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_ptr_ + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ptr_ + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ptr_ + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq_ptr_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ptr_ + params.cq_off.cqes);
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) {
+      ::munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_ != nullptr) {
+      ::munmap(sq_ptr_, sq_size_);
+    }
+    ::close(fd_);
+  }
+
+  void ReadBatch(std::span<ReadRequest> requests) {
+    std::vector<iovec> iovs(requests.size());
+    size_t submitted = 0, completed = 0, in_flight = 0;
+    /* The entries in the submission queue that the kernel has not consumed */
+    unsigned to_submit = 0;
+    while (completed < requests.size()) {
+      /* This thread is the only producer, so the tail is not raced. */
+      unsigned tail = *sq_tail_;
+      while (submitted < requests.size() && in_flight < entries_) {
+        auto& request = requests[submitted];
+        iovs[submitted].iov_base = request.data_;
+        iovs[submitted].iov_len = request.size_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = request.file_->fd();
+        sqe->addr = reinterpret_cast<uint64_t>(&iovs[submitted]);
+        sqe->len = 1;
+        sqe->off = request.offset_;
+        sqe->user_data = submitted;
+        sq_array_[index] = index;
+        GetStatsContext()->total_read_bytes.fetch_add(
+            request.size_, std::memory_order_relaxed);
+        tail += 1;
+        submitted += 1;
+        in_flight += 1;
+        to_submit += 1;
+      }
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+      int ret = ::syscall(__NR_io_uring_enter, fd_, to_submit, 1,
+          IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (ret < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+          throw DBException("io_uring_enter Error! Error: {}", errno);
+        }
+      } else {
+        to_submit -= ret;
+      }
+      unsigned head = *cq_head_;
+      while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        auto& cqe = cqes_[head & cq_mask_];
+        requests[cqe.user_data].result_ = cqe.res;
+        head += 1;
+        completed += 1;
+        in_flight -= 1;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+  }
+
+ private:
+  char* Map(size_t size, off_t offset) {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd_, offset);
+    if (ptr == MAP_FAILED) {
+      throw DBException("io_uring mmap Error! Error: {}", errno);
+    }
+    return reinterpret_cast<char*>(ptr);
+  }
+
+  int fd_;
+  unsigned entries_{0};
+  char* sq_ptr_{nullptr};
+  char* cq_ptr_{nullptr};
+  size_t sq_size_{0};
+  size_t cq_size_{0};
+  io_uring_sqe* sqes_{nullptr};
+  size_t sqes_size_{0};
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+};
+
+/**
+ * An io_uring is not shared by threads. Each batch takes an idle io_uring,
+ * or sets up a new one if all of them are in use.
+ */
+class IoUringReader final : public AsyncReader {
+ public:
+  explicit IoUringReader(size_t queue_depth) : queue_depth_(queue_depth) {
+    /* Fail here if the kernel does not support io_uring */
+    idle_.push_back(std::make_unique<IoUring>(queue_depth_));
+  }
+
+  void ReadBatch(std::span<ReadRequest> requests) override {
+    std::unique_ptr<IoUring> ring;
+    {
+      std::unique_lock lck(mu_);
+      if (!idle_.empty()) {
+        ring = std::move(idle_.back());
+        idle_.pop_back();
+      }
+    }
+    if (!ring) {
+      ring = std::make_unique<IoUring>(queue_depth_);
+    }
+    ring->ReadBatch(requests);
+    std::unique_lock lck(mu_);
+    idle_.push_back(std::move(ring));
+  }
+
+ private:
+  size_t queue_depth_;
+  std::mutex mu_;
+  std::vector<std::unique_ptr<IoUring>> idle_;
+};
+
+#endif
+
+class ThreadPoolReader final : public AsyncReader {
+ public:
+  explicit ThreadPoolReader(size_t num_threads) : pool_(num_threads) {}
+
+  void ReadBatch(std::span<ReadRequest> requests) override {
+    std::vector<std::future<void>> futures;
+    for (size_t i = 1; i < requests.size(); i++) {
+      auto task = std::make_shared<std::packaged_task<void()>>(
+          [&request = requests[i]]() { Read(&request); });
+      futures.push_back(task->get_future());
+      pool_.Push([task]() { (*task)(); });
+    }
+    /* The calling thread reads the first one */
+    if (!requests.empty()) {
+      Read(&requests[0]);
+    }
+    for (auto& future : futures) {
+      future.get();
+    }
+  }
+
+ private:
+  static void Read(ReadRequest* request) {
+    request->result_ = request->file_->Read(
+        request->data_, request->size_, request->offset_);
+  }
+
+  ThreadPool pool_;
+};
+
+std::unique_ptr<AsyncReader> AsyncReader::Create(
+    std::string_view backend, size_t queue_depth, size_t num_threads) {
+  if (backend == "none") {
+    return nullptr;
+  }
+  if (backend == "io_uring") {
+#if defined(__linux__)
+    try {
+      return std::make_unique<IoUringReader>(std::max<size_t>(queue_depth, 1));
+    } catch (const DBException& e) {
+      DB_INFO("{}. Fall back to the thread pool.", e.what());
+    }
+#endif
+    return std::make_unique<ThreadPoolReader>(std::max<size_t>(num_threads, 1));
+  }
+  if (backend == "thread_pool") {
+    return std::make_unique<ThreadPoolReader>(std::max<size_t>(num_threads, 1));
+  }
+  throw DBException("Unknown async I/O backend `{}'", backend);
+}
+
 void FileReader::Read(char* data, size_t n) {
   file_->Read(data, n, offset_);
   offset_ += n;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <span>
 
 #include "common/logging.hpp"
 #include "common/util.hpp"
@@ -24,6 +25,7 @@ class ReadFile {
 
   ssize_t Read(char* data, size_t n, offset_t offset);
   bool use_direct_io() const { return use_direct_io_; }
+  int fd() const { return fd_; }
 
  private:
   int fd_;
@@ -31,6 +33,38 @@ class ReadFile {
   bool use_direct_io_;
 };
 
+/* A read submitted to AsyncReader. */
+struct ReadRequest {
+  ReadFile* file_;
+  char* data_;
+  size_t size_;
+  offset_t offset_;
+  /* The number of bytes read, or -errno if the read fails. */
+  ssize_t result_{0};
+};
+
+/**
+ * It reads a batch of requests concurrently, so that the device sees a
+ * queue depth larger than 1.
+ */
+class AsyncReader {
+ public:
+  virtual ~AsyncReader() = default;
+
+  /* Submit the requests, and wait until all of them complete. */
+  virtual void ReadBatch(std::span<ReadRequest> requests) = 0;
+
+  /**
+   * backend is "io_uring", "thread_pool" or "none".
+   * "io_uring" falls back to "thread_pool" if the kernel does not support
+   * io_uring. "none" returns null, and the reads are issued one by one.
+   * queue_depth is the maximum number of reads in flight in an io_uring, and
+   * num_threads is the number of threads of "thread_pool".
+   */
+  static std::unique_ptr<AsyncReader> Create(
+      std::string_view backend, size_t queue_depth, size_t num_threads);
+};
+
 class SeqWriteFile {
  public:
   SeqWriteFile(const std::string& filename, bool use_direct_io);
@@ -43,6 +77,8 @@ class SeqWriteFile {
   SeqWriteFile& operator=(SeqWriteFile&&) = delete;
 
   ssize_t Write(const char* data, size_t n);
+  /* Persist the written data to the device. */
+  void Sync();
   bool use_direct_io() const { return use_direct_io_; }
 
  private:
@@ -75,6 +111,9 @@ class FileWriter {
 
   void Flush();
 
+  /* Flush the buffer and persist the written data to the device. */
+  void Sync();
+
   size_t size() const { return size_; }
 
  private:
@@ -126,9 +165,9 @@ class FileNameGenerator {
   FileNameGenerator(std::string_view prefix, size_t id_begin)
     : prefix_(prefix), id_(id_begin) {}
 
-  std::pair<std::string, size_t> Generate() {
+  std::pair<std::string, size_t> Generate(std::string_view ext = "sst") {
     auto id = id_.fetch_add(1);
-    return {fmt::format("{}{}.sst", prefix_, id), id};
+    return {fmt::format("{}{}.{}", prefix_, id, ext), id};
   }
 
   size_t GetID() const { return id_.load(std::memory_order_relaxed); }
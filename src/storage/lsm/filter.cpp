@@ -0,0 +1,100 @@
+#include "storage/lsm/filter.hpp"
+
+#include <cmath>
+
+#include "common/bloomfilter.hpp"
+#include "common/exception.hpp"
+#include "common/ribbonfilter.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+FilterType ParseFilterType(std::string_view name) {
+  if (name == "bloom") {
+    return FilterType::kBloom;
+  } else if (name == "ribbon") {
+    return FilterType::kRibbon;
+  }
+  throw DBException("Unknown filter type `{}'", name);
+}
+
+std::string BuildFilter(
+    FilterType type, std::span<const size_t> hashes, size_t bits_per_key) {
+  std::string filter;
+  if (type == FilterType::kRibbon) {
+    utils::RibbonFilter::Build(hashes, bits_per_key, filter);
+  } else {
+    utils::BloomFilter::Create(hashes.size(), bits_per_key, filter);
+    for (auto hash : hashes) {
+      utils::BloomFilter::Add(hash, filter);
+    }
+  }
+  filter.push_back(static_cast<char>(type));
+  return filter;
+}
+
+bool FilterMayMatch(std::string_view filter, size_t hash) {
+  auto type = static_cast<FilterType>(filter.back());
+  filter.remove_suffix(1);
+  if (type == FilterType::kRibbon) {
+    return utils::RibbonFilter::Find(hash, filter);
+  }
+  return utils::BloomFilter::Find(hash, filter);
+}
+
+std::vector<double> OptimizeBitsPerKey(std::span<const size_t> runs,
+    std::span<const size_t> sizes, double bits_per_key, FilterType type) {
+  /**
+   * The false positive rate is exp(-c * bits per key). A ribbon filter
+   * spends 1/16 of its bits on the overhead of the band matrix.
+   */
+  double c = type == FilterType::kRibbon ? std::log(2) * 15 / 16
+                                         : std::log(2) * std::log(2);
+  std::vector<double> ret(sizes.size(), 0);
+  std::vector<bool> enabled(sizes.size());
+  double budget = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    enabled[i] = runs[i] > 0 && sizes[i] > 0;
+    budget += bits_per_key * sizes[i];
+  }
+  /**
+   * The rate of level i is lambda * n_i, where n_i is the size of its runs.
+   * So bits_i = (budget / total - log(n_i) + mean log(n)) / c over the
+   * enabled levels. The level with the largest runs is disabled if its bits
+   * are negative, and the others are solved again.
+   */
+  while (true) {
+    double total = 0, sum_log = 0;
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (enabled[i]) {
+        double n = static_cast<double>(sizes[i]) / runs[i];
+        total += sizes[i];
+        sum_log += sizes[i] * std::log(n);
+      }
+    }
+    if (total == 0) {
+      return ret;
+    }
+    size_t worst = sizes.size();
+    for (size_t i = 0; i < sizes.size(); i++) {
+      if (!enabled[i]) {
+        ret[i] = 0;
+        continue;
+      }
+      double n = static_cast<double>(sizes[i]) / runs[i];
+      ret[i] = budget / total + (sum_log / total - std::log(n)) / c;
+      if (ret[i] < 0 && (worst == sizes.size() || ret[i] < ret[worst])) {
+        worst = i;
+      }
+    }
+    if (worst == sizes.size()) {
+      return ret;
+    }
+    enabled[worst] = false;
+  }
+}
+
+}  // namespace lsm
+
+}  // namespace wing
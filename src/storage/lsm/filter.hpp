@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * The filters of the index partitions. kBloom is utils::BloomFilter, and
+ * kRibbon is utils::RibbonFilter, which has a lower false positive rate with
+ * the same number of bits per key, but is slower to build.
+ */
+enum class FilterType : uint8_t {
+  kBloom = 0,
+  kRibbon = 1,
+};
+
+/* "bloom" or "ribbon". It throws DBException for other names. */
+FilterType ParseFilterType(std::string_view name);
+
+/**
+ * Build the filter block of the key hashes (i.e. BloomFilter::BloomHash).
+ * The block is | filter | FilterType (uint8_t) |.
+ */
+std::string BuildFilter(
+    FilterType type, std::span<const size_t> hashes, size_t bits_per_key);
+
+/* Check if the key hash may be in the filter block */
+bool FilterMayMatch(std::string_view filter, size_t hash);
+
+/**
+ * Monkey (Dayan et al., SIGMOD 2017). A point lookup probes the filter of
+ * each sorted run, so its expected number of wasted reads is the sum of the
+ * false positive rates of the runs. With the false positive rate
+ * exp(-c * bits per key), the sum is minimized under a memory budget when the
+ * rate of each run is proportional to its number of keys, i.e. the smaller
+ * runs of the upper levels get more bits per key than the last level.
+ *
+ * runs[i] and sizes[i] are the number of sorted runs and the total size of
+ * level i. It returns the bits per key of each level, such that the total
+ * memory is the same as bits_per_key for all the levels. The levels whose
+ * filters are not worth their memory get 0 bits.
+ */
+std::vector<double> OptimizeBitsPerKey(std::span<const size_t> runs,
+    std::span<const size_t> sizes, double bits_per_key, FilterType type);
+
+}  // namespace lsm
+
+}  // namespace wing
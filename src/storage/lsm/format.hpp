@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "storage/lsm/common.hpp"
 #include "storage/lsm/file.hpp"
@@ -16,6 +17,21 @@ using PinnableSlice = std::string;
 enum class RecordType : uint8_t {
   Deletion = 0,
   Value,
+  /**
+   * A range tombstone (see lsm/range_del.hpp) in the write-ahead log. The user
+   * key is the begin of the range, and the value is the end.
+   */
+  RangeDeletion,
+  /**
+   * A value stored in a blob file (see lsm/blob.hpp). The value of the record
+   * is the encoded BlobIndex.
+   */
+  BlobIndex,
+  /**
+   * A merge operand (see lsm/merge_operator.hpp). It is combined with the
+   * older records of the key by Options::merge_operator.
+   */
+  Merge,
 };
 
 class ParsedKey;
@@ -104,7 +120,7 @@ inline InternalKey::InternalKey(ParsedKey key)
 struct BlockHandle {
   /* The offset of the block. */
   offset_t offset_;
-  /* The size of the block. */
+  /* The size of the block in the file, including the trailer. */
   offset_t size_;
   /* The number of entries in the block. */
   offset_t count_;
@@ -117,19 +133,66 @@ struct IndexValue {
   BlockHandle block_;
 };
 
+struct IndexPartition {
+  /* The largest key in the data blocks of the partition. */
+  InternalKey key_;
+  /* The handle of the index partition, whose entries are IndexValue. */
+  BlockHandle index_;
+  /* The handle of the filter partition. size_ is 0 if there is no filter. */
+  BlockHandle filter_;
+  /* The total size of the data blocks in the partition. */
+  offset_t data_size_;
+};
+
+/* A key looked up by MultiGet, and its result. */
+struct KeyContext {
+  /* The user key */
+  Slice key_;
+  /* The value, which is valid if result_ is GetResult::kFound. */
+  std::string value_;
+  /* It is kNotFound until a record of the key is found. */
+  GetResult result_{GetResult::kNotFound};
+  /**
+   * The merge operands newer than the record of result_, from the newest to
+   * the oldest. They are found while result_ is kNotFound.
+   */
+  std::vector<std::string> operands_;
+};
+
+/**
+ * The version of the SSTable format.
+ * 1: Data blocks are prefix-compressed with restart points (see BlockBuilder).
+ * 2: Data blocks have a trailer with the compression type and the checksum.
+ * 3: The checksum is CRC32C, and the index block and the bloom filter also
+ *    have the trailer.
+ * 4: The index and the bloom filter are partitioned (see SSTableBuilder).
+ * 5: The range tombstones are stored in a block, and the top-level index
+ *    stores the largest key.
+ * 6: The values can be stored in blob files (RecordType::BlobIndex).
+ * 7: The filter partitions end with their FilterType.
+ * 8: The top-level index stores the handle of the range filter.
+ */
+static constexpr uint32_t kBlockFormatVersion = 8;
+
 struct SSTInfo {
   /* The size of the SSTable */
   size_t size_;
   /* The number of records in the SSTable */
   size_t count_;
+  /* The number of deletions and range tombstones in the SSTable */
+  size_t num_deletions_{0};
   /* The ID of the SSTable */
   size_t sst_id_;
-  /* The offset of the index block */
+  /* The offset of the top-level index */
   size_t index_offset_;
-  /* The offset of the bloom filter */
+  /* The offset of the first filter partition */
   size_t bloom_filter_offset_;
   /* The path of the SSTable */
   std::string filename_;
+  /* The IDs of the blob files that the SSTable refers to */
+  std::vector<size_t> blob_files_;
+  /* The format of the SSTable. SSTables of other versions can't be read. */
+  uint32_t format_version_{kBlockFormatVersion};
 };
 
 }  // namespace lsm
@@ -0,0 +1,117 @@
+#include "storage/lsm/ingestion_job.hpp"
+
+#include <algorithm>
+
+namespace wing {
+
+namespace lsm {
+
+void IngestionJob::Sort(
+    std::vector<std::pair<std::string, std::string>>* records,
+    ThreadPool* pool, size_t num_threads) {
+  auto& r = *records;
+  auto less = [](const auto& a, const auto& b) { return a.first < b.first; };
+  /* The chunks are sorted and merged stably, so the last record wins. */
+  size_t num_chunks = std::max<size_t>(1, std::min(num_threads, r.size()));
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= num_chunks; i++) {
+    bounds.push_back(r.size() * i / num_chunks);
+  }
+  for (size_t i = 0; i < num_chunks; i++) {
+    pool->Push([&, i]() {
+      std::stable_sort(r.begin() + bounds[i], r.begin() + bounds[i + 1], less);
+    });
+  }
+  pool->WaitForAllTasks();
+  while (bounds.size() > 2) {
+    std::vector<size_t> merged;
+    for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+      merged.push_back(bounds[i]);
+      if (i + 2 < bounds.size()) {
+        pool->Push([&, i]() {
+          std::inplace_merge(r.begin() + bounds[i], r.begin() + bounds[i + 1],
+              r.begin() + bounds[i + 2], less);
+        });
+      }
+    }
+    merged.push_back(bounds.back());
+    pool->WaitForAllTasks();
+    bounds = std::move(merged);
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < r.size(); i++) {
+    if (n > 0 && r[n - 1].first == r[i].first) {
+      r[n - 1] = std::move(r[i]);
+    } else {
+      if (n != i) {
+        r[n] = std::move(r[i]);
+      }
+      n += 1;
+    }
+  }
+  r.resize(n);
+}
+
+std::vector<SSTInfo> IngestionJob::Run(
+    std::span<const std::pair<std::string, std::string>> records, seq_t seq,
+    ThreadPool* pool) {
+  /* Cut the records into SSTables of about sst_size_ bytes */
+  std::vector<size_t> bounds{0};
+  size_t size = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    size += records[i].first.size() + records[i].second.size();
+    if (size >= sst_size_ && i + 1 < records.size()) {
+      bounds.push_back(i + 1);
+      size = 0;
+    }
+  }
+  bounds.push_back(records.size());
+  std::vector<SSTInfo> ret(bounds.size() - 1);
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    pool->Push([&, i]() {
+      ret[i] = WriteSSTable(
+          records.subspan(bounds[i], bounds[i + 1] - bounds[i]), seq);
+    });
+  }
+  pool->WaitForAllTasks();
+  return ret;
+}
+
+SSTInfo IngestionJob::WriteSSTable(
+    std::span<const std::pair<std::string, std::string>> records, seq_t seq) {
+  auto [filename, id] = file_gen_->Generate();
+  SSTableBuilder builder(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>(filename, use_direct_io_),
+          write_buffer_size_),
+      block_size_, bloom_bits_per_key_, block_restart_interval_,
+      compression_, filter_type_);
+  std::unique_ptr<BlobFileBuilder> blob_builder;
+  if (blobs_ != nullptr && min_blob_size_ > 0) {
+    blob_builder = blobs_->NewBuilder(file_gen_);
+    builder.SetBlobBuilder(blob_builder.get(), min_blob_size_);
+  }
+  builder.SetRangeFilter(range_filter_bits_per_key_);
+  for (auto& [key, value] : records) {
+    builder.Append(ParsedKey(key, seq, RecordType::Value), value);
+  }
+  /* The values are written before the SSTable refers to them */
+  if (blob_builder) {
+    blob_builder->Finish();
+  }
+  builder.Finish();
+  SSTInfo info;
+  info.count_ = builder.count();
+  info.num_deletions_ = builder.num_deletions();
+  info.size_ = builder.size();
+  info.sst_id_ = id;
+  info.index_offset_ = builder.GetIndexOffset();
+  info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.filename_ = filename;
+  info.blob_files_ = builder.GetBlobFiles();
+  return info;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/threadpool.hpp"
+#include "storage/lsm/sst.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * It bulk-loads records into the LSM tree by writing SSTables directly,
+ * bypassing the log, the MemTables and the compactions of L0.
+ */
+class IngestionJob {
+ public:
+  IngestionJob(FileNameGenerator* gen, size_t block_size, size_t sst_size,
+      size_t write_buffer_size, size_t bloom_bits_per_key, bool use_direct_io,
+      size_t block_restart_interval = BlockBuilder::kDefaultRestartInterval,
+      CompressionType compression = CompressionType::kNone,
+      FilterType filter_type = FilterType::kBloom)
+    : file_gen_(gen),
+      block_size_(block_size),
+      sst_size_(sst_size),
+      write_buffer_size_(write_buffer_size),
+      bloom_bits_per_key_(bloom_bits_per_key),
+      use_direct_io_(use_direct_io),
+      block_restart_interval_(block_restart_interval),
+      compression_(compression),
+      filter_type_(filter_type) {}
+
+  /**
+   * Store the values of at least min_blob_size bytes in blob files of blobs.
+   * Each SSTable has its own blob file.
+   */
+  void SetBlobs(BlobStore* blobs, size_t min_blob_size) {
+    blobs_ = blobs;
+    min_blob_size_ = min_blob_size;
+  }
+
+  /* Build range filters. See SSTableBuilder::SetRangeFilter. */
+  void SetRangeFilter(size_t bits_per_key) {
+    range_filter_bits_per_key_ = bits_per_key;
+  }
+
+  /**
+   * Sort the records by key with num_threads workers of pool. Each worker
+   * sorts a chunk, and the sorted chunks are merged pairwise in parallel.
+   * If a key appears more than once, only its last record is kept.
+   */
+  static void Sort(std::vector<std::pair<std::string, std::string>>* records,
+      ThreadPool* pool, size_t num_threads);
+
+  /**
+   * Write the sorted records with sequence number seq to SSTables of about
+   * sst_size bytes in parallel on pool. The SSTables form a sorted run and
+   * are returned in key order.
+   */
+  std::vector<SSTInfo> Run(
+      std::span<const std::pair<std::string, std::string>> records, seq_t seq,
+      ThreadPool* pool);
+
+ private:
+  /* Write the records to a new SSTable. */
+  SSTInfo WriteSSTable(
+      std::span<const std::pair<std::string, std::string>> records, seq_t seq);
+
+  /* Generate new SSTable file name */
+  FileNameGenerator* file_gen_;
+  /* The target block size */
+  size_t block_size_;
+  /* The target SSTable size */
+  size_t sst_size_;
+  /* The size of write buffer in FileWriter */
+  size_t write_buffer_size_;
+  /* The number of bits per key in bloom filter */
+  size_t bloom_bits_per_key_;
+  /* Use O_DIRECT or not */
+  bool use_direct_io_;
+  /* The number of keys between restart points in data blocks */
+  size_t block_restart_interval_;
+  /* The codec of data blocks */
+  CompressionType compression_;
+  /* The type of the filters */
+  FilterType filter_type_;
+  /* The blob files of the SSTables. It may be null. */
+  BlobStore* blobs_{nullptr};
+  /* The minimum size of the separated values */
+  size_t min_blob_size_{0};
+  /* The number of bits per key prefix of the range filters */
+  size_t range_filter_bits_per_key_{0};
+};
+
+}  // namespace lsm
+
+}  // namespace wing
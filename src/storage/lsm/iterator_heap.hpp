@@ -1,6 +1,7 @@
 #pragma once
 
-#include <queue>
+#include <algorithm>
+#include <vector>
 
 #include "storage/lsm/format.hpp"
 #include "storage/lsm/iterator.hpp"
@@ -9,24 +10,51 @@ namespace wing {
 
 namespace lsm {
 
+/**
+ * It merges the iterators into one iterator in the order of the internal
+ * keys, i.e. the records of a user key are given from the newest to the
+ * oldest. The iterators are not owned.
+ */
 template <typename T>
 class IteratorHeap final : public Iterator {
  public:
   IteratorHeap() = default;
 
-  void Push(T* it) { DB_ERR("Not implemented!"); }
+  /* Add an iterator. It is ignored if it is not valid. */
+  void Push(T* it) {
+    if (it->Valid()) {
+      its_.push_back(it);
+    }
+  }
 
-  void Build() { DB_ERR("Not implemented!"); }
+  /* Build the heap after the iterators are pushed. */
+  void Build() { std::make_heap(its_.begin(), its_.end(), Greater); }
 
-  bool Valid() override { DB_ERR("Not implemented!"); }
+  bool Valid() override { return !its_.empty(); }
 
-  Slice key() const override { DB_ERR("Not implemented!"); }
+  Slice key() const override { return its_.front()->key(); }
 
-  Slice value() const override { DB_ERR("Not implemented!"); }
+  Slice value() const override { return its_.front()->value(); }
 
-  void Next() override { DB_ERR("Not implemented!"); }
+  void Next() override {
+    std::pop_heap(its_.begin(), its_.end(), Greater);
+    auto it = its_.back();
+    it->Next();
+    if (it->Valid()) {
+      std::push_heap(its_.begin(), its_.end(), Greater);
+    } else {
+      its_.pop_back();
+    }
+  }
 
  private:
+  /* The iterator with the smallest key is at the top of the heap */
+  static bool Greater(T* a, T* b) {
+    return ParsedKey(a->key()) > ParsedKey(b->key());
+  }
+
+  /* The valid iterators */
+  std::vector<T*> its_;
 };
 
 }  // namespace lsm
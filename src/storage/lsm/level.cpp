@@ -1,18 +1,75 @@
 #include "storage/lsm/level.hpp"
 
+#include <algorithm>
+
 namespace wing {
 
 namespace lsm {
 
-GetResult SortedRun::Get(Slice key, uint64_t seq, std::string* value) {
-  DB_ERR("Not implemented!");
+GetResult SortedRun::Get(Slice key, uint64_t seq, std::string* value,
+    std::vector<std::string>* operands) {
+  ParsedKey target(key, seq, RecordType::Value);
+  auto it = std::partition_point(ssts_.begin(), ssts_.end(),
+      [&](const auto& sst) { return sst->GetLargestKey() < target; });
+  /* The records of a user key are in one SSTable of the run */
+  if (it == ssts_.end() || (*it)->GetSmallestKey().user_key_ > key) {
+    return GetResult::kNotFound;
+  }
+  return (*it)->Get(key, seq, value, operands);
+}
+
+void SortedRun::MultiGet(std::span<KeyContext*> keys, uint64_t seq) {
+  size_t i = 0;
+  while (i < keys.size()) {
+    ParsedKey target(keys[i]->key_, seq, RecordType::Value);
+    auto it = std::partition_point(ssts_.begin(), ssts_.end(),
+        [&](const auto& sst) { return sst->GetLargestKey() < target; });
+    if (it == ssts_.end()) {
+      break;
+    }
+    ParsedKey largest = (*it)->GetLargestKey();
+    size_t end = i + 1;
+    while (end < keys.size() &&
+           ParsedKey(keys[end]->key_, seq, RecordType::Value) <= largest) {
+      end += 1;
+    }
+    (*it)->MultiGet(keys.subspan(i, end - i), seq);
+    i = end;
+  }
+}
+
+bool SortedRun::RangeMayMatch(Slice lower, Slice upper) const {
+  auto it = std::partition_point(ssts_.begin(), ssts_.end(),
+      [&](const auto& sst) { return sst->GetLargestKey().user_key_ < lower; });
+  for (; it != ssts_.end() && (*it)->GetSmallestKey().user_key_ <= upper;
+       ++it) {
+    if ((*it)->RangeMayMatch(lower, upper)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 SortedRunIterator SortedRun::Seek(Slice key, uint64_t seq) {
-  DB_ERR("Not implemented!");
+  ParsedKey target(key, seq, RecordType::Value);
+  size_t id = std::partition_point(ssts_.begin(), ssts_.end(),
+                  [&](const auto& sst) {
+                    return sst->GetLargestKey() < target;
+                  }) -
+              ssts_.begin();
+  if (id == ssts_.size()) {
+    return SortedRunIterator(this, SSTableIterator(), id);
+  }
+  SortedRunIterator it(this, ssts_[id]->Seek(key, seq), id);
+  it.SkipEmptySSTs();
+  return it;
 }
 
-SortedRunIterator SortedRun::Begin() { DB_ERR("Not implemented!"); }
+SortedRunIterator SortedRun::Begin() {
+  SortedRunIterator it(this, SSTableIterator(), 0);
+  it.SeekToFirst();
+  return it;
+}
 
 SortedRun::~SortedRun() {
   if (remove_tag_) {
@@ -22,19 +79,37 @@ SortedRun::~SortedRun() {
   }
 }
 
-void SortedRunIterator::SeekToFirst() { DB_ERR("Not implemented!"); }
+void SortedRunIterator::SeekToFirst() {
+  sst_id_ = 0;
+  if (sst_id_ < run_->ssts_.size()) {
+    sst_it_ = run_->ssts_[sst_id_]->Begin();
+    SkipEmptySSTs();
+  }
+}
 
-bool SortedRunIterator::Valid() { DB_ERR("Not implemented!"); }
+bool SortedRunIterator::Valid() {
+  return run_ != nullptr && sst_id_ < run_->ssts_.size();
+}
 
-Slice SortedRunIterator::key() const { DB_ERR("Not implemented!"); }
+Slice SortedRunIterator::key() const { return sst_it_.key(); }
 
-Slice SortedRunIterator::value() const { DB_ERR("Not implemented!"); }
+Slice SortedRunIterator::value() const { return sst_it_.value(); }
 
-void SortedRunIterator::Next() { DB_ERR("Not implemented!"); }
+void SortedRunIterator::Next() {
+  sst_it_.Next();
+  SkipEmptySSTs();
+}
 
-GetResult Level::Get(Slice key, uint64_t seq, std::string* value) {
+void SortedRunIterator::SkipEmptySSTs() {
+  while (!sst_it_.Valid() && ++sst_id_ < run_->ssts_.size()) {
+    sst_it_ = run_->ssts_[sst_id_]->Begin();
+  }
+}
+
+GetResult Level::Get(Slice key, uint64_t seq, std::string* value,
+    std::vector<std::string>* operands) {
   for (int i = runs_.size() - 1; i >= 0; --i) {
-    auto res = runs_[i]->Get(key, seq, value);
+    auto res = runs_[i]->Get(key, seq, value, operands);
     if (res != GetResult::kNotFound) {
       return res;
     }
@@ -42,6 +117,15 @@ GetResult Level::Get(Slice key, uint64_t seq, std::string* value) {
   return GetResult::kNotFound;
 }
 
+void Level::MultiGet(std::vector<KeyContext*>* keys, uint64_t seq) {
+  for (int i = runs_.size() - 1; i >= 0 && !keys->empty(); --i) {
+    runs_[i]->MultiGet(*keys, seq);
+    std::erase_if(*keys, [](KeyContext* key) {
+      return key->result_ != GetResult::kNotFound;
+    });
+  }
+}
+
 void Level::Append(std::vector<std::shared_ptr<SortedRun>> runs) {
   for (auto& run : runs) {
     size_ += run->size();
@@ -10,13 +10,16 @@ class SortedRunIterator;
 
 class SortedRun {
  public:
-  SortedRun(
-      const std::vector<SSTInfo>& ssts, size_t block_size, bool use_direct_io)
+  SortedRun(const std::vector<SSTInfo>& ssts, size_t block_size,
+      bool use_direct_io, bool verify_checksums = true, Cache* cache = nullptr,
+      AsyncReader* reader = nullptr, size_t max_readahead_size = 256 * 1024,
+      BlobStore* blobs = nullptr, TableCache* table_cache = nullptr)
     : block_size_(block_size), use_direct_io_(use_direct_io) {
     size_ = 0;
     for (auto& sst : ssts) {
-      ssts_.push_back(
-          std::make_shared<SSTable>(sst, block_size_, use_direct_io_));
+      ssts_.push_back(std::make_shared<SSTable>(sst, block_size_,
+          use_direct_io_, verify_checksums, cache, reader,
+          max_readahead_size, blobs, table_cache));
       size_ += sst.size_;
     }
   }
@@ -40,8 +43,23 @@ class SortedRun {
    * If the record has type RecordType::Deletion, then it does nothing to the
    * value, and returns GetResult::kDelete If there is no such record, it
    * returns GetResult::kNotFound.
+   * The merge operands newer than the record are appended to operands (see
+   * SSTable::Get).
    * */
-  GetResult Get(Slice key, uint64_t seq, std::string* value);
+  GetResult Get(Slice key, uint64_t seq, std::string* value,
+      std::vector<std::string>* operands = nullptr);
+
+  /**
+   * Get the keys in a batch (see SSTable::MultiGet). keys are sorted by the
+   * user key, and each SSTable gets the keys in its key range.
+   */
+  void MultiGet(std::span<KeyContext*> keys, uint64_t seq);
+
+  /**
+   * Return false if the run has no record whose user key is in
+   * [lower, upper] (see SSTable::RangeMayMatch).
+   */
+  bool RangeMayMatch(Slice lower, Slice upper) const;
 
   /* Return an iterator positioned at the first record >= (key, seq). */
   SortedRunIterator Seek(Slice key, uint64_t seq);
@@ -110,12 +128,21 @@ class SortedRunIterator final : public Iterator {
   void Next() override;
 
  private:
+  /**
+   * If the current SSTable has no more records, move to the first record of
+   * the next SSTable that has one. An SSTable may have only range
+   * tombstones, or its key range may be extended by them.
+   */
+  void SkipEmptySSTs();
+
   /* The referenced sorted run */
-  SortedRun* run_;
+  SortedRun* run_{nullptr};
   /* The SSTable iterator of the current SSTable */
   SSTableIterator sst_it_;
   /* The index of the current SSTable */
   size_t sst_id_{0};
+
+  friend class SortedRun;
 };
 
 class Level {
@@ -134,7 +161,14 @@ class Level {
     return runs_;
   }
 
-  GetResult Get(Slice key, uint64_t seq, std::string* value);
+  GetResult Get(Slice key, uint64_t seq, std::string* value,
+      std::vector<std::string>* operands = nullptr);
+
+  /**
+   * Get the keys in a batch from the newest sorted run to the oldest one.
+   * The keys whose records are found are removed from keys.
+   */
+  void MultiGet(std::vector<KeyContext*>* keys, uint64_t seq);
 
   /* Get the level id */
   int GetID() const { return level_id_; }
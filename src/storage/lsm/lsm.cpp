@@ -1,7 +1,9 @@
 #include "storage/lsm/lsm.hpp"
 
+#include <cmath>
 #include <fstream>
 
+#include "common/exception.hpp"
 #include "common/stopwatch.hpp"
 #include "storage/lsm/compaction_job.hpp"
 #include "storage/lsm/stats.hpp"
@@ -10,18 +12,63 @@ namespace wing {
 
 namespace lsm {
 
-DBImpl::DBImpl(const Options& options)
-  : options_(options), cache_(options_.cache) {
+/* The blob files that the SSTables of the version refer to */
+static std::set<size_t> GetBlobFiles(const Version& version) {
+  std::set<size_t> ret;
+  for (auto& level : version.GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      for (auto& sst : run->GetSSTs()) {
+        auto& blob_files = sst->GetSSTInfo().blob_files_;
+        ret.insert(blob_files.begin(), blob_files.end());
+      }
+    }
+  }
+  return ret;
+}
+
+DBImpl::DBImpl(const Options& options, std::shared_ptr<Env> env)
+  : options_(options),
+    env_(env ? std::move(env) : std::make_shared<Env>(options_)),
+    cache_(env_->GetCache()),
+    reader_(env_->GetReader()),
+    table_cache_(env_->GetTableCache()),
+    blobs_(std::make_unique<BlobStore>(options_.db_path.string() + "/",
+        options_.verify_checksums, options_.write_buffer_size)),
+    write_controller_(options_.delayed_write_rate) {
+  if (options_.memtable_rep_name == "skiplist") {
+    memtable_rep_ = MemTableRep::kSkipList;
+  } else if (options_.memtable_rep_name == "map") {
+    memtable_rep_ = MemTableRep::kMap;
+  } else {
+    throw DBException("Unknown MemTable representation `{}'",
+        options_.memtable_rep_name);
+  }
+  for (auto& name : options_.compression_per_level) {
+    compression_per_level_.push_back(ParseCompressionType(name));
+  }
+  filter_type_ = ParseFilterType(options_.filter_type);
   if (options_.create_new) {
     seq_ = 0;
-    sv_ = std::make_shared<SuperVersion>(std::make_shared<MemTable>(),
-        std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
-        std::make_shared<Version>());
     filename_gen_ =
         std::make_unique<FileNameGenerator>(options_.db_path.string() + "/", 0);
+    /* Remove the logs left by the previous database in the directory */
+    for (auto& entry : std::filesystem::directory_iterator(options_.db_path)) {
+      if (ParseLogFileName(entry.path().filename().string())) {
+        std::filesystem::remove(entry.path());
+      }
+    }
+    sv_ = std::make_shared<SuperVersion>(NewMemTable(),
+        std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
+        std::make_shared<Version>());
+    /* So that the database can be recovered from the logs after a crash */
+    SaveMetadata();
   } else {
     LoadMetadata();
+    /* The edits are appended to a new MANIFEST */
+    SaveMetadata();
   }
+  /* Remove the blob files of unfinished flushes and compactions */
+  blobs_->RemoveObsoleteFiles(GetBlobFiles(*sv_->GetVersion()));
   if (options_.compaction_strategy_name == "leveled") {
     compaction_picker_ = std::make_unique<LeveledCompactionPicker>(
         options_.compaction_size_ratio,
@@ -42,35 +89,142 @@ DBImpl::DBImpl(const Options& options)
         options_.target_alpha_part3, options_.target_scan_length_part3,
         options_.level0_compaction_trigger * options_.sst_file_size,
         options_.level0_compaction_trigger);
+  } else if (options_.compaction_strategy_name == "dynamic") {
+    compaction_picker_ = std::make_unique<DynamicLeveledCompactionPicker>(
+        options_.compaction_size_ratio,
+        options_.level0_compaction_trigger * options_.sst_file_size,
+        options_.level0_compaction_trigger, options_.num_levels);
   }
-
-  threads_.emplace_back([&]() { FlushThread(); });
-  threads_.emplace_back([&]() { CompactionThread(); });
+  subcompaction_pool_ = env_->GetSubcompactionPool();
+  env_->Register(this);
+  UpdateMemoryUsage();
+  /* Flush the MemTables recovered from the logs */
+  std::unique_lock db_lck(db_mutex_);
+  UpdateWriteState();
+  MaybeScheduleWork();
 }
 
 DBImpl::~DBImpl() {
+  env_->Unregister(this);
   FlushAll();
-  stop_signal_ = true;
-  flush_cv_.notify_all();
-  compact_cv_.notify_all();
-  for (auto& thread : threads_) {
-    thread.join();
+  {
+    std::unique_lock db_lck(db_mutex_);
+    stop_signal_ = true;
   }
+  stall_cv_.notify_all();
+  /* Wait for the running jobs. The scheduler may be shared. */
+  WaitForFlushAndCompaction();
   Save();
+  std::unique_lock lck(memory_mutex_);
+  env_->UpdateMemoryUsage(
+      -static_cast<ssize_t>(reported_mutable_memory_.load()),
+      -static_cast<ssize_t>(reported_memory_));
 }
 
-void DBImpl::StopWrite() {
-  db_mutex_.unlock();
-  std::this_thread::sleep_for(std::chrono::milliseconds(100));
-  db_mutex_.lock();
+void DBImpl::UpdateWriteState() {
+  auto sv = GetSV();
+  auto& levels = sv->GetVersion()->GetLevels();
+  size_t l0_runs = levels.size() > 0 ? levels[0].GetRuns().size() : 0;
+  size_t pending_bytes = EstimatePendingCompactionBytes(*sv->GetVersion());
+  auto exceeds = [](size_t value, size_t limit) {
+    return limit > 0 && value >= limit;
+  };
+  WriteState state = WriteState::kNormal;
+  if (l0_runs >= options_.level0_stop_writes_trigger ||
+      exceeds(pending_bytes, options_.hard_pending_compaction_bytes_limit)) {
+    state = WriteState::kStopped;
+  } else if (l0_runs >= options_.level0_slowdown_writes_trigger ||
+             exceeds(pending_bytes,
+                 options_.soft_pending_compaction_bytes_limit) ||
+             (options_.max_immutable_count > 1 &&
+                 sv->GetImms()->size() + 1 >= options_.max_immutable_count)) {
+    state = WriteState::kDelayed;
+  }
+  if (state != write_controller_.GetState()) {
+    DB_INFO("Write state: {} -> {}, L0 runs: {}, pending compaction bytes: {}",
+        static_cast<int>(write_controller_.GetState()),
+        static_cast<int>(state), l0_runs, pending_bytes);
+    write_controller_.SetState(state);
+  }
+  /* The number of immutable MemTables may also be reduced. */
+  stall_cv_.notify_all();
 }
 
-void DBImpl::SwitchMemtable(bool force) {
+size_t DBImpl::EstimatePendingCompactionBytes(const Version& version) const {
+  auto& levels = version.GetLevels();
+  size_t pending_bytes = 0;
+  if (levels.size() > 0 &&
+      levels[0].GetRuns().size() >= options_.level0_compaction_trigger) {
+    pending_bytes += levels[0].size();
+  }
+  /* The same target sizes as those given to the compaction picker */
+  double target =
+      options_.level0_compaction_trigger * options_.sst_file_size;
+  for (size_t i = 1; i < levels.size(); i++) {
+    if (levels[i].size() > target) {
+      /**
+       * Each byte over the target is merged with about size_ratio bytes in
+       * the next level.
+       */
+      pending_bytes += (levels[i].size() - target) *
+                       (options_.compaction_size_ratio + 1);
+    }
+    target *= options_.compaction_size_ratio;
+  }
+  return pending_bytes;
+}
+
+size_t DBImpl::GetBlobRelocationCutoff(const Version& version) const {
+  auto blob_files = GetBlobFiles(version);
+  /* The IDs are allocated in order, so smaller IDs are older files. */
+  size_t num_relocated = blob_files.size() *
+                         options_.blob_garbage_collection_age_cutoff;
+  if (num_relocated == 0) {
+    return 0;
+  }
+  if (num_relocated >= blob_files.size()) {
+    return *blob_files.rbegin() + 1;
+  }
+  return *std::next(blob_files.begin(), num_relocated);
+}
+
+void DBImpl::DelayWrite(size_t num_bytes) {
+  {
+    std::unique_lock db_lck(db_mutex_);
+    stall_cv_.wait(db_lck, [&]() {
+      return write_controller_.GetState() != WriteState::kStopped ||
+             stop_signal_;
+    });
+  }
+  auto delay = write_controller_.GetDelay(num_bytes);
+  if (delay.count() > 0) {
+    std::this_thread::sleep_for(delay);
+  }
+}
+
+std::shared_ptr<MemTable> DBImpl::NewMemTable() {
+  auto [filename, log_number] = filename_gen_->Generate("wal");
+  if (options_.enable_wal) {
+    wal_ = std::make_unique<WALWriter>(filename, options_.write_buffer_size);
+  }
+  return std::make_shared<MemTable>(log_number, memtable_rep_);
+}
+
+void DBImpl::RemoveLog(const MemTable& mt) {
+  std::filesystem::remove(
+      LogFileName(options_.db_path.string(), mt.GetLogNumber()));
+}
+
+bool DBImpl::SwitchMemtable(bool force, bool wait) {
   std::unique_lock db_lck(db_mutex_);
   auto old_sv = GetSV();
   while (old_sv->GetImms()->size() >= options_.max_immutable_count) {
+    if (!wait) {
+      return false;
+    }
     old_sv.reset();
-    StopWrite();
+    /* Wait for flushes */
+    stall_cv_.wait(db_lck);
     old_sv = GetSV();
   }
   if ((force && old_sv->GetMt()->size() > 0) ||
@@ -81,65 +235,379 @@ void DBImpl::SwitchMemtable(bool force) {
     new_imm->push_back(mt);
     new_imm->insert(
         new_imm->end(), old_sv->GetImms()->begin(), old_sv->GetImms()->end());
-    auto new_mt = std::make_shared<MemTable>();
+    auto new_mt = NewMemTable();
     auto new_sv = std::make_shared<SuperVersion>(new_mt, new_imm, version);
     InstallSV(new_sv);
     DB_INFO("{}", new_sv->ToString());
-    flush_cv_.notify_one();
+    UpdateWriteState();
+    MaybeScheduleWork();
   }
+  return true;
 }
 
-void DBImpl::Put(Slice key, Slice value) {
+void DBImpl::HandleFlushRequest() {
+  if (!flush_requested_ || !SwitchMemtable(true, false)) {
+    return;
+  }
+  flush_requested_ = false;
+  UpdateMemoryUsage();
+  env_->FlushDone(this);
+}
+
+/**
+ * Writers queued at the same time are committed together by the writer at the
+ * front of the queue, which writes their batches to the write-ahead log with a
+ * single write (and sync).
+ */
+void DBImpl::Write(const WriteBatch& batch) {
+  if (batch.empty()) {
+    return;
+  }
+  Writer w;
+  w.batch = &batch;
   std::unique_lock lck(write_mutex_);
-  auto seq = ++seq_;
+  writers_.push_back(&w);
+  while (!w.done && &w != writers_.front()) {
+    w.cv.wait(lck);
+  }
+  if (w.done) {
+    return;
+  }
+  /* w is the leader. Group the queued writes after it. */
+  std::vector<Writer*> group;
+  size_t group_size = 0;
+  auto seq = seq_;
+  for (auto writer : writers_) {
+    if (writer->job != nullptr ||
+        (!group.empty() && group_size >= options_.max_write_group_size)) {
+      break;
+    }
+    writer->seq = seq + 1;
+    seq += writer->batch->Count();
+    group_size += writer->batch->rep().size();
+    group.push_back(writer);
+  }
+  /**
+   * The later writers only enqueue themselves, and the MemTable and the log
+   * are not switched until the leader finishes. So the lock can be released.
+   */
+  lck.unlock();
+  DelayWrite(group_size);
   auto sv = GetSV();
-  sv->GetMt()->Put(key, seq, value);
-  if (sv->GetMt()->size() > options_.sst_file_size) {
+  auto mt = sv->GetMt();
+  if (wal_) {
+    for (auto writer : group) {
+      wal_->AddBatch(writer->seq, *writer->batch);
+    }
+    wal_->Commit(options_.sync_wal);
+  }
+  for (auto writer : group) {
+    mt->Apply(*writer->batch, writer->seq);
+  }
+  /* Publish the sequence numbers after all the batches are in the MemTable */
+  lck.lock();
+  seq_ = seq;
+  if (mt->size() > options_.sst_file_size) {
+    /* w is still at the front, so the lock is not needed while it waits. */
+    lck.unlock();
     SwitchMemtable();
+    lck.lock();
+  }
+  HandleFlushRequest();
+  UpdateMemoryUsage();
+  /* Another DBImpl sharing env_ may be asked to flush */
+  env_->MaybeFlush();
+  for (auto writer : group) {
+    writers_.pop_front();
+    writer->done = true;
+    if (writer != &w) {
+      writer->cv.notify_one();
+    }
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.notify_one();
   }
 }
 
-void DBImpl::Del(Slice key) {
+void DBImpl::RunExclusive(const std::function<void()>& job) {
+  Writer w;
+  w.job = &job;
   std::unique_lock lck(write_mutex_);
-  auto seq = ++seq_;
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.wait(lck);
+  }
+  /* The job may wait, e.g. for flushes. w keeps the others out. */
+  lck.unlock();
+  job();
+  lck.lock();
+  HandleFlushRequest();
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.notify_one();
+  }
+}
+
+void DBImpl::Put(Slice key, Slice value) {
+  WriteBatch batch;
+  batch.Put(key, value);
+  Write(batch);
+}
+
+void DBImpl::Merge(Slice key, Slice operand) {
+  GetMergeOperator();
+  WriteBatch batch;
+  batch.Merge(key, operand);
+  Write(batch);
+}
+
+const MergeOperator& DBImpl::GetMergeOperator() const {
+  if (options_.merge_operator == nullptr) {
+    throw DBException("No merge operator in {}", options_.db_path.string());
+  }
+  return *options_.merge_operator;
+}
+
+void DBImpl::Del(Slice key) {
+  WriteBatch batch;
+  batch.Del(key);
+  Write(batch);
+}
+
+void DBImpl::DeleteRange(Slice begin, Slice end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  Write(batch);
+}
+
+/* If mt has a record or a range tombstone in [smallest, largest] */
+static bool MemTableOverlaps(MemTable& mt, Slice smallest, Slice largest) {
+  /* The smallest user key larger than largest */
+  std::string upper(largest);
+  upper.push_back('\0');
+  /* A range tombstone hides the older records, even ingested ones. */
+  if (!mt.GetRangeTombstones()->ToTombstones(smallest, upper).empty()) {
+    return true;
+  }
+  auto it = mt.Seek(smallest, std::numeric_limits<seq_t>::max());
+  return it.Valid() && ParsedKey(it.key()).user_key_ <= largest;
+}
+
+void DBImpl::Ingest(std::vector<std::pair<std::string, std::string>> records) {
+  if (records.empty()) {
+    return;
+  }
+  std::call_once(ingest_pool_once_, [&]() {
+    ingest_pool_ = std::make_unique<ThreadPool>(
+        std::max<size_t>(options_.ingest_threads, 1));
+  });
+  IngestionJob::Sort(&records, ingest_pool_.get(), options_.ingest_threads);
+  Slice smallest = records.front().first;
+  Slice largest = records.back().first;
+  bool done = false;
+  while (true) {
+    RunExclusive([&]() {
+      /**
+       * The MemTables are read before the SSTables, so their records of the
+       * keys must be flushed first. The flush is waited for below, so that
+       * the writes are not blocked meanwhile.
+       */
+      if (MemTablesOverlap(smallest, largest)) {
+        SwitchMemtable(true, false);
+        return;
+      }
+      done = true;
+      auto version = GetSV()->GetVersion();
+      size_t level = PickIngestionLevel(*version, smallest, largest);
+      size_t size = 0;
+      for (auto& [key, value] : records) {
+        size += key.size() + value.size();
+      }
+      IngestionJob job(filename_gen_.get(), options_.block_size,
+          options_.sst_file_size, options_.write_buffer_size,
+          GetBitsPerKey(*version, level, size), options_.use_direct_io,
+          options_.block_restart_interval, GetCompression(level),
+          filter_type_);
+      job.SetBlobs(blobs_.get(), options_.min_blob_size);
+      job.SetRangeFilter(options_.range_filter_bits_per_key);
+      /* The records are newer than all the committed writes */
+      auto seq = seq_ + 1;
+      auto run = std::make_shared<SortedRun>(
+          job.Run(records, seq, ingest_pool_.get()), options_.block_size,
+          options_.use_direct_io, options_.verify_checksums, cache_, reader_,
+          options_.max_readahead_size, blobs_.get(), table_cache_);
+      std::unique_lock db_lck(db_mutex_);
+      auto old_sv = GetSV();
+      /* A compaction may have moved records into the range. */
+      if (PickIngestionLevel(*old_sv->GetVersion(), smallest, largest) <
+          level) {
+        level = 0;
+      }
+      auto new_version = std::make_shared<Version>(*old_sv->GetVersion());
+      /* Below L0, the SSTables join the sorted run of the level. */
+      if (level == 0) {
+        new_version->Append(0, std::move(run));
+      } else {
+        new_version->Insert(level, std::move(run));
+      }
+      auto new_sv = std::make_shared<SuperVersion>(
+          old_sv->GetMt(), old_sv->GetImms(), new_version);
+      DB_INFO("Ingest {} records to level {}", records.size(), level);
+      InstallSV(std::move(new_sv), seq);
+      seq_ = seq;
+      UpdateWriteState();
+      MaybeScheduleWork();
+    });
+    if (done) {
+      return;
+    }
+    /**
+     * Wait until the overlapping MemTables are flushed, and there is room to
+     * switch the active one. BackgroundFlush wakes it up.
+     */
+    std::unique_lock db_lck(db_mutex_);
+    stall_cv_.wait(db_lck, [&]() {
+      auto imms = GetSV()->GetImms();
+      if (stop_signal_) {
+        return true;
+      }
+      if (imms->size() >= options_.max_immutable_count) {
+        return false;
+      }
+      for (auto& imm : *imms) {
+        if (MemTableOverlaps(*imm, smallest, largest)) {
+          return false;
+        }
+      }
+      return true;
+    });
+    if (stop_signal_) {
+      throw DBException("{} is closed", options_.db_path.string());
+    }
+  }
+}
+
+bool DBImpl::MemTablesOverlap(Slice smallest, Slice largest) {
   auto sv = GetSV();
-  sv->GetMt()->Del(key, seq);
-  if (sv->GetMt()->size() > options_.sst_file_size) {
-    SwitchMemtable();
+  if (MemTableOverlaps(*sv->GetMt(), smallest, largest)) {
+    return true;
+  }
+  for (auto& imm : *sv->GetImms()) {
+    if (MemTableOverlaps(*imm, smallest, largest)) {
+      return true;
+    }
   }
+  return false;
+}
+
+size_t DBImpl::PickIngestionLevel(
+    const Version& version, Slice smallest, Slice largest) const {
+  size_t level = 0;
+  for (auto& lvl : version.GetLevels()) {
+    for (auto& run : lvl.GetRuns()) {
+      if (run->GetSmallestKey().user_key_ <= largest &&
+          run->GetLargestKey().user_key_ >= smallest) {
+        return level;
+      }
+    }
+    level = lvl.GetID();
+  }
+  return level;
 }
 
 void DBImpl::DropAll() {
   WaitForFlushAndCompaction();
-  std::unique_lock db_lck(db_mutex_);
-  auto sv = GetSV();
-  auto new_sv = std::make_shared<SuperVersion>(std::make_shared<MemTable>(),
-      std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
-      std::make_shared<Version>());
-  auto version = sv->GetVersion();
-  for (auto& level : version->GetLevels()) {
-    for (auto& sr : level.GetRuns()) {
-      sr->SetRemoveTag(true);
+  RunExclusive([&]() {
+    std::unique_lock db_lck(db_mutex_);
+    auto sv = GetSV();
+    auto new_sv = std::make_shared<SuperVersion>(NewMemTable(),
+        std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
+        std::make_shared<Version>());
+    auto version = sv->GetVersion();
+    for (auto& level : version->GetLevels()) {
+      for (auto& sr : level.GetRuns()) {
+        sr->SetRemoveTag(true);
+      }
+    }
+    InstallSV(new_sv);
+    UpdateWriteState();
+    RemoveLog(*sv->GetMt());
+    for (auto& imm : *sv->GetImms()) {
+      RemoveLog(*imm);
     }
+  });
+}
+
+bool DBImpl::Get(Slice key, std::string* value, const Snapshot* snapshot) {
+  auto sv = GetSV();
+  auto seq = snapshot ? snapshot->GetSeq() : seq_;
+  std::vector<std::string> operands;
+  bool found = sv->Get(key, seq, value, &operands);
+  if (operands.empty()) {
+    return found;
   }
-  InstallSV(new_sv);
+  Slice base = *value;
+  *value = MergeOperands(
+      GetMergeOperator(), key, found ? &base : nullptr, operands);
+  return true;
 }
 
-bool DBImpl::Get(Slice key, std::string* value) {
+const Snapshot* DBImpl::GetSnapshot() {
+  std::unique_lock lck(write_mutex_);
+  return snapshots_.New(seq_);
+}
+
+void DBImpl::ReleaseSnapshot(const Snapshot* snapshot) {
+  snapshots_.Release(snapshot);
+}
+
+std::vector<std::optional<std::string>> DBImpl::MultiGet(
+    std::span<const Slice> keys, const Snapshot* snapshot) {
   auto sv = GetSV();
-  auto seq = seq_;
-  return sv->Get(key, seq, value);
+  auto seq = snapshot ? snapshot->GetSeq() : seq_;
+  std::vector<KeyContext> contexts(keys.size());
+  std::vector<KeyContext*> pending;
+  for (size_t i = 0; i < keys.size(); i++) {
+    contexts[i].key_ = keys[i];
+    pending.push_back(&contexts[i]);
+  }
+  std::sort(pending.begin(), pending.end(),
+      [](KeyContext* a, KeyContext* b) { return a->key_ < b->key_; });
+  sv->MultiGet(&pending, seq);
+  std::vector<std::optional<std::string>> ret(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto& context = contexts[i];
+    if (!context.operands_.empty()) {
+      Slice base = context.value_;
+      ret[i] = MergeOperands(GetMergeOperator(), keys[i],
+          context.result_ == GetResult::kFound ? &base : nullptr,
+          context.operands_);
+    } else if (context.result_ == GetResult::kFound) {
+      ret[i] = std::move(context.value_);
+    }
+  }
+  return ret;
 }
 
 void DBImpl::SaveMetadata() {
-  auto metadata_file = options_.db_path.string() + "/metadata";
+  auto db_path = options_.db_path.string();
+  auto metadata_file = db_path + "/metadata";
+  auto tmp_file = metadata_file + ".tmp";
   FileWriter writer(
-      std::make_unique<SeqWriteFile>(metadata_file, options_.use_direct_io),
+      std::make_unique<SeqWriteFile>(tmp_file, options_.use_direct_io),
       1 << 20);
   auto sv = GetSV();
   auto version = sv->GetVersion();
-  writer.AppendValue<uint64_t>(seq_)
+  /* The logs older than all the live MemTables are persisted. */
+  size_t min_log_number = sv->GetMt()->GetLogNumber();
+  for (auto& imm : *sv->GetImms()) {
+    min_log_number = std::min(min_log_number, imm->GetLogNumber());
+  }
+  persisted_seq_ = std::max<seq_t>(persisted_seq_, seq_);
+  writer.AppendValue<uint64_t>(persisted_seq_)
       .AppendValue<uint64_t>(filename_gen_->GetID())
+      .AppendValue<uint64_t>(min_log_number)
+      .AppendValue<uint64_t>(manifest_number_ + 1)
       .AppendValue<uint64_t>(version->GetLevels().size());
   for (auto& level : version->GetLevels()) {
     writer.AppendValue<uint64_t>(level.GetID())
@@ -149,63 +617,171 @@ void DBImpl::SaveMetadata() {
       for (auto& sst : run->GetSSTs()) {
         auto& info = sst->GetSSTInfo();
         writer.AppendValue<uint64_t>(info.count_)
+            .AppendValue<uint64_t>(info.num_deletions_)
             .AppendValue<uint64_t>(info.size_)
             .AppendValue<uint64_t>(info.sst_id_)
             .AppendValue<uint64_t>(info.index_offset_)
             .AppendValue<uint64_t>(info.bloom_filter_offset_)
+            .AppendValue<uint32_t>(info.format_version_)
             .AppendValue<uint64_t>(info.filename_.size())
-            .AppendString(info.filename_);
+            .AppendString(info.filename_)
+            .AppendValue<uint64_t>(info.blob_files_.size());
+        for (auto id : info.blob_files_) {
+          writer.AppendValue<uint64_t>(id);
+        }
       }
     }
   }
-  writer.Flush();
+  /* Replace the old metadata atomically */
+  writer.Sync();
+  std::filesystem::rename(tmp_file, metadata_file);
+  /* The edits in the old MANIFEST are in the checkpoint. */
+  manifest_number_ += 1;
+  manifest_ = std::make_unique<ManifestWriter>(
+      ManifestFileName(db_path, manifest_number_));
+  std::filesystem::remove(ManifestFileName(db_path, manifest_number_ - 1));
 }
 
 void DBImpl::LoadMetadata() {
-  auto metadata_filename = options_.db_path.string() + "/metadata";
+  auto db_path = options_.db_path.string();
+  auto metadata_filename = db_path + "/metadata";
   auto file =
       std::make_unique<ReadFile>(metadata_filename, options_.use_direct_io);
   FileReader reader(file.get(), 1 << 20, 0);
   seq_ = reader.ReadValue<uint64_t>();
   auto latest_file_id = reader.ReadValue<uint64_t>();
+  auto min_log_number = reader.ReadValue<uint64_t>();
+  manifest_number_ = reader.ReadValue<uint64_t>();
   auto num_levels = reader.ReadValue<uint64_t>();
-  std::vector<Level> levels;
+  std::vector<LevelInfo> level_infos;
   for (uint64_t i = 0; i < num_levels; i++) {
     auto id = reader.ReadValue<uint64_t>();
     auto num_run = reader.ReadValue<uint64_t>();
-    std::vector<std::shared_ptr<SortedRun>> runs;
+    LevelInfo level_info{id, {}};
     for (uint64_t j = 0; j < num_run; j++) {
       auto num_sst = reader.ReadValue<uint64_t>();
       std::vector<SSTInfo> ssts;
       for (uint64_t k = 0; k < num_sst; k++) {
         SSTInfo info;
         info.count_ = reader.ReadValue<uint64_t>();
+        info.num_deletions_ = reader.ReadValue<uint64_t>();
         info.size_ = reader.ReadValue<uint64_t>();
         info.sst_id_ = reader.ReadValue<uint64_t>();
         info.index_offset_ = reader.ReadValue<uint64_t>();
         info.bloom_filter_offset_ = reader.ReadValue<uint64_t>();
+        info.format_version_ = reader.ReadValue<uint32_t>();
         auto len = reader.ReadValue<uint64_t>();
         info.filename_ = reader.ReadString(len);
+        auto num_blob_files = reader.ReadValue<uint64_t>();
+        for (uint64_t l = 0; l < num_blob_files; l++) {
+          info.blob_files_.push_back(reader.ReadValue<uint64_t>());
+        }
         ssts.push_back(info);
       }
-      runs.push_back(std::make_shared<SortedRun>(
-          ssts, options_.block_size, options_.use_direct_io));
+      level_info.runs_.push_back(std::move(ssts));
+    }
+    level_infos.push_back(std::move(level_info));
+  }
+  /* Replay the edits after the checkpoint */
+  for (auto& entry : std::filesystem::directory_iterator(db_path)) {
+    auto number = ParseManifestFileName(entry.path().filename().string());
+    if (number && *number != manifest_number_) {
+      /* It is left by a crash during a checkpoint. */
+      std::filesystem::remove(entry.path());
     }
-    levels.emplace_back(id, std::move(runs));
+  }
+  auto manifest_filename = ManifestFileName(db_path, manifest_number_);
+  if (std::filesystem::exists(manifest_filename)) {
+    ManifestReader manifest(manifest_filename);
+    VersionEdit edit;
+    size_t num_edits = 0;
+    while (manifest.ReadEdit(&edit)) {
+      edit.Apply(&level_infos);
+      seq_ = edit.seq_;
+      latest_file_id = edit.next_file_id_;
+      min_log_number = edit.min_log_number_;
+      num_edits += 1;
+    }
+    DB_INFO("Replayed {} version edits", num_edits);
+  }
+  persisted_seq_ = seq_;
+  std::vector<Level> levels;
+  for (auto& level_info : level_infos) {
+    std::vector<std::shared_ptr<SortedRun>> runs;
+    for (auto& ssts : level_info.runs_) {
+      runs.push_back(std::make_shared<SortedRun>(ssts, options_.block_size,
+          options_.use_direct_io, options_.verify_checksums, cache_,
+          reader_, options_.max_readahead_size, blobs_.get(),
+          table_cache_));
+    }
+    levels.emplace_back(level_info.id_, std::move(runs));
   }
   auto version = std::make_shared<Version>(std::move(levels));
+  PinLevel0(*version);
   sv_ = std::make_shared<SuperVersion>(std::make_shared<MemTable>(),
       std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
       std::move(version));
-  DB_INFO("SuperVersion: {}", sv_->ToString());
   filename_gen_ = std::make_unique<FileNameGenerator>(
       options_.db_path.string() + "/", latest_file_id);
+  RecoverLogs(min_log_number);
+  DB_INFO("SuperVersion: {}", sv_->ToString());
+}
+
+void DBImpl::RecoverLogs(size_t min_log_number) {
+  std::vector<size_t> log_numbers;
+  for (auto& entry : std::filesystem::directory_iterator(options_.db_path)) {
+    auto log_number = ParseLogFileName(entry.path().filename().string());
+    if (!log_number) {
+      continue;
+    }
+    if (*log_number < min_log_number) {
+      /* The MemTable of this log has been persisted. */
+      std::filesystem::remove(entry.path());
+    } else {
+      log_numbers.push_back(*log_number);
+    }
+  }
+  std::sort(log_numbers.begin(), log_numbers.end());
+  /**
+   * Each segment is replayed into its own immutable MemTable, so that it is
+   * removed as soon as the MemTable is flushed.
+   * The newer MemTables are in the front.
+   */
+  auto imms = std::make_shared<std::vector<std::shared_ptr<MemTable>>>();
+  for (auto log_number : log_numbers) {
+    auto mt = std::make_shared<MemTable>(log_number, memtable_rep_);
+    WALReader reader(LogFileName(options_.db_path.string(), log_number));
+    ParsedKey key;
+    Slice value;
+    while (reader.ReadRecord(&key, &value)) {
+      if (key.type_ == RecordType::Deletion) {
+        mt->Del(key.user_key_, key.seq_);
+      } else if (key.type_ == RecordType::Merge) {
+        mt->Merge(key.user_key_, key.seq_, value);
+      } else if (key.type_ == RecordType::RangeDeletion) {
+        mt->DelRange(key.user_key_, value, key.seq_);
+      } else {
+        mt->Put(key.user_key_, key.seq_, value);
+      }
+      seq_ = std::max<size_t>(seq_, key.seq_);
+    }
+    if (mt->size() == 0) {
+      RemoveLog(*mt);
+    } else {
+      imms->insert(imms->begin(), std::move(mt));
+    }
+  }
+  sv_ = std::make_shared<SuperVersion>(
+      NewMemTable(), std::move(imms), sv_->GetVersion());
 }
 
-void DBImpl::Save() { SaveMetadata(); }
+void DBImpl::Save() {
+  std::unique_lock lck(db_mutex_);
+  SaveMetadata();
+}
 
 void DBImpl::FlushAll() {
-  SwitchMemtable(true);
+  RunExclusive([&]() { SwitchMemtable(true); });
   while (true) {
     {
       auto sv = GetSV();
@@ -217,98 +793,324 @@ void DBImpl::FlushAll() {
   }
 }
 
+std::vector<std::string> DBImpl::VerifyChecksums() {
+  auto sv = GetSV();
+  std::vector<std::shared_ptr<SSTable>> ssts;
+  for (auto& level : sv->GetVersion()->GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      ssts.insert(ssts.end(), run->GetSSTs().begin(), run->GetSSTs().end());
+    }
+  }
+  std::vector<char> ok(ssts.size());
+  {
+    ThreadPool pool(std::min<size_t>(
+        std::max(std::thread::hardware_concurrency(), 1u), ssts.size()));
+    for (size_t i = 0; i < ssts.size(); i++) {
+      pool.Push([&, i]() { ok[i] = ssts[i]->VerifyChecksums(); });
+    }
+    pool.WaitForAllTasks();
+  }
+  std::vector<std::string> corrupted;
+  for (size_t i = 0; i < ssts.size(); i++) {
+    if (!ok[i]) {
+      corrupted.push_back(ssts[i]->GetSSTInfo().filename_);
+    }
+  }
+  DB_INFO("Verified {} SSTables, {} corrupted", ssts.size(), corrupted.size());
+  return corrupted;
+}
+
 void DBImpl::WaitForFlushAndCompaction() {
-  while (true) {
-    db_mutex_.lock();
-    if (!flush_flag_ && !compact_flag_) {
-      db_mutex_.unlock();
-      return;
+  std::unique_lock lck(jobs_mutex_);
+  jobs_cv_.wait(lck, [&]() { return pending_jobs_ == 0; });
+}
+
+void DBImpl::Schedule(int priority, std::function<void()> job) {
+  {
+    std::unique_lock lck(jobs_mutex_);
+    pending_jobs_ += 1;
+  }
+  bool accepted = env_->GetScheduler()->Schedule(
+      priority, [this, job = std::move(job)]() mutable {
+        job();
+        /* Release the captured resources before the DBImpl is destroyed */
+        job = nullptr;
+        std::unique_lock lck(jobs_mutex_);
+        pending_jobs_ -= 1;
+        jobs_cv_.notify_all();
+      });
+  /* The scheduler is stopping, so the job never runs */
+  if (!accepted) {
+    std::unique_lock lck(jobs_mutex_);
+    pending_jobs_ -= 1;
+    jobs_cv_.notify_all();
+  }
+}
+
+void DBImpl::RequestFlush() {
+  Schedule(BackgroundScheduler::kFlushPriority, [this]() {
+    std::unique_lock lck(write_mutex_);
+    flush_requested_ = true;
+    if (writers_.empty()) {
+      HandleFlushRequest();
     }
-    db_mutex_.unlock();
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  });
+}
+
+void DBImpl::UpdateMemoryUsage() {
+  std::unique_lock lck(memory_mutex_);
+  auto sv = GetSV();
+  size_t mutable_usage = sv->GetMt()->size();
+  size_t usage = mutable_usage;
+  for (auto& imm : *sv->GetImms()) {
+    usage += imm->size();
   }
+  env_->UpdateMemoryUsage(static_cast<ssize_t>(mutable_usage) -
+                              static_cast<ssize_t>(reported_mutable_memory_),
+      static_cast<ssize_t>(usage) - static_cast<ssize_t>(reported_memory_));
+  reported_mutable_memory_ = mutable_usage;
+  reported_memory_ = usage;
 }
 
-void DBImpl::FlushThread() {
-  while (!stop_signal_) {
-    /* Wait for the signal from SwitchMemtable */
-    std::unique_lock lck(db_mutex_);
-    if (stop_signal_) {
-      flush_flag_ = false;
-      return;
+void DBImpl::MaybeScheduleWork() {
+  if (stop_signal_) {
+    return;
+  }
+  auto sv = GetSV();
+  auto& levels = sv->GetVersion()->GetLevels();
+  /* Too many sorted runs in L0. Wait for compactions to reduce them. */
+  bool stop_flush = levels.size() > 0 && levels[0].GetRuns().size() >=
+                                             options_.level0_stop_writes_trigger;
+  if (!stop_flush) {
+    for (auto& imm : PickMemTables()) {
+      imm->SetFlushInProgress(true);
+      Schedule(BackgroundScheduler::kFlushPriority,
+          [this, imm = std::move(imm)]() { BackgroundFlush(imm); });
     }
-    /* Pick the memtables that require flushing */
-    std::vector<std::shared_ptr<MemTable>> imms;
-    {
-      auto old_sv = GetSV();
-      while (old_sv->GetVersion()->GetLevels().size() > 0 &&
-             old_sv->GetVersion()->GetLevels()[0].GetRuns().size() >=
-                 options_.level0_stop_writes_trigger) {
-        old_sv.reset();
-        StopWrite();
-        old_sv = GetSV();
-      }
-      imms = PickMemTables();
-      if (imms.empty()) {
-        old_sv.reset();
-        flush_flag_ = false;
-        flush_cv_.wait(lck);
-        continue;
-      }
+  }
+  /* There is nothing to compact before the first flush. */
+  while (compaction_picker_ && !levels.empty() &&
+         running_compactions_ < options_.max_background_jobs) {
+    std::shared_ptr<Compaction> compaction =
+        compaction_picker_->Get(sv->GetVersion().get());
+    /* The picker must not pick the inputs of running compactions */
+    if (!compaction || IsCompactionInProcess(*compaction)) {
+      break;
+    }
+    SetCompactionInProcess(*compaction, true);
+    running_compactions_ += 1;
+    /* Not in the arguments, since the lambda may move compaction first */
+    int priority =
+        BackgroundScheduler::CompactionPriority(compaction->src_level());
+    Schedule(priority, [this, compaction = std::move(compaction)]() {
+      BackgroundCompaction(compaction);
+    });
+  }
+}
 
-      for (auto& imm : imms) {
-        imm->SetFlushInProgress(true);
-      }
-      flush_flag_ = true;
+void DBImpl::BackgroundFlush(std::shared_ptr<MemTable> imm) {
+  CompactionJob worker(filename_gen_.get(), options_.block_size,
+      options_.sst_file_size, options_.write_buffer_size,
+      GetBitsPerKey(*GetSV()->GetVersion(), 0, imm->size()),
+      options_.use_direct_io, options_.block_restart_interval,
+      GetCompression(0), filter_type_);
+  worker.SetRangeTombstones(imm->GetRangeTombstones());
+  worker.SetSnapshots(snapshots_.GetSeqs());
+  worker.SetBlobs(blobs_.get(), options_.min_blob_size);
+  worker.SetMergeOperator(options_.merge_operator.get());
+  worker.SetRangeFilter(options_.range_filter_bits_per_key);
+  auto ssts = worker.Run(imm->Begin());
+  std::shared_ptr<SortedRun> run;
+  if (!ssts.empty()) {
+    run = std::make_shared<SortedRun>(ssts, options_.block_size,
+        options_.use_direct_io, options_.verify_checksums, cache_,
+        reader_, options_.max_readahead_size, blobs_.get(),
+        table_cache_);
+    GetStatsContext()->total_input_bytes.fetch_add(
+        run->size(), std::memory_order_relaxed);
+  }
+  std::unique_lock db_lck(db_mutex_);
+  imm->SetFlushComplete(true);
+  flushed_runs_[imm.get()] = std::move(run);
+  /**
+   * Install the flushed MemTables from the oldest one. A MemTable flushed
+   * before an older one waits, so that the sorted runs in L0 are ordered by
+   * age.
+   */
+  auto old_sv = GetSV();
+  auto& imms = *old_sv->GetImms();
+  size_t num_installed = 0;
+  std::vector<std::shared_ptr<SortedRun>> runs;
+  for (auto it = imms.rbegin(); it != imms.rend() && (*it)->GetFlushComplete();
+       ++it) {
+    auto run_it = flushed_runs_.find(it->get());
+    if (run_it->second) {
+      runs.push_back(std::move(run_it->second));
     }
-    /* Flush the memtables */
-    std::vector<std::shared_ptr<SortedRun>> runs;
-    {
-      db_mutex_.unlock();
-      for (auto& imm : imms) {
-        CompactionJob worker(filename_gen_.get(), options_.block_size,
-            options_.sst_file_size, options_.write_buffer_size,
-            options_.bloom_bits_per_key, options_.use_direct_io);
-        auto ssts = worker.Run(imm->Begin());
-        if (ssts.empty()) {
-          continue;
-        }
-        runs.push_back(std::make_shared<SortedRun>(
-            ssts, options_.block_size, options_.use_direct_io));
-        GetStatsContext()->total_input_bytes.fetch_add(
-            runs.back()->size(), std::memory_order_relaxed);
-      }
-      db_mutex_.lock();
+    flushed_runs_.erase(run_it);
+    num_installed += 1;
+  }
+  if (num_installed > 0) {
+    auto new_imm = std::make_shared<std::vector<std::shared_ptr<MemTable>>>(
+        imms.begin(), imms.end() - num_installed);
+    auto new_version = std::make_shared<Version>(*old_sv->GetVersion());
+    /* Append the sorted runs to the first level (L0) of the LSM tree. */
+    new_version->Append(0, std::move(runs));
+    auto new_sv = std::make_shared<SuperVersion>(
+        old_sv->GetMt(), new_imm, new_version);
+    DB_INFO("{}", new_sv->ToString());
+    InstallSV(std::move(new_sv));
+    UpdateWriteState();
+    /* The logs can be removed since the new SSTables are recorded. */
+    for (size_t i = imms.size() - num_installed; i < imms.size(); i++) {
+      RemoveLog(*imms[i]);
     }
-    /* Install the new SuperVersion */
-    {
-      for (auto& imm : imms) {
-        imm->SetFlushComplete(true);
-      }
-      auto old_sv = GetSV();
-      auto mt = old_sv->GetMt();
-      auto new_imm = std::make_shared<std::vector<std::shared_ptr<MemTable>>>();
-      auto new_version = std::make_shared<Version>(*old_sv->GetVersion());
-      /* Filter out all completed Memtables */
-      for (auto imm : *old_sv->GetImms()) {
-        if (!imm->GetFlushComplete()) {
-          new_imm->push_back(imm);
-        }
-      }
-      /* Append the sorted runs to the first level (L0) of the LSM tree. */
-      new_version->Append(0, std::move(runs));
-      auto new_sv =
-          std::make_shared<SuperVersion>(std::move(mt), new_imm, new_version);
-      DB_INFO("{}", new_sv->ToString());
-      InstallSV(std::move(new_sv));
-      compact_cv_.notify_one();
+  }
+  MaybeScheduleWork();
+  db_lck.unlock();
+  /* A flush request of env_ may wait for the immutable MemTables. */
+  std::unique_lock lck(write_mutex_);
+  if (writers_.empty()) {
+    HandleFlushRequest();
+  }
+}
+
+void DBImpl::BackgroundCompaction(std::shared_ptr<Compaction> compaction) {
+  size_t target = compaction->target_level();
+  /* The SSTables of the inputs and of the target sorted run */
+  auto inputs = compaction->input_ssts();
+  for (auto& input_run : compaction->input_runs()) {
+    inputs.insert(
+        inputs.end(), input_run->GetSSTs().begin(), input_run->GetSSTs().end());
+  }
+  if (compaction->target_sorted_run()) {
+    auto& ssts = compaction->target_sorted_run()->GetSSTs();
+    inputs.insert(inputs.end(), ssts.begin(), ssts.end());
+  }
+  std::shared_ptr<SortedRun> run;
+  if (compaction->is_trivial_move()) {
+    /* No sorted run in the target level overlaps the SSTables. */
+    run = std::make_shared<SortedRun>(compaction->input_ssts(),
+        options_.block_size, options_.use_direct_io);
+  } else {
+    size_t input_size = 0;
+    std::vector<RangeTombstone> tombstones;
+    for (auto& sst : inputs) {
+      input_size += sst->GetSSTInfo().size_;
+      auto ret = sst->GetRangeTombstones().ToTombstones();
+      tombstones.insert(tombstones.end(), std::make_move_iterator(ret.begin()),
+          std::make_move_iterator(ret.end()));
+    }
+    auto sv = GetSV();
+    CompactionJob worker(filename_gen_.get(), options_.block_size,
+        options_.sst_file_size, options_.write_buffer_size,
+        GetBitsPerKey(*sv->GetVersion(), target, input_size),
+        options_.use_direct_io, options_.block_restart_interval,
+        GetCompression(target), filter_type_);
+    /* The tombstones drop the records they cover, and are kept. */
+    if (!tombstones.empty()) {
+      worker.SetRangeTombstones(std::make_shared<const RangeTombstoneList>(
+          std::move(tombstones)));
     }
+    /* The records that the live snapshots read are kept. */
+    worker.SetSnapshots(snapshots_.GetSeqs());
+    /* The values in the oldest blob files are moved to a new blob file. */
+    worker.SetBlobs(blobs_.get(), options_.min_blob_size,
+        GetBlobRelocationCutoff(*sv->GetVersion()));
+    worker.SetMergeOperator(options_.merge_operator.get());
+    worker.SetRangeFilter(options_.range_filter_bits_per_key);
+    auto make_iterator = [&](std::optional<Slice> lower) {
+      return CompactionInputIterator(*compaction, lower);
+    };
+    std::vector<SSTInfo> ssts;
+    if (subcompaction_pool_) {
+      /* The key ranges are merged in parallel into one sorted run. */
+      auto boundaries = worker.SplitKeyRanges(
+          *compaction, options_.max_subcompactions);
+      ssts = worker.RunParallel(boundaries, make_iterator, subcompaction_pool_);
+    } else {
+      ssts = worker.Run(make_iterator(std::nullopt));
+    }
+    if (!ssts.empty()) {
+      run = std::make_shared<SortedRun>(ssts, options_.block_size,
+          options_.use_direct_io, options_.verify_checksums, cache_,
+          reader_, options_.max_readahead_size, blobs_.get(),
+          table_cache_);
+    }
+  }
+  std::unique_lock db_lck(db_mutex_);
+  auto old_sv = GetSV();
+  auto new_version = std::make_shared<Version>(*old_sv->GetVersion());
+  /**
+   * The output has the records of the target sorted run, so it takes the
+   * place of its SSTables. The sorted run of the target level may have been
+   * merged with other SSTables by Version::Insert since the compaction was
+   * picked, so the SSTables are removed by identity.
+   */
+  new_version->Remove(inputs);
+  if (run) {
+    new_version->Insert(target, run);
   }
+  if (!compaction->is_trivial_move()) {
+    /* The files are removed when the old Versions are released. */
+    for (auto& sst : inputs) {
+      sst->SetRemoveTag(true);
+    }
+  }
+  auto new_sv = std::make_shared<SuperVersion>(
+      old_sv->GetMt(), old_sv->GetImms(), new_version);
+  DB_INFO("{}", new_sv->ToString());
+  InstallSV(std::move(new_sv));
+  UpdateWriteState();
+  SetCompactionInProcess(*compaction, false);
+  running_compactions_ -= 1;
+  MaybeScheduleWork();
 }
 
-void DBImpl::CompactionThread() {
-  // DB_ERR("Not Implemented!");
-  // TODO
+bool DBImpl::IsCompactionInProcess(const Compaction& compaction) {
+  for (auto& sst : compaction.input_ssts()) {
+    if (sst->GetCompactionInProcess()) {
+      return true;
+    }
+  }
+  for (auto& run : compaction.input_runs()) {
+    if (run->GetCompactionInProcess()) {
+      return true;
+    }
+  }
+  auto target = compaction.target_sorted_run();
+  if (!target) {
+    return false;
+  }
+  if (target->GetCompactionInProcess()) {
+    return true;
+  }
+  for (auto& sst : target->GetSSTs()) {
+    if (sst->GetCompactionInProcess()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void DBImpl::SetCompactionInProcess(
+    const Compaction& compaction, bool in_process) {
+  for (auto& sst : compaction.input_ssts()) {
+    sst->SetCompactionInProcess(in_process);
+  }
+  for (auto& run : compaction.input_runs()) {
+    run->SetCompactionInProcess(in_process);
+  }
+  /**
+   * The SSTables of the target are marked too, since Version::Insert may
+   * merge them into another sorted run while the compaction runs.
+   */
+  if (compaction.target_sorted_run()) {
+    compaction.target_sorted_run()->SetCompactionInProcess(in_process);
+    for (auto& sst : compaction.target_sorted_run()->GetSSTs()) {
+      sst->SetCompactionInProcess(in_process);
+    }
+  }
 }
 
 std::vector<std::shared_ptr<MemTable>> DBImpl::PickMemTables() {
@@ -327,53 +1129,186 @@ std::shared_ptr<SuperVersion> DBImpl::GetSV() {
   return new_sv;
 }
 
-void DBImpl::InstallSV(std::shared_ptr<SuperVersion> sv) {
-  std::unique_lock lck(sv_mutex_);
-  sv_ = std::move(sv);
+size_t DBImpl::GetBitsPerKey(
+    const Version& version, size_t level, size_t new_run_size) const {
+  if (!options_.optimize_filters_per_level) {
+    return options_.bloom_bits_per_key;
+  }
+  auto& levels = version.GetLevels();
+  std::vector<size_t> runs(std::max(levels.size(), level + 1), 0);
+  std::vector<size_t> sizes(runs.size(), 0);
+  for (size_t i = 0; i < levels.size(); i++) {
+    runs[i] = levels[i].GetRuns().size();
+    sizes[i] = levels[i].size();
+  }
+  runs[level] += 1;
+  sizes[level] += new_run_size;
+  auto bits = OptimizeBitsPerKey(
+      runs, sizes, options_.bloom_bits_per_key, filter_type_);
+  return std::lround(bits[level]);
+}
+
+CompressionType DBImpl::GetCompression(size_t level) const {
+  if (compression_per_level_.empty()) {
+    return CompressionType::kNone;
+  }
+  return compression_per_level_[std::min(
+      level, compression_per_level_.size() - 1)];
 }
 
-DBIterator DBImpl::Begin() {
-  DBIterator it(GetSV(), seq_);
+void DBImpl::InstallSV(std::shared_ptr<SuperVersion> sv, seq_t seq) {
+  auto old_version = GetSV()->GetVersion();
+  bool new_version = sv->GetVersion() != old_version;
+  if (new_version) {
+    auto edit = VersionEdit::Diff(*old_version, *sv->GetVersion());
+    persisted_seq_ = std::max<seq_t>({persisted_seq_, seq_, seq});
+    edit.seq_ = persisted_seq_;
+    edit.next_file_id_ = filename_gen_->GetID();
+    edit.min_log_number_ = sv->GetMt()->GetLogNumber();
+    for (auto& imm : *sv->GetImms()) {
+      edit.min_log_number_ =
+          std::min(edit.min_log_number_, imm->GetLogNumber());
+    }
+    manifest_->AddEdit(edit);
+  }
+  if (new_version) {
+    PinLevel0(*sv->GetVersion());
+  }
+  {
+    std::unique_lock lck(sv_mutex_);
+    sv_ = std::move(sv);
+  }
+  if (new_version &&
+      manifest_->count() >= options_.manifest_checkpoint_interval) {
+    SaveMetadata();
+  }
+  UpdateMemoryUsage();
+}
+
+void DBImpl::PinLevel0(const Version& version) {
+  for (auto& level : version.GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      for (auto& sst : run->GetSSTs()) {
+        sst->SetPinned(level.GetID() == 0);
+      }
+    }
+  }
+}
+
+DBIterator DBImpl::Begin(const Snapshot* snapshot) {
+  DBIterator it(GetSV(), snapshot ? snapshot->GetSeq() : seq_, blobs_.get(),
+      options_.merge_operator.get());
   it.SeekToFirst();
   return it;
 }
 
-DBIterator DBImpl::Seek(Slice key) {
-  DBIterator it(GetSV(), seq_);
+DBIterator DBImpl::Seek(Slice key, const Snapshot* snapshot) {
+  DBIterator it(GetSV(), snapshot ? snapshot->GetSeq() : seq_, blobs_.get(),
+      options_.merge_operator.get());
   it.Seek(key);
   return it;
 }
 
+DBIterator DBImpl::SeekRange(
+    Slice lower, Slice upper, const Snapshot* snapshot) {
+  auto sv = GetSV();
+  sv = std::make_shared<SuperVersion>(sv->GetMt(), sv->GetImms(),
+      sv->GetVersion()->FilterRange(lower, upper));
+  DBIterator it(std::move(sv), snapshot ? snapshot->GetSeq() : seq_,
+      blobs_.get(), options_.merge_operator.get());
+  it.Seek(lower);
+  return it;
+}
+
+bool DBIterator::IsDeleted() const {
+  return current_key_.record_type() == RecordType::Deletion ||
+         range_dels_->ShouldDelete(ParsedKey(current_key_), seq_);
+}
+
+void DBIterator::MergeCurrent() {
+  merged_ = current_key_.record_type() == RecordType::Merge;
+  if (!merged_) {
+    return;
+  }
+  if (merge_operator_ == nullptr) {
+    throw DBException(
+        "Merge operand of key {} is not expected", current_key_.user_key());
+  }
+  std::vector<std::string> operands{std::string(it_.value())};
+  std::optional<std::string> base;
+  for (it_.Next(); it_.Valid(); it_.Next()) {
+    ParsedKey key(it_.key());
+    if (key.user_key_ != current_key_.user_key() ||
+        key.type_ == RecordType::Deletion ||
+        range_dels_->ShouldDelete(key, seq_)) {
+      break;
+    }
+    if (key.type_ == RecordType::Merge) {
+      operands.emplace_back(it_.value());
+      continue;
+    }
+    base.emplace();
+    if (key.type_ == RecordType::BlobIndex) {
+      blobs_->Get(BlobIndex::Decode(it_.value()), &*base);
+    } else {
+      base->assign(it_.value());
+    }
+    break;
+  }
+  Slice base_value = base ? Slice(*base) : Slice();
+  merged_value_ = MergeOperands(*merge_operator_, current_key_.user_key(),
+      base ? &base_value : nullptr, operands);
+}
+
 void DBIterator::SeekToFirst() {
   it_.SeekToFirst();
+  merged_ = false;
   if (it_.Valid()) {
     current_key_ = ParsedKey(it_.key());
-    if (current_key_.record_type() == RecordType::Deletion ||
-        current_key_.seq() > seq_) {
+    if (IsDeleted() || current_key_.seq() > seq_) {
       Next();
+    } else {
+      MergeCurrent();
     }
   }
 }
 
 void DBIterator::Seek(Slice key) {
   it_.Seek(key, seq_);
+  merged_ = false;
   if (it_.Valid()) {
     current_key_ = ParsedKey(it_.key());
-    if (current_key_.record_type() == RecordType::Deletion ||
-        current_key_.seq() > seq_) {
+    if (IsDeleted() || current_key_.seq() > seq_) {
       Next();
+    } else {
+      MergeCurrent();
     }
   }
 }
 
-bool DBIterator::Valid() { return it_.Valid(); }
+/* After a merge, it_ may be at the end while the merged key is current. */
+bool DBIterator::Valid() { return merged_ || it_.Valid(); }
 
 Slice DBIterator::key() const { return current_key_.user_key(); }
 
-Slice DBIterator::value() const { return it_.value(); }
+Slice DBIterator::value() const {
+  if (merged_) {
+    return merged_value_;
+  }
+  if (current_key_.record_type() != RecordType::BlobIndex) {
+    return it_.value();
+  }
+  blobs_->Get(BlobIndex::Decode(it_.value()), &blob_value_);
+  return blob_value_;
+}
 
 void DBIterator::Next() {
-  it_.Next();
+  /* MergeCurrent has moved it_ past the operands. */
+  if (merged_) {
+    merged_ = false;
+  } else {
+    it_.Next();
+  }
   while (true) {
     while (it_.Valid() && (seq_ < ParsedKey(it_.key()).seq_ ||
                               (current_key_.seq() <= seq_ &&
@@ -383,10 +1318,11 @@ void DBIterator::Next() {
     }
     if (it_.Valid()) {
       current_key_ = ParsedKey(it_.key());
-      if (current_key_.record_type() == RecordType::Deletion) {
+      if (IsDeleted()) {
         it_.Next();
         continue;
       }
+      MergeCurrent();
     }
     break;
   }
@@ -3,20 +3,34 @@
 #include <cassert>
 #include <condition_variable>
 #include <deque>
+#include <functional>
 #include <limits>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <set>
+#include <span>
 #include <shared_mutex>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 
+#include "common/threadpool.hpp"
+#include "storage/lsm/blob.hpp"
 #include "storage/lsm/cache.hpp"
 #include "storage/lsm/compaction_pick.hpp"
+#include "storage/lsm/env.hpp"
+#include "storage/lsm/ingestion_job.hpp"
+#include "storage/lsm/manifest.hpp"
 #include "storage/lsm/memtable.hpp"
 #include "storage/lsm/options.hpp"
+#include "storage/lsm/scheduler.hpp"
+#include "storage/lsm/snapshot.hpp"
 #include "storage/lsm/version.hpp"
+#include "storage/lsm/wal.hpp"
+#include "storage/lsm/write_batch.hpp"
+#include "storage/lsm/write_controller.hpp"
 
 namespace wing {
 
@@ -26,64 +40,290 @@ class DBIterator;
 
 class DBImpl {
  public:
-  DBImpl(const Options &options);
+  /**
+   * The DBImpl uses the cache, the background threads and the MemTable
+   * budget of env, which may be shared with other DBImpls. If env is null,
+   * it creates its own Env with options.
+   */
+  DBImpl(const Options &options, std::shared_ptr<Env> env = nullptr);
   ~DBImpl();
 
-  static std::unique_ptr<DBImpl> Create(const Options &options) {
-    return std::make_unique<DBImpl>(options);
+  static std::unique_ptr<DBImpl> Create(
+      const Options &options, std::shared_ptr<Env> env = nullptr) {
+    return std::make_unique<DBImpl>(options, std::move(env));
   }
 
   void Put(Slice key, Slice value);
   void Del(Slice key);
+  /**
+   * Add a merge operand, which is combined with the older records of the key
+   * by options.merge_operator when the key is read. It throws DBException
+   * if there is no merge operator.
+   */
+  void Merge(Slice key, Slice operand);
+  /**
+   * Delete the keys in [begin, end) with a single range tombstone.
+   * It does nothing if begin >= end.
+   */
+  void DeleteRange(Slice begin, Slice end);
+  /**
+   * Commit the records of the batch atomically. They are given consecutive
+   * sequence numbers, written to the log as one entry, and become visible to
+   * readers at the same time.
+   */
+  void Write(const WriteBatch &batch);
+  /**
+   * Bulk-load the records. They are sorted in parallel and written to new
+   * SSTables directly, which are placed at the lowest level that no level
+   * above it (inclusive) overlaps (see Version::Insert). If a key appears
+   * more than once, the last record wins. The records overwrite the older
+   * records of the keys, and become visible at the same time. Writes are
+   * blocked while the SSTables are written. If the MemTables have records
+   * in the range, it waits for them to be flushed first, and the writes go
+   * on meanwhile.
+   */
+  void Ingest(std::vector<std::pair<std::string, std::string>> records);
   // Return true if kFound, false if not
-  bool Get(Slice key, std::string *value);
+  // The reads below see the latest writes if snapshot is null, or the writes
+  // visible to the snapshot otherwise.
+  bool Get(Slice key, std::string *value, const Snapshot *snapshot = nullptr);
+  /**
+   * Get the values of keys with one SuperVersion. The i-th result is the
+   * value of keys[i], or std::nullopt if it is not found.
+   */
+  std::vector<std::optional<std::string>> MultiGet(
+      std::span<const Slice> keys, const Snapshot *snapshot = nullptr);
+  /**
+   * Pin the current sequence number. The records visible to the snapshot are
+   * kept by flushes and compactions until ReleaseSnapshot is called.
+   */
+  const Snapshot *GetSnapshot();
+  void ReleaseSnapshot(const Snapshot *snapshot);
   void Save();
   void FlushAll();
   void WaitForFlushAndCompaction();
+  /**
+   * Verify the checksums of all the blocks in the live SSTables in parallel.
+   * Return the file names of the corrupted SSTables.
+   */
+  std::vector<std::string> VerifyChecksums();
   size_t CurrentSeq() const { return seq_; }
   /* Delete all things */
   void DropAll();
 
-  DBIterator Begin();
-  DBIterator Seek(Slice key);
+  DBIterator Begin(const Snapshot *snapshot = nullptr);
+  DBIterator Seek(Slice key, const Snapshot *snapshot = nullptr);
+  /**
+   * Seek(lower) for a scan that stops after upper. The sorted runs without a
+   * key in [lower, upper] are skipped (see Version::FilterRange), so the
+   * iterator may miss the keys after upper.
+   */
+  DBIterator SeekRange(
+      Slice lower, Slice upper, const Snapshot *snapshot = nullptr);
   std::shared_ptr<SuperVersion> GetSV();
   const Options &GetOptions() const { return options_; }
 
+  /* The memory of the active MemTable, as reported to env_ */
+  size_t GetMutableMemoryUsage() const {
+    return reported_mutable_memory_.load();
+  }
+  /**
+   * Switch the active MemTable in the background, so that it is flushed.
+   * It is called by Env::MaybeFlush. It never blocks a background thread:
+   * if a write is running, the writer switches the MemTable when it
+   * finishes (see HandleFlushRequest).
+   */
+  void RequestFlush();
+
  private:
-  void SwitchMemtable(bool force = false);
-  void FlushThread();
-  void CompactionThread();
+  /* A pending write, or an exclusive job if job is not null. */
+  struct Writer {
+    const WriteBatch *batch{nullptr};
+    /* The sequence number of the first record of the batch */
+    seq_t seq{0};
+    const std::function<void()> *job{nullptr};
+    bool done{false};
+    std::condition_variable cv;
+  };
+
+  /* Run the job after the queued writes are committed, and block new writes. */
+  void RunExclusive(const std::function<void()> &job);
+  /**
+   * Return true if a MemTable has a record or a range tombstone in
+   * [smallest, largest].
+   */
+  bool MemTablesOverlap(Slice smallest, Slice largest);
+  /**
+   * The lowest level that the sorted runs in it and the levels above it do
+   * not overlap [smallest, largest]. It is 0 if L0 overlaps.
+   */
+  size_t PickIngestionLevel(
+      const Version &version, Slice smallest, Slice largest) const;
+  /* Create a new MemTable with a new write-ahead log segment. */
+  std::shared_ptr<MemTable> NewMemTable();
+  /* Replay the write-ahead log segments that are not persisted. */
+  void RecoverLogs(size_t min_log_number);
+  /* Remove the write-ahead log segment of the MemTable. */
+  void RemoveLog(const MemTable &mt);
+  /**
+   * Switch the active MemTable if it is full, or if force and it is not
+   * empty. If the immutable MemTables are full, it waits for a flush, or
+   * returns false without switching if wait is false.
+   */
+  bool SwitchMemtable(bool force = false, bool wait = true);
+  /**
+   * Switch the MemTable for the request of env_ (see RequestFlush) without
+   * waiting. If the immutable MemTables are full, the request is kept and
+   * retried after a flush.
+   * Require: write_mutex_ held, and no write or exclusive job is running
+   * except the caller.
+   */
+  void HandleFlushRequest();
+  /**
+   * Schedule flushes of the immutable MemTables that are not being flushed,
+   * and the compactions picked by compaction_picker_.
+   * Require: DB Mutex held
+   */
+  void MaybeScheduleWork();
+  /**
+   * Schedule the job on the scheduler of env_. The jobs are counted, so that
+   * WaitForFlushAndCompaction and the destructor wait for the jobs of this
+   * DBImpl only.
+   */
+  void Schedule(int priority, std::function<void()> job);
+  /* It throws DBException if options_.merge_operator is null. */
+  const MergeOperator &GetMergeOperator() const;
+  /* Report the changes of the MemTable memory to env_ */
+  void UpdateMemoryUsage();
+  /**
+   * Pin the SSTables of L0 of the version, which are probed by every read,
+   * and unpin the others (see SSTable::SetPinned).
+   */
+  static void PinLevel0(const Version &version);
+  void BackgroundFlush(std::shared_ptr<MemTable> imm);
+  void BackgroundCompaction(std::shared_ptr<Compaction> compaction);
+  /* If any input of the compaction is picked by a running compaction */
+  bool IsCompactionInProcess(const Compaction &compaction);
+  void SetCompactionInProcess(const Compaction &compaction, bool in_process);
   std::vector<std::shared_ptr<MemTable>> PickMemTables();
-  void InstallSV(std::shared_ptr<SuperVersion> sv);
+  /**
+   * Install sv. If its Version is new, the change is appended to the
+   * MANIFEST before sv is visible. seq is the largest sequence number in the
+   * new SSTables if it is larger than seq_, i.e., of ingested records.
+   */
+  void InstallSV(std::shared_ptr<SuperVersion> sv, seq_t seq = 0);
+  /* Write a checkpoint of the metadata and start a new MANIFEST. */
   void SaveMetadata();
+  /* Load the checkpoint and replay the MANIFEST. */
   void LoadMetadata();
 
-  // Require: DB Mutex held
-  void StopWrite();
+  /**
+   * Recompute the state of write_controller_ from the current SuperVersion,
+   * and wake up the stalled writers.
+   * Require: DB Mutex held
+   */
+  void UpdateWriteState();
+  /**
+   * The blob files whose IDs are smaller are relocated by compactions.
+   * See options_.blob_garbage_collection_age_cutoff.
+   */
+  size_t GetBlobRelocationCutoff(const Version &version) const;
+  /**
+   * The bytes that compactions need to rewrite so that each level is within
+   * its target size.
+   */
+  size_t EstimatePendingCompactionBytes(const Version &version) const;
+  /* Wait while writes are stopped, and sleep if they are delayed. */
+  void DelayWrite(size_t num_bytes);
+
+  /* The codec of data blocks in the level */
+  CompressionType GetCompression(size_t level) const;
+  /**
+   * The bits per key of the filters of a new sorted run of new_run_size
+   * bytes in the level. See options_.optimize_filters_per_level.
+   */
+  size_t GetBitsPerKey(
+      const Version &version, size_t level, size_t new_run_size) const;
 
   Options options_;
-  Cache cache_;
+  MemTableRep memtable_rep_;
+  /* Parsed from options_.compression_per_level */
+  std::vector<CompressionType> compression_per_level_;
+  /* Parsed from options_.filter_type */
+  FilterType filter_type_;
+  std::shared_ptr<Env> env_;
+  /* The block cache of env_ */
+  Cache *cache_;
+  /* The reader of batched block reads of env_. SSTables refer to it. */
+  AsyncReader *reader_;
+  /* The table cache of env_. SSTables refer to it. */
+  TableCache *table_cache_;
+  /* The blob files of separated values. SSTables refer to it. */
+  std::unique_ptr<BlobStore> blobs_;
   size_t seq_;
+  SnapshotList snapshots_;
 
-  std::vector<std::thread> threads_;
-  std::condition_variable flush_cv_;
-  std::condition_variable compact_cv_;
+  /* The number of scheduled jobs that have not finished */
+  size_t pending_jobs_{0};
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_cv_;
+  /* The memory of the MemTables reported to env_ */
+  std::atomic<size_t> reported_mutable_memory_{0};
+  size_t reported_memory_{0};
+  std::mutex memory_mutex_;
   bool stop_signal_{false};
-  bool compact_flag_{false};
-  bool flush_flag_{false};
+  size_t running_compactions_{0};
+  /* The sorted runs of flushed MemTables that wait for older MemTables */
+  std::unordered_map<MemTable *, std::shared_ptr<SortedRun>> flushed_runs_;
 
+  /**
+   * It protects writers_ and is never held while waiting, so that the
+   * background threads can take it.
+   */
   std::mutex write_mutex_;
+  std::deque<Writer *> writers_;
+  /* env_ asked to flush the MemTable. Use with write_mutex_. */
+  bool flush_requested_{false};
+  /* The log of the active MemTable. It is only used by the leading writer. */
+  std::unique_ptr<WALWriter> wal_;
   std::mutex db_mutex_;
+  WriteController write_controller_;
+  /* Writers wait on it when writes are stopped. Use with db_mutex_. */
+  std::condition_variable stall_cv_;
   std::shared_mutex sv_mutex_;
   std::shared_ptr<SuperVersion> sv_;
   std::unique_ptr<FileNameGenerator> filename_gen_;
+  /* The MANIFEST after the last checkpoint. Use with db_mutex_. */
+  std::unique_ptr<ManifestWriter> manifest_;
+  size_t manifest_number_{0};
+  /* The largest sequence number recorded in the metadata */
+  seq_t persisted_seq_{0};
   std::unique_ptr<CompactionPicker> compaction_picker_;
+  /**
+   * The workers of subcompactions of env_ (see CompactionJob::RunParallel).
+   * It is null if options_.max_subcompactions <= 1.
+   */
+  ThreadPool *subcompaction_pool_;
+  /* The workers of Ingest. It is created by the first ingestion. */
+  std::unique_ptr<ThreadPool> ingest_pool_;
+  std::once_flag ingest_pool_once_;
 };
 
 class DBIterator final : public Iterator {
  public:
-  DBIterator(std::shared_ptr<SuperVersion> sv, seq_t seq)
-    : sv_(std::move(sv)), it_(sv_.get()), seq_(seq) {}
+  /**
+   * blobs reads the values stored in blob files. merge_operator combines
+   * the merge operands with the older records of their keys.
+   */
+  DBIterator(std::shared_ptr<SuperVersion> sv, seq_t seq,
+      BlobStore *blobs = nullptr,
+      const MergeOperator *merge_operator = nullptr)
+    : sv_(std::move(sv)),
+      it_(sv_.get()),
+      seq_(seq),
+      range_dels_(sv_->GetRangeTombstones()),
+      blobs_(blobs),
+      merge_operator_(merge_operator) {}
 
   void SeekToFirst();
 
@@ -93,15 +333,36 @@ class DBIterator final : public Iterator {
 
   Slice key() const override;
 
+  /**
+   * If the value is stored in a blob file, it is read when value() is
+   * called, so that the scans that only read the keys skip the blob files.
+   */
   Slice value() const override;
 
   void Next() override;
 
  private:
+  /* If current_key_ is a deletion or is covered by a range tombstone */
+  bool IsDeleted() const;
+  /**
+   * If current_key_ is a merge operand, combine it with the older records of
+   * the key into merged_value_. it_ is left at the first record not read.
+   */
+  void MergeCurrent();
+
   std::shared_ptr<SuperVersion> sv_;
   SuperVersionIterator it_;
   seq_t seq_;
   InternalKey current_key_;
+  /* The range tombstones of all the components of sv_ */
+  std::shared_ptr<const RangeTombstoneList> range_dels_;
+  BlobStore *blobs_;
+  /* The value read from the blob file */
+  mutable std::string blob_value_;
+  const MergeOperator *merge_operator_;
+  /* If current_key_ is a merge operand, its value is merged_value_. */
+  bool merged_{false};
+  std::string merged_value_;
 };
 
 }  // namespace lsm
@@ -30,7 +30,7 @@ class LSMStorage : public Storage {
       lsm::Options options0 = options;
       options0.create_new = false;
       options0.db_path = fmt::format("{}/tables/t'{}'", path.string(), name);
-      auto lsm = std::make_unique<lsm::DBImpl>(options0);
+      auto lsm = std::make_unique<lsm::DBImpl>(options0, db->env_);
       if (!lsm) {
         throw DBException("LSM tree of `{}' is invalid.", name);
       }
@@ -88,6 +88,30 @@ class LSMStorage : public Storage {
       table_.lsm_->Put(key, new_value);
       return true;
     }
+    /**
+     * The keys are checked with one MultiGet, and the rows are written with
+     * one lsm::WriteBatch. So either all the rows are inserted or none of
+     * them are.
+     */
+    bool BatchInsert(std::span<const std::string_view> keys,
+        std::span<const std::string_view> values) override {
+      std::set<std::string_view> key_set(keys.begin(), keys.end());
+      if (key_set.size() != keys.size()) {
+        return false;
+      }
+      for (auto& value : table_.lsm_->MultiGet(keys)) {
+        if (value) {
+          return false;
+        }
+      }
+      lsm::WriteBatch batch;
+      for (size_t i = 0; i < keys.size(); i++) {
+        batch.Put(keys[i], values[i]);
+      }
+      table_.lsm_->Write(batch);
+      table_.tick_ += keys.size();
+      return true;
+    }
 
    private:
     Table& table_;
@@ -105,16 +129,39 @@ class LSMStorage : public Storage {
       return reinterpret_cast<const uint8_t*>(value_.data());
     }
 
+    /**
+     * Search the keys in a batch with lsm::DBImpl::MultiGet. The i-th result
+     * is the result of Search(keys[i]). The results are valid until the next
+     * Search() or MultiSearch() is called.
+     */
+    std::vector<const uint8_t*> MultiSearch(
+        std::span<const std::string_view> keys) {
+      values_ = lsm_->MultiGet(keys);
+      std::vector<const uint8_t*> ret;
+      for (auto& value : values_) {
+        ret.push_back(
+            value ? reinterpret_cast<const uint8_t*>(value->data()) : nullptr);
+      }
+      return ret;
+    }
+
    private:
     lsm::DBImpl* lsm_;
     std::string value_;
+    std::vector<std::optional<std::string>> values_;
   };
 
+  /**
+   * If both L and R are bounded, the sorted runs without a key in [L, R]
+   * are skipped by the range filters (see lsm::DBImpl::SeekRange).
+   */
   class LSMIterator : public wing::Iterator<const uint8_t*> {
    public:
     LSMIterator(lsm::DBImpl* lsm, std::tuple<std::string_view, bool, bool> L,
         std::tuple<std::string_view, bool, bool> R)
-      : it_(std::get<1>(L) ? lsm->Begin() : lsm->Seek(std::get<0>(L))) {
+      : it_(std::get<1>(L)   ? lsm->Begin()
+            : std::get<1>(R) ? lsm->Seek(std::get<0>(L))
+                             : lsm->SeekRange(std::get<0>(L), std::get<0>(R))) {
       if (!std::get<1>(L) && !std::get<2>(L) && it_.Valid() &&
           it_.key() == std::get<0>(L)) {
         it_.Next();
@@ -152,7 +199,7 @@ class LSMStorage : public Storage {
     option.db_path = fmt::format("{}/tables/t'{}'", db_path_, table_name);
     std::filesystem::create_directory(option.db_path);
     auto table = std::make_unique<Table>();
-    table->lsm_ = std::make_unique<lsm::DBImpl>(option);
+    table->lsm_ = std::make_unique<lsm::DBImpl>(option, env_);
     table->tick_ = 0;
     tables_.emplace(table_name, std::move(table));
     schema_.AddTable(schema);
@@ -202,6 +249,7 @@ class LSMStorage : public Storage {
   LSMStorage(const std::filesystem::path& path, const lsm::Options& options) {
     db_path_ = path.string();
     options_ = options;
+    env_ = std::make_shared<lsm::Env>(options_);
   }
   Table& GetTable(std::string_view table_name) {
     auto it = tables_.find(table_name);
@@ -213,6 +261,8 @@ class LSMStorage : public Storage {
   }
 
   std::string db_path_;
+  /* The cache, threads and MemTable budget shared by the tables */
+  std::shared_ptr<lsm::Env> env_;
   std::map<std::string, std::unique_ptr<Table>, std::less<>> tables_;
   lsm::Options options_;
   DBSchema schema_;
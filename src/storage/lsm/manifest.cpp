@@ -0,0 +1,274 @@
+#include "storage/lsm/manifest.hpp"
+
+#include <charconv>
+#include <filesystem>
+#include <unordered_map>
+
+#include "common/exception.hpp"
+#include "common/murmurhash.hpp"
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+static constexpr size_t kManifestChecksumSeed = 0x202410161720;
+
+static constexpr size_t kManifestHeaderSize =
+    sizeof(uint32_t) + sizeof(uint64_t);
+
+template <typename T>
+static void Append(std::string& s, T x) {
+  s.append(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+static void EncodeSSTInfo(std::string& s, const SSTInfo& info) {
+  Append<uint64_t>(s, info.count_);
+  Append<uint64_t>(s, info.num_deletions_);
+  Append<uint64_t>(s, info.size_);
+  Append<uint64_t>(s, info.sst_id_);
+  Append<uint64_t>(s, info.index_offset_);
+  Append<uint64_t>(s, info.bloom_filter_offset_);
+  Append<uint32_t>(s, info.format_version_);
+  Append<uint64_t>(s, info.filename_.size());
+  s.append(info.filename_);
+  Append<uint64_t>(s, info.blob_files_.size());
+  for (auto id : info.blob_files_) {
+    Append<uint64_t>(s, id);
+  }
+}
+
+static SSTInfo DecodeSSTInfo(utils::Deserializer& des) {
+  SSTInfo info;
+  info.count_ = des.Read<uint64_t>();
+  info.num_deletions_ = des.Read<uint64_t>();
+  info.size_ = des.Read<uint64_t>();
+  info.sst_id_ = des.Read<uint64_t>();
+  info.index_offset_ = des.Read<uint64_t>();
+  info.bloom_filter_offset_ = des.Read<uint64_t>();
+  info.format_version_ = des.Read<uint32_t>();
+  info.filename_ = des.ReadString(des.Read<uint64_t>());
+  auto num_blob_files = des.Read<uint64_t>();
+  for (uint64_t i = 0; i < num_blob_files; i++) {
+    info.blob_files_.push_back(des.Read<uint64_t>());
+  }
+  return info;
+}
+
+VersionEdit VersionEdit::Diff(
+    const Version& old_version, const Version& new_version) {
+  /* The run and the position of each SSTable in the old Version */
+  std::unordered_map<size_t, std::pair<const SortedRun*, size_t>> old_ssts;
+  std::unordered_map<size_t, const Level*> old_levels;
+  for (auto& level : old_version.GetLevels()) {
+    old_levels[level.GetID()] = &level;
+    for (auto& run : level.GetRuns()) {
+      for (size_t i = 0; i < run->GetSSTs().size(); i++) {
+        old_ssts[run->GetSSTs()[i]->GetSSTInfo().sst_id_] = {run.get(), i};
+      }
+    }
+  }
+  VersionEdit edit;
+  for (auto& level : new_version.GetLevels()) {
+    auto it = old_levels.find(level.GetID());
+    bool changed =
+        it == old_levels.end() || it->second->GetRuns() != level.GetRuns();
+    LevelEdit level_edit{static_cast<size_t>(level.GetID()), changed, {}};
+    if (changed) {
+      for (auto& run : level.GetRuns()) {
+        std::vector<Piece> pieces;
+        /* The position of the last SSTable of the last piece */
+        std::pair<const SortedRun*, size_t> last{nullptr, 0};
+        for (auto& sst : run->GetSSTs()) {
+          auto& info = sst->GetSSTInfo();
+          auto sst_it = old_ssts.find(info.sst_id_);
+          if (sst_it == old_ssts.end()) {
+            pieces.push_back(Piece{info, 0, 0});
+            last = {nullptr, 0};
+            continue;
+          }
+          auto [old_run, pos] = sst_it->second;
+          if (last.first == old_run && last.second + 1 == pos) {
+            pieces.back().count_ += 1;
+          } else {
+            pieces.push_back(Piece{std::nullopt, info.sst_id_, 1});
+          }
+          last = {old_run, pos};
+        }
+        level_edit.runs_.push_back(std::move(pieces));
+      }
+    }
+    edit.levels_.push_back(std::move(level_edit));
+  }
+  return edit;
+}
+
+std::string VersionEdit::Encode() const {
+  std::string ret;
+  Append<uint64_t>(ret, seq_);
+  Append<uint64_t>(ret, next_file_id_);
+  Append<uint64_t>(ret, min_log_number_);
+  Append<uint64_t>(ret, levels_.size());
+  for (auto& level : levels_) {
+    Append<uint64_t>(ret, level.id_);
+    Append<uint8_t>(ret, level.changed_);
+    if (!level.changed_) {
+      continue;
+    }
+    Append<uint64_t>(ret, level.runs_.size());
+    for (auto& run : level.runs_) {
+      Append<uint64_t>(ret, run.size());
+      for (auto& piece : run) {
+        Append<uint8_t>(ret, piece.info_.has_value());
+        if (piece.info_) {
+          EncodeSSTInfo(ret, *piece.info_);
+        } else {
+          Append<uint64_t>(ret, piece.sst_id_);
+          Append<uint64_t>(ret, piece.count_);
+        }
+      }
+    }
+  }
+  return ret;
+}
+
+VersionEdit VersionEdit::Decode(Slice data) {
+  utils::Deserializer des(data.data());
+  VersionEdit edit;
+  edit.seq_ = des.Read<uint64_t>();
+  edit.next_file_id_ = des.Read<uint64_t>();
+  edit.min_log_number_ = des.Read<uint64_t>();
+  auto num_levels = des.Read<uint64_t>();
+  for (uint64_t i = 0; i < num_levels; i++) {
+    LevelEdit level;
+    level.id_ = des.Read<uint64_t>();
+    level.changed_ = des.Read<uint8_t>();
+    if (level.changed_) {
+      auto num_runs = des.Read<uint64_t>();
+      for (uint64_t j = 0; j < num_runs; j++) {
+        std::vector<Piece> run(des.Read<uint64_t>());
+        for (auto& piece : run) {
+          if (des.Read<uint8_t>()) {
+            piece.info_ = DecodeSSTInfo(des);
+          } else {
+            piece.sst_id_ = des.Read<uint64_t>();
+            piece.count_ = des.Read<uint64_t>();
+          }
+        }
+        level.runs_.push_back(std::move(run));
+      }
+    }
+    edit.levels_.push_back(std::move(level));
+  }
+  if (des.data() != data.data() + data.size()) {
+    throw DBException("Corrupted version edit of size {}", data.size());
+  }
+  return edit;
+}
+
+void VersionEdit::Apply(std::vector<LevelInfo>* levels) const {
+  /* The run and the position of each SSTable in the old levels */
+  std::unordered_map<size_t, std::pair<const std::vector<SSTInfo>*, size_t>>
+      old_ssts;
+  std::unordered_map<size_t, const LevelInfo*> old_levels;
+  for (auto& level : *levels) {
+    old_levels[level.id_] = &level;
+    for (auto& run : level.runs_) {
+      for (size_t i = 0; i < run.size(); i++) {
+        old_ssts[run[i].sst_id_] = {&run, i};
+      }
+    }
+  }
+  std::vector<LevelInfo> new_levels;
+  for (auto& level : levels_) {
+    if (!level.changed_) {
+      auto it = old_levels.find(level.id_);
+      if (it == old_levels.end()) {
+        throw DBException("Version edit refers to missing level {}", level.id_);
+      }
+      new_levels.push_back(*it->second);
+      continue;
+    }
+    LevelInfo new_level{level.id_, {}};
+    for (auto& pieces : level.runs_) {
+      std::vector<SSTInfo> run;
+      for (auto& piece : pieces) {
+        if (piece.info_) {
+          run.push_back(*piece.info_);
+          continue;
+        }
+        auto it = old_ssts.find(piece.sst_id_);
+        if (it == old_ssts.end() ||
+            it->second.second + piece.count_ > it->second.first->size()) {
+          throw DBException(
+              "Version edit refers to missing SSTable {}", piece.sst_id_);
+        }
+        auto begin = it->second.first->begin() + it->second.second;
+        run.insert(run.end(), begin, begin + piece.count_);
+      }
+      new_level.runs_.push_back(std::move(run));
+    }
+    new_levels.push_back(std::move(new_level));
+  }
+  *levels = std::move(new_levels);
+}
+
+void ManifestWriter::AddEdit(const VersionEdit& edit) {
+  auto payload = edit.Encode();
+  writer_.AppendValue<uint32_t>(payload.size())
+      .AppendValue<uint64_t>(
+          utils::Hash(payload.data(), payload.size(), kManifestChecksumSeed))
+      .AppendString(payload);
+  writer_.Sync();
+  count_ += 1;
+}
+
+ManifestReader::ManifestReader(const std::string& filename) {
+  data_.resize(std::filesystem::file_size(filename));
+  if (data_.size() > 0) {
+    ReadFile file(filename, false);
+    auto len = file.Read(data_.data(), data_.size(), 0);
+    data_.resize(len);
+  }
+}
+
+bool ManifestReader::ReadEdit(VersionEdit* edit) {
+  if (offset_ + kManifestHeaderSize > data_.size()) {
+    return false;
+  }
+  auto header = utils::Deserializer(data_.data() + offset_);
+  size_t payload_size = header.Read<uint32_t>();
+  size_t checksum = header.Read<uint64_t>();
+  const char* payload = header.data();
+  if (offset_ + kManifestHeaderSize + payload_size > data_.size() ||
+      utils::Hash(payload, payload_size, kManifestChecksumSeed) != checksum) {
+    return false;
+  }
+  *edit = VersionEdit::Decode(Slice(payload, payload_size));
+  offset_ += kManifestHeaderSize + payload_size;
+  return true;
+}
+
+std::string ManifestFileName(std::string_view db_path, size_t manifest_number) {
+  return fmt::format("{}/MANIFEST-{}", db_path, manifest_number);
+}
+
+std::optional<size_t> ParseManifestFileName(std::string_view filename) {
+  std::string_view prefix = "MANIFEST-";
+  if (filename.size() <= prefix.size() ||
+      filename.substr(0, prefix.size()) != prefix) {
+    return std::nullopt;
+  }
+  size_t manifest_number;
+  auto begin = filename.data() + prefix.size();
+  auto end = filename.data() + filename.size();
+  auto [ptr, ec] = std::from_chars(begin, end, manifest_number);
+  if (ec != std::errc() || ptr != end) {
+    return std::nullopt;
+  }
+  return manifest_number;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "storage/lsm/file.hpp"
+#include "storage/lsm/format.hpp"
+#include "storage/lsm/version.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * The metadata of a database is a checkpoint and a log of version edits.
+ *
+ * The checkpoint "metadata" stores all the SSTables of a Version, and the
+ * number of the MANIFEST that follows it. The MANIFEST "MANIFEST-<number>"
+ * stores the changes of the Versions installed after the checkpoint, so a
+ * flush or a compaction writes the SSTables it adds instead of all the
+ * SSTables. The metadata is loaded by replaying the MANIFEST on the
+ * checkpoint. A new checkpoint starts a new MANIFEST.
+ *
+ * Each entry of the MANIFEST is stored as:
+ * | payload size (uint32_t) | checksum of payload (uint64_t) | payload |
+ * and the payload is an encoded VersionEdit.
+ */
+
+/* The SSTables of a level, which are not opened. */
+struct LevelInfo {
+  size_t id_;
+  std::vector<std::vector<SSTInfo>> runs_;
+};
+
+/**
+ * The change from a Version to the next one.
+ *
+ * It lists all the levels of the new Version. An unchanged level is stored
+ * as its ID. A changed level stores its sorted runs, and each run is a
+ * sequence of pieces. A piece is either a new SSTable, or consecutive
+ * SSTables of a run of the old Version, which are stored as the ID of the
+ * first SSTable and the number of SSTables.
+ */
+class VersionEdit {
+ public:
+  /* The largest sequence number that is not in the logs */
+  seq_t seq_{0};
+  /* The ID of the next file */
+  size_t next_file_id_{0};
+  /* The logs older than it are persisted. */
+  size_t min_log_number_{0};
+
+  /* Record the levels of new_version as changes from old_version. */
+  static VersionEdit Diff(
+      const Version& old_version, const Version& new_version);
+
+  std::string Encode() const;
+
+  static VersionEdit Decode(Slice data);
+
+  /* Apply the edit. It throws DBException if it does not match levels. */
+  void Apply(std::vector<LevelInfo>* levels) const;
+
+ private:
+  struct Piece {
+    /* The new SSTable. It is empty if the SSTables exist. */
+    std::optional<SSTInfo> info_;
+    /* The ID of the first existing SSTable */
+    size_t sst_id_{0};
+    /* The number of existing SSTables */
+    size_t count_{0};
+  };
+
+  struct LevelEdit {
+    size_t id_;
+    bool changed_;
+    std::vector<std::vector<Piece>> runs_;
+  };
+
+  std::vector<LevelEdit> levels_;
+};
+
+class ManifestWriter {
+ public:
+  /* It creates an empty MANIFEST. */
+  ManifestWriter(const std::string& filename)
+    : writer_(std::make_unique<SeqWriteFile>(filename, false), 1 << 16) {}
+
+  /* Append the edit and wait for it to reach the device. */
+  void AddEdit(const VersionEdit& edit);
+
+  /* The number of edits in the MANIFEST. */
+  size_t count() const { return count_; }
+
+ private:
+  FileWriter writer_;
+  size_t count_{0};
+};
+
+class ManifestReader {
+ public:
+  ManifestReader(const std::string& filename);
+
+  /**
+   * Read the next edit. Return false at the end of the MANIFEST, or at the
+   * first incomplete or corrupted entry (e.g. an entry torn by a crash).
+   */
+  bool ReadEdit(VersionEdit* edit);
+
+ private:
+  /* The content of the MANIFEST */
+  std::string data_;
+  /* The offset of the next entry */
+  size_t offset_{0};
+};
+
+/* The path of the MANIFEST with number manifest_number. */
+std::string ManifestFileName(std::string_view db_path, size_t manifest_number);
+
+/* Return the MANIFEST number if filename is the name of a MANIFEST. */
+std::optional<size_t> ParseManifestFileName(std::string_view filename);
+
+}  // namespace lsm
+
+}  // namespace wing
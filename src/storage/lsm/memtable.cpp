@@ -1,7 +1,9 @@
 #include "storage/lsm/memtable.hpp"
 
+#include "common/exception.hpp"
 #include "common/logging.hpp"
 #include "common/serializer.hpp"
+#include "common/util.hpp"
 
 namespace wing {
 
@@ -18,7 +20,11 @@ void MemTable::Add(ParsedKey key, Slice value) {
   auto parsed_key =
       ParsedKey(Slice(ptr, key.user_key_.size()), key.seq_, key.type_);
   auto copied_value = Slice(ptr + key.size(), value.size());
-  table_.emplace(parsed_key, copied_value);
+  if (rep_ == MemTableRep::kSkipList) {
+    list_.Insert(Entry{parsed_key, copied_value});
+  } else {
+    table_.emplace(parsed_key, copied_value);
+  }
 }
 
 void MemTable::Put(Slice user_key, seq_t seq, Slice value) {
@@ -31,26 +37,96 @@ void MemTable::Del(Slice user_key, seq_t seq) {
   Add(ParsedKey(user_key, seq, RecordType::Deletion), Slice());
 }
 
+void MemTable::Merge(Slice user_key, seq_t seq, Slice operand) {
+  std::unique_lock<std::shared_mutex> lck(mu_);
+  Add(ParsedKey(user_key, seq, RecordType::Merge), operand);
+}
+
+void MemTable::DelRange(Slice begin, Slice end, seq_t seq) {
+  /* size_ is protected by mu_ */
+  std::unique_lock<std::shared_mutex> lck(mu_);
+  AddRangeTombstone(begin, end, seq);
+}
+
+void MemTable::AddRangeTombstone(Slice begin, Slice end, seq_t seq) {
+  std::unique_lock range_del_lck(range_del_mu_);
+  range_dels_.push_back(
+      RangeTombstone{std::string(begin), std::string(end), seq});
+  fragmented_range_dels_.reset();
+  size_ += begin.size() + end.size() + sizeof(seq_t) + sizeof(offset_t) * 2;
+  num_range_dels_.fetch_add(1, std::memory_order_release);
+}
+
+void MemTable::Apply(const WriteBatch& batch, seq_t seq) {
+  std::unique_lock<std::shared_mutex> lck(mu_);
+  WriteBatchReader reader(batch.rep());
+  RecordType type;
+  Slice key, value;
+  while (reader.Next(&type, &key, &value)) {
+    if (type == RecordType::RangeDeletion) {
+      AddRangeTombstone(key, value, seq);
+    } else {
+      Add(ParsedKey(key, seq, type), value);
+    }
+    seq += 1;
+  }
+}
+
+std::shared_ptr<const RangeTombstoneList> MemTable::GetRangeTombstones() {
+  std::unique_lock lck(range_del_mu_);
+  if (!fragmented_range_dels_) {
+    fragmented_range_dels_ =
+        std::make_shared<const RangeTombstoneList>(range_dels_);
+  }
+  return fragmented_range_dels_;
+}
+
 void MemTable::Clear() {
+  wing_assert(rep_ == MemTableRep::kMap,
+      "Nodes in the skiplist cannot be removed.");
   std::unique_lock<std::shared_mutex> lck(mu_);
   table_.clear();
 }
 
-GetResult MemTable::Get(Slice user_key, seq_t seq, std::string *value) {
-  std::shared_lock<std::shared_mutex> lock(mu_);
-  auto it = table_.lower_bound(ParsedKey(user_key, seq, RecordType::Value));
-  if (it == table_.end() || it->first.user_key_ != user_key) {
-    return GetResult::kNotFound;
-  } else {
-    switch (it->first.type_) {
+GetResult MemTable::Get(Slice user_key, seq_t seq, std::string *value,
+    std::vector<std::string> *operands) {
+  /* Readers of the skiplist do not take the lock */
+  std::shared_lock<std::shared_mutex> lock(mu_, std::defer_lock);
+  if (rep_ == MemTableRep::kMap) {
+    lock.lock();
+  }
+  seq_t covering_seq = 0;
+  if (num_range_dels_.load(std::memory_order_acquire) > 0) {
+    covering_seq = GetRangeTombstones()->MaxCoveringSeq(user_key, seq);
+  }
+  /* The older records are read if the newer ones are merge operands. */
+  for (auto it = Seek(user_key, seq); it.Valid(); it.Next()) {
+    ParsedKey key(it.key());
+    if (key.user_key_ != user_key) {
+      break;
+    }
+    if (covering_seq > key.seq_) {
+      return GetResult::kDelete;
+    }
+    switch (key.type_) {
       case RecordType::Deletion:
         return GetResult::kDelete;
       case RecordType::Value:
-        *value = it->second;
+        *value = it.value();
         return GetResult::kFound;
+      case RecordType::Merge:
+        if (operands == nullptr) {
+          throw DBException(
+              "Merge operand of key {} is not expected", user_key);
+        }
+        operands->emplace_back(it.value());
+        continue;
+      default:
+        break;
     }
+    DB_ERR("Incorrect key value!");
   }
-  DB_ERR("Incorrect key value!");
+  return covering_seq > 0 ? GetResult::kDelete : GetResult::kNotFound;
 }
 
 MemTableIterator MemTable::Seek(Slice user_key, seq_t seq) {
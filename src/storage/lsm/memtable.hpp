@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <map>
+#include <mutex>
 #include <shared_mutex>
 #include <string>
 
@@ -9,6 +11,9 @@
 #include "storage/lsm/format.hpp"
 #include "storage/lsm/iterator.hpp"
 #include "storage/lsm/options.hpp"
+#include "storage/lsm/range_del.hpp"
+#include "storage/lsm/skiplist.hpp"
+#include "storage/lsm/write_batch.hpp"
 
 namespace wing {
 
@@ -16,20 +21,59 @@ namespace lsm {
 
 class MemTableIterator;
 
+/* The data structure which stores the records in MemTable. */
+enum class MemTableRep : uint8_t {
+  /**
+   * A skiplist in the arena. Writers are serialized, and readers do not
+   * acquire any lock.
+   */
+  kSkipList = 0,
+  /* std::map protected by a reader-writer lock */
+  kMap,
+};
+
 class MemTable {
  public:
-  MemTable() : size_(0) {}
+  /* log_number is the number of the write-ahead log segment of the MemTable */
+  MemTable(size_t log_number = 0, MemTableRep rep = MemTableRep::kSkipList)
+    : size_(0),
+      log_number_(log_number),
+      rep_(rep),
+      list_(EntryCompare(), &alloc_) {}
 
   void Put(Slice user_key, seq_t seq, Slice value);
 
   void Del(Slice user_key, seq_t seq);
 
-  /* Find a record with the same key and the largest sequence number <= seq */
-  GetResult Get(Slice user_key, seq_t seq, std::string* value);
+  /* Add a merge operand */
+  void Merge(Slice user_key, seq_t seq, Slice operand);
+
+  /* Delete the user keys in [begin, end) */
+  void DelRange(Slice begin, Slice end, seq_t seq);
+
+  /**
+   * Add the records of the batch with sequence numbers seq, seq + 1, ...
+   * The lock is acquired once for the whole batch.
+   */
+  void Apply(const WriteBatch& batch, seq_t seq);
+
+  /**
+   * Find a record with the same key and the largest sequence number <= seq.
+   * It returns GetResult::kDelete if the record is covered by a newer range
+   * tombstone in the MemTable.
+   * The merge operands newer than the record are appended to operands, and
+   * it returns GetResult::kNotFound if there is only merge operands. It
+   * throws DBException if operands is null and it finds a merge operand.
+   */
+  GetResult Get(Slice user_key, seq_t seq, std::string* value,
+      std::vector<std::string>* operands = nullptr);
+
+  /* The range tombstones in the MemTable. */
+  std::shared_ptr<const RangeTombstoneList> GetRangeTombstones();
 
   size_t size() const { return size_; }
 
-  std::map<ParsedKey, Slice>& GetTable() { return table_; }
+  MemTableRep GetRep() const { return rep_; }
 
   MemTableIterator Seek(Slice user_key, seq_t seq);
 
@@ -43,44 +87,104 @@ class MemTable {
 
   bool GetFlushComplete() const { return flush_complete_; }
 
+  size_t GetLogNumber() const { return log_number_; }
+
   void Clear();
 
  private:
+  struct Entry {
+    ParsedKey key;
+    Slice value;
+  };
+
+  struct EntryCompare {
+    std::strong_ordering operator()(const Entry& a, const Entry& b) const {
+      return a.key <=> b.key;
+    }
+  };
+
+  using List = SkipList<Entry, EntryCompare>;
+
   void Add(ParsedKey key, Slice value);
 
+  /* Add a range tombstone. mu_ must be held. */
+  void AddRangeTombstone(Slice begin, Slice end, seq_t seq);
+
+  /**
+   * For MemTableRep::kMap, it protects table_.
+   * For MemTableRep::kSkipList, it serializes writers.
+   */
   std::shared_mutex mu_;
   std::map<ParsedKey, Slice> table_;
   uint64_t size_;
   ArenaAllocator alloc_;
+  size_t log_number_{0};
+  MemTableRep rep_;
+  List list_;
   bool flush_in_progress_{false};
   bool flush_complete_{false};
+  /* It protects range_dels_ and fragmented_range_dels_. */
+  std::mutex range_del_mu_;
+  std::vector<RangeTombstone> range_dels_;
+  /* Readers skip the lock if there is no range tombstone. */
+  std::atomic<size_t> num_range_dels_{0};
+  /* Fragmented from range_dels_ on demand. It is reset by DelRange. */
+  std::shared_ptr<const RangeTombstoneList> fragmented_range_dels_;
 
   friend class MemTableIterator;
 };
 
 class MemTableIterator final : public Iterator {
  public:
-  MemTableIterator(MemTable* table) : table_(table) {}
+  MemTableIterator(MemTable* table) : table_(table), list_it_(&table->list_) {}
 
   void Seek(Slice key, seq_t seq) {
-    it_ = table_->table_.lower_bound(ParsedKey(key, seq, RecordType::Value));
+    ParsedKey target(key, seq, RecordType::Value);
+    if (table_->rep_ == MemTableRep::kSkipList) {
+      list_it_.Seek(MemTable::Entry{target, Slice()});
+    } else {
+      it_ = table_->table_.lower_bound(target);
+    }
   }
 
-  void SeekToFirst() { it_ = table_->table_.begin(); }
+  void SeekToFirst() {
+    if (table_->rep_ == MemTableRep::kSkipList) {
+      list_it_.SeekToFirst();
+    } else {
+      it_ = table_->table_.begin();
+    }
+  }
 
-  bool Valid() override { return it_ != table_->table_.end(); }
+  bool Valid() override {
+    if (table_->rep_ == MemTableRep::kSkipList) {
+      return list_it_.Valid();
+    }
+    return it_ != table_->table_.end();
+  }
 
   Slice key() const override {
-    return Slice(it_->first.user_key_.data(), it_->first.size());
+    auto& key = table_->rep_ == MemTableRep::kSkipList ? list_it_.key().key
+                                                       : it_->first;
+    return Slice(key.user_key_.data(), key.size());
   }
 
-  Slice value() const override { return it_->second; }
+  Slice value() const override {
+    return table_->rep_ == MemTableRep::kSkipList ? list_it_.key().value
+                                                  : it_->second;
+  }
 
-  void Next() override { it_++; }
+  void Next() override {
+    if (table_->rep_ == MemTableRep::kSkipList) {
+      list_it_.Next();
+    } else {
+      it_++;
+    }
+  }
 
  private:
   MemTable* table_;
   std::map<ParsedKey, Slice>::iterator it_;
+  MemTable::List::Iterator list_it_;
 };
 
 }  // namespace lsm
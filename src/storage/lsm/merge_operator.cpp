@@ -0,0 +1,46 @@
+#include "storage/lsm/merge_operator.hpp"
+
+#include "common/exception.hpp"
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+static int64_t DecodeInt64(Slice key, Slice value) {
+  if (value.size() != sizeof(int64_t)) {
+    throw DBException(
+        "The value of key {} is not an int64 (size {})", key, value.size());
+  }
+  return utils::Deserializer(value.data()).Read<int64_t>();
+}
+
+std::string Int64AddOperator::Merge(
+    Slice key, const Slice* existing, Slice operand) const {
+  int64_t sum = DecodeInt64(key, operand);
+  if (existing != nullptr) {
+    sum += DecodeInt64(key, *existing);
+  }
+  std::string ret(sizeof(int64_t), 0);
+  utils::Serializer(ret.data()).Write<int64_t>(sum);
+  return ret;
+}
+
+std::string MergeOperands(const MergeOperator& op, Slice key,
+    const Slice* base, std::span<const std::string> operands) {
+  std::string ret;
+  bool has_value = base != nullptr;
+  if (has_value) {
+    ret = *base;
+  }
+  for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+    Slice existing = ret;
+    ret = op.Merge(key, has_value ? &existing : nullptr, *it);
+    has_value = true;
+  }
+  return ret;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
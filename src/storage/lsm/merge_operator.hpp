@@ -0,0 +1,56 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "storage/lsm/format.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * An associative merge operator. A RecordType::Merge record stores an
+ * operand, which is combined with the older records of the key when the key
+ * is read, so a read-modify-write (e.g. incrementing a counter) is a blind
+ * write.
+ *
+ * The values and the operands have the same format, and Merge must be
+ * associative, i.e., Merge(Merge(a, b), c) == Merge(a, Merge(b, c)). So the
+ * operands of a key can be combined in any grouping, e.g. a compaction that
+ * does not read the older value combines its operands into one operand.
+ */
+class MergeOperator {
+ public:
+  virtual ~MergeOperator() = default;
+
+  /**
+   * Combine the operand with the older value. existing is null if there is
+   * no older value, i.e., the key does not exist or is deleted.
+   * It throws DBException if they are malformed.
+   */
+  virtual std::string Merge(
+      Slice key, const Slice* existing, Slice operand) const = 0;
+};
+
+/**
+ * The values and the operands are int64_t, and the operands are added to
+ * the values. A missing value is 0.
+ */
+class Int64AddOperator final : public MergeOperator {
+ public:
+  std::string Merge(
+      Slice key, const Slice* existing, Slice operand) const override;
+};
+
+/**
+ * Combine the operands, from the newest to the oldest, with the value base
+ * (null if there is no value).
+ */
+std::string MergeOperands(const MergeOperator& op, Slice key,
+    const Slice* base, std::span<const std::string> operands);
+
+}  // namespace lsm
+
+}  // namespace wing
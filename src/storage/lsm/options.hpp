@@ -1,8 +1,11 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
+#include <vector>
 
 #include "storage/lsm/cache.hpp"
+#include "storage/lsm/merge_operator.hpp"
 
 namespace wing {
 
@@ -15,8 +18,41 @@ struct Options {
   uint64_t sst_file_size = 64 * 1024 * 1024;
   /* The target size of data block in SSTable */
   size_t block_size = 4 * 1024;
+  /**
+   * The number of keys between restart points in a data block. Keys are
+   * prefix-compressed against the previous key, except at restart points.
+   */
+  size_t block_restart_interval = 16;
+  /**
+   * The codec of data blocks in each level: "none", "lz4" or "lz4hc".
+   * Level i uses compression_per_level[i], and the levels after the last
+   * one use the last one. Data blocks are not compressed if it is empty.
+   * e.g. {"lz4", "lz4", "lz4hc"} uses the fast codec for L0 and L1, and the
+   * strong codec for the deeper levels.
+   */
+  std::vector<std::string> compression_per_level;
+  /**
+   * Verify the CRC32C of each block read by Get and iterators. Blocks in the
+   * cache are verified only once when they are read from the file.
+   */
+  bool verify_checksums = true;
+  /**
+   * The data structure of MemTable. "skiplist" or "map".
+   * See MemTableRep in lsm/memtable.hpp.
+   */
+  std::string memtable_rep_name = "skiplist";
   /* The size of write buffer */
   size_t write_buffer_size = 1024 * 1024;
+  /* Write records to the write-ahead log before inserting them to MemTable */
+  bool enable_wal = true;
+  /**
+   * Whether each commit group of writes is synced to the device before it is
+   * acknowledged. If it is false, acknowledged writes survive process crashes,
+   * but may be lost on power failures.
+   */
+  bool sync_wal = false;
+  /* The maximum size of the records written in one commit group */
+  size_t max_write_group_size = 1024 * 1024;
   /* Use O_DIRECT or not */
   bool use_direct_io = false;
   /* Use bloom filter or not*/
@@ -25,8 +61,39 @@ struct Options {
   bool create_new = true;
   /* The maximum number of immutable MemTables. */
   size_t max_immutable_count = 4;
-  /* The name of compaction strategy. */
+  /**
+   * The budget of the MemTables of all the DBImpls sharing an Env. If they
+   * exceed it, the largest active MemTable is flushed early. 0 disables it.
+   */
+  size_t db_write_buffer_size = 0;
+  /**
+   * The number of version edits appended to the MANIFEST before a new
+   * checkpoint of the metadata is written.
+   */
+  size_t manifest_checkpoint_interval = 256;
+  /**
+   * It combines the RecordType::Merge records with the older records of a
+   * key (e.g. Int64AddOperator for counters). DBImpl::Merge throws
+   * DBException if it is null.
+   */
+  std::shared_ptr<MergeOperator> merge_operator;
+  /**
+   * The number of background threads running flushes and compactions.
+   * Flushes are scheduled before compactions, and compactions from upper
+   * levels are scheduled before those from deeper levels. It is also the
+   * maximum number of concurrent compactions.
+   */
+  size_t max_background_jobs = 2;
+  /**
+   * The name of compaction strategy: "leveled", "tiered", "lazyleveling",
+   * "fluid" or "dynamic" (see DynamicLeveledCompactionPicker).
+   */
   std::string compaction_strategy_name = "leveled";
+  /**
+   * The number of levels of the "dynamic" strategy. The last level holds
+   * most of the data.
+   */
+  size_t num_levels = 7;
   /* The minimum number of sorted runs for triggering compaction in Level 0*/
   size_t level0_compaction_trigger = 4;
   /**
@@ -34,15 +101,88 @@ struct Options {
    * It stops writes when the number of sorted runs reaches this limit.
    */
   size_t level0_stop_writes_trigger = 20;
+  /**
+   * The number of sorted runs in Level 0 that starts to limit the write rate
+   * to delayed_write_rate.
+   */
+  size_t level0_slowdown_writes_trigger = 12;
+  /**
+   * The estimated bytes that compactions need to rewrite to bring the levels
+   * back to their target sizes. Writes are delayed when it reaches the soft
+   * limit, and stopped when it reaches the hard limit. 0 means no limit.
+   */
+  size_t soft_pending_compaction_bytes_limit = 64ull * 1024 * 1024 * 1024;
+  size_t hard_pending_compaction_bytes_limit = 256ull * 1024 * 1024 * 1024;
+  /* The write rate in bytes per second when writes are delayed. */
+  size_t delayed_write_rate = 16 * 1024 * 1024;
+  /**
+   * The maximum number of key ranges that a compaction is split into.
+   * The ranges are merged in parallel by a pool of this many threads.
+   */
+  size_t max_subcompactions = 1;
+  /**
+   * The backend that reads the blocks missed by MultiGet in batches:
+   * "io_uring", "thread_pool" or "none". "io_uring" falls back to
+   * "thread_pool" if the kernel does not support it. With "none", the blocks
+   * are read one by one by the calling thread.
+   */
+  std::string async_io_backend = "io_uring";
+  /* The maximum number of reads in flight in an io_uring */
+  size_t async_io_queue_depth = 32;
+  /* The number of threads of the "thread_pool" backend */
+  size_t async_io_threads = 4;
+  /**
+   * The maximum size of a read of iterators. When an iterator moves to the
+   * next data block, it reads 2 blocks ahead, and doubles the size in each
+   * read until it reaches this size. The blocks read ahead bypass the block
+   * cache. Readahead is disabled if it is 0.
+   */
+  size_t max_readahead_size = 256 * 1024;
+  /* The number of threads that sort and write the records of an ingestion */
+  size_t ingest_threads = 4;
+  /**
+   * The values of at least this size are stored in blob files, and the
+   * SSTables store pointers to them (see lsm/blob.hpp). It is disabled if it
+   * is 0.
+   */
+  size_t min_blob_size = 0;
+  /**
+   * The fraction of the oldest blob files whose values are relocated to new
+   * blob files by compactions. An old blob file is removed when no SSTable
+   * refers to it, so the space of the overwritten and deleted values in it
+   * is reclaimed.
+   */
+  double blob_garbage_collection_age_cutoff = 0.25;
   /* The default size ratio used in tiering/leveling compaction strategy. */
   size_t compaction_size_ratio = 10;
   /* The number of bits per key in bloom filter, by default */
   size_t bloom_bits_per_key = 10;
+  /* The filter of SSTables: "bloom" or "ribbon". See lsm/filter.hpp. */
+  std::string filter_type = "bloom";
+  /**
+   * Allocate the filter memory of bloom_bits_per_key per key among the
+   * levels to minimize the expected I/Os of point lookups (see
+   * OptimizeBitsPerKey), instead of bloom_bits_per_key for every level.
+   */
+  bool optimize_filters_per_level = false;
+  /**
+   * The number of bits per key prefix of each level of the range filters of
+   * SSTables (see utils::RangeFilter), which let DBImpl::SeekRange skip the
+   * sorted runs without keys in the range. They are disabled if it is 0.
+   */
+  size_t range_filter_bits_per_key = 0;
   /* The target scan length in part3 */
   double target_scan_length_part3 = 0;
   /* The target alpha in part3 */
   double target_alpha_part3 = 0;
   CacheOptions cache{};
+  /**
+   * The limits of the table cache (see TableCache): the number of open
+   * SSTable files and the memory of their top-level indexes and range
+   * filters. The SSTables of L0 are pinned and not counted.
+   */
+  size_t max_open_files = 512;
+  size_t table_cache_capacity = 64 * 1024 * 1024;  // 64MiB
 };
 
 }  // namespace lsm
@@ -0,0 +1,93 @@
+#include "storage/lsm/range_del.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace wing {
+
+namespace lsm {
+
+RangeTombstoneList::RangeTombstoneList(
+    std::vector<RangeTombstone> tombstones) {
+  std::erase_if(tombstones, [](const RangeTombstone& tombstone) {
+    return tombstone.begin_ >= tombstone.end_;
+  });
+  std::sort(tombstones.begin(), tombstones.end(),
+      [](const auto& a, const auto& b) { return a.begin_ < b.begin_; });
+  std::vector<Slice> points;
+  for (auto& tombstone : tombstones) {
+    points.push_back(tombstone.begin_);
+    points.push_back(tombstone.end_);
+  }
+  std::sort(points.begin(), points.end());
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  /* The ends and the sequence numbers of the tombstones covering a point */
+  std::multimap<Slice, seq_t> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < points.size(); i++) {
+    while (next < tombstones.size() && tombstones[next].begin_ == points[i]) {
+      active.emplace(tombstones[next].end_, tombstones[next].seq_);
+      next += 1;
+    }
+    active.erase(active.begin(), active.upper_bound(points[i]));
+    if (active.empty()) {
+      continue;
+    }
+    std::vector<seq_t> seqs;
+    for (auto& [_, seq] : active) {
+      seqs.push_back(seq);
+    }
+    std::sort(seqs.begin(), seqs.end(), std::greater<>());
+    seqs.erase(std::unique(seqs.begin(), seqs.end()), seqs.end());
+    /* Merge the adjacent fragments covered by the same tombstones */
+    if (!fragments_.empty() && fragments_.back().end_ == points[i] &&
+        fragments_.back().seqs_ == seqs) {
+      fragments_.back().end_ = points[i + 1];
+      continue;
+    }
+    fragments_.push_back(
+        Fragment{std::string(points[i]), std::string(points[i + 1]), seqs});
+  }
+}
+
+seq_t RangeTombstoneList::MaxCoveringSeq(Slice user_key, seq_t seq) const {
+  auto it = std::upper_bound(fragments_.begin(), fragments_.end(), user_key,
+      [](Slice key, const Fragment& fragment) {
+        return key < fragment.begin_;
+      });
+  if (it == fragments_.begin()) {
+    return 0;
+  }
+  --it;
+  if (user_key >= it->end_) {
+    return 0;
+  }
+  auto seq_it = std::lower_bound(
+      it->seqs_.begin(), it->seqs_.end(), seq, std::greater<>());
+  return seq_it == it->seqs_.end() ? 0 : *seq_it;
+}
+
+std::vector<RangeTombstone> RangeTombstoneList::ToTombstones(
+    std::optional<Slice> lower, std::optional<Slice> upper) const {
+  std::vector<RangeTombstone> ret;
+  for (auto& fragment : fragments_) {
+    Slice begin = fragment.begin_, end = fragment.end_;
+    if (lower && begin < *lower) {
+      begin = *lower;
+    }
+    if (upper && end > *upper) {
+      end = *upper;
+    }
+    if (begin >= end) {
+      continue;
+    }
+    for (auto seq : fragment.seqs_) {
+      ret.push_back(RangeTombstone{std::string(begin), std::string(end), seq});
+    }
+  }
+  return ret;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
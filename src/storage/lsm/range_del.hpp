@@ -0,0 +1,74 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "storage/lsm/format.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * A range deletion. It deletes the records whose user keys are in
+ * [begin_, end_) and whose sequence numbers are smaller than seq_.
+ */
+struct RangeTombstone {
+  std::string begin_;
+  std::string end_;
+  seq_t seq_;
+};
+
+/**
+ * The range tombstones of a MemTable or an SSTable, split into fragments
+ * that do not overlap. Each fragment stores the sequence numbers of the
+ * tombstones covering it, so a lookup is a binary search.
+ */
+class RangeTombstoneList {
+ public:
+  RangeTombstoneList() = default;
+
+  explicit RangeTombstoneList(std::vector<RangeTombstone> tombstones);
+
+  /**
+   * The largest sequence number <= seq of the tombstones covering user_key,
+   * or 0 if there is no such tombstone.
+   */
+  seq_t MaxCoveringSeq(Slice user_key, seq_t seq) const;
+
+  /* If the record is deleted by a tombstone visible at read_seq. */
+  bool ShouldDelete(ParsedKey key, seq_t read_seq) const {
+    return MaxCoveringSeq(key.user_key_, read_seq) > key.seq_;
+  }
+
+  /**
+   * The tombstones truncated to [lower, upper). A missing bound means that
+   * the range is unbounded on that side.
+   */
+  std::vector<RangeTombstone> ToTombstones(
+      std::optional<Slice> lower = std::nullopt,
+      std::optional<Slice> upper = std::nullopt) const;
+
+  bool empty() const { return fragments_.empty(); }
+
+  /* The smallest user key covered by the tombstones. Require: !empty() */
+  Slice smallest() const { return fragments_.front().begin_; }
+
+  /* The exclusive end of the tombstones. Require: !empty() */
+  Slice largest() const { return fragments_.back().end_; }
+
+ private:
+  struct Fragment {
+    std::string begin_;
+    std::string end_;
+    /* In descending order */
+    std::vector<seq_t> seqs_;
+  };
+
+  std::vector<Fragment> fragments_;
+};
+
+}  // namespace lsm
+
+}  // namespace wing
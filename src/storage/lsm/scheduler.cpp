@@ -0,0 +1,73 @@
+#include "storage/lsm/scheduler.hpp"
+
+#include <algorithm>
+
+namespace wing {
+
+namespace lsm {
+
+BackgroundScheduler::BackgroundScheduler(size_t thread_num) {
+  thread_num = std::max<size_t>(1, thread_num);
+  for (size_t i = 0; i < thread_num; i++) {
+    threads_.emplace_back([this]() { WorkerThread(); });
+  }
+}
+
+BackgroundScheduler::~BackgroundScheduler() {
+  {
+    std::unique_lock lck(mu_);
+    stop_signal_ = true;
+    jobs_.clear();
+  }
+  cv_.notify_all();
+  finish_cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+bool BackgroundScheduler::Schedule(int priority, std::function<void()> job) {
+  {
+    std::unique_lock lck(mu_);
+    if (stop_signal_) {
+      return false;
+    }
+    jobs_.emplace(std::make_pair(priority, next_seq_++), std::move(job));
+  }
+  cv_.notify_one();
+  return true;
+}
+
+void BackgroundScheduler::WaitForAll() {
+  std::unique_lock lck(mu_);
+  finish_cv_.wait(lck, [&]() { return jobs_.empty() && running_ == 0; });
+}
+
+size_t BackgroundScheduler::GetQueueLength() {
+  std::unique_lock lck(mu_);
+  return jobs_.size();
+}
+
+void BackgroundScheduler::WorkerThread() {
+  std::unique_lock lck(mu_);
+  while (true) {
+    cv_.wait(lck, [&]() { return !jobs_.empty() || stop_signal_; });
+    if (stop_signal_) {
+      return;
+    }
+    auto job = std::move(jobs_.begin()->second);
+    jobs_.erase(jobs_.begin());
+    running_ += 1;
+    lck.unlock();
+    job();
+    lck.lock();
+    running_ -= 1;
+    if (jobs_.empty() && running_ == 0) {
+      finish_cv_.notify_all();
+    }
+  }
+}
+
+}  // namespace lsm
+
+}  // namespace wing
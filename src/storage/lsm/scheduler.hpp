@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * A pool of background threads which runs flushes and compactions.
+ *
+ * Jobs with smaller priority values run first, and jobs with the same
+ * priority run in FIFO order.
+ */
+class BackgroundScheduler {
+ public:
+  /* Flushes run before any compaction. */
+  static constexpr int kFlushPriority = 0;
+
+  /* Compactions from upper levels run before those from deeper levels. */
+  static int CompactionPriority(int src_level) { return 1 + src_level; }
+
+  BackgroundScheduler(size_t thread_num);
+
+  /* It waits for the running jobs, and discards the queued ones. */
+  ~BackgroundScheduler();
+
+  BackgroundScheduler(const BackgroundScheduler&) = delete;
+  BackgroundScheduler& operator=(const BackgroundScheduler&) = delete;
+
+  /**
+   * Queue the job. It returns false and drops the job if the scheduler is
+   * being destroyed, so the caller can undo what it did for the job.
+   */
+  bool Schedule(int priority, std::function<void()> job);
+
+  /* Wait until there are no queued or running jobs. */
+  void WaitForAll();
+
+  size_t GetQueueLength();
+
+ private:
+  void WorkerThread();
+
+  std::vector<std::thread> threads_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::condition_variable finish_cv_;
+  /* (priority, sequence number) -> job */
+  std::map<std::pair<int, size_t>, std::function<void()>> jobs_;
+  size_t next_seq_{0};
+  size_t running_{0};
+  bool stop_signal_{false};
+};
+
+}  // namespace lsm
+
+}  // namespace wing
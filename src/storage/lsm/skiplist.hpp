@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <random>
+#include <type_traits>
+
+#include "common/allocator.hpp"
+#include "common/logging.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * A skiplist whose nodes are allocated in an ArenaAllocator.
+ *
+ * Writes require external synchronization, i.e. there is at most one writer
+ * at the same time. Readers do not need any lock, and they can run
+ * concurrently with the writer. Nodes are never deleted until the skiplist is
+ * destroyed, and a key is not modified after it is inserted.
+ *
+ * Compare(a, b) returns a std::strong_ordering.
+ */
+template <typename Key, typename Compare>
+class SkipList {
+  static_assert(std::is_trivially_destructible_v<Key>,
+      "Keys in the arena are never destroyed.");
+
+  struct Node;
+
+ public:
+  SkipList(Compare cmp, ArenaAllocator* alloc)
+    : cmp_(cmp), alloc_(alloc), head_(NewNode(Key(), kMaxHeight)) {}
+
+  SkipList(const SkipList&) = delete;
+  SkipList& operator=(const SkipList&) = delete;
+
+  /**
+   * Insert the key. Return false if an equal key exists.
+   * REQUIRES: no concurrent Insert.
+   */
+  bool Insert(const Key& key) {
+    Node* prev[kMaxHeight];
+    Node* x = FindGreaterOrEqual(key, prev);
+    if (x != nullptr && cmp_(x->key, key) == 0) {
+      return false;
+    }
+    int height = RandomHeight();
+    int max_height = max_height_.load(std::memory_order_relaxed);
+    if (height > max_height) {
+      for (int i = max_height; i < height; i++) {
+        prev[i] = head_;
+      }
+      /**
+       * Readers that see the new height before the new node is linked
+       * simply go down from head_, whose next pointers are null.
+       */
+      max_height_.store(height, std::memory_order_relaxed);
+    }
+    x = NewNode(key, height);
+    for (int i = 0; i < height; i++) {
+      x->SetNextRelaxed(i, prev[i]->NextRelaxed(i));
+      /* Publish the node after it is fully initialized. */
+      prev[i]->SetNext(i, x);
+    }
+    return true;
+  }
+
+  class Iterator {
+   public:
+    Iterator() = default;
+
+    Iterator(const SkipList* list) : list_(list) {}
+
+    bool Valid() const { return node_ != nullptr; }
+
+    const Key& key() const { return node_->key; }
+
+    void Next() { node_ = node_->Next(0); }
+
+    /* Move to the first key >= target */
+    void Seek(const Key& target) {
+      node_ = list_->FindGreaterOrEqual(target, nullptr);
+    }
+
+    void SeekToFirst() { node_ = list_->head_->Next(0); }
+
+   private:
+    const SkipList* list_{nullptr};
+    Node* node_{nullptr};
+  };
+
+ private:
+  static constexpr int kMaxHeight = 12;
+  static constexpr int kBranching = 4;
+
+  struct Node {
+    Node(const Key& k) : key(k) {}
+
+    Node* Next(int level) const {
+      return next_[level].load(std::memory_order_acquire);
+    }
+
+    void SetNext(int level, Node* x) {
+      next_[level].store(x, std::memory_order_release);
+    }
+
+    Node* NextRelaxed(int level) const {
+      return next_[level].load(std::memory_order_relaxed);
+    }
+
+    void SetNextRelaxed(int level, Node* x) {
+      next_[level].store(x, std::memory_order_relaxed);
+    }
+
+    const Key key;
+    /* The array has the length of the height of the node. */
+    std::atomic<Node*> next_[1];
+  };
+
+  Node* NewNode(const Key& key, int height) {
+    auto ptr = alloc_->AllocateAligned(
+        sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1),
+        alignof(Node));
+    auto node = new (ptr) Node(key);
+    for (int i = 0; i < height; i++) {
+      new (&node->next_[i]) std::atomic<Node*>(nullptr);
+    }
+    return node;
+  }
+
+  int RandomHeight() {
+    int height = 1;
+    while (height < kMaxHeight && rgen_() % kBranching == 0) {
+      height++;
+    }
+    return height;
+  }
+
+  /**
+   * Return the first node whose key >= key, or nullptr if there is no such
+   * node. If prev is not null, prev[i] is set to the last node whose key <
+   * key in level i.
+   */
+  Node* FindGreaterOrEqual(const Key& key, Node** prev) const {
+    Node* x = head_;
+    int level = max_height_.load(std::memory_order_relaxed) - 1;
+    while (true) {
+      Node* next = x->Next(level);
+      if (next != nullptr && cmp_(next->key, key) < 0) {
+        x = next;
+      } else {
+        if (prev != nullptr) {
+          prev[level] = x;
+        }
+        if (level == 0) {
+          return next;
+        }
+        level--;
+      }
+    }
+  }
+
+  Compare cmp_;
+  ArenaAllocator* alloc_;
+  Node* const head_;
+  std::atomic<int> max_height_{1};
+  /* Only used by the writer */
+  std::minstd_rand rgen_{0x202404021044};
+};
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "storage/lsm/common.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * A sequence number pinned by DBImpl::GetSnapshot. Reads at the snapshot see
+ * the records with sequence numbers <= GetSeq(), and compactions keep them
+ * until the snapshot is released.
+ */
+class Snapshot {
+ public:
+  explicit Snapshot(seq_t seq) : seq_(seq) {}
+
+  seq_t GetSeq() const { return seq_; }
+
+ private:
+  seq_t seq_;
+};
+
+/* The live snapshots of a database. It is thread-safe. */
+class SnapshotList {
+ public:
+  const Snapshot* New(seq_t seq) {
+    auto snapshot = std::make_unique<Snapshot>(seq);
+    auto ret = snapshot.get();
+    std::unique_lock lck(mu_);
+    snapshots_.emplace(ret, std::move(snapshot));
+    seqs_.insert(seq);
+    return ret;
+  }
+
+  void Release(const Snapshot* snapshot) {
+    std::unique_lock lck(mu_);
+    auto it = snapshots_.find(snapshot);
+    if (it == snapshots_.end()) {
+      return;
+    }
+    seqs_.erase(seqs_.find(snapshot->GetSeq()));
+    snapshots_.erase(it);
+  }
+
+  /* The distinct sequence numbers of the live snapshots in ascending order. */
+  std::vector<seq_t> GetSeqs() const {
+    std::unique_lock lck(mu_);
+    std::vector<seq_t> ret;
+    for (auto seq : seqs_) {
+      if (ret.empty() || ret.back() != seq) {
+        ret.push_back(seq);
+      }
+    }
+    return ret;
+  }
+
+  bool empty() const {
+    std::unique_lock lck(mu_);
+    return snapshots_.empty();
+  }
+
+ private:
+  mutable std::mutex mu_;
+  std::unordered_map<const Snapshot*, std::unique_ptr<Snapshot>> snapshots_;
+  std::multiset<seq_t> seqs_;
+};
+
+}  // namespace lsm
+
+}  // namespace wing
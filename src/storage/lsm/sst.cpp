@@ -6,54 +6,913 @@
 #include <unistd.h>
 
 #include <fstream>
+#include <limits>
+#include <thread>
 
 #include "common/bloomfilter.hpp"
+#include "common/exception.hpp"
+#include "common/rangefilter.hpp"
+#include "common/serializer.hpp"
 
 namespace wing {
 
 namespace lsm {
 
-SSTable::SSTable(SSTInfo sst_info, size_t block_size, bool use_direct_io)
-  : sst_info_(std::move(sst_info)), block_size_(block_size) {
-  DB_ERR("Not implemented!");
+/**
+ * The number of levels of the range filters. A range that spans at most
+ * 2^15 key prefixes is probed with a few intervals.
+ */
+static constexpr size_t kRangeFilterLevels = 16;
+
+static void PutHandle(std::string* dst, BlockHandle handle) {
+  dst->append(reinterpret_cast<const char*>(&handle), sizeof(BlockHandle));
+}
+
+static void PutKey(std::string* dst, Slice key) {
+  offset_t size = key.size();
+  dst->append(reinterpret_cast<const char*>(&size), sizeof(offset_t));
+  dst->append(key);
+}
+
+static BlockHandle DecodeHandle(Slice value) {
+  return utils::Deserializer(value.data()).Read<BlockHandle>();
+}
+
+static void PutRangeTombstone(
+    std::string* dst, const RangeTombstone& tombstone) {
+  PutKey(dst, tombstone.begin_);
+  PutKey(dst, tombstone.end_);
+  dst->append(reinterpret_cast<const char*>(&tombstone.seq_), sizeof(seq_t));
+}
+
+static std::vector<RangeTombstone> DecodeRangeTombstones(Slice block) {
+  std::vector<RangeTombstone> ret;
+  utils::Deserializer des(block.data());
+  while (des.data() < block.data() + block.size()) {
+    RangeTombstone tombstone;
+    tombstone.begin_ = des.ReadString(des.Read<offset_t>());
+    tombstone.end_ = des.ReadString(des.Read<offset_t>());
+    tombstone.seq_ = des.Read<seq_t>();
+    ret.push_back(std::move(tombstone));
+  }
+  return ret;
+}
+
+/* The smallest internal key of user_key */
+static InternalKey FirstKeyOf(Slice user_key) {
+  return InternalKey(user_key, std::numeric_limits<seq_t>::max(),
+      RecordType::RangeDeletion);
+}
+
+/* The handle used by BlockIterator for the decompressed contents. */
+static BlockHandle ContentsHandle(Slice contents, BlockHandle handle) {
+  return BlockHandle{handle.offset_, static_cast<offset_t>(contents.size()),
+      handle.count_};
+}
+
+/**
+ * The read of the block into buf. O_DIRECT requires aligned offsets and
+ * sizes, so it may read more than the block.
+ */
+static ReadRequest PrepareRead(
+    ReadFile* file, BlockHandle handle, AlignedBuffer* buf) {
+  static constexpr size_t kAlignment = 4096;
+  size_t begin = handle.offset_, end = handle.offset_ + handle.size_;
+  if (file->use_direct_io()) {
+    begin = begin / kAlignment * kAlignment;
+    end = (end + kAlignment - 1) / kAlignment * kAlignment;
+  }
+  size_t buf_size = (end - begin + kAlignment - 1) / kAlignment * kAlignment;
+  if (buf->size() < buf_size) {
+    *buf = AlignedBuffer(buf_size, kAlignment);
+  }
+  return ReadRequest{file, buf->data(), end - begin,
+      static_cast<offset_t>(begin)};
+}
+
+/**
+ * Verify and decompress the block read by request.
+ * The returned contents point to the buffer of request or contents.
+ */
+static Slice FinishRead(const ReadRequest& request, BlockHandle handle,
+    bool verify_checksum, std::string* contents) {
+  if (request.result_ <
+      static_cast<ssize_t>(handle.offset_ + handle.size_ - request.offset_)) {
+    throw DBException("Corrupted SSTable: short read at offset {}, size {}",
+        handle.offset_, handle.size_);
+  }
+  return UncompressBlock(
+      Slice(request.data_ + handle.offset_ - request.offset_, handle.size_),
+      contents, verify_checksum);
+}
+
+/**
+ * Read the block from the file, then verify and decompress it.
+ * The returned contents point to buf or contents.
+ */
+static Slice ReadBlockContents(ReadFile* file, BlockHandle handle,
+    bool verify_checksum, AlignedBuffer* buf, std::string* contents) {
+  auto request = PrepareRead(file, handle, buf);
+  request.result_ = file->Read(request.data_, request.size_, request.offset_);
+  return FinishRead(request, handle, verify_checksum, contents);
+}
+
+SSTable::SSTable(SSTInfo sst_info, size_t block_size, bool use_direct_io,
+    bool verify_checksums, Cache* cache, AsyncReader* reader,
+    size_t max_readahead_size, BlobStore* blobs, TableCache* table_cache)
+  : sst_info_(std::move(sst_info)),
+    use_direct_io_(use_direct_io),
+    table_cache_(table_cache),
+    block_size_(block_size),
+    verify_checksums_(verify_checksums),
+    cache_(cache),
+    reader_(reader),
+    max_readahead_size_(max_readahead_size) {
+  if (sst_info_.format_version_ != kBlockFormatVersion) {
+    throw DBException("SSTable {} has format version {}, expected {}",
+        sst_info_.filename_, sst_info_.format_version_, kBlockFormatVersion);
+  }
+  if (cache_ == nullptr) {
+    own_cache_ = std::make_unique<Cache>(CacheOptions());
+    cache_ = own_cache_.get();
+  }
+  cache_id_ = cache_->NewId();
+  BlockHandle range_dels;
+  auto table = OpenReader(&range_dels, &smallest_key_, &largest_key_);
+  if (range_dels.size_ > 0) {
+    AlignedBuffer buf;
+    std::string contents;
+    Slice block = ReadBlockContents(table->file_.get(), range_dels,
+        verify_checksums_, &buf, &contents);
+    range_dels_ = RangeTombstoneList(DecodeRangeTombstones(block));
+  }
+  if (table->partitions_.empty() && range_dels_.empty()) {
+    throw DBException("SSTable {} has no data block", sst_info_.filename_);
+  }
+  if (!sst_info_.blob_files_.empty() && blobs == nullptr) {
+    throw DBException("SSTable {} refers to blob files", sst_info_.filename_);
+  }
+  for (auto id : sst_info_.blob_files_) {
+    blob_files_.push_back(blobs->GetFile(id));
+    blob_files_.back()->AddReference();
+  }
+  if (table_cache_ == nullptr) {
+    pinned_ = std::move(table);
+    pinned_reader_ = pinned_.get();
+  } else {
+    table_cache_->Insert(cache_id_, std::move(table));
+  }
 }
 
 SSTable::~SSTable() {
+  /* Close the file */
+  if (table_cache_ != nullptr) {
+    table_cache_->Erase(cache_id_);
+  }
+  pinned_.reset();
   if (remove_tag_) {
-    file_.reset();
     std::filesystem::remove(sst_info_.filename_);
+    for (auto& blob_file : blob_files_) {
+      blob_file->RemoveReference();
+    }
+  }
+}
+
+std::shared_ptr<const TableReader> SSTable::OpenReader(BlockHandle* range_dels,
+    InternalKey* smallest_key, InternalKey* largest_key) const {
+  auto table = std::make_shared<TableReader>();
+  table->file_ =
+      std::make_unique<ReadFile>(sst_info_.filename_, use_direct_io_);
+  AlignedBuffer buf;
+  std::string contents;
+  BlockHandle handle{static_cast<offset_t>(sst_info_.index_offset_),
+      static_cast<offset_t>(sst_info_.size_ - sst_info_.index_offset_), 0};
+  Slice index = ReadBlockContents(
+      table->file_.get(), handle, verify_checksums_, &buf, &contents);
+  utils::Deserializer des(index.data());
+  auto read_key = [&]() {
+    auto size = des.Read<offset_t>();
+    return des.ReadString(size);
+  };
+  auto range_dels_handle = des.Read<BlockHandle>();
+  auto range_filter = des.Read<BlockHandle>();
+  auto smallest = read_key();
+  auto largest = read_key();
+  if (range_dels != nullptr) {
+    *range_dels = range_dels_handle;
+    *smallest_key = smallest;
+    *largest_key = largest;
+  }
+  while (des.data() < index.data() + index.size()) {
+    IndexPartition partition;
+    partition.key_ = read_key();
+    partition.index_ = des.Read<BlockHandle>();
+    partition.filter_ = des.Read<BlockHandle>();
+    partition.data_size_ = des.Read<offset_t>();
+    table->partitions_.push_back(std::move(partition));
+  }
+  if (range_filter.size_ > 0) {
+    table->range_filter_ = ReadBlockContents(table->file_.get(),
+        range_filter, verify_checksums_, &buf, &contents);
+  }
+  return table;
+}
+
+std::shared_ptr<const TableReader> SSTable::Open() const {
+  {
+    std::unique_lock lck(pin_mutex_);
+    if (pinned_) {
+      return pinned_;
+    }
+  }
+  return table_cache_->Get(
+      cache_id_, [this]() { return OpenReader(nullptr, nullptr, nullptr); });
+}
+
+void SSTable::SetPinned(bool pinned) {
+  if (table_cache_ == nullptr) {
+    return;
+  }
+  /* It keeps the unpinned reader alive for the lookups using it */
+  std::shared_ptr<const TableReader> unpinned;
+  {
+    std::unique_lock lck(pin_mutex_);
+    if (pinned == (pinned_ != nullptr)) {
+      return;
+    }
+    if (pinned) {
+      pinned_ = table_cache_->Get(cache_id_,
+          [this]() { return OpenReader(nullptr, nullptr, nullptr); });
+      table_cache_->Erase(cache_id_);
+      pinned_reader_ = pinned_.get();
+      return;
+    }
+    pinned_reader_ = nullptr;
+    unpinned = pinned_;
+    table_cache_->Insert(cache_id_, std::move(pinned_));
+    pinned_.reset();
+  }
+  /* The table cache may drop the reader, but the lookups that loaded
+   * pinned_reader_ before it was cleared still use it. The lock is not held,
+   * since they may call Open(). */
+  while (pinned_users_ > 0) {
+    std::this_thread::yield();
+  }
+}
+
+SSTable::ReaderRef::ReaderRef(const SSTable* sst) {
+  /* Either SetPinned(false) sees the new user, or the cleared reader is
+   * seen here (both are sequentially consistent) */
+  sst->pinned_users_ += 1;
+  table_ = sst->pinned_reader_;
+  if (table_ != nullptr) {
+    pinned_sst_ = sst;
+    return;
+  }
+  sst->pinned_users_ -= 1;
+  holder_ = sst->Open();
+  table_ = holder_.get();
+}
+
+SSTable::ReaderRef::~ReaderRef() {
+  if (pinned_sst_ != nullptr) {
+    pinned_sst_->pinned_users_ -= 1;
+  }
+}
+
+void SSTable::ReadBlob(Slice index, std::string* value) const {
+  auto blob_index = BlobIndex::Decode(index);
+  for (auto& blob_file : blob_files_) {
+    if (blob_file->id() == blob_index.file_id_) {
+      blob_file->Read(blob_index, value);
+      return;
+    }
+  }
+  throw DBException("SSTable {} does not refer to blob file {}",
+      sst_info_.filename_, blob_index.file_id_);
+}
+
+bool SSTable::VerifyChecksums() const {
+  auto table = Open();
+  auto file = table->file_.get();
+  AlignedBuffer buf;
+  std::string contents, index;
+  BlockHandle handle{static_cast<offset_t>(sst_info_.index_offset_),
+      static_cast<offset_t>(sst_info_.size_ - sst_info_.index_offset_), 0};
+  try {
+    Slice top = ReadBlockContents(file, handle, true, &buf, &contents);
+    /* The range tombstones and the range filter. The handles are decoded
+     * first, because reading a block overwrites top. */
+    BlockHandle handles[2];
+    for (size_t i = 0; i < 2; i++) {
+      handles[i] = DecodeHandle(top.substr(i * sizeof(BlockHandle)));
+    }
+    for (auto h : handles) {
+      handle = h;
+      if (handle.size_ > 0) {
+        ReadBlockContents(file, handle, true, &buf, &contents);
+      }
+    }
+    for (auto& partition : table->partitions_) {
+      if (partition.filter_.size_ > 0) {
+        handle = partition.filter_;
+        ReadBlockContents(file, handle, true, &buf, &contents);
+      }
+      handle = partition.index_;
+      index = ReadBlockContents(file, handle, true, &buf, &contents);
+      BlockIterator it(index.data(), ContentsHandle(index, handle));
+      for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        handle = DecodeHandle(it.value());
+        ReadBlockContents(file, handle, true, &buf, &contents);
+      }
+    }
+  } catch (const DBException& e) {
+    DB_INFO("{}: {} at offset {}", sst_info_.filename_, e.what(),
+        handle.offset_);
+    return false;
+  }
+  return true;
+}
+
+bool SSTable::RangeMayMatch(Slice lower, Slice upper) const {
+  if (upper < smallest_key_.user_key() || lower > largest_key_.user_key()) {
+    return false;
+  }
+  if (!range_dels_.empty()) {
+    return true;
+  }
+  auto table = Open();
+  if (table->range_filter_.empty()) {
+    return true;
+  }
+  return utils::RangeFilter::MayContain(utils::RangeFilter::KeyPrefix(lower),
+      utils::RangeFilter::KeyPrefix(upper), table->range_filter_);
+}
+
+size_t SSTable::FindPartition(
+    const std::vector<IndexPartition>& partitions, Slice key, seq_t seq) {
+  ParsedKey target(key, seq, RecordType::Value);
+  auto it = std::partition_point(partitions.begin(), partitions.end(),
+      [&](const IndexPartition& partition) {
+        return ParsedKey(partition.key_) < target;
+      });
+  return it - partitions.begin();
+}
+
+Cache::Handle SSTable::ReadBlock(const TableReader& table, BlockHandle handle,
+    Cache::Priority priority) {
+  auto cached = cache_->get(cache_id_, handle);
+  if (cached) {
+    return std::move(*cached);
+  }
+  AlignedBuffer buf;
+  std::string contents;
+  Slice block = ReadBlockContents(
+      table.file_.get(), handle, verify_checksums_, &buf, &contents);
+  if (block.data() != contents.data()) {
+    contents.assign(block);
+  }
+  return cache_->insert(
+      cache_id_, handle, std::move(contents), priority);
+}
+
+std::vector<Cache::Handle> SSTable::ReadBlocks(const TableReader& table,
+    std::span<const BlockHandle> handles, Cache::Priority priority) {
+  std::vector<std::optional<Cache::Handle>> blocks(handles.size());
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < handles.size(); i++) {
+    blocks[i] = cache_->get(cache_id_, handles[i]);
+    if (!blocks[i]) {
+      misses.push_back(i);
+    }
+  }
+  if (reader_ != nullptr && misses.size() > 1) {
+    std::vector<AlignedBuffer> bufs(misses.size());
+    std::vector<ReadRequest> requests;
+    for (size_t j = 0; j < misses.size(); j++) {
+      requests.push_back(
+          PrepareRead(table.file_.get(), handles[misses[j]], &bufs[j]));
+    }
+    reader_->ReadBatch(requests);
+    for (size_t j = 0; j < misses.size(); j++) {
+      auto handle = handles[misses[j]];
+      std::string contents;
+      Slice block =
+          FinishRead(requests[j], handle, verify_checksums_, &contents);
+      if (block.data() != contents.data()) {
+        contents.assign(block);
+      }
+      blocks[misses[j]] = cache_->insert(
+          cache_id_, handle, std::move(contents), priority);
+    }
+  } else {
+    for (auto i : misses) {
+      blocks[i] = ReadBlock(table, handles[i], priority);
+    }
+  }
+  std::vector<Cache::Handle> ret;
+  ret.reserve(blocks.size());
+  for (auto& block : blocks) {
+    ret.push_back(std::move(*block));
+  }
+  return ret;
+}
+
+GetResult SSTable::Get(Slice key, uint64_t seq, std::string* value,
+    std::vector<std::string>* operands) {
+  seq_t found_seq = 0;
+  /* The filter rejects most absent keys before any tombstone is looked up */
+  auto result = GetRecord(*ReaderRef(this), key, seq, value, &found_seq);
+  if (range_dels_.empty()) {
+    /* Only merge operands are found */
+    if (result == GetResult::kNotFound && found_seq > 0) {
+      return GetMergeOperands(key, seq, 0, value, operands);
+    }
+    return result;
+  }
+  auto covering_seq = range_dels_.MaxCoveringSeq(key, seq);
+  if (covering_seq > found_seq) {
+    return GetResult::kDelete;
+  }
+  if (result == GetResult::kNotFound && found_seq > 0) {
+    return GetMergeOperands(key, seq, covering_seq, value, operands);
+  }
+  return result;
+}
+
+GetResult SSTable::GetMergeOperands(Slice key, uint64_t seq,
+    seq_t covering_seq, std::string* value,
+    std::vector<std::string>* operands) {
+  if (operands == nullptr) {
+    throw DBException("Merge operand of key {} is not expected", key);
+  }
+  for (auto it = Seek(key, seq); it.Valid(); it.Next()) {
+    ParsedKey found(it.key());
+    if (found.user_key_ != key) {
+      break;
+    }
+    if (covering_seq > found.seq_) {
+      return GetResult::kDelete;
+    }
+    switch (found.type_) {
+      case RecordType::Merge:
+        operands->emplace_back(it.value());
+        continue;
+      case RecordType::Deletion:
+        return GetResult::kDelete;
+      case RecordType::BlobIndex:
+        ReadBlob(it.value(), value);
+        return GetResult::kFound;
+      default:
+        value->assign(it.value());
+        return GetResult::kFound;
+    }
+  }
+  return covering_seq > 0 ? GetResult::kDelete : GetResult::kNotFound;
+}
+
+GetResult SSTable::GetRecord(const TableReader& table, Slice key,
+    uint64_t seq, std::string* value, seq_t* found_seq) {
+  size_t id = FindPartition(table.partitions_, key, seq);
+  if (id == table.partitions_.size()) {
+    return GetResult::kNotFound;
+  }
+  auto& partition = table.partitions_[id];
+  if (partition.filter_.size_ > 0) {
+    auto filter = ReadBlock(table, partition.filter_, Cache::Priority::kHigh);
+    if (!FilterMayMatch(
+            filter.block(), utils::BloomFilter::BloomHash(key))) {
+      return GetResult::kNotFound;
+    }
+  }
+  BlockHandle handle;
+  {
+    auto index = ReadBlock(table, partition.index_, Cache::Priority::kHigh);
+    BlockIterator index_it(
+        index.block().data(), ContentsHandle(index.block(), partition.index_));
+    index_it.Seek(key, seq);
+    if (!index_it.Valid()) {
+      return GetResult::kNotFound;
+    }
+    handle = DecodeHandle(index_it.value());
+  }
+  auto block = ReadBlock(table, handle, Cache::Priority::kLow);
+  BlockIterator it(block.block().data(), ContentsHandle(block.block(), handle));
+  it.Seek(key, seq);
+  if (!it.Valid()) {
+    return GetResult::kNotFound;
   }
+  ParsedKey found(it.key());
+  if (found.user_key_ != key) {
+    return GetResult::kNotFound;
+  }
+  *found_seq = found.seq_;
+  if (found.type_ == RecordType::Deletion) {
+    return GetResult::kDelete;
+  }
+  if (found.type_ == RecordType::Merge) {
+    return GetResult::kNotFound;
+  }
+  if (found.type_ == RecordType::BlobIndex) {
+    ReadBlob(it.value(), value);
+  } else {
+    value->assign(it.value());
+  }
+  return GetResult::kFound;
 }
 
-GetResult SSTable::Get(Slice key, uint64_t seq, std::string* value) {
-  DB_ERR("Not implemented!");
+void SSTable::MultiGet(std::span<KeyContext*> keys, uint64_t seq) {
+  /* One reader for all the keys */
+  ReaderRef table(this);
+  /* The sequence numbers of the records found */
+  std::vector<seq_t> found_seqs(keys.size(), 0);
+  /* The keys that may be in the SSTable, and their data blocks */
+  std::vector<std::pair<size_t, BlockHandle>> probes;
+  size_t i = 0;
+  while (i < keys.size()) {
+    size_t id = FindPartition(table->partitions_, keys[i]->key_, seq);
+    if (id == table->partitions_.size()) {
+      /* The remaining keys are larger than the largest key */
+      break;
+    }
+    auto& partition = table->partitions_[id];
+    ParsedKey largest(partition.key_);
+    size_t end = i + 1;
+    while (end < keys.size() &&
+           ParsedKey(keys[end]->key_, seq, RecordType::Value) <= largest) {
+      end += 1;
+    }
+    std::optional<Cache::Handle> filter;
+    if (partition.filter_.size_ > 0) {
+      filter = ReadBlock(*table, partition.filter_, Cache::Priority::kHigh);
+    }
+    std::optional<Cache::Handle> index;
+    BlockIterator index_it;
+    for (; i < end; i++) {
+      if (filter && !FilterMayMatch(filter->block(),
+                        utils::BloomFilter::BloomHash(keys[i]->key_))) {
+        continue;
+      }
+      if (!index) {
+        index = ReadBlock(*table, partition.index_, Cache::Priority::kHigh);
+        index_it = BlockIterator(index->block().data(),
+            ContentsHandle(index->block(), partition.index_));
+      }
+      index_it.Seek(keys[i]->key_, seq);
+      if (index_it.Valid()) {
+        probes.emplace_back(i, DecodeHandle(index_it.value()));
+      }
+    }
+  }
+  /* The probes are sorted by their blocks. Read each block once. */
+  std::vector<BlockHandle> blocks;
+  for (auto& [_, block] : probes) {
+    if (blocks.empty() || blocks.back().offset_ != block.offset_) {
+      blocks.push_back(block);
+    }
+  }
+  auto handles = ReadBlocks(*table, blocks, Cache::Priority::kLow);
+  size_t j = 0;
+  for (auto& [i, block] : probes) {
+    auto key = keys[i];
+    while (blocks[j].offset_ != block.offset_) {
+      j += 1;
+    }
+    Slice contents = handles[j].block();
+    BlockIterator it(contents.data(), ContentsHandle(contents, block));
+    it.Seek(key->key_, seq);
+    if (!it.Valid()) {
+      continue;
+    }
+    ParsedKey found(it.key());
+    if (found.user_key_ != key->key_) {
+      continue;
+    }
+    found_seqs[i] = found.seq_;
+    if (found.type_ == RecordType::Deletion) {
+      key->result_ = GetResult::kDelete;
+    } else if (found.type_ == RecordType::Merge) {
+      auto covering_seq = range_dels_.MaxCoveringSeq(key->key_, seq);
+      if (covering_seq <= found.seq_) {
+        key->result_ = GetMergeOperands(key->key_, seq, covering_seq,
+            &key->value_, &key->operands_);
+      }
+    } else {
+      key->result_ = GetResult::kFound;
+      if (found.type_ == RecordType::BlobIndex) {
+        ReadBlob(it.value(), &key->value_);
+      } else {
+        key->value_.assign(it.value());
+      }
+    }
+  }
+  if (!range_dels_.empty()) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (range_dels_.MaxCoveringSeq(keys[i]->key_, seq) > found_seqs[i]) {
+        keys[i]->result_ = GetResult::kDelete;
+      }
+    }
+  }
 }
 
 SSTableIterator SSTable::Seek(Slice key, uint64_t seq) {
-  DB_ERR("Not implemented!");
+  SSTableIterator it(this);
+  it.Seek(key, seq);
+  return it;
+}
+
+SSTableIterator SSTable::Begin() {
+  SSTableIterator it(this);
+  it.SeekToFirst();
+  return it;
 }
 
-SSTableIterator SSTable::Begin() { DB_ERR("Not implemented!"); }
+bool SSTableIterator::LoadPartition() {
+  block_it_ = BlockIterator();
+  index_it_ = BlockIterator();
+  data_block_.reset();
+  index_block_.reset();
+  if (partition_id_ >= table_->partitions_.size()) {
+    return false;
+  }
+  auto handle = table_->partitions_[partition_id_].index_;
+  index_block_ = sst_->ReadBlock(*table_, handle, Cache::Priority::kHigh);
+  Slice index = index_block_->block();
+  index_it_ = BlockIterator(index.data(), ContentsHandle(index, handle));
+  return true;
+}
+
+void SSTableIterator::LoadDataBlock(bool sequential) {
+  block_it_ = BlockIterator();
+  data_block_.reset();
+  auto handle = DecodeHandle(index_it_.value());
+  if (!sequential || sst_->max_readahead_size_ == 0) {
+    readahead_size_ = 0;
+    data_block_ = sst_->ReadBlock(*table_, handle, Cache::Priority::kLow);
+    Slice block = data_block_->block();
+    block_it_ = BlockIterator(block.data(), ContentsHandle(block, handle));
+    return;
+  }
+  if (handle.offset_ < readahead_begin_ ||
+      handle.offset_ + handle.size_ > readahead_end_) {
+    data_block_ = sst_->cache_->get(sst_->cache_id_, handle);
+    if (data_block_) {
+      Slice block = data_block_->block();
+      block_it_ = BlockIterator(block.data(), ContentsHandle(block, handle));
+      return;
+    }
+    Readahead(handle);
+  }
+  Slice block = UncompressBlock(
+      Slice(readahead_buf_.data() + handle.offset_ - readahead_begin_,
+          handle.size_),
+      &block_contents_, sst_->verify_checksums_);
+  block_it_ = BlockIterator(block.data(), ContentsHandle(block, handle));
+}
+
+void SSTableIterator::Readahead(BlockHandle handle) {
+  size_t size =
+      readahead_size_ == 0 ? 2 * sst_->block_size_ : 2 * readahead_size_;
+  readahead_size_ = std::min(size, sst_->max_readahead_size_);
+  /* The data blocks end at the filter partitions */
+  size_t end = std::min<size_t>(
+      handle.offset_ + readahead_size_, sst_->sst_info_.bloom_filter_offset_);
+  end = std::max<size_t>(end, handle.offset_ + handle.size_);
+  BlockHandle range{handle.offset_,
+      static_cast<offset_t>(end - handle.offset_), 0};
+  auto request = PrepareRead(table_->file_.get(), range, &readahead_buf_);
+  request.result_ = table_->file_->Read(
+      request.data_, request.size_, request.offset_);
+  if (request.result_ <
+      static_cast<ssize_t>(handle.offset_ + handle.size_ - request.offset_)) {
+    throw DBException("Corrupted SSTable: short read at offset {}, size {}",
+        handle.offset_, handle.size_);
+  }
+  readahead_begin_ = request.offset_;
+  readahead_end_ = request.offset_ + request.result_;
+}
+
+void SSTableIterator::NextBlock() {
+  index_it_.Next();
+  while (!index_it_.Valid()) {
+    partition_id_ += 1;
+    if (!LoadPartition()) {
+      return;
+    }
+    index_it_.SeekToFirst();
+  }
+  LoadDataBlock(true);
+  block_it_.SeekToFirst();
+}
 
 void SSTableIterator::Seek(Slice key, uint64_t seq) {
-  DB_ERR("Not implemented!");
+  partition_id_ = SSTable::FindPartition(table_->partitions_, key, seq);
+  if (!LoadPartition()) {
+    return;
+  }
+  index_it_.Seek(key, seq);
+  if (!index_it_.Valid()) {
+    /* It does not happen unless the partition is corrupted. */
+    NextBlock();
+    return;
+  }
+  LoadDataBlock();
+  block_it_.Seek(key, seq);
+  if (!block_it_.Valid()) {
+    NextBlock();
+  }
 }
 
-void SSTableIterator::SeekToFirst() { DB_ERR("Not implemented!"); }
+void SSTableIterator::SeekToFirst() {
+  partition_id_ = 0;
+  if (!LoadPartition()) {
+    return;
+  }
+  index_it_.SeekToFirst();
+  LoadDataBlock();
+  block_it_.SeekToFirst();
+}
 
-bool SSTableIterator::Valid() { DB_ERR("Not implemented!"); }
+bool SSTableIterator::Valid() {
+  return sst_ != nullptr && partition_id_ < table_->partitions_.size() &&
+         block_it_.Valid();
+}
 
-Slice SSTableIterator::key() const { DB_ERR("Not implemented!"); }
+Slice SSTableIterator::key() const { return block_it_.key(); }
 
-Slice SSTableIterator::value() const { DB_ERR("Not implemented!"); }
+Slice SSTableIterator::value() const { return block_it_.value(); }
 
-void SSTableIterator::Next() { DB_ERR("Not implemented!"); }
+void SSTableIterator::Next() {
+  block_it_.Next();
+  if (!block_it_.Valid()) {
+    NextBlock();
+  }
+}
 
 void SSTableBuilder::Append(ParsedKey key, Slice value) {
-  DB_ERR("Not implemented!");
+  if (blob_builder_ != nullptr) {
+    if (key.type_ == RecordType::Value && min_blob_size_ > 0 &&
+        value.size() >= min_blob_size_) {
+      blob_value_ = blob_builder_->Add(key.user_key_, value).Encode();
+      key.type_ = RecordType::BlobIndex;
+      value = blob_value_;
+    } else if (key.type_ == RecordType::BlobIndex &&
+               BlobIndex::Decode(value).file_id_ < relocate_before_) {
+      blob_builder_->store()->Get(BlobIndex::Decode(value), &blob_value_);
+      blob_value_ = blob_builder_->Add(key.user_key_, blob_value_).Encode();
+      value = blob_value_;
+    }
+  }
+  if (key.type_ == RecordType::BlobIndex) {
+    blob_files_.insert(BlobIndex::Decode(value).file_id_);
+  }
+  if (count_ == 0) {
+    smallest_key_ = InternalKey(key);
+  }
+  if (!block_builder_.Append(key, value)) {
+    FinishDataBlock();
+    block_builder_.Append(key, value);
+  }
+  largest_key_ = InternalKey(key);
+  count_ += 1;
+  if (key.type_ == RecordType::Deletion) {
+    num_deletions_ += 1;
+  }
+  if (bloom_bits_per_key_ > 0) {
+    key_hashes_.push_back(utils::BloomFilter::BloomHash(key.user_key_));
+  }
+  if (range_filter_bits_per_key_ > 0) {
+    auto prefix = utils::RangeFilter::KeyPrefix(key.user_key_);
+    if (range_filter_keys_.empty() || range_filter_keys_.back() != prefix) {
+      range_filter_keys_.push_back(prefix);
+    }
+  }
+}
+
+void SSTableBuilder::AddRangeTombstone(RangeTombstone tombstone) {
+  range_dels_.push_back(std::move(tombstone));
+  num_deletions_ += 1;
+}
+
+void SSTableBuilder::FinishDataBlock() {
+  block_builder_.Finish();
+  IndexValue index;
+  index.key_ = largest_key_;
+  index.block_.offset_ = current_block_offset_;
+  index.block_.size_ = block_builder_.disk_size();
+  index.block_.count_ = block_builder_.count();
+  current_block_offset_ += index.block_.size_;
+  partition_data_size_ += index.block_.size_;
+  /* The key, the handle and the three varint32 lengths in the partition */
+  partition_size_ += index.key_.size() + sizeof(BlockHandle) + 3;
+  index_data_.push_back(std::move(index));
+  block_builder_.Clear();
+  if (partition_size_ >= block_size_) {
+    FinishPartition();
+  }
+}
+
+void SSTableBuilder::FinishPartition() {
+  IndexPartition partition;
+  partition.key_ = index_data_.back().key_;
+  partition.index_.count_ = index_data_.size() - partition_begin_;
+  partition.filter_.count_ = key_hashes_.size();
+  partition.data_size_ = partition_data_size_;
+  partitions_.push_back(std::move(partition));
+  std::string filter;
+  if (bloom_bits_per_key_ > 0) {
+    filter = BuildFilter(filter_type_, key_hashes_, bloom_bits_per_key_);
+  }
+  filters_.push_back(std::move(filter));
+  key_hashes_.clear();
+  partition_begin_ = index_data_.size();
+  partition_size_ = partition_data_size_ = 0;
 }
 
-void SSTableBuilder::Finish() { DB_ERR("Not implemented!"); }
+void SSTableBuilder::Finish() {
+  if (block_builder_.count() > 0) {
+    FinishDataBlock();
+  }
+  if (partition_begin_ < index_data_.size()) {
+    FinishPartition();
+  }
+  size_t offset = current_block_offset_;
+  bloom_filter_offset_ = offset;
+  for (size_t i = 0; i < partitions_.size(); i++) {
+    if (filters_[i].empty()) {
+      partitions_[i].filter_ = BlockHandle{0, 0, 0};
+      continue;
+    }
+    partitions_[i].filter_.offset_ = offset;
+    partitions_[i].filter_.size_ =
+        WriteBlock(writer_.get(), filters_[i], CompressionType::kNone);
+    offset += partitions_[i].filter_.size_;
+  }
+  /* Entries are searched by binary search, so every entry is a restart. */
+  BlockBuilder index_builder(
+      std::numeric_limits<size_t>::max(), writer_.get(), 1);
+  size_t begin = 0;
+  for (auto& partition : partitions_) {
+    for (size_t i = begin; i < begin + partition.index_.count_; i++) {
+      std::string handle;
+      PutHandle(&handle, index_data_[i].block_);
+      index_builder.Append(ParsedKey(index_data_[i].key_), handle);
+    }
+    begin += partition.index_.count_;
+    index_builder.Finish();
+    partition.index_.offset_ = offset;
+    partition.index_.size_ = index_builder.disk_size();
+    offset += partition.index_.size_;
+    index_builder.Clear();
+  }
+  BlockHandle range_dels_handle{0, 0, 0};
+  if (!range_dels_.empty()) {
+    RangeTombstoneList range_dels(std::move(range_dels_));
+    std::string block;
+    for (auto& tombstone : range_dels.ToTombstones()) {
+      PutRangeTombstone(&block, tombstone);
+      range_dels_handle.count_ += 1;
+    }
+    range_dels_handle.offset_ = offset;
+    range_dels_handle.size_ =
+        WriteBlock(writer_.get(), block, CompressionType::kNone);
+    offset += range_dels_handle.size_;
+    /* Extend the key range to cover the range tombstones */
+    auto smallest = FirstKeyOf(range_dels.smallest());
+    auto largest = FirstKeyOf(range_dels.largest());
+    if (count_ == 0 || ParsedKey(smallest) < ParsedKey(smallest_key_)) {
+      smallest_key_ = std::move(smallest);
+    }
+    if (count_ == 0 || ParsedKey(largest) > ParsedKey(largest_key_)) {
+      largest_key_ = std::move(largest);
+    }
+  }
+  BlockHandle range_filter_handle{0, 0, 0};
+  if (range_filter_bits_per_key_ > 0 && !range_filter_keys_.empty()) {
+    std::string filter;
+    utils::RangeFilter::Build(range_filter_keys_, kRangeFilterLevels,
+        range_filter_bits_per_key_, filter);
+    range_filter_handle.offset_ = offset;
+    range_filter_handle.size_ =
+        WriteBlock(writer_.get(), filter, CompressionType::kNone);
+    offset += range_filter_handle.size_;
+  }
+  index_offset_ = offset;
+  std::string index;
+  PutHandle(&index, range_dels_handle);
+  PutHandle(&index, range_filter_handle);
+  PutKey(&index, smallest_key_.GetSlice());
+  PutKey(&index, largest_key_.GetSlice());
+  for (auto& partition : partitions_) {
+    PutKey(&index, partition.key_.GetSlice());
+    PutHandle(&index, partition.index_);
+    PutHandle(&index, partition.filter_);
+    index.append(reinterpret_cast<const char*>(&partition.data_size_),
+        sizeof(offset_t));
+  }
+  WriteBlock(writer_.get(), index, CompressionType::kNone);
+  writer_->Flush();
+}
 
 }  // namespace lsm
 
@@ -1,15 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
 #include <string>
 #include <vector>
 
+#include "storage/lsm/blob.hpp"
 #include "storage/lsm/block.hpp"
 #include "storage/lsm/cache.hpp"
 #include "storage/lsm/common.hpp"
 #include "storage/lsm/file.hpp"
+#include "storage/lsm/filter.hpp"
 #include "storage/lsm/format.hpp"
 #include "storage/lsm/iterator.hpp"
 #include "storage/lsm/options.hpp"
+#include "storage/lsm/range_del.hpp"
+#include "storage/lsm/table_cache.hpp"
 
 namespace wing {
 
@@ -25,20 +34,55 @@ class SSTable {
    * Below are global options (see lsm/options.hpp):
    * block_size: The size of data block in the SSTable
    * use_direct_io: Enable O_DIRECT or not.
+   * verify_checksums: Verify the checksum of each block read from the file.
+   * cache: The block cache, which holds the data blocks and the index and
+   * filter partitions. If it is null, the SSTable uses its own cache.
+   * reader: It reads the blocks missed by MultiGet in batches. If it is
+   * null, the blocks are read one by one.
+   * max_readahead_size: The maximum size of a read of sequential scans.
+   * Readahead is disabled if it is 0.
+   * blobs: It opens the blob files that the SSTable refers to. The SSTable
+   * holds a reference to each of them until it is removed.
+   * table_cache: It holds the file and the top-level index (see
+   * TableReader) unless the SSTable is pinned, so they are closed and
+   * dropped when it is evicted. If it is null, they are always pinned.
+   *
+   * Only the top-level index is read in construction. The key range and the
+   * range tombstones stay in memory.
    */
-  SSTable(SSTInfo sst_info, size_t block_size, bool use_direct_io);
+  SSTable(SSTInfo sst_info, size_t block_size, bool use_direct_io,
+      bool verify_checksums = true, Cache* cache = nullptr,
+      AsyncReader* reader = nullptr, size_t max_readahead_size = 256 * 1024,
+      BlobStore* blobs = nullptr, TableCache* table_cache = nullptr);
 
   ~SSTable();
 
   /**
    * Try to get the associated value of key with the sequence number <= seq.
    * If the record has type RecordType::Value, then it copies the value,
-   * and returns GetResult::kFound
+   * and returns GetResult::kFound. If it has type RecordType::BlobIndex, the
+   * value is read from the blob file.
    * If the record has type RecordType::Deletion, then it does nothing to the
    * value, and returns GetResult::kDelete If there is no such record, it
    * returns GetResult::kNotFound.
+   * If the record is covered by a newer range tombstone in the SSTable, or
+   * there is no record but the key is covered by a range tombstone, it
+   * returns GetResult::kDelete.
+   * The merge operands newer than the record are appended to operands (see
+   * MemTable::Get).
    * */
-  GetResult Get(Slice key, uint64_t seq, std::string* value);
+  GetResult Get(Slice key, uint64_t seq, std::string* value,
+      std::vector<std::string>* operands = nullptr);
+
+  /**
+   * Get the keys in a batch. keys are sorted by the user key, and their
+   * results are kNotFound. It sets the results like Get.
+   *
+   * The keys in the same partition share one probe of the filter partition
+   * and the index partition, and the keys in the same data block share one
+   * read. The data blocks that are not in the cache are read in one batch.
+   */
+  void MultiGet(std::span<KeyContext*> keys, uint64_t seq);
 
   /* Return an iterator positioned at the first record that is not smaller than
    * (key, seq). */
@@ -65,13 +109,131 @@ class SSTable {
 
   const SSTInfo& GetSSTInfo() const { return sst_info_; }
 
+  /* The range tombstones, which are read in construction. */
+  const RangeTombstoneList& GetRangeTombstones() const { return range_dels_; }
+
+  /**
+   * Return false if the SSTable has no record whose user key is in
+   * [lower, upper], checked with the key range and the range filter. It
+   * returns true if the SSTable has range tombstones, since they may delete
+   * the keys of other SSTables.
+   */
+  bool RangeMayMatch(Slice lower, Slice upper) const;
+
+  /**
+   * A copy of the top-level index, which has an entry for each index
+   * partition. The reader may be evicted after it returns.
+   */
+  std::vector<IndexPartition> GetPartitions() const {
+    return Open()->partitions_;
+  }
+
+  /**
+   * Keep the reader of the SSTable out of the table cache, so it is never
+   * closed, or put it back to the cache. DBImpl pins the SSTables of L0.
+   */
+  void SetPinned(bool pinned);
+
+  /**
+   * Read all the blocks from the file and verify their checksums.
+   * Return false if any block is corrupted.
+   */
+  bool VerifyChecksums() const;
+
  private:
+  /**
+   * Open the file and read the top-level index and the range filter. If
+   * range_dels is not null, the handle of the range tombstones and the key
+   * range are read too.
+   */
+  std::shared_ptr<const TableReader> OpenReader(BlockHandle* range_dels,
+      InternalKey* smallest_key, InternalKey* largest_key) const;
+
+  /* The pinned reader, or the reader in the table cache. */
+  std::shared_ptr<const TableReader> Open() const;
+
+  /**
+   * The reader of one lookup. A pinned reader is used without pin_mutex_
+   * and without copying pinned_, and SetPinned(false) keeps it alive until
+   * the lookups using it are done. Otherwise it holds the reader of Open().
+   */
+  class ReaderRef {
+   public:
+    explicit ReaderRef(const SSTable* sst);
+    ~ReaderRef();
+    ReaderRef(const ReaderRef&) = delete;
+    ReaderRef& operator=(const ReaderRef&) = delete;
+
+    const TableReader& operator*() const { return *table_; }
+    const TableReader* operator->() const { return table_; }
+
+   private:
+    /* The SSTable whose pinned reader is used, or null */
+    const SSTable* pinned_sst_{nullptr};
+    const TableReader* table_{nullptr};
+    std::shared_ptr<const TableReader> holder_;
+  };
+
+  /**
+   * The id of the first partition whose largest key >= (key, seq),
+   * or partitions.size() if there is no such partition.
+   */
+  static size_t FindPartition(
+      const std::vector<IndexPartition>& partitions, Slice key, seq_t seq);
+
+  /**
+   * Get the record like Get, ignoring the range tombstones. found_seq is set
+   * to the sequence number of the record if it is found. If the record is a
+   * merge operand, it returns GetResult::kNotFound with found_seq set, and
+   * the operands are read by GetMergeOperands.
+   */
+  GetResult GetRecord(const TableReader& table, Slice key, uint64_t seq,
+      std::string* value, seq_t* found_seq);
+
+  /**
+   * Get the record like Get when the newest record is a merge operand. The
+   * records older than covering_seq are deleted by a range tombstone. It
+   * reads the records of the key with an iterator, since they may span
+   * blocks.
+   */
+  GetResult GetMergeOperands(Slice key, uint64_t seq, seq_t covering_seq,
+      std::string* value, std::vector<std::string>* operands);
+
+  /* Read the value of a RecordType::BlobIndex record from its blob file. */
+  void ReadBlob(Slice index, std::string* value) const;
+
+  /* Read the block of the file of table through the cache. */
+  Cache::Handle ReadBlock(const TableReader& table, BlockHandle handle,
+      Cache::Priority priority);
+
+  /**
+   * Read the blocks through the cache. The blocks that are not in the cache
+   * are read in one batch by reader_.
+   */
+  std::vector<Cache::Handle> ReadBlocks(const TableReader& table,
+      std::span<const BlockHandle> handles, Cache::Priority priority);
+
   /* The information of SSTable. */
   SSTInfo sst_info_;
-  /* The file manager. */
-  std::unique_ptr<ReadFile> file_;
-  /* The index data, which is initialized in construction. */
-  std::vector<IndexValue> index_;
+  /* Use O_DIRECT or not, which is used when the file is opened again. */
+  bool use_direct_io_;
+  /**
+   * The reader if the SSTable is pinned or there is no table cache. The
+   * index and filter partitions are read through the block cache on demand.
+   */
+  std::shared_ptr<const TableReader> pinned_;
+  /* It protects pinned_. */
+  mutable std::mutex pin_mutex_;
+  /* pinned_.get(), which ReaderRef reads without pin_mutex_ */
+  std::atomic<const TableReader*> pinned_reader_{nullptr};
+  /* The number of ReaderRefs using pinned_reader_ */
+  mutable std::atomic<size_t> pinned_users_{0};
+  /* The cache of the readers that are not pinned. It may be null. */
+  TableCache* table_cache_{nullptr};
+  /* The range tombstones */
+  RangeTombstoneList range_dels_;
+  /* The blob files that the SSTable refers to */
+  std::vector<std::shared_ptr<BlobFile>> blob_files_;
   /* The block size of the data block. */
   size_t block_size_;
   /* The key range of the SSTable, which is initialized in construction. */
@@ -80,8 +242,18 @@ class SSTable {
   bool compaction_in_process_{false};
   /* If it is true, then the SSTable file will be removed in deconstrution. */
   bool remove_tag_{false};
-  /* The bloom filter buffer */
-  std::string bloom_filter_;
+  /* Verify the checksums of the blocks read in Get and iterators or not */
+  bool verify_checksums_{true};
+  /* The block cache */
+  Cache* cache_{nullptr};
+  /* The ID of the blocks of the SSTable in cache_. See Cache::NewId. */
+  uint64_t cache_id_{0};
+  /* The cache used if no cache is given in construction */
+  std::unique_ptr<Cache> own_cache_;
+  /* The reader of batched reads. It may be null. */
+  AsyncReader* reader_{nullptr};
+  /* The maximum readahead size of iterators */
+  size_t max_readahead_size_{0};
 
   friend class SSTableIterator;
 };
@@ -90,7 +262,7 @@ class SSTableIterator final : public Iterator {
  public:
   SSTableIterator() = default;
 
-  SSTableIterator(SSTable* sst) : sst_(sst), buf_(sst->block_size_, 4096) {}
+  SSTableIterator(SSTable* sst) : sst_(sst), table_(sst->Open()) {}
 
   /* Move the the beginning */
   void SeekToFirst();
@@ -107,28 +279,123 @@ class SSTableIterator final : public Iterator {
   void Next() override;
 
  private:
+  /**
+   * Load the index partition partition_id_. If it is the end of the
+   * SSTable, make the iterator invalid and return false.
+   */
+  bool LoadPartition();
+
+  /**
+   * Load the data block that index_it_ points to. If sequential is true,
+   * the block is read from the readahead buffer if it is not in the cache.
+   */
+  void LoadDataBlock(bool sequential = false);
+
+  /**
+   * Read the blocks from handle into the readahead buffer. The size of the
+   * read starts at 2 blocks, and doubles in each read of a sequential scan
+   * until it reaches SSTable::max_readahead_size_.
+   */
+  void Readahead(BlockHandle handle);
+
+  /* Move to the first record of the next data block. */
+  void NextBlock();
+
   /* The reference to the SSTable */
   SSTable* sst_{nullptr};
-  /* Current data block id */
-  size_t block_id_{0};
+  /* The reader of the SSTable, which stays open while it is referenced. */
+  std::shared_ptr<const TableReader> table_;
+  /* Current partition id */
+  size_t partition_id_{0};
+  /* The current index partition, which is pinned in the cache. */
+  std::optional<Cache::Handle> index_block_;
+  /* The iterator of the index partition */
+  BlockIterator index_it_;
+  /* The current data block, which is pinned in the cache. */
+  std::optional<Cache::Handle> data_block_;
   /* The block iterator of the current data block. */
   BlockIterator block_it_;
-  /* The buffer */
-  AlignedBuffer buf_;
+  /**
+   * The blocks read ahead, which are in [readahead_begin_, readahead_end_)
+   * of the file. They are not inserted into the cache, so scans do not
+   * evict the blocks of point lookups.
+   */
+  AlignedBuffer readahead_buf_;
+  size_t readahead_begin_{0};
+  size_t readahead_end_{0};
+  /* The size of the last read of readahead_buf_. 0 if it is not sequential */
+  size_t readahead_size_{0};
+  /* The decompressed contents of the block read from readahead_buf_. */
+  std::string block_contents_;
 };
 
+/**
+ * The layout of an SSTable file is
+ *
+ * | data blocks | filter partitions | index partitions | range tombstones |
+ * | top-level index |
+ *
+ * where every block has the trailer written by WriteBlock (see block.hpp).
+ * BlockHandle::size_ of a block includes its trailer.
+ *
+ * The index is partitioned. An index partition has the format of a data
+ * block, and each entry maps the largest key of a data block to its
+ * BlockHandle. A partition is cut when it reaches block_size. The filter
+ * partition of an index partition is the bloom filter of the user keys in
+ * its data blocks.
+ *
+ * The top-level index starts at SSTInfo::index_offset_ and ends at the end
+ * of the file. It is
+ *
+ * | range tombstones handle | range filter handle | smallest key |
+ * largest key | partition 0 | ... | partition m - 1 |
+ *
+ * where each key is its size (offset_t) followed by the internal key, and
+ * each partition is
+ *
+ * | largest key | index handle | filter handle | data size |
+ *
+ * (see IndexPartition). The filter partitions start at
+ * SSTInfo::bloom_filter_offset_.
+ *
+ * The range tombstones block is a list of
+ *
+ * | begin size | begin | end size | end | seq |
+ *
+ * where the sizes are offset_t. Its handle has size_ 0 if there is no range
+ * tombstone. The key range of the SSTable covers its range tombstones, and
+ * the exclusive end of a tombstone is represented by the smallest internal
+ * key of the user key. An SSTable may have no data block if it has range
+ * tombstones.
+ *
+ * The range filter is the utils::RangeFilter of the user keys, with
+ * kRangeFilterLevels levels. Its handle has size_ 0 if it is disabled.
+ */
 class SSTableBuilder {
  public:
   SSTableBuilder(std::unique_ptr<FileWriter> writer, size_t block_size,
-      size_t bloom_bits_per_key)
+      size_t bloom_bits_per_key,
+      size_t restart_interval = BlockBuilder::kDefaultRestartInterval,
+      CompressionType compression = CompressionType::kNone,
+      FilterType filter_type = FilterType::kBloom)
     : writer_(std::move(writer)),
-      block_builder_(block_size, writer_.get()),
-      bloom_bits_per_key_(bloom_bits_per_key) {}
+      block_builder_(
+          block_size, writer_.get(), restart_interval, compression),
+      block_size_(block_size),
+      bloom_bits_per_key_(bloom_bits_per_key),
+      filter_type_(filter_type) {}
 
   ~SSTableBuilder() = default;
 
   void Append(ParsedKey key, Slice value);
 
+  /**
+   * Add a range tombstone. It can be called at any time before Finish().
+   * A compaction that splits its output truncates the tombstones to the key
+   * range of each output SSTable, so that the SSTables do not overlap.
+   */
+  void AddRangeTombstone(RangeTombstone tombstone);
+
   void Finish();
 
   std::vector<IndexValue> GetIndexData() const { return index_data_; }
@@ -141,31 +408,100 @@ class SSTableBuilder {
 
   size_t count() const { return count_; }
 
+  /* The number of deletions and range tombstones. See SSTInfo. */
+  size_t num_deletions() const { return num_deletions_; }
+
+  /**
+   * Store the values of at least min_blob_size bytes in the blob file of
+   * builder. The values in the blob files whose IDs are smaller than
+   * relocate_before are read and written to it again, so that the old blob
+   * files are removed when the SSTables referring to them are removed.
+   * Separation is disabled if min_blob_size is 0.
+   */
+  void SetBlobBuilder(BlobFileBuilder* builder, size_t min_blob_size,
+      size_t relocate_before = 0) {
+    blob_builder_ = builder;
+    min_blob_size_ = min_blob_size;
+    relocate_before_ = relocate_before;
+  }
+
+  /**
+   * Build a range filter of bits_per_key bits per key prefix of each level,
+   * so that short range scans skip the SSTable if it has no key in the
+   * range. It is disabled if bits_per_key is 0.
+   */
+  void SetRangeFilter(size_t bits_per_key) {
+    range_filter_bits_per_key_ = bits_per_key;
+  }
+
+  /* The IDs of the blob files that the SSTable refers to. See SSTInfo. */
+  std::vector<size_t> GetBlobFiles() const {
+    return {blob_files_.begin(), blob_files_.end()};
+  }
+
   size_t GetIndexOffset() const { return index_offset_; }
 
   size_t GetBloomFilterOffset() const { return bloom_filter_offset_; }
 
  private:
+  /* Write the current data block and add it to the index. */
+  void FinishDataBlock();
+
+  /* Cut the current index partition and build its filter. */
+  void FinishPartition();
+
   /* The file writer */
   std::unique_ptr<FileWriter> writer_;
   /* The builder for the data block */
   BlockBuilder block_builder_;
   /* The index data */
   std::vector<IndexValue> index_data_;
+  /* The index partitions. Their handles are set in Finish(). */
+  std::vector<IndexPartition> partitions_;
+  /* The filter partitions */
+  std::vector<std::string> filters_;
+  /* The range tombstones */
+  std::vector<RangeTombstone> range_dels_;
+  /* The first entry of the current partition in index_data_ */
+  size_t partition_begin_{0};
+  /* The estimated size of the current index partition */
+  size_t partition_size_{0};
+  /* The data size of the current index partition */
+  size_t partition_data_size_{0};
+  /* The target size of data blocks and index partitions */
+  size_t block_size_{0};
   /* The index offset */
   size_t index_offset_{0};
   /* The key range of the SSTable */
   InternalKey largest_key_, smallest_key_;
   /* The number of records in this SSTable. */
   size_t count_{0};
+  /* The number of deletions and range tombstones */
+  size_t num_deletions_{0};
   /* Current offset */
   size_t current_block_offset_{0};
-  /* hashes of keys used to build bloom filter */
+  /* hashes of keys in the current partition used to build bloom filter */
   std::vector<size_t> key_hashes_;
   /* The offset of the bloom filter */
   size_t bloom_filter_offset_{0};
   /* The number of bits per key in bloom filter */
   size_t bloom_bits_per_key_{0};
+  /* The type of the filter partitions */
+  FilterType filter_type_{FilterType::kBloom};
+  /* The number of bits per key prefix in the range filter */
+  size_t range_filter_bits_per_key_{0};
+  /* The distinct key prefixes of the range filter in ascending order */
+  std::vector<uint64_t> range_filter_keys_;
+  /* The builder of the blob file. It may be null. */
+  BlobFileBuilder* blob_builder_{nullptr};
+  /* The minimum size of the values stored in the blob file */
+  size_t min_blob_size_{0};
+  /* The values in the blob files whose IDs are smaller are relocated */
+  size_t relocate_before_{0};
+  /* The IDs of the blob files referred to */
+  std::set<size_t> blob_files_;
+  /* The value of the current RecordType::BlobIndex record */
+  std::string blob_value_;
 };
 
 }  // namespace lsm
@@ -0,0 +1,90 @@
+#include "storage/lsm/table_cache.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+size_t TableReader::charge() const {
+  size_t ret = sizeof(TableReader) + range_filter_.size();
+  for (auto& partition : partitions_) {
+    ret += sizeof(IndexPartition) + partition.key_.size();
+  }
+  return ret;
+}
+
+std::shared_ptr<const TableReader> TableCache::Get(uint64_t id,
+    const std::function<std::shared_ptr<const TableReader>()>& open) {
+  {
+    std::unique_lock lck(mu_);
+    auto it = readers_.find(id);
+    if (it != readers_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->second;
+    }
+  }
+  /* Files are opened and read outside the lock. */
+  auto reader = open();
+  std::unique_lock lck(mu_);
+  auto it = readers_.find(id);
+  if (it != readers_.end()) {
+    /* It was opened by another thread. */
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+  lru_.emplace_front(id, reader);
+  readers_.emplace(id, lru_.begin());
+  size_ += reader->charge();
+  Evict();
+  return reader;
+}
+
+void TableCache::Insert(
+    uint64_t id, std::shared_ptr<const TableReader> reader) {
+  std::unique_lock lck(mu_);
+  if (readers_.count(id)) {
+    return;
+  }
+  size_ += reader->charge();
+  lru_.emplace_front(id, std::move(reader));
+  readers_.emplace(id, lru_.begin());
+  Evict();
+}
+
+void TableCache::Erase(uint64_t id) {
+  std::shared_ptr<const TableReader> reader;
+  std::unique_lock lck(mu_);
+  auto it = readers_.find(id);
+  if (it == readers_.end()) {
+    return;
+  }
+  /* The file is closed after the lock is released. */
+  reader = std::move(it->second->second);
+  size_ -= reader->charge();
+  lru_.erase(it->second);
+  readers_.erase(it);
+}
+
+void TableCache::Evict() {
+  /* The most recently used reader is kept, since it is about to be used. */
+  while (lru_.size() > 1 &&
+         (lru_.size() > max_open_files_ || size_ > capacity_)) {
+    auto& [id, reader] = lru_.back();
+    size_ -= reader->charge();
+    readers_.erase(id);
+    lru_.pop_back();
+  }
+}
+
+size_t TableCache::count() {
+  std::unique_lock lck(mu_);
+  return lru_.size();
+}
+
+size_t TableCache::size() {
+  std::unique_lock lck(mu_);
+  return size_;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
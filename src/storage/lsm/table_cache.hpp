@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "storage/lsm/file.hpp"
+#include "storage/lsm/format.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * The open file and the in-memory metadata of an SSTable: the top-level
+ * index and the range filter. It is dropped when the SSTable is evicted from
+ * the TableCache, and read again when the SSTable is accessed.
+ */
+struct TableReader {
+  std::unique_ptr<ReadFile> file_;
+  /* The top-level index, which has an entry for each index partition. */
+  std::vector<IndexPartition> partitions_;
+  /* The range filter. It is empty if the SSTable has no range filter. */
+  std::string range_filter_;
+
+  /* The memory of the metadata */
+  size_t charge() const;
+};
+
+/**
+ * The readers of the SSTables that are not pinned. It keeps at most
+ * max_open_files readers, whose metadata takes at most capacity bytes, and
+ * evicts the least recently used ones. A reader in use (e.g. by an
+ * iterator) stays open until it is released, so the limits may be exceeded
+ * by the readers in use.
+ *
+ * The SSTables of L0 are pinned (see SSTable::SetPinned), since every read
+ * probes all of them. Their readers are held by the SSTables instead.
+ */
+class TableCache {
+ public:
+  TableCache(size_t max_open_files, size_t capacity)
+    : max_open_files_(max_open_files), capacity_(capacity) {}
+
+  /**
+   * Return the reader of the SSTable id (see Cache::NewId). If it is not
+   * cached, it is opened by open without holding the lock.
+   */
+  std::shared_ptr<const TableReader> Get(uint64_t id,
+      const std::function<std::shared_ptr<const TableReader>()>& open);
+
+  /* Insert the reader of the SSTable id, e.g. an unpinned reader. */
+  void Insert(uint64_t id, std::shared_ptr<const TableReader> reader);
+
+  /* Remove the reader of the SSTable id, e.g. a pinned or removed one. */
+  void Erase(uint64_t id);
+
+  /* The number of cached readers */
+  size_t count();
+
+  /* The memory of the cached readers */
+  size_t size();
+
+ private:
+  using Entry = std::pair<uint64_t, std::shared_ptr<const TableReader>>;
+
+  // REQUIRES: this->mu_ held
+  void Evict();
+
+  const size_t max_open_files_;
+  const size_t capacity_;
+
+  std::mutex mu_;
+  /* The readers from the most recently used to the least recently used */
+  std::list<Entry> lru_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> readers_;
+  size_t size_{0};
+};
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -1,11 +1,48 @@
 #include "storage/lsm/version.hpp"
 
+#include <algorithm>
+
 namespace wing {
 
 namespace lsm {
 
-bool Version::Get(std::string_view user_key, seq_t seq, std::string* value) {
-  DB_ERR("Not implemented!");
+bool Version::Get(std::string_view user_key, seq_t seq, std::string* value,
+    std::vector<std::string>* operands) {
+  /* A record or a range tombstone in a newer level hides the older levels */
+  for (auto& level : levels_) {
+    auto res = level.Get(user_key, seq, value, operands);
+    if (res != GetResult::kNotFound) {
+      return res == GetResult::kFound;
+    }
+  }
+  return false;
+}
+
+void Version::MultiGet(std::vector<KeyContext*>* keys, seq_t seq) {
+  for (auto& level : levels_) {
+    if (keys->empty()) {
+      break;
+    }
+    level.MultiGet(keys, seq);
+  }
+}
+
+std::shared_ptr<Version> Version::FilterRange(
+    Slice lower, Slice upper) const {
+  std::vector<Level> levels;
+  for (auto& level : levels_) {
+    std::vector<std::shared_ptr<SortedRun>> runs;
+    for (auto& run : level.GetRuns()) {
+      if (run->RangeMayMatch(lower, upper)) {
+        runs.push_back(run);
+      }
+    }
+    levels.emplace_back(level.GetID(), std::move(runs));
+  }
+  auto ret = std::make_shared<Version>(std::move(levels));
+  /* A superset of the tombstones of the kept runs is still correct */
+  ret->range_dels_ = GetRangeTombstones();
+  return ret;
 }
 
 void Version::Append(
@@ -14,17 +51,159 @@ void Version::Append(
     levels_.push_back(Level(levels_.size()));
   }
   levels_[level_id].Append(std::move(sorted_runs));
+  range_dels_.reset();
 }
 void Version::Append(uint32_t level_id, std::shared_ptr<SortedRun> sorted_run) {
   while (levels_.size() <= level_id) {
     levels_.push_back(Level(levels_.size()));
   }
   levels_[level_id].Append(std::move(sorted_run));
+  range_dels_.reset();
+}
+
+void Version::Insert(
+    uint32_t level_id, std::shared_ptr<SortedRun> sorted_run) {
+  while (levels_.size() <= level_id) {
+    levels_.push_back(Level(levels_.size()));
+  }
+  range_dels_.reset();
+  auto& runs = levels_[level_id].GetRuns();
+  if (runs.size() != 1) {
+    levels_[level_id].Append(std::move(sorted_run));
+    return;
+  }
+  auto& run = runs[0];
+  auto ssts = run->GetSSTs();
+  ssts.insert(
+      ssts.end(), sorted_run->GetSSTs().begin(), sorted_run->GetSSTs().end());
+  std::sort(ssts.begin(), ssts.end(), [](const auto& a, const auto& b) {
+    return a->GetSmallestKey() < b->GetSmallestKey();
+  });
+  for (size_t i = 1; i < ssts.size(); i++) {
+    if (ssts[i]->GetSmallestKey() < ssts[i - 1]->GetLargestKey()) {
+      levels_[level_id].Append(std::move(sorted_run));
+      return;
+    }
+  }
+  auto merged = std::make_shared<SortedRun>(
+      ssts, run->block_size(), run->use_direct_io());
+  levels_[level_id] = Level(level_id, {std::move(merged)});
+}
+
+void Version::Remove(const std::vector<std::shared_ptr<SSTable>>& ssts) {
+  for (auto& level : levels_) {
+    std::vector<std::shared_ptr<SortedRun>> runs;
+    bool changed = false;
+    for (auto& run : level.GetRuns()) {
+      auto kept = run->GetSSTs();
+      std::erase_if(kept, [&](const auto& sst) {
+        return std::find(ssts.begin(), ssts.end(), sst) != ssts.end();
+      });
+      if (kept.size() == run->SSTCount()) {
+        runs.push_back(run);
+        continue;
+      }
+      changed = true;
+      if (!kept.empty()) {
+        runs.push_back(std::make_shared<SortedRun>(
+            kept, run->block_size(), run->use_direct_io()));
+      }
+    }
+    if (changed) {
+      level = Level(level.GetID(), std::move(runs));
+    }
+  }
+  range_dels_.reset();
+}
+
+std::shared_ptr<const RangeTombstoneList> Version::GetRangeTombstones()
+    const {
+  std::unique_lock lck(range_dels_mu_);
+  if (range_dels_) {
+    return range_dels_;
+  }
+  std::vector<RangeTombstone> tombstones;
+  for (auto& level : levels_) {
+    for (auto& run : level.GetRuns()) {
+      for (auto& sst : run->GetSSTs()) {
+        auto ret = sst->GetRangeTombstones().ToTombstones();
+        tombstones.insert(tombstones.end(),
+            std::make_move_iterator(ret.begin()),
+            std::make_move_iterator(ret.end()));
+      }
+    }
+  }
+  range_dels_ =
+      std::make_shared<const RangeTombstoneList>(std::move(tombstones));
+  return range_dels_;
+}
+
+bool SuperVersion::Get(std::string_view user_key, seq_t seq,
+    std::string* value, std::vector<std::string>* operands) {
+  auto res = mt_->Get(user_key, seq, value, operands);
+  if (res != GetResult::kNotFound) {
+    return res == GetResult::kFound;
+  }
+  /* The newer immutable MemTables are in the front */
+  for (auto& imm : *imms_) {
+    res = imm->Get(user_key, seq, value, operands);
+    if (res != GetResult::kNotFound) {
+      return res == GetResult::kFound;
+    }
+  }
+  return version_->Get(user_key, seq, value, operands);
 }
 
-bool SuperVersion::Get(
-    std::string_view user_key, seq_t seq, std::string* value) {
-  DB_ERR("Not implemented!");
+void SuperVersion::MultiGet(std::vector<KeyContext*>* keys, seq_t seq) {
+  auto get_from = [&](MemTable& mt) {
+    for (auto key : *keys) {
+      key->result_ = mt.Get(key->key_, seq, &key->value_, &key->operands_);
+    }
+    std::erase_if(*keys, [](KeyContext* key) {
+      return key->result_ != GetResult::kNotFound;
+    });
+  };
+  get_from(*mt_);
+  /* The newer immutable MemTables are in the front */
+  for (auto& imm : *imms_) {
+    if (keys->empty()) {
+      return;
+    }
+    get_from(*imm);
+  }
+  version_->MultiGet(keys, seq);
+}
+
+std::shared_ptr<const RangeTombstoneList> SuperVersion::GetRangeTombstones()
+    const {
+  auto mt_range_dels = mt_->GetRangeTombstones();
+  bool empty = mt_range_dels->empty();
+  for (auto& imm : *imms_) {
+    empty = empty && imm->GetRangeTombstones()->empty();
+  }
+  if (empty) {
+    return version_->GetRangeTombstones();
+  }
+  std::unique_lock lck(range_dels_mu_);
+  /* The immutable MemTables and the Version never change */
+  if (range_dels_ && mt_range_dels_ == mt_range_dels) {
+    return range_dels_;
+  }
+  std::vector<RangeTombstone> tombstones;
+  auto add = [&](const RangeTombstoneList& range_dels) {
+    auto ret = range_dels.ToTombstones();
+    tombstones.insert(tombstones.end(), std::make_move_iterator(ret.begin()),
+        std::make_move_iterator(ret.end()));
+  };
+  add(*mt_range_dels);
+  for (auto& imm : *imms_) {
+    add(*imm->GetRangeTombstones());
+  }
+  add(*version_->GetRangeTombstones());
+  mt_range_dels_ = std::move(mt_range_dels);
+  range_dels_ =
+      std::make_shared<const RangeTombstoneList>(std::move(tombstones));
+  return range_dels_;
 }
 
 std::string SuperVersion::ToString() const {
@@ -43,19 +222,54 @@ std::string SuperVersion::ToString() const {
   return ret;
 }
 
-void SuperVersionIterator::SeekToFirst() { DB_ERR("Not implemented!"); }
+void SuperVersionIterator::SeekToFirst() {
+  mt_its_.clear();
+  sst_its_.clear();
+  mt_its_.push_back(sv_->mt_->Begin());
+  for (auto& imm : *sv_->imms_) {
+    mt_its_.push_back(imm->Begin());
+  }
+  for (auto& level : sv_->version_->GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      sst_its_.push_back(run->Begin());
+    }
+  }
+  BuildHeap();
+}
 
 void SuperVersionIterator::Seek(Slice key, seq_t seq) {
-  DB_ERR("Not implemented!");
+  mt_its_.clear();
+  sst_its_.clear();
+  mt_its_.push_back(sv_->mt_->Seek(key, seq));
+  for (auto& imm : *sv_->imms_) {
+    mt_its_.push_back(imm->Seek(key, seq));
+  }
+  for (auto& level : sv_->version_->GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      sst_its_.push_back(run->Seek(key, seq));
+    }
+  }
+  BuildHeap();
+}
+
+void SuperVersionIterator::BuildHeap() {
+  it_ = IteratorHeap<Iterator>();
+  for (auto& it : mt_its_) {
+    it_.Push(&it);
+  }
+  for (auto& it : sst_its_) {
+    it_.Push(&it);
+  }
+  it_.Build();
 }
 
-bool SuperVersionIterator::Valid() { DB_ERR("Not implemented!"); }
+bool SuperVersionIterator::Valid() { return it_.Valid(); }
 
-Slice SuperVersionIterator::key() const { DB_ERR("Not implemented!"); }
+Slice SuperVersionIterator::key() const { return it_.key(); }
 
-Slice SuperVersionIterator::value() const { DB_ERR("Not implemented!"); }
+Slice SuperVersionIterator::value() const { return it_.value(); }
 
-void SuperVersionIterator::Next() { DB_ERR("Not implemented!"); }
+void SuperVersionIterator::Next() { it_.Next(); }
 
 }  // namespace lsm
 
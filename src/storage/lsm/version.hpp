@@ -1,5 +1,7 @@
 #pragma once
 
+#include <mutex>
+
 #include "storage/lsm/common.hpp"
 #include "storage/lsm/iterator_heap.hpp"
 #include "storage/lsm/level.hpp"
@@ -16,12 +18,37 @@ class Version {
 
   Version() = default;
 
+  /* The copy does not share the range tombstones, since it may be modified */
+  Version(const Version& version) : levels_(version.levels_) {}
+
+  Version& operator=(const Version& version) {
+    levels_ = version.levels_;
+    range_dels_.reset();
+    return *this;
+  }
+
   // Return true if the GetResult is kFound
   // Otherwise return false
-  bool Get(Slice user_key, seq_t seq, std::string* value);
+  // The merge operands newer than the record are appended to operands (see
+  // Level::Get). If there are only merge operands, it returns false.
+  bool Get(Slice user_key, seq_t seq, std::string* value,
+      std::vector<std::string>* operands = nullptr);
+
+  /**
+   * Get the keys in a batch level by level.
+   * The keys whose records are found are removed from keys.
+   */
+  void MultiGet(std::vector<KeyContext*>* keys, seq_t seq);
 
   const std::vector<Level>& GetLevels() const { return levels_; }
 
+  /**
+   * A Version with the same levels, which keeps only the sorted runs that
+   * may have a record whose user key is in [lower, upper] (see
+   * SortedRun::RangeMayMatch). Scans of short ranges seek in fewer runs.
+   */
+  std::shared_ptr<Version> FilterRange(Slice lower, Slice upper) const;
+
   /**
    * Append sorted runs to the Level level_id
    * It will create new levels if level_id >= levels_.size()
@@ -35,8 +62,34 @@ class Version {
    * */
   void Append(uint32_t level_id, std::shared_ptr<SortedRun> sorted_run);
 
+  /**
+   * Add a sorted run to the Level level_id. If the level has exactly one
+   * sorted run and no SSTable of the new run overlaps it, the SSTables are
+   * merged into it in key order, so that a leveled level keeps one sorted
+   * run. Otherwise it is appended.
+   * It will create new levels if level_id >= levels_.size()
+   */
+  void Insert(uint32_t level_id, std::shared_ptr<SortedRun> sorted_run);
+
+  /**
+   * Remove the SSTables, e.g. the inputs of a compaction. A sorted run that
+   * loses some of its SSTables is replaced by a new sorted run of the
+   * others, and it is removed if none is left. The SSTables are found by
+   * identity, so they are removed even if their sorted run was merged with
+   * others by Insert in the meantime.
+   */
+  void Remove(const std::vector<std::shared_ptr<SSTable>>& ssts);
+
+  /**
+   * The range tombstones of the SSTables. They are fragmented once when it
+   * is first called, and shared by the later calls and by FilterRange.
+   */
+  std::shared_ptr<const RangeTombstoneList> GetRangeTombstones() const;
+
  private:
   std::vector<Level> levels_;
+  mutable std::mutex range_dels_mu_;
+  mutable std::shared_ptr<const RangeTombstoneList> range_dels_;
 };
 
 class SuperVersionIterator;
@@ -58,7 +111,24 @@ class SuperVersion {
 
   // Return true if the GetResult is kFound
   // Otherwise return false
-  bool Get(Slice user_key, seq_t seq, std::string* value);
+  // The merge operands newer than the record are appended to operands, from
+  // the MemTables to the levels. DBImpl::Get combines them with the value.
+  bool Get(Slice user_key, seq_t seq, std::string* value,
+      std::vector<std::string>* operands = nullptr);
+
+  /**
+   * Get the keys in a batch. keys are sorted by the user key.
+   * The results are set in the KeyContexts, and the keys whose records are
+   * found are removed from keys.
+   */
+  void MultiGet(std::vector<KeyContext*>* keys, seq_t seq);
+
+  /**
+   * The range tombstones of the MemTables and the SSTables. If no MemTable
+   * has range tombstones, it is the list of the Version. Otherwise the
+   * combined list is kept until the mutable MemTable gets a new tombstone.
+   */
+  std::shared_ptr<const RangeTombstoneList> GetRangeTombstones() const;
 
   std::string ToString() const;
 
@@ -66,10 +136,19 @@ class SuperVersion {
   std::shared_ptr<MemTable> mt_;
   std::shared_ptr<std::vector<std::shared_ptr<MemTable>>> imms_;
   std::shared_ptr<Version> version_;
+  mutable std::mutex range_dels_mu_;
+  /* The range tombstones of mt_ when range_dels_ was built */
+  mutable std::shared_ptr<const RangeTombstoneList> mt_range_dels_;
+  mutable std::shared_ptr<const RangeTombstoneList> range_dels_;
 
   friend class SuperVersionIterator;
 };
 
+/**
+ * It gives all the records of the MemTables and the sorted runs in the order
+ * of the internal keys, including the deleted ones. The range tombstones are
+ * not applied here: DBIterator skips the records they cover.
+ */
 class SuperVersionIterator final : public Iterator {
  public:
   SuperVersionIterator(SuperVersion* sv) : sv_(sv) {}
@@ -89,6 +168,9 @@ class SuperVersionIterator final : public Iterator {
   void Next() override;
 
  private:
+  /* Merge mt_its_ and sst_its_ after they are positioned */
+  void BuildHeap();
+
   /* The referenced superversion */
   SuperVersion* sv_;
   /* The iterators */
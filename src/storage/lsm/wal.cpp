@@ -0,0 +1,125 @@
+#include "storage/lsm/wal.hpp"
+
+#include <charconv>
+#include <filesystem>
+
+#include "common/murmurhash.hpp"
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+static constexpr size_t kWALChecksumSeed = 0x202404011532;
+
+static constexpr size_t kWALHeaderSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+static constexpr size_t kWALEntryHeaderSize = sizeof(seq_t) + sizeof(uint32_t);
+
+void WALWriter::AddRecord(ParsedKey key, Slice value) {
+  WriteBatch batch;
+  batch.Add(key.type_, key.user_key_, value);
+  AddBatch(key.seq_, batch);
+}
+
+void WALWriter::AddBatch(seq_t seq, const WriteBatch& batch) {
+  AddEntry(seq, batch.Count(), batch.rep());
+}
+
+void WALWriter::AddEntry(seq_t seq, size_t count, Slice rep) {
+  payload_.resize(kWALEntryHeaderSize + rep.size());
+  utils::Serializer(payload_.data())
+      .Write(seq)
+      .Write<uint32_t>(count)
+      .WriteString(rep);
+  writer_.AppendValue<uint32_t>(payload_.size())
+      .AppendValue<uint64_t>(
+          utils::Hash(payload_.data(), payload_.size(), kWALChecksumSeed))
+      .AppendString(payload_);
+}
+
+void WALWriter::Commit(bool sync) {
+  if (sync) {
+    writer_.Sync();
+  } else {
+    writer_.Flush();
+  }
+}
+
+WALReader::WALReader(const std::string& filename) {
+  data_.resize(std::filesystem::file_size(filename));
+  if (data_.size() > 0) {
+    ReadFile file(filename, false);
+    auto len = file.Read(data_.data(), data_.size(), 0);
+    data_.resize(len);
+  }
+}
+
+bool WALReader::ReadRecord(ParsedKey* key, Slice* value) {
+  while (batch_.AtEnd()) {
+    if (!ReadEntry()) {
+      return false;
+    }
+  }
+  batch_.Next(&key->type_, &key->user_key_, value);
+  key->seq_ = seq_++;
+  return true;
+}
+
+bool WALReader::ReadEntry() {
+  if (offset_ + kWALHeaderSize > data_.size()) {
+    return false;
+  }
+  auto header = utils::Deserializer(data_.data() + offset_);
+  size_t payload_size = header.Read<uint32_t>();
+  size_t checksum = header.Read<uint64_t>();
+  const char* payload = header.data();
+  if (payload_size < kWALEntryHeaderSize ||
+      offset_ + kWALHeaderSize + payload_size > data_.size() ||
+      utils::Hash(payload, payload_size, kWALChecksumSeed) != checksum) {
+    return false;
+  }
+  auto des = utils::Deserializer(payload);
+  seq_t seq = des.Read<seq_t>();
+  size_t count = des.Read<uint32_t>();
+  Slice rep(des.data(), payload_size - kWALEntryHeaderSize);
+  /* Check all the records first, so that the entry is replayed as a whole. */
+  WriteBatchReader reader(rep);
+  RecordType type;
+  Slice key, value;
+  for (size_t i = 0; i < count; i++) {
+    if (!reader.Next(&type, &key, &value)) {
+      return false;
+    }
+  }
+  if (!reader.AtEnd()) {
+    return false;
+  }
+  batch_ = WriteBatchReader(rep);
+  seq_ = seq;
+  offset_ += kWALHeaderSize + payload_size;
+  return true;
+}
+
+std::string LogFileName(std::string_view db_path, size_t log_number) {
+  return fmt::format("{}/{}.wal", db_path, log_number);
+}
+
+std::optional<size_t> ParseLogFileName(std::string_view filename) {
+  std::string_view ext = ".wal";
+  if (filename.size() <= ext.size() ||
+      filename.substr(filename.size() - ext.size()) != ext) {
+    return std::nullopt;
+  }
+  size_t log_number;
+  auto end = filename.data() + filename.size() - ext.size();
+  auto [ptr, ec] = std::from_chars(filename.data(), end, log_number);
+  if (ec != std::errc() || ptr != end) {
+    return std::nullopt;
+  }
+  return log_number;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "storage/lsm/file.hpp"
+#include "storage/lsm/format.hpp"
+#include "storage/lsm/write_batch.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * The write-ahead log (WAL) of a MemTable.
+ *
+ * Each MemTable has its own log segment "<log_number>.wal" in the database
+ * directory. The segment can be removed once the MemTable is persisted as
+ * SSTables and the metadata is saved.
+ *
+ * Each entry is stored as:
+ * | payload size (uint32_t) | checksum of payload (uint64_t) | payload |
+ * and the payload is a batch of records (see WriteBatch):
+ * | seq of the first record | record count (uint32_t) | records |
+ * The records of an entry have consecutive sequence numbers. An entry is
+ * replayed as a whole or not at all, so a WriteBatch stays atomic.
+ */
+class WALWriter {
+ public:
+  WALWriter(const std::string& filename, size_t buffer_size)
+    : writer_(std::make_unique<SeqWriteFile>(filename, false), buffer_size) {}
+
+  /* Append a record to the write buffer. */
+  void AddRecord(ParsedKey key, Slice value);
+
+  /* Append the records of a batch, with sequence numbers seq, seq + 1, ... */
+  void AddBatch(seq_t seq, const WriteBatch& batch);
+
+  /**
+   * Write the buffered records to the file.
+   * If sync is true, it also waits for the data to reach the device.
+   */
+  void Commit(bool sync);
+
+  /* The number of bytes in the log. */
+  size_t size() const { return writer_.size(); }
+
+ private:
+  FileWriter writer_;
+  void AddEntry(seq_t seq, size_t count, Slice rep);
+
+  /* The buffer for encoding a payload. */
+  std::string payload_;
+};
+
+class WALReader {
+ public:
+  WALReader(const std::string& filename);
+
+  /**
+   * Read the next record. The key and value reference the internal buffer.
+   * Return false at the end of the log, or at the first incomplete or
+   * corrupted entry (e.g. an entry torn by a crash).
+   */
+  bool ReadRecord(ParsedKey* key, Slice* value);
+
+ private:
+  /* Check the next entry and start reading its records. */
+  bool ReadEntry();
+
+  /* The content of the log */
+  std::string data_;
+  /* The offset of the next entry */
+  size_t offset_{0};
+  /* The records of the current entry */
+  WriteBatchReader batch_{Slice()};
+  /* The sequence number of the next record in the current entry */
+  seq_t seq_{0};
+};
+
+/* The path of the log segment with number log_number. */
+std::string LogFileName(std::string_view db_path, size_t log_number);
+
+/* Return the log number if filename is the name of a log segment. */
+std::optional<size_t> ParseLogFileName(std::string_view filename);
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,47 @@
+#include "storage/lsm/write_batch.hpp"
+
+#include "common/serializer.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+static constexpr size_t kRecordHeaderSize =
+    sizeof(RecordType) + sizeof(uint32_t) * 2;
+
+void WriteBatch::Add(RecordType type, Slice key, Slice value) {
+  size_t offset = rep_.size();
+  rep_.resize(offset + kRecordHeaderSize + key.size() + value.size());
+  utils::Serializer(rep_.data() + offset)
+      .Write(type)
+      .Write<uint32_t>(key.size())
+      .WriteString(key)
+      .Write<uint32_t>(value.size())
+      .WriteString(value);
+  count_ += 1;
+}
+
+bool WriteBatchReader::Next(RecordType* type, Slice* key, Slice* value) {
+  if (offset_ + kRecordHeaderSize > rep_.size()) {
+    return false;
+  }
+  auto des = utils::Deserializer(rep_.data() + offset_);
+  *type = des.Read<RecordType>();
+  size_t key_size = des.Read<uint32_t>();
+  if (offset_ + kRecordHeaderSize + key_size > rep_.size()) {
+    return false;
+  }
+  *key = Slice(des.data(), key_size);
+  des = utils::Deserializer(des.data() + key_size);
+  size_t value_size = des.Read<uint32_t>();
+  if (offset_ + kRecordHeaderSize + key_size + value_size > rep_.size()) {
+    return false;
+  }
+  *value = Slice(des.data(), value_size);
+  offset_ += kRecordHeaderSize + key_size + value_size;
+  return true;
+}
+
+}  // namespace lsm
+
+}  // namespace wing
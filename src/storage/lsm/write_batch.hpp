@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+
+#include "storage/lsm/common.hpp"
+#include "storage/lsm/format.hpp"
+
+namespace wing {
+
+namespace lsm {
+
+/**
+ * A batch of writes which is committed atomically by DBImpl::Write. The
+ * records are given a contiguous range of sequence numbers in the order they
+ * are added, and readers see either all of them or none of them.
+ *
+ * Each record is encoded as:
+ * | record type | key size (uint32_t) | key | value size (uint32_t) | value |
+ * A deletion has an empty value, and the value of a range deletion is the end
+ * of the range.
+ */
+class WriteBatch {
+ public:
+  void Put(Slice key, Slice value) { Add(RecordType::Value, key, value); }
+
+  void Del(Slice key) { Add(RecordType::Deletion, key, Slice()); }
+
+  /* Add a merge operand (see MergeOperator). */
+  void Merge(Slice key, Slice operand) {
+    Add(RecordType::Merge, key, operand);
+  }
+
+  /* Delete the keys in [begin, end). It does nothing if begin >= end. */
+  void DeleteRange(Slice begin, Slice end) {
+    if (begin < end) {
+      Add(RecordType::RangeDeletion, begin, end);
+    }
+  }
+
+  /* Add a record as it is. */
+  void Add(RecordType type, Slice key, Slice value);
+
+  void Clear() {
+    rep_.clear();
+    count_ = 0;
+  }
+
+  /* The number of records */
+  size_t Count() const { return count_; }
+
+  bool empty() const { return count_ == 0; }
+
+  /* The encoded records */
+  Slice rep() const { return rep_; }
+
+ private:
+  std::string rep_;
+  size_t count_{0};
+};
+
+/* Read the records encoded by WriteBatch. */
+class WriteBatchReader {
+ public:
+  explicit WriteBatchReader(Slice rep) : rep_(rep) {}
+
+  /**
+   * Read the next record. The key and value reference rep.
+   * Return false at the end, or at the first malformed record.
+   */
+  bool Next(RecordType* type, Slice* key, Slice* value);
+
+  /* Return true if all the records are read. */
+  bool AtEnd() const { return offset_ == rep_.size(); }
+
+ private:
+  Slice rep_;
+  size_t offset_{0};
+};
+
+}  // namespace lsm
+
+}  // namespace wing
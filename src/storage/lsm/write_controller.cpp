@@ -0,0 +1,46 @@
+#include "storage/lsm/write_controller.hpp"
+
+#include <algorithm>
+
+namespace wing {
+
+namespace lsm {
+
+void WriteController::SetState(WriteState state) {
+  std::unique_lock lck(mu_);
+  if (state == WriteState::kDelayed && state_ != WriteState::kDelayed) {
+    /* Start with an empty bucket */
+    tokens_ = 0;
+    last_refill_ = std::chrono::steady_clock::now();
+  }
+  state_ = state;
+}
+
+WriteState WriteController::GetState() {
+  std::unique_lock lck(mu_);
+  return state_;
+}
+
+std::chrono::microseconds WriteController::GetDelay(size_t num_bytes) {
+  std::unique_lock lck(mu_);
+  if (state_ != WriteState::kDelayed) {
+    return std::chrono::microseconds(0);
+  }
+  auto now = std::chrono::steady_clock::now();
+  double elapsed_us =
+      std::chrono::duration<double, std::micro>(now - last_refill_).count();
+  double max_tokens = delayed_write_rate_ * (kRefillIntervalUs / 1e6);
+  tokens_ = std::min(
+      tokens_ + elapsed_us * delayed_write_rate_ / 1e6, max_tokens);
+  last_refill_ = now;
+  tokens_ -= num_bytes;
+  if (tokens_ >= 0) {
+    return std::chrono::microseconds(0);
+  }
+  return std::chrono::microseconds(
+      static_cast<uint64_t>(-tokens_ * 1e6 / delayed_write_rate_));
+}
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace wing {
+
+namespace lsm {
+
+enum class WriteState : uint8_t {
+  /* Writes are not limited */
+  kNormal = 0,
+  /* Writes are limited to the delayed write rate */
+  kDelayed,
+  /* Writes wait until the background jobs catch up */
+  kStopped,
+};
+
+/**
+ * It limits the write rate when the background jobs fall behind.
+ *
+ * In the delayed state, writes are throttled by a token bucket which is
+ * refilled at delayed_write_rate bytes per second and holds at most
+ * kRefillIntervalUs worth of tokens. A writer that takes more tokens than the
+ * bucket has sleeps until the debt is repaid. So the writes are delayed by
+ * a small amount each, instead of stopping all of them for a long time.
+ *
+ * The DB decides the state, and writers wait by themselves in the stopped
+ * state (see DBImpl::DelayWrite).
+ */
+class WriteController {
+ public:
+  WriteController(size_t delayed_write_rate)
+    : delayed_write_rate_(std::max<size_t>(delayed_write_rate, 1)) {}
+
+  void SetState(WriteState state);
+
+  WriteState GetState();
+
+  /**
+   * Take num_bytes tokens. Return the time the writer should sleep before
+   * writing num_bytes bytes. It is zero unless the state is kDelayed.
+   */
+  std::chrono::microseconds GetDelay(size_t num_bytes);
+
+ private:
+  static constexpr uint64_t kRefillIntervalUs = 1000;
+
+  const size_t delayed_write_rate_;
+  std::mutex mu_;
+  WriteState state_{WriteState::kNormal};
+  /* The available tokens. It is negative if writers are in debt. */
+  double tokens_{0};
+  std::chrono::steady_clock::time_point last_refill_;
+};
+
+}  // namespace lsm
+
+}  // namespace wing
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <span>
 #include <vector>
 
 #include "catalog/schema.hpp"
@@ -34,6 +35,21 @@ class ModifyHandle {
   virtual bool Delete(std::string_view key) = 0;
   virtual bool Insert(std::string_view key, std::string_view value) = 0;
   virtual bool Update(std::string_view key, std::string_view new_value) = 0;
+  /**
+   * Insert (keys[i], values[i]) for all i. Return false if a key is
+   * duplicate. The default one inserts them one by one and stops at the first
+   * duplicate key. A storage may override it to insert all of them or none of
+   * them.
+   */
+  virtual bool BatchInsert(std::span<const std::string_view> keys,
+      std::span<const std::string_view> values) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (!Insert(keys[i], values[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
 };
 
 /**
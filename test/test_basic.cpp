@@ -3,6 +3,8 @@
 #include <filesystem>
 
 #include "common/bloomfilter.hpp"
+#include "common/rangefilter.hpp"
+#include "common/ribbonfilter.hpp"
 #include "common/threadpool.hpp"
 #include "instance/instance.hpp"
 #include "test.hpp"
@@ -656,6 +658,26 @@ TEST(ConcurrencyToolTest, ThreadPool) {
   EXPECT_TRUE(fabs(6323.09512394 - sum.load()) < 1e-7);
 }
 
+TEST(ConcurrencyToolTest, ThreadPoolMultipleWaiters) {
+  wing::ThreadPool pool(4);
+  std::atomic<size_t> done = 0;
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < 8; i++) {
+    waiters.emplace_back([&]() {
+      for (int round = 0; round < 100; round++) {
+        for (int j = 0; j < 10; j++) {
+          pool.Push([&]() { done += 1; });
+        }
+        pool.WaitForAllTasks();
+      }
+    });
+  }
+  for (auto& t : waiters) {
+    t.join();
+  }
+  EXPECT_EQ(done.load(), 8 * 100 * 10);
+}
+
 TEST(UtilsTest, BloomFilter) {
   std::string bf;
   size_t N = 1e5;
@@ -674,3 +696,62 @@ TEST(UtilsTest, BloomFilter) {
   DB_INFO("{}", fp / (double)N);
   ASSERT_TRUE(fp / (double)N <= 0.01);
 }
+
+TEST(UtilsTest, RibbonFilter) {
+  using wing::utils::BloomFilter;
+  using wing::utils::RibbonFilter;
+  size_t N = 1e5;
+  auto kv = wing::wing_testing::GenKVData(0x202410161120, 2 * N, 10, 9);
+  std::vector<size_t> hashes;
+  for (uint32_t i = 0; i < N; i++) {
+    hashes.push_back(BloomFilter::BloomHash(kv[i].key()));
+  }
+  std::string rf;
+  RibbonFilter::Build(hashes, 10, rf);
+  /* It is smaller than a bloom filter with 10 bits per key */
+  ASSERT_LE(rf.size() * 8, N * 10);
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_TRUE(RibbonFilter::Find(BloomFilter::BloomHash(kv[i].key()), rf));
+  }
+  size_t fp = 0;
+  for (uint32_t i = N; i < 2 * N; i++) {
+    fp += RibbonFilter::Find(BloomFilter::BloomHash(kv[i].key()), rf);
+  }
+  DB_INFO("{}", fp / (double)N);
+  ASSERT_TRUE(fp / (double)N <= 0.004);
+}
+
+TEST(UtilsTest, RangeFilter) {
+  using wing::utils::RangeFilter;
+  size_t N = 1e5;
+  std::mt19937_64 rgen(0x202410171600);
+  std::vector<uint64_t> keys;
+  for (uint32_t i = 0; i < N; i++) {
+    keys.push_back(rgen());
+  }
+  std::sort(keys.begin(), keys.end());
+  std::string rf;
+  RangeFilter::Build(keys, 16, 10, rf);
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_TRUE(RangeFilter::MayContain(keys[i], keys[i], rf));
+    ASSERT_TRUE(RangeFilter::MayContain(keys[i] - 100, keys[i] + 100, rf));
+  }
+  /* Empty ranges of up to 1000 keys */
+  size_t fp = 0, empty = 0;
+  for (uint32_t i = 0; i < N; i++) {
+    uint64_t lo = rgen(), hi = lo + rgen() % 1000;
+    auto it = std::lower_bound(keys.begin(), keys.end(), lo);
+    if (hi < lo || (it != keys.end() && *it <= hi)) {
+      continue;
+    }
+    empty += 1;
+    fp += RangeFilter::MayContain(lo, hi, rf);
+  }
+  DB_INFO("{}", fp / (double)empty);
+  ASSERT_TRUE(fp / (double)empty <= 0.02);
+  /* Long ranges are not filtered */
+  ASSERT_TRUE(RangeFilter::MayContain(0, -1, rf));
+  ASSERT_FALSE(RangeFilter::MayContain(1, 0, rf));
+  ASSERT_EQ(RangeFilter::KeyPrefix("a"), uint64_t('a') << 56);
+  ASSERT_LT(RangeFilter::KeyPrefix("ab"), RangeFilter::KeyPrefix("b"));
+}
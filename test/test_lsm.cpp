@@ -1,15 +1,29 @@
+#include <fstream>
+
+#include "common/bloomfilter.hpp"
+#include "common/crc32c.hpp"
 #include "common/stopwatch.hpp"
 #include "gtest/gtest.h"
+#include "storage/lsm/blob.hpp"
 #include "storage/lsm/block.hpp"
 #include "storage/lsm/compaction_job.hpp"
+#include "storage/lsm/compaction_pick.hpp"
 #include "storage/lsm/file.hpp"
+#include "storage/lsm/filter.hpp"
+#include "storage/lsm/ingestion_job.hpp"
 #include "storage/lsm/iterator_heap.hpp"
 #include "storage/lsm/level.hpp"
 #include "storage/lsm/lsm.hpp"
+#include "storage/lsm/manifest.hpp"
 #include "storage/lsm/memtable.hpp"
+#include "storage/lsm/scheduler.hpp"
+#include "storage/lsm/snapshot.hpp"
 #include "storage/lsm/sst.hpp"
 #include "storage/lsm/stats.hpp"
 #include "storage/lsm/version.hpp"
+#include "storage/lsm/wal.hpp"
+#include "storage/lsm/write_batch.hpp"
+#include "storage/lsm/write_controller.hpp"
 #include "test.hpp"
 
 using namespace wing::lsm;
@@ -80,6 +94,57 @@ TEST(LSMTest, MemTableSmallTest) {
     f.get();
 }
 
+TEST(LSMTest, MemTableConcurrentReadTest) {
+  for (auto rep : {MemTableRep::kSkipList, MemTableRep::kMap}) {
+    MemTable t(0, rep);
+    size_t n = 1e5, TH = 4;
+    auto kv = GenKVData(0x202404021129, n, 13, 29);
+    std::atomic<size_t> published{0};
+    std::vector<std::future<void>> pool;
+    /* One writer, which is how DBImpl writes MemTable */
+    pool.push_back(std::async([&]() {
+      for (uint32_t i = 0; i < n; i++) {
+        t.Put(kv[i].key(), i + 1, kv[i].value());
+        published.store(i + 1, std::memory_order_release);
+      }
+    }));
+    for (uint32_t th = 0; th < TH; th++) {
+      pool.push_back(std::async([&, seed = th]() {
+        std::mt19937_64 rgen(seed);
+        for (uint32_t i = 0; i < n / TH; i++) {
+          size_t end = published.load(std::memory_order_acquire);
+          if (end == 0) {
+            std::this_thread::yield();
+            continue;
+          }
+          size_t id = rgen() % end;
+          std::string value;
+          ASSERT_EQ(t.Get(kv[id].key(), n, &value), GetResult::kFound);
+          ASSERT_EQ(value, kv[id].value());
+        }
+      }));
+    }
+    for (auto& f : pool)
+      f.get();
+    std::vector<std::pair<std::string, size_t>> keys;
+    for (uint32_t i = 0; i < n; i++) {
+      keys.emplace_back(kv[i].key(), i + 1);
+    }
+    /* Larger sequence numbers are in the front */
+    std::sort(keys.begin(), keys.end(), [](auto& a, auto& b) {
+      return a.first != b.first ? a.first < b.first : a.second > b.second;
+    });
+    auto it = t.Begin();
+    for (auto& [key, seq] : keys) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, key);
+      ASSERT_EQ(ParsedKey(it.key()).seq_, seq);
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  }
+}
+
 TEST(LSMTest, FileWriterTest) {
   FileWriter writer(
       std::make_unique<SeqWriteFile>("__tmpLSMFileWriterTest", false), 4096);
@@ -95,198 +160,1979 @@ TEST(LSMTest, FileWriterTest) {
         ch = rgen() % 256;
       writer.AppendString(s);
     }
-    writer.Flush();
+    writer.Flush();
+  }
+  // Read integers and strings.
+  {
+    auto buf = std::unique_ptr<char[]>(new char[writer.size()]);
+    ReadFile("__tmpLSMFileWriterTest", false).Read(buf.get(), writer.size(), 0);
+    std::mt19937_64 rgen(0x202403152244);
+    for (uint32_t i = 0, off = 0; i < write_n; i++) {
+      uint64_t ans = *reinterpret_cast<uint64_t*>(buf.get() + off);
+      off += sizeof(uint64_t);
+      ASSERT_EQ(ans, rgen());
+      std::uniform_int_distribution<> dis(1, 13);
+      size_t len = dis(rgen);
+      for (uint32_t i = 0; i < len; i++) {
+        ASSERT_EQ(rgen() % 256, (uint8_t)(buf[off]));
+        off += 1;
+      }
+    }
+  }
+  std::remove("__tmpLSMFileWriterTest");
+}
+
+TEST(LSMTest, AsyncReaderTest) {
+  size_t file_size = 1 << 22;
+  std::string data(file_size, 0);
+  std::mt19937_64 rgen(0x202404121530);
+  for (auto& ch : data)
+    ch = rgen() % 256;
+  {
+    FileWriter writer(std::make_unique<SeqWriteFile>(
+                          "__tmpLSMAsyncReaderTest", false),
+        4096);
+    writer.Append(data.data(), data.size());
+    writer.Flush();
+  }
+  ReadFile file("__tmpLSMAsyncReaderTest", false);
+  for (auto backend : {"io_uring", "thread_pool"}) {
+    /* The batches are larger than the queue depth */
+    auto reader = AsyncReader::Create(backend, 8, 4);
+    ASSERT_NE(reader, nullptr);
+    for (uint32_t round = 0; round < 50; round++) {
+      std::vector<std::string> bufs(rgen() % 100 + 1);
+      std::vector<ReadRequest> requests;
+      for (auto& buf : bufs) {
+        buf.resize(rgen() % 8192 + 1);
+        offset_t offset = rgen() % (file_size - buf.size());
+        requests.push_back(ReadRequest{&file, buf.data(), buf.size(), offset});
+      }
+      /* The reads beyond the end of the file are short */
+      requests[0].offset_ = file_size - requests[0].size_ / 2;
+      reader->ReadBatch(requests);
+      for (auto& request : requests) {
+        auto expected = std::string_view(data).substr(
+            request.offset_, request.size_);
+        ASSERT_EQ(request.result_, static_cast<ssize_t>(expected.size()));
+        ASSERT_EQ(std::string_view(request.data_, expected.size()), expected);
+      }
+    }
+  }
+  ASSERT_EQ(AsyncReader::Create("none", 8, 4), nullptr);
+  ASSERT_THROW(AsyncReader::Create("aio", 8, 4), wing::DBException);
+  std::remove("__tmpLSMAsyncReaderTest");
+}
+
+TEST(LSMTest, WALTest) {
+  uint32_t N = 1e5;
+  auto kv = GenKVDataWithRandomLen(0x202404011613, N, {1, 20}, {0, 100});
+  {
+    WALWriter writer("__tmpLSMWALTest", 4096);
+    for (uint32_t i = 0; i < N; i++) {
+      auto type = i % 3 == 0 ? RecordType::Deletion : RecordType::Value;
+      writer.AddRecord(ParsedKey(kv[i].key(), i + 1, type), kv[i].value());
+      if (i % 100 == 0) {
+        writer.Commit(i % 1000 == 0);
+      }
+    }
+    writer.Commit(true);
+    /* A record torn by a crash */
+    writer.AddRecord(ParsedKey("torn", N + 1, RecordType::Value), "record");
+    writer.Commit(false);
+  }
+  std::filesystem::resize_file(
+      "__tmpLSMWALTest", std::filesystem::file_size("__tmpLSMWALTest") - 1);
+  WALReader reader("__tmpLSMWALTest");
+  ParsedKey key;
+  Slice value;
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_TRUE(reader.ReadRecord(&key, &value));
+    ASSERT_EQ(key.user_key_, kv[i].key());
+    ASSERT_EQ(key.seq_, i + 1);
+    ASSERT_EQ(key.type_,
+        i % 3 == 0 ? RecordType::Deletion : RecordType::Value);
+    ASSERT_EQ(value, kv[i].value());
+  }
+  ASSERT_FALSE(reader.ReadRecord(&key, &value));
+  ASSERT_EQ(ParseLogFileName("123.wal"), 123);
+  ASSERT_FALSE(ParseLogFileName("123.sst").has_value());
+  ASSERT_FALSE(ParseLogFileName("a123.wal").has_value());
+  std::remove("__tmpLSMWALTest");
+}
+
+TEST(LSMTest, WriteBatchTest) {
+  WriteBatch batch;
+  batch.Put("a", "1");
+  batch.Del("b");
+  batch.DeleteRange("c", "e");
+  batch.DeleteRange("e", "c");
+  batch.Put("d", "2");
+  ASSERT_EQ(batch.Count(), 4);
+  {
+    WALWriter writer("__tmpLSMWriteBatchTest", 4096);
+    writer.AddBatch(10, batch);
+    writer.Commit(true);
+    /* A batch torn by a crash is dropped as a whole */
+    WriteBatch torn;
+    torn.Put("x", "3");
+    torn.Put("y", "4");
+    writer.AddBatch(14, torn);
+    writer.Commit(false);
+  }
+  std::filesystem::resize_file("__tmpLSMWriteBatchTest",
+      std::filesystem::file_size("__tmpLSMWriteBatchTest") - 1);
+  WALReader reader("__tmpLSMWriteBatchTest");
+  ParsedKey key;
+  Slice value;
+  std::vector<std::tuple<std::string, seq_t, RecordType, std::string>>
+      records;
+  while (reader.ReadRecord(&key, &value)) {
+    records.emplace_back(key.user_key_, key.seq_, key.type_, value);
+  }
+  ASSERT_EQ(records.size(), 4);
+  ASSERT_EQ(records[0], std::make_tuple("a", 10, RecordType::Value, "1"));
+  ASSERT_EQ(records[1], std::make_tuple("b", 11, RecordType::Deletion, ""));
+  ASSERT_EQ(records[2],
+      std::make_tuple("c", 12, RecordType::RangeDeletion, "e"));
+  ASSERT_EQ(records[3], std::make_tuple("d", 13, RecordType::Value, "2"));
+  std::remove("__tmpLSMWriteBatchTest");
+
+  MemTable mt;
+  mt.Put("b", 1, "0");
+  mt.Put("c", 1, "0");
+  mt.Apply(batch, 10);
+  std::string v;
+  ASSERT_EQ(mt.Get("a", 10, &v), GetResult::kFound);
+  ASSERT_EQ(v, "1");
+  ASSERT_EQ(mt.Get("a", 9, &v), GetResult::kNotFound);
+  ASSERT_EQ(mt.Get("b", 11, &v), GetResult::kDelete);
+  ASSERT_EQ(mt.Get("b", 10, &v), GetResult::kFound);
+  ASSERT_EQ(mt.Get("c", 12, &v), GetResult::kDelete);
+  ASSERT_EQ(mt.Get("c", 11, &v), GetResult::kFound);
+  ASSERT_EQ(mt.Get("d", 13, &v), GetResult::kFound);
+  ASSERT_EQ(v, "2");
+}
+
+TEST(LSMTest, CacheTest) {
+  /* Single shard: blocks accessed twice survive a scan */
+  {
+    CacheOptions options;
+    options.capacity = 100 * 1024;
+    options.shard_count = 1;
+    Cache cache(options);
+    auto handle = [](offset_t offset) {
+      return BlockHandle{.offset_ = offset, .size_ = 1024, .count_ = 0};
+    };
+    for (offset_t i = 0; i < 50; i++) {
+      cache.insert(0, handle(i), std::string(1024, i));
+      ASSERT_TRUE(cache.get(0, handle(i)).has_value());
+    }
+    for (offset_t i = 0; i < 10000; i++) {
+      auto h = cache.insert(1, handle(i), std::string(1024, i));
+      ASSERT_EQ(h.block(), std::string(1024, i));
+    }
+    for (offset_t i = 0; i < 50; i++) {
+      auto h = cache.get(0, handle(i));
+      ASSERT_TRUE(h.has_value());
+      ASSERT_EQ(h->block(), std::string(1024, i));
+    }
+    ASSERT_LE(cache.size(), options.capacity);
+  }
+  /* Referenced blocks are not evicted */
+  {
+    CacheOptions options;
+    options.capacity = 64 * 1024;
+    options.shard_count = 4;
+    Cache cache(options);
+    size_t TH = 4, n = 20000;
+    std::vector<std::future<void>> pool;
+    for (uint32_t th = 0; th < TH; th++) {
+      pool.push_back(std::async([&, seed = th]() {
+        std::mt19937_64 rgen(seed);
+        std::vector<Cache::Handle> handles;
+        for (uint32_t i = 0; i < n; i++) {
+          offset_t offset = rgen() % 1000;
+          BlockHandle block{.offset_ = offset, .size_ = 512, .count_ = 0};
+          auto h = cache.get(seed, block);
+          if (!h) {
+            h = cache.insert(seed, block, std::string(512, offset % 256));
+          }
+          ASSERT_EQ(h->block(), std::string(512, offset % 256));
+          handles.push_back(std::move(*h));
+          if (handles.size() > 10) {
+            handles.erase(handles.begin());
+          }
+        }
+      }));
+    }
+    for (auto& f : pool)
+      f.get();
+    ASSERT_LE(cache.size(), options.capacity);
+  }
+}
+
+TEST(LSMTest, BackgroundSchedulerTest) {
+  using namespace wing;
+  using namespace wing::lsm;
+  BackgroundScheduler scheduler(1);
+  std::mutex mu;
+  std::condition_variable cv;
+  bool started = false, release = false;
+  std::vector<int> order;
+  /* Block the only thread so that the following jobs are queued */
+  scheduler.Schedule(BackgroundScheduler::CompactionPriority(0), [&]() {
+    std::unique_lock lck(mu);
+    started = true;
+    cv.notify_all();
+    cv.wait(lck, [&]() { return release; });
+  });
+  {
+    std::unique_lock lck(mu);
+    cv.wait(lck, [&]() { return started; });
+  }
+  for (int level : {3, 1, 2, 0}) {
+    scheduler.Schedule(BackgroundScheduler::CompactionPriority(level),
+        [&, level]() { order.push_back(level); });
+  }
+  scheduler.Schedule(
+      BackgroundScheduler::kFlushPriority, [&]() { order.push_back(-1); });
+  scheduler.Schedule(
+      BackgroundScheduler::kFlushPriority, [&]() { order.push_back(-2); });
+  ASSERT_EQ(scheduler.GetQueueLength(), 6);
+  {
+    std::unique_lock lck(mu);
+    release = true;
+    cv.notify_all();
+  }
+  scheduler.WaitForAll();
+  ASSERT_EQ(order, std::vector<int>({-1, -2, 0, 1, 2, 3}));
+  /* A job scheduled while the scheduler is destroyed is rejected */
+  auto stopping = std::make_unique<BackgroundScheduler>(1);
+  auto stopping_ptr = stopping.get();
+  std::atomic<bool> running = false, accepted = true;
+  stopping->Schedule(BackgroundScheduler::kFlushPriority, [&]() {
+    running = true;
+    while (accepted) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      accepted = stopping_ptr->Schedule(
+          BackgroundScheduler::kFlushPriority, []() {});
+    }
+  });
+  while (!running) {
+    std::this_thread::yield();
+  }
+  stopping.reset();
+  ASSERT_FALSE(accepted);
+}
+
+TEST(LSMTest, WriteControllerTest) {
+  using namespace wing;
+  using namespace wing::lsm;
+  WriteController controller(1024 * 1024);
+  ASSERT_EQ(controller.GetDelay(1024 * 1024).count(), 0);
+  controller.SetState(WriteState::kDelayed);
+  /**
+   * Writers that do not sleep accumulate debt: 64 writes of 1 KiB without
+   * sleeping make the last one wait about 64 / 1024 seconds at 1 MiB/s.
+   */
+  std::chrono::microseconds delay(0);
+  for (int i = 0; i < 64; i++) {
+    delay = controller.GetDelay(1024);
+  }
+  ASSERT_GE(delay.count(), 50000);
+  ASSERT_LE(delay.count(), 70000);
+  /* After the debt is repaid, a write waits about its own size / rate */
+  std::this_thread::sleep_for(delay);
+  delay = controller.GetDelay(1024);
+  ASSERT_LE(delay.count(), 2000);
+  controller.SetState(WriteState::kStopped);
+  ASSERT_EQ(controller.GetDelay(1024).count(), 0);
+  ASSERT_EQ(controller.GetState(), WriteState::kStopped);
+}
+
+TEST(LSMTest, BlockTest) {
+  FileWriter writer(
+      std::make_unique<SeqWriteFile>("__tmpLSMBlockTest", false), 4096);
+  BlockBuilder builder(16384, &writer);
+  uint32_t N = 512, klen = 5, vlen = 6;
+  auto kv = GenKVData(0x202403152328, N, klen, vlen);
+  /* Store the key-value pairs into the block */
+  std::sort(kv.begin(), kv.end());
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_TRUE(builder.Append(
+        ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value()));
+  }
+  builder.Finish();
+  /* Flush the block data to disk */
+  writer.Flush();
+  /* Read the block from the file */
+  auto buf = std::unique_ptr<char[]>(new char[writer.size()]);
+  ReadFile("__tmpLSMBlockTest", false).Read(buf.get(), writer.size(), 0);
+  for (uint32_t i = 0; i < N; i++) {
+    BlockHandle handle;
+    handle.offset_ = 0;
+    handle.size_ = builder.size();
+    handle.count_ = builder.count();
+    BlockIterator it(buf.get(), handle);
+    it.Seek(kv[i].key(), 1);
+    for (uint32_t j = i; j < N; j++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[j].key());
+      ASSERT_EQ(it.value(), kv[j].value());
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  }
+  std::remove("__tmpLSMBlockTest");
+}
+
+TEST(LSMTest, BlockPrefixCompressionTest) {
+  /* Keys with long common prefixes */
+  uint32_t N = 1000;
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < N; i++) {
+    keys.push_back(fmt::format("user/profile/{:08}", i));
+  }
+  std::string value = "v";
+  for (size_t interval : {1, 4, 16}) {
+    FileWriter writer(std::make_unique<SeqWriteFile>(
+                          "__tmpLSMBlockPrefixCompressionTest", false),
+        4096);
+    BlockBuilder builder(1 << 20, &writer, interval);
+    for (uint32_t i = 0; i < N; i++) {
+      /* Two versions of each key */
+      ASSERT_TRUE(builder.Append(
+          ParsedKey(keys[i], 2, RecordType::Value), value + keys[i]));
+      ASSERT_TRUE(
+          builder.Append(ParsedKey(keys[i], 1, RecordType::Deletion), ""));
+    }
+    builder.Finish();
+    writer.Flush();
+    ASSERT_EQ(writer.size(), builder.disk_size());
+    ASSERT_EQ(builder.disk_size(), builder.size() + kBlockTrailerSize);
+    if (interval == 16) {
+      /* The shared prefixes are not stored */
+      size_t full_size = 0;
+      for (auto& key : keys) {
+        full_size += 2 * (key.size() + sizeof(seq_t) + sizeof(RecordType)) +
+                     value.size() + key.size();
+      }
+      ASSERT_LT(builder.size(), full_size * 2 / 3);
+    }
+    auto buf = std::unique_ptr<char[]>(new char[writer.size()]);
+    ReadFile("__tmpLSMBlockPrefixCompressionTest", false)
+        .Read(buf.get(), writer.size(), 0);
+    BlockHandle handle{0, (offset_t)builder.size(), (offset_t)builder.count()};
+    BlockIterator it(buf.get(), handle);
+    it.SeekToFirst();
+    for (uint32_t i = 0; i < N; i++) {
+      for (seq_t seq : {2, 1}) {
+        ASSERT_TRUE(it.Valid());
+        ParsedKey key(it.key());
+        ASSERT_EQ(key.user_key_, keys[i]);
+        ASSERT_EQ(key.seq_, seq);
+        ASSERT_EQ(it.value(), seq == 2 ? value + keys[i] : "");
+        it.Next();
+      }
+    }
+    ASSERT_FALSE(it.Valid());
+    for (uint32_t i = 0; i < N; i += 7) {
+      /* The newer version is skipped if seq is smaller */
+      it.Seek(keys[i], 1);
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, keys[i]);
+      ASSERT_EQ(ParsedKey(it.key()).seq_, 1);
+      it.Seek(keys[i] + "~", 2);
+      if (i + 1 < N) {
+        ASSERT_TRUE(it.Valid());
+        ASSERT_EQ(ParsedKey(it.key()).user_key_, keys[i + 1]);
+      } else {
+        ASSERT_FALSE(it.Valid());
+      }
+    }
+    it.Seek("", 0);
+    ASSERT_TRUE(it.Valid());
+    ASSERT_EQ(ParsedKey(it.key()).user_key_, keys[0]);
+    std::remove("__tmpLSMBlockPrefixCompressionTest");
+  }
+}
+
+TEST(LSMTest, BlockCompressionTest) {
+  /* The codecs round-trip random and repetitive data */
+  std::mt19937_64 rgen(0x202404071702);
+  for (auto type : {CompressionType::kLZ4, CompressionType::kLZ4HC}) {
+    for (size_t len : {0, 1, 12, 13, 100, 4096, 100000}) {
+      for (bool repetitive : {false, true}) {
+        std::string input;
+        while (input.size() < len) {
+          if (repetitive) {
+            /* Words from a small vocabulary */
+            input += fmt::format("word{} ", rgen() % 8);
+          } else {
+            input.push_back(static_cast<char>(rgen()));
+          }
+        }
+        input.resize(len);
+        std::string compressed, output;
+        Compress(type, input, &compressed);
+        ASSERT_TRUE(Decompress(type, compressed, &output));
+        ASSERT_EQ(input, output);
+        if (repetitive && len >= 4096) {
+          ASSERT_LT(compressed.size(), len / 2);
+        }
+      }
+    }
+  }
+  /* Compressed blocks are decompressed by UncompressBlock */
+  uint32_t N = 512;
+  auto kv = GenKVData(0x202404071703, N, 16, 100);
+  std::sort(kv.begin(), kv.end());
+  size_t raw_size = 0;
+  for (auto type :
+      {CompressionType::kNone, CompressionType::kLZ4, CompressionType::kLZ4HC}) {
+    FileWriter writer(
+        std::make_unique<SeqWriteFile>("__tmpLSMBlockCompressionTest", false),
+        4096);
+    BlockBuilder builder(1 << 20, &writer, 16, type);
+    for (uint32_t i = 0; i < N; i++) {
+      ASSERT_TRUE(builder.Append(
+          ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value()));
+    }
+    builder.Finish();
+    writer.Flush();
+    if (type == CompressionType::kNone) {
+      raw_size = builder.disk_size();
+    } else {
+      ASSERT_LT(builder.disk_size(), raw_size * 7 / 8);
+    }
+    std::string block(builder.disk_size(), 0);
+    ReadFile("__tmpLSMBlockCompressionTest", false)
+        .Read(block.data(), block.size(), 0);
+    std::string buf;
+    auto contents = UncompressBlock(block, &buf);
+    ASSERT_EQ(contents.size(), builder.size());
+    BlockIterator it(contents.data(),
+        BlockHandle{0, (offset_t)contents.size(), (offset_t)builder.count()});
+    it.SeekToFirst();
+    for (uint32_t i = 0; i < N; i++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[i].key());
+      ASSERT_EQ(it.value(), kv[i].value());
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+    /* Corruption is detected */
+    block[block.size() / 2] ^= 1;
+    ASSERT_THROW(UncompressBlock(block, &buf), wing::DBException);
+    std::remove("__tmpLSMBlockCompressionTest");
+  }
+}
+
+TEST(LSMTest, BlockChecksumTest) {
+  using wing::utils::Crc32c;
+  ASSERT_EQ(Crc32c("123456789"), 0xe3069283);
+  ASSERT_EQ(Crc32c(std::string(32, 0)), 0x8a9136aa);
+  std::string data = "The quick brown fox jumps over the lazy dog";
+  for (size_t i = 0; i <= data.size(); i++) {
+    ASSERT_EQ(Crc32c(data.substr(i), Crc32c(data.substr(0, i))), Crc32c(data));
+  }
+  /* Every bit flip is detected */
+  std::string block;
+  {
+    FileWriter writer(
+        std::make_unique<SeqWriteFile>("__tmpLSMBlockChecksumTest", false),
+        4096);
+    ASSERT_EQ(WriteBlock(&writer, data, CompressionType::kNone),
+        data.size() + kBlockTrailerSize);
+    writer.Flush();
+    block.resize(writer.size());
+    ReadFile("__tmpLSMBlockChecksumTest", false)
+        .Read(block.data(), block.size(), 0);
+  }
+  std::string buf;
+  ASSERT_EQ(UncompressBlock(block, &buf), data);
+  for (size_t i = 0; i < block.size() * 8; i++) {
+    block[i / 8] ^= 1 << (i % 8);
+    ASSERT_THROW(UncompressBlock(block, &buf), wing::DBException);
+    block[i / 8] ^= 1 << (i % 8);
+  }
+  /* Not verified */
+  block[0] ^= 1;
+  ASSERT_EQ(UncompressBlock(block, &buf, false).size(), data.size());
+  std::remove("__tmpLSMBlockChecksumTest");
+}
+
+TEST(LSMTest, SSTableTest) {
+  SSTableBuilder builder(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>("__tmpLSMSSTableTest", false), 4096),
+      4096, 10);
+  uint32_t klen = 9, vlen = 13, N = 1e5;
+  auto kv =
+      GenKVDataWithRandomLen(0x202403152328, N, {klen - 1, klen}, {1, vlen});
+  auto kv_notinsert =
+      GenKVDataWithRandomLen(0x202403220115, 5e6, {klen - 1, klen}, {1, vlen});
+  std::sort(kv.begin(), kv.end());
+  /* Store the sorted key-value pairs into the SSTable */
+  for (uint32_t i = 0; i < N; i++) {
+    builder.Append(ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value());
+  }
+  /* Flush the SSTable data to disk */
+  builder.Finish();
+  DB_INFO("SSTable size: {} bytes", builder.size());
+  /* Read the SSTable from the file */
+  SSTInfo info;
+  info.count_ = N;
+  info.size_ = builder.size();
+  info.filename_ = "__tmpLSMSSTableTest";
+  info.index_offset_ = builder.GetIndexOffset();
+  info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.sst_id_ = 0;
+  SSTable sst(info, 4096, false);
+  /* Test SSTable::Get */
+  for (uint32_t i = 0; i < N; i++) {
+    std::string value;
+    ASSERT_EQ(sst.Get(kv[i].key(), 1, &value), GetResult::kFound);
+    ASSERT_EQ(value, kv[i].value());
+    ASSERT_EQ(sst.Get(kv[i].key(), 0, &value), GetResult::kNotFound);
+  }
+  /* Test bloom filter */
+  wing::wing_testing::TestTimeout(
+      [&]() {
+        wing::StopWatch sw;
+        for (uint32_t i = 0; i < kv_notinsert.size(); i++) {
+          std::string value;
+          ASSERT_EQ(
+              sst.Get(kv_notinsert[i].key(), 1, &value), GetResult::kNotFound);
+        }
+        DB_INFO("Cost: {}s", sw.GetTimeInSeconds());
+      },
+      1000, "Did you utilize bloom filter? ");
+  /* Test SSTable::Seek */
+  for (uint32_t i = 0; i < 500; i++) {
+    size_t id = i * (N / 499);
+    auto it = sst.Seek(kv[id].key(), 1);
+    for (uint32_t j = id; j < N; j++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[j].key());
+      ASSERT_EQ(it.value(), kv[j].value());
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  }
+  std::remove("__tmpLSMSSTableTest");
+}
+
+TEST(LSMTest, SSTablePartitionedIndexTest) {
+  /* Blocks of high priority survive a scan of blocks of low priority */
+  {
+    CacheOptions options;
+    options.capacity = 100 * 1024;
+    options.shard_count = 1;
+    Cache cache(options);
+    BlockHandle handle{.offset_ = 0, .size_ = 1024, .count_ = 0};
+    cache.insert(0, handle, std::string(1024, 0), Cache::Priority::kHigh);
+    for (offset_t i = 0; i < 10000; i++) {
+      handle.offset_ = i;
+      cache.insert(1, handle, std::string(1024, i));
+    }
+    handle.offset_ = 0;
+    ASSERT_TRUE(cache.get(0, handle).has_value());
+  }
+  SSTableBuilder builder(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>("__tmpLSMPartitionedIndexTest", false),
+          4096),
+      4096, 10);
+  uint32_t klen = 9, vlen = 13, N = 1e5;
+  auto kv =
+      GenKVDataWithRandomLen(0x202404101530, N, {klen - 1, klen}, {1, vlen});
+  std::sort(kv.begin(), kv.end());
+  for (uint32_t i = 0; i < N; i++) {
+    builder.Append(ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value());
+  }
+  builder.Finish();
+  SSTInfo info;
+  info.count_ = N;
+  info.size_ = builder.size();
+  info.filename_ = "__tmpLSMPartitionedIndexTest";
+  info.index_offset_ = builder.GetIndexOffset();
+  info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.sst_id_ = 0;
+  CacheOptions options;
+  options.capacity = 64 * 1024;
+  options.shard_count = 1;
+  Cache cache(options);
+  {
+    SSTable sst(info, 4096, false, true, &cache);
+    /* Only the top-level index is loaded */
+    auto partitions = sst.GetPartitions();
+    ASSERT_GT(partitions.size(), 1);
+    ASSERT_LT(partitions.size() * 50, builder.GetIndexData().size());
+    ASSERT_EQ(cache.size(), 0);
+    ASSERT_EQ(sst.GetSmallestKey().user_key_, kv[0].key());
+    ASSERT_EQ(sst.GetLargestKey().user_key_, kv[N - 1].key());
+    size_t num_blocks = 0;
+    for (auto& partition : partitions) {
+      num_blocks += partition.index_.count_;
+    }
+    ASSERT_EQ(num_blocks, builder.GetIndexData().size());
+    /* Partitions are read through the bounded cache */
+    for (uint32_t i = 0; i < N; i += 7) {
+      std::string value;
+      ASSERT_EQ(sst.Get(kv[i].key(), 1, &value), GetResult::kFound);
+      ASSERT_EQ(value, kv[i].value());
+    }
+    ASSERT_GT(cache.size(), 0);
+    ASSERT_LE(cache.size(), options.capacity);
+    auto it = sst.Begin();
+    for (uint32_t i = 0; i < N; i++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[i].key());
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+    ASSERT_TRUE(sst.VerifyChecksums());
+  }
+  /* Corrupt a byte of the last data block */
+  {
+    std::fstream file("__tmpLSMPartitionedIndexTest",
+        std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(builder.GetBloomFilterOffset() - kBlockTrailerSize - 1);
+    file.put('\xff');
+  }
+  info.sst_id_ = 1;
+  SSTable sst(info, 4096, false, true, &cache);
+  ASSERT_FALSE(sst.VerifyChecksums());
+  std::remove("__tmpLSMPartitionedIndexTest");
+}
+
+TEST(LSMTest, SSTableReadaheadTest) {
+  SSTableBuilder builder(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>("__tmpLSMReadaheadTest", false),
+          4096),
+      4096, 10);
+  uint32_t klen = 9, vlen = 13, N = 1e5;
+  auto kv =
+      GenKVDataWithRandomLen(0x202404121630, N, {klen - 1, klen}, {1, vlen});
+  std::sort(kv.begin(), kv.end());
+  for (uint32_t i = 0; i < N; i++) {
+    builder.Append(ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value());
+  }
+  builder.Finish();
+  SSTInfo info;
+  info.count_ = N;
+  info.size_ = builder.size();
+  info.filename_ = "__tmpLSMReadaheadTest";
+  info.index_offset_ = builder.GetIndexOffset();
+  info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.sst_id_ = 0;
+  Cache cache(CacheOptions{});
+  auto check_scan = [&](SSTable& sst, uint32_t begin) {
+    auto it = sst.Seek(kv[begin].key(), 1);
+    for (uint32_t i = begin; i < N; i++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[i].key());
+      ASSERT_EQ(it.value(), kv[i].value());
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  };
+  {
+    /* The data blocks read ahead are not inserted into the cache */
+    SSTable sst(info, 4096, false, true, &cache, nullptr, 64 * 1024);
+    check_scan(sst, 0);
+    check_scan(sst, N / 3);
+    ASSERT_LT(cache.size(), info.bloom_filter_offset_ / 10);
+    /* Scans use the blocks cached by point lookups */
+    for (uint32_t i = 0; i < N; i += 97) {
+      std::string value;
+      ASSERT_EQ(sst.Get(kv[i].key(), 1, &value), GetResult::kFound);
+    }
+    check_scan(sst, 0);
+  }
+  {
+    info.sst_id_ = 1;
+    size_t cache_size = cache.size();
+    SSTable sst(info, 4096, false, true, &cache, nullptr, 0);
+    check_scan(sst, 0);
+    ASSERT_GT(cache.size(), cache_size + info.bloom_filter_offset_ / 2);
+  }
+  std::remove("__tmpLSMReadaheadTest");
+}
+
+TEST(LSMTest, FilterTest) {
+  uint32_t klen = 9, vlen = 13, N = 1e5;
+  auto kv = GenKVData(0x202410161135, 2 * N, klen, vlen);
+  std::sort(kv.begin(), kv.begin() + N);
+  std::vector<size_t> hashes;
+  for (uint32_t i = 0; i < N; i++) {
+    hashes.push_back(wing::utils::BloomFilter::BloomHash(kv[i].key()));
+  }
+  /* The ribbon filter has fewer false positives with the same memory */
+  size_t fp[2] = {0, 0};
+  for (auto type : {FilterType::kBloom, FilterType::kRibbon}) {
+    auto filter = BuildFilter(type, hashes, 10);
+    ASSERT_LE(filter.size() * 8, N * 10 + 1024);
+    for (uint32_t i = 0; i < N; i++) {
+      ASSERT_TRUE(FilterMayMatch(filter, hashes[i]));
+    }
+    for (uint32_t i = N; i < 2 * N; i++) {
+      fp[static_cast<int>(type)] += FilterMayMatch(
+          filter, wing::utils::BloomFilter::BloomHash(kv[i].key()));
+    }
+  }
+  DB_INFO("False positives: bloom {}, ribbon {}", fp[0], fp[1]);
+  ASSERT_LT(fp[1], fp[0]);
+
+  SSTableBuilder builder(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>("__tmpLSMFilterTest", false), 4096),
+      4096, 10, BlockBuilder::kDefaultRestartInterval, CompressionType::kNone,
+      FilterType::kRibbon);
+  for (uint32_t i = 0; i < N; i++) {
+    builder.Append(ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value());
+  }
+  builder.Finish();
+  SSTInfo info;
+  info.count_ = N;
+  info.size_ = builder.size();
+  info.filename_ = "__tmpLSMFilterTest";
+  info.index_offset_ = builder.GetIndexOffset();
+  info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.sst_id_ = 0;
+  {
+    SSTable sst(info, 4096, false);
+    for (uint32_t i = 0; i < 2 * N; i++) {
+      std::string value;
+      ASSERT_EQ(sst.Get(kv[i].key(), 1, &value),
+          i < N ? GetResult::kFound : GetResult::kNotFound);
+    }
+  }
+  std::remove("__tmpLSMFilterTest");
+
+  /* The memory is moved from the last level to the smaller runs */
+  std::vector<size_t> runs{4, 1, 1, 1}, sizes{4 << 20, 10 << 20, 100 << 20,
+                                             1000 << 20};
+  for (auto type : {FilterType::kBloom, FilterType::kRibbon}) {
+    auto bits = OptimizeBitsPerKey(runs, sizes, 10, type);
+    double memory = 0, total = 0;
+    for (size_t i = 0; i < bits.size(); i++) {
+      if (i > 0) {
+        ASSERT_GT(bits[i - 1], bits[i]);
+      }
+      memory += bits[i] * sizes[i];
+      total += sizes[i];
+    }
+    ASSERT_NEAR(memory / total, 10, 1e-6);
+    ASSERT_LT(bits.back(), 10);
+  }
+  /* A single level gets all the memory */
+  ASSERT_NEAR(OptimizeBitsPerKey(std::vector<size_t>{1},
+                  std::vector<size_t>{1 << 20}, 10, FilterType::kBloom)[0],
+      10, 1e-6);
+  /* The last level does not get a filter if the memory is scarce */
+  auto bits = OptimizeBitsPerKey(runs, sizes, 0.5, FilterType::kBloom);
+  ASSERT_EQ(bits.back(), 0);
+  ASSERT_GT(bits.front(), 1);
+}
+
+TEST(LSMTest, SortedRunTest) {
+  uint32_t klen = 9, vlen = 13, N = 3e6, fileN = 10;
+  auto kv =
+      GenKVDataWithRandomLen(0x202403191425, N, {klen - 1, klen}, {1, vlen});
+  std::sort(kv.begin(), kv.end());
+  /* Create 10 SSTables */
+  wing::StopWatch sw;
+  std::vector<SSTInfo> sst_infos;
+  for (uint32_t i = 0; i < fileN; i++) {
+    auto L = (i) * (N / fileN);
+    auto R = std::min((i + 1) * (N / fileN), N);
+    SSTableBuilder builder(
+        std::make_unique<FileWriter>(
+            std::make_unique<SeqWriteFile>(
+                fmt::format("__tmpSortedRunTest{}", i), false),
+            1 << 20),
+        4096, 10);
+    /* Build the SSTable */
+    for (uint32_t j = L; j < R; j++) {
+      builder.Append(
+          ParsedKey(kv[j].key(), 1, RecordType::Value), kv[j].value());
+    }
+    builder.Finish();
+    /* Add the SSTable*/
+    SSTInfo info;
+    info.count_ = builder.count();
+    info.filename_ = fmt::format("__tmpSortedRunTest{}", i);
+    info.index_offset_ = builder.GetIndexOffset();
+    info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+    info.size_ = builder.size();
+    info.sst_id_ = i;
+    sst_infos.emplace_back(info);
+  }
+  DB_INFO("Create Sorted Run Cost: {}s", sw.GetTimeInSeconds());
+  sw.Reset();
+  SortedRun sr(sst_infos, 4096, false);
+  /* Test SortedRun::Get */
+  for (uint32_t i = 0; i < N; i++) {
+    std::string value;
+    ASSERT_EQ(sr.Get(kv[i].key(), 1, &value), GetResult::kFound);
+    ASSERT_EQ(value, kv[i].value());
+  }
+  DB_INFO("SortedRun::Get Cost: {}s", sw.GetTimeInSeconds());
+  sw.Reset();
+  /* Test SortedRun::Seek */
+  for (uint32_t i = 0; i < 500; i++) {
+    size_t step = (N / 499);
+    size_t id = i * step;
+    auto it = sr.Seek(kv[id].key(), 1);
+    for (uint32_t j = id; j < N && j < id + step * 10; j++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[j].key());
+      ASSERT_EQ(it.value(), kv[j].value());
+      it.Next();
+    }
+  }
+  DB_INFO("Short Range Scan Cost: {}s", sw.GetTimeInSeconds());
+  sw.Reset();
+  /* Test SortedRun::Begin */
+  {
+    auto it = sr.Begin();
+    for (uint32_t i = 0; i < N; i++) {
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[i].key());
+      ASSERT_EQ(it.value(), kv[i].value());
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+  }
+  DB_INFO("Full Scan Cost: {}s", sw.GetTimeInSeconds());
+  /* Delete all SSTables */
+  for (uint32_t i = 0; i < fileN * 2; i++) {
+    std::remove(fmt::format("__tmpSortedRunTest{}", i).c_str());
+  }
+}
+
+TEST(LSMTest, MultiGetTest) {
+  uint32_t klen = 9, vlen = 13, N = 2e5, fileN = 4;
+  auto kv =
+      GenKVDataWithRandomLen(0x202404111002, N, {klen - 1, klen}, {1, vlen});
+  std::sort(kv.begin(), kv.end());
+  kv.erase(std::unique(kv.begin(), kv.end(),
+               [](auto& a, auto& b) { return a.key() == b.key(); }),
+      kv.end());
+  N = kv.size();
+  std::vector<SSTInfo> sst_infos;
+  for (uint32_t i = 0; i < fileN; i++) {
+    auto L = i * (N / fileN);
+    auto R = i + 1 == fileN ? N : (i + 1) * (N / fileN);
+    auto filename = fmt::format("__tmpMultiGetTest{}", i);
+    SSTableBuilder builder(
+        std::make_unique<FileWriter>(
+            std::make_unique<SeqWriteFile>(filename, false), 1 << 20),
+        4096, 10);
+    for (uint32_t j = L; j < R; j++) {
+      /* Delete every 5th key in the SSTables */
+      if (j % 5 == 0) {
+        builder.Append(ParsedKey(kv[j].key(), 2, RecordType::Deletion), "");
+      }
+      builder.Append(
+          ParsedKey(kv[j].key(), 1, RecordType::Value), kv[j].value());
+    }
+    builder.Finish();
+    SSTInfo info;
+    info.count_ = builder.count();
+    info.filename_ = filename;
+    info.index_offset_ = builder.GetIndexOffset();
+    info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+    info.size_ = builder.size();
+    info.sst_id_ = i;
+    sst_infos.emplace_back(info);
+  }
+  /* Every 7th key is overwritten in the MemTable */
+  auto mt = std::make_shared<MemTable>();
+  for (uint32_t i = 0; i < N; i += 7) {
+    mt->Put(kv[i].key(), 3, "new");
+  }
+  auto absent = GenKVData(0x202404111003, 1000, klen + 1, 1);
+  for (auto backend : {"none", "thread_pool", "io_uring"}) {
+    auto reader = AsyncReader::Create(backend, 32, 4);
+    Cache cache(CacheOptions{});
+    auto run = std::make_shared<SortedRun>(
+        sst_infos, 4096, false, true, &cache, reader.get());
+    std::vector<Level> levels;
+    levels.emplace_back(0, std::vector<std::shared_ptr<SortedRun>>{run});
+    SuperVersion sv(mt,
+        std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
+        std::make_shared<Version>(std::move(levels)));
+    for (uint32_t round = 0; round < 20; round++) {
+      std::mt19937_64 rgen(round);
+      std::vector<KeyContext> contexts(500);
+      std::vector<size_t> ids;
+      for (uint32_t i = 0; i < contexts.size(); i++) {
+        /* Some keys are looked up twice, and some are absent */
+        if (i % 10 == 9) {
+          contexts[i].key_ = absent[rgen() % absent.size()].key();
+          ids.push_back(N);
+        } else {
+          ids.push_back(i % 10 == 8 ? ids[i - 1] : rgen() % N);
+          contexts[i].key_ = kv[ids[i]].key();
+        }
+      }
+      std::vector<KeyContext*> keys;
+      for (auto& context : contexts) {
+        keys.push_back(&context);
+      }
+      std::sort(keys.begin(), keys.end(),
+          [](auto a, auto b) { return a->key_ < b->key_; });
+      sv.MultiGet(&keys, 2);
+      for (uint32_t i = 0; i < contexts.size(); i++) {
+        auto id = ids[i];
+        if (id == N) {
+          ASSERT_EQ(contexts[i].result_, GetResult::kNotFound);
+        } else if (id % 5 == 0) {
+          ASSERT_EQ(contexts[i].result_, GetResult::kDelete);
+        } else {
+          ASSERT_EQ(contexts[i].result_, GetResult::kFound);
+          ASSERT_EQ(contexts[i].value_, kv[id].value());
+        }
+      }
+      /* The records in the MemTable are newer */
+      keys.clear();
+      for (auto& context : contexts) {
+        context.result_ = GetResult::kNotFound;
+        keys.push_back(&context);
+      }
+      std::sort(keys.begin(), keys.end(),
+          [](auto a, auto b) { return a->key_ < b->key_; });
+      sv.MultiGet(&keys, 3);
+      for (uint32_t i = 0; i < contexts.size(); i++) {
+        if (ids[i] != N && ids[i] % 7 == 0) {
+          ASSERT_EQ(contexts[i].result_, GetResult::kFound);
+          ASSERT_EQ(contexts[i].value_, "new");
+        }
+      }
+    }
+    /* Scans read ahead the blocks that are not cached by MultiGet */
+    uint32_t j = 0;
+    for (auto& sst : run->GetSSTs()) {
+      for (auto it = sst->Begin(); it.Valid(); it.Next()) {
+        ParsedKey key(it.key());
+        ASSERT_EQ(key.user_key_, kv[j].key());
+        if (key.type_ == RecordType::Value) {
+          ASSERT_EQ(it.value(), kv[j].value());
+          j += 1;
+        }
+      }
+    }
+    ASSERT_EQ(j, N);
+  }
+  for (uint32_t i = 0; i < fileN; i++) {
+    std::remove(fmt::format("__tmpMultiGetTest{}", i).c_str());
+  }
+}
+
+TEST(LSMTest, RangeDeletionTest) {
+  auto key = [](uint32_t i) { return fmt::format("{:08}", i); };
+  uint32_t N = 1000;
+  /* Fragments agree with the tombstones */
+  {
+    std::mt19937_64 rgen(0x202404131050);
+    std::vector<RangeTombstone> tombstones;
+    for (uint32_t i = 0; i < 100; i++) {
+      uint32_t begin = rgen() % N, end = begin + rgen() % 100;
+      tombstones.push_back(
+          RangeTombstone{key(begin), key(end), rgen() % 50 + 1});
+    }
+    RangeTombstoneList list(tombstones);
+    auto covering = [&](uint32_t k, seq_t seq) {
+      seq_t ret = 0;
+      for (auto& t : tombstones) {
+        if (t.begin_ <= key(k) && key(k) < t.end_ && t.seq_ <= seq) {
+          ret = std::max(ret, t.seq_);
+        }
+      }
+      return ret;
+    };
+    RangeTombstoneList truncated(list.ToTombstones(key(300), key(600)));
+    for (uint32_t k = 0; k < N + 100; k++) {
+      seq_t seq = rgen() % 60;
+      ASSERT_EQ(list.MaxCoveringSeq(key(k), seq), covering(k, seq));
+      ASSERT_EQ(truncated.MaxCoveringSeq(key(k), seq),
+          300 <= k && k < 600 ? covering(k, seq) : 0);
+    }
+    ASSERT_TRUE(RangeTombstoneList({{key(2), key(1), 1}}).empty());
+  }
+  /* A range tombstone deletes the older records in the MemTable */
+  {
+    MemTable mt;
+    for (uint32_t i = 0; i < N; i++) {
+      mt.Put(key(i), i + 1, "v");
+    }
+    mt.DelRange(key(100), key(200), N + 1);
+    mt.Put(key(150), N + 2, "new");
+    std::string value;
+    ASSERT_EQ(mt.Get(key(99), N + 2, &value), GetResult::kFound);
+    ASSERT_EQ(mt.Get(key(100), N + 2, &value), GetResult::kDelete);
+    ASSERT_EQ(mt.Get(key(199), N + 2, &value), GetResult::kDelete);
+    ASSERT_EQ(mt.Get(key(200), N + 2, &value), GetResult::kFound);
+    ASSERT_EQ(mt.Get(key(150), N + 2, &value), GetResult::kFound);
+    ASSERT_EQ(value, "new");
+    /* Keys that are not in the MemTable, and reads before the deletion */
+    ASSERT_EQ(mt.Get(key(120) + "x", N + 2, &value), GetResult::kDelete);
+    ASSERT_EQ(mt.Get(key(120), N, &value), GetResult::kFound);
+    ASSERT_EQ(mt.Get(key(N), N + 2, &value), GetResult::kNotFound);
+  }
+  /* Range tombstones in SSTables */
+  std::vector<SSTInfo> sst_infos;
+  auto build = [&](uint32_t id, uint32_t begin, uint32_t end,
+                   std::vector<RangeTombstone> tombstones) {
+    auto filename = fmt::format("__tmpRangeDeletionTest{}", id);
+    SSTableBuilder builder(
+        std::make_unique<FileWriter>(
+            std::make_unique<SeqWriteFile>(filename, false), 1 << 20),
+        4096, 10);
+    for (uint32_t i = begin; i < end; i++) {
+      builder.Append(ParsedKey(key(i), 1, RecordType::Value), "v");
+    }
+    for (auto& tombstone : tombstones) {
+      builder.AddRangeTombstone(tombstone);
+    }
+    builder.Finish();
+    SSTInfo info;
+    info.count_ = builder.count();
+    info.filename_ = filename;
+    info.index_offset_ = builder.GetIndexOffset();
+    info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+    info.size_ = builder.size();
+    info.sst_id_ = id;
+    sst_infos.push_back(info);
+  };
+  build(0, 0, N / 2, {{key(100), key(N), 2}});
+  /* An SSTable with range tombstones only */
+  build(1, 0, 0, {{key(N), key(N + 100), 2}, {key(N + 50), key(N + 200), 3}});
+  build(2, N + 200, N + 300, {});
+  {
+    SSTable sst(sst_infos[0], 4096, false);
+    std::string value;
+    ASSERT_EQ(sst.Get(key(99), 2, &value), GetResult::kFound);
+    ASSERT_EQ(sst.Get(key(100), 2, &value), GetResult::kDelete);
+    ASSERT_EQ(sst.Get(key(100), 1, &value), GetResult::kFound);
+    /* The key range covers the range tombstones */
+    ASSERT_EQ(sst.Get(key(N - 1), 2, &value), GetResult::kDelete);
+    ASSERT_EQ(sst.GetLargestKey().user_key_, key(N));
+    ASSERT_EQ(sst.GetLargestKey().seq_, std::numeric_limits<seq_t>::max());
+    SSTable only(sst_infos[1], 4096, false);
+    ASSERT_EQ(only.GetSmallestKey().user_key_, key(N));
+    ASSERT_EQ(only.GetLargestKey().user_key_, key(N + 200));
+    ASSERT_EQ(only.Get(key(N - 1), 3, &value), GetResult::kNotFound);
+    ASSERT_EQ(only.Get(key(N + 60), 2, &value), GetResult::kDelete);
+    ASSERT_EQ(only.Get(key(N + 150), 2, &value), GetResult::kNotFound);
+    ASSERT_FALSE(only.Begin().Valid());
+    ASSERT_TRUE(only.VerifyChecksums());
+  }
+  /* The range tombstones delete the records in the older levels */
+  std::vector<Level> levels;
+  levels.emplace_back(0, std::vector<std::shared_ptr<SortedRun>>{
+                             std::make_shared<SortedRun>(
+                                 std::vector<SSTInfo>{sst_infos[0],
+                                     sst_infos[1], sst_infos[2]},
+                                 4096, false)});
+  {
+    std::vector<SSTInfo> old_ssts;
+    std::swap(old_ssts, sst_infos);
+    build(3, N / 2, N + 300, {});
+    std::swap(old_ssts, sst_infos);
+    levels.emplace_back(1, std::vector<std::shared_ptr<SortedRun>>{
+                               std::make_shared<SortedRun>(old_ssts, 4096,
+                                   false)});
+  }
+  auto mt = std::make_shared<MemTable>();
+  mt->DelRange(key(N + 250), key(N + 260), 4);
+  auto sv = std::make_shared<SuperVersion>(mt,
+      std::make_shared<std::vector<std::shared_ptr<MemTable>>>(),
+      std::make_shared<Version>(std::move(levels)));
+  std::vector<KeyContext> contexts(N + 300);
+  std::vector<KeyContext*> keys;
+  std::vector<std::string> key_strs;
+  for (uint32_t i = 0; i < N + 300; i++) {
+    key_strs.push_back(key(i));
+  }
+  for (uint32_t i = 0; i < N + 300; i++) {
+    contexts[i].key_ = key_strs[i];
+    keys.push_back(&contexts[i]);
+  }
+  sv->MultiGet(&keys, 4);
+  for (uint32_t i = 0; i < N + 300; i++) {
+    bool deleted = (100 <= i && i < N + 200) || (N + 250 <= i && i < N + 260);
+    ASSERT_EQ(contexts[i].result_,
+        deleted ? GetResult::kDelete : GetResult::kFound);
+  }
+  /* The point lookups and the scans skip them too */
+  for (uint32_t i = 0; i < N + 300; i++) {
+    bool deleted = (100 <= i && i < N + 200) || (N + 250 <= i && i < N + 260);
+    std::string value;
+    ASSERT_EQ(sv->Get(key(i), 4, &value), !deleted);
+  }
+  {
+    std::vector<std::string> scanned;
+    auto it = DBIterator(sv, 4);
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+      scanned.emplace_back(it.key());
+    }
+    ASSERT_EQ(scanned.size(), 190);
+    ASSERT_EQ(scanned[99], key(99));
+    ASSERT_EQ(scanned[100], key(N + 200));
+    ASSERT_EQ(scanned[150], key(N + 260));
+  }
+  auto range_dels = sv->GetRangeTombstones();
+  ASSERT_EQ(range_dels->MaxCoveringSeq(key(N + 60), 4), 3);
+  ASSERT_EQ(range_dels->MaxCoveringSeq(key(N + 255), 4), 4);
+  /* The fragmented tombstones are built once and shared */
+  ASSERT_EQ(sv->GetRangeTombstones(), range_dels);
+  /* A compaction removes the records covered by the range tombstones */
+  {
+    auto& runs = sv->GetVersion()->GetLevels();
+    Compaction compaction(
+        {}, {runs[0].GetRuns()[0], runs[1].GetRuns()[0]}, 0, 1, nullptr,
+        false);
+    FileNameGenerator gen("__tmpRangeDeletionTestOutput", 0);
+    CompactionJob job(&gen, 256, 1024, 4096, 10, false);
+    job.SetRangeTombstones(sv->GetVersion()->GetRangeTombstones());
+    auto outputs = job.Run(CompactionInputIterator(compaction, std::nullopt));
+    size_t count = 0;
+    for (auto& info : outputs) {
+      count += info.count_;
+    }
+    ASSERT_EQ(count, 200);
+    ASSERT_GT(outputs.size(), 1);
+    SortedRun run(outputs, 256, false);
+    run.SetRemoveTag(true);
+    auto it = run.Begin();
+    for (uint32_t i = 0; i < N + 300; i++) {
+      if (100 <= i && i < N + 200) {
+        continue;
+      }
+      ASSERT_TRUE(it.Valid());
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, key(i));
+      it.Next();
+    }
+    ASSERT_FALSE(it.Valid());
+    /* The range tombstones are kept for the older levels */
+    for (uint32_t i = 0; i < N + 300; i++) {
+      std::string value;
+      bool deleted = 100 <= i && i < N + 200;
+      ASSERT_EQ(run.Get(key(i), 4, &value),
+          deleted ? GetResult::kDelete : GetResult::kFound);
+    }
+  }
+  sv.reset();
+  for (uint32_t i = 0; i < 4; i++) {
+    std::remove(fmt::format("__tmpRangeDeletionTest{}", i).c_str());
+  }
+}
+
+TEST(LSMTest, SnapshotTest) {
+  SnapshotList list;
+  auto s1 = list.New(5);
+  auto s2 = list.New(3);
+  auto s3 = list.New(5);
+  ASSERT_EQ(s1->GetSeq(), 5);
+  ASSERT_EQ(list.GetSeqs(), std::vector<seq_t>({3, 5}));
+  list.Release(s1);
+  ASSERT_EQ(list.GetSeqs(), std::vector<seq_t>({3, 5}));
+  list.Release(s3);
+  ASSERT_EQ(list.GetSeqs(), std::vector<seq_t>({3}));
+  list.Release(s2);
+  ASSERT_TRUE(list.empty());
+
+  /* The records of "a" and "b" from the newest to the oldest */
+  auto range_dels = std::make_shared<RangeTombstoneList>(
+      std::vector<RangeTombstone>{{"b", "c", 7}});
+  VisibilityFilter filter({2, 5}, range_dels);
+  /* Stripe 2: (5, max]. Only the newest record is kept. */
+  ASSERT_TRUE(filter.Keep(ParsedKey("a", 8, RecordType::Value)));
+  ASSERT_FALSE(filter.Keep(ParsedKey("a", 7, RecordType::Value)));
+  /* Stripe 1: (2, 5] */
+  ASSERT_TRUE(filter.Keep(ParsedKey("a", 5, RecordType::Deletion)));
+  ASSERT_FALSE(filter.Keep(ParsedKey("a", 4, RecordType::Value)));
+  ASSERT_FALSE(filter.Keep(ParsedKey("a", 3, RecordType::Value)));
+  /* Stripe 0: [0, 2] */
+  ASSERT_TRUE(filter.Keep(ParsedKey("a", 1, RecordType::Value)));
+  /* The tombstone at 7 covers the records in stripe 2 only */
+  ASSERT_FALSE(filter.Keep(ParsedKey("b", 6, RecordType::Value)));
+  ASSERT_TRUE(filter.Keep(ParsedKey("b", 4, RecordType::Value)));
+  ASSERT_TRUE(filter.Keep(ParsedKey("b", 2, RecordType::Value)));
+  ASSERT_FALSE(filter.Keep(ParsedKey("b", 1, RecordType::Value)));
+
+  /* Without snapshots, only the newest record of a key is kept */
+  VisibilityFilter latest({}, range_dels);
+  ASSERT_TRUE(latest.Keep(ParsedKey("a", 8, RecordType::Value)));
+  ASSERT_FALSE(latest.Keep(ParsedKey("a", 1, RecordType::Value)));
+  ASSERT_FALSE(latest.Keep(ParsedKey("b", 4, RecordType::Value)));
+  ASSERT_FALSE(latest.Keep(ParsedKey("b", 2, RecordType::Value)));
+  ASSERT_TRUE(latest.Keep(ParsedKey("c", 1, RecordType::Value)));
+
+  /* A live snapshot reads the overwritten records after compactions */
+  Options options;
+  options.db_path = "__tmpSnapshotTest/";
+  options.compaction_strategy_name = "dynamic";
+  options.sst_file_size = 64 * 1024;
+  options.write_buffer_size = 64 * 1024;
+  options.level0_compaction_trigger = 2;
+  std::filesystem::create_directories(options.db_path);
+  auto lsm = DBImpl::Create(options);
+  uint32_t N = 20000;
+  auto key = [](uint32_t i) { return fmt::format("{:08}", i); };
+  for (uint32_t i = 0; i < N; i++) {
+    lsm->Put(key(i), fmt::format("old{:032}", i));
+  }
+  auto snapshot = lsm->GetSnapshot();
+  for (uint32_t i = 0; i < N; i++) {
+    if (i % 3 == 0) {
+      lsm->Del(key(i));
+    } else {
+      lsm->Put(key(i), fmt::format("new{:032}", i));
+    }
+  }
+  lsm->WaitForFlushAndCompaction();
+  size_t num_ssts = 0;
+  for (auto& level : lsm->GetSV()->GetVersion()->GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      num_ssts += level.GetID() > 0 ? run->SSTCount() : 0;
+    }
+  }
+  ASSERT_GT(num_ssts, 0);
+  for (uint32_t i = 0; i < N; i++) {
+    std::string value;
+    ASSERT_TRUE(lsm->Get(key(i), &value, snapshot));
+    ASSERT_EQ(value, fmt::format("old{:032}", i));
+    ASSERT_EQ(lsm->Get(key(i), &value), i % 3 != 0);
+    if (i % 3 != 0) {
+      ASSERT_EQ(value, fmt::format("new{:032}", i));
+    }
+  }
+  {
+    uint32_t i = 0;
+    for (auto it = lsm->Begin(snapshot); it.Valid(); it.Next(), i++) {
+      ASSERT_EQ(it.key(), key(i));
+      ASSERT_EQ(it.value(), fmt::format("old{:032}", i));
+    }
+    ASSERT_EQ(i, N);
+  }
+  lsm->ReleaseSnapshot(snapshot);
+  lsm.reset();
+  std::filesystem::remove_all(options.db_path);
+}
+
+TEST(LSMTest, IngestionTest) {
+  uint32_t N = 1e5;
+  std::vector<std::pair<std::string, std::string>> records;
+  for (uint32_t i = 0; i < N; i++) {
+    records.emplace_back(fmt::format("{:08}", (i * 7919) % N), "old");
+  }
+  /* The last record of a key wins */
+  records.emplace_back(fmt::format("{:08}", 5), "new");
+  wing::ThreadPool pool(4);
+  FileNameGenerator gen("__tmpIngestionTest", 0);
+  IngestionJob::Sort(&records, &pool, 4);
+  ASSERT_EQ(records.size(), N);
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_EQ(records[i].first, fmt::format("{:08}", i));
+    ASSERT_EQ(records[i].second, i == 5 ? "new" : "old");
+  }
+
+  auto ssts = IngestionJob(&gen, 4096, 256 * 1024, 4096, 10, false)
+                  .Run(records, 3, &pool);
+  ASSERT_GT(ssts.size(), 2);
+  /* They are merged into the sorted run of a level in key order */
+  {
+    auto run = [&](std::vector<SSTInfo> infos) {
+      return std::make_shared<SortedRun>(infos, 4096, false);
+    };
+    Version version;
+    version.Append(1, run({ssts[0], ssts[2]}));
+    version.Insert(1, run({ssts[1]}));
+    auto& runs = version.GetLevels()[1].GetRuns();
+    ASSERT_EQ(runs.size(), 1);
+    ASSERT_EQ(runs[0]->SSTCount(), 3);
+    for (uint32_t i = 0; i < 3; i++) {
+      ASSERT_EQ(runs[0]->GetSSTs()[i]->GetSSTInfo().sst_id_, ssts[i].sst_id_);
+    }
+    /* A run that overlaps the run of the level is appended. */
+    version.Insert(1, run({ssts[1]}));
+    ASSERT_EQ(version.GetLevels()[1].GetRuns().size(), 2);
+    /* A new level gets a new run */
+    version.Insert(2, run({ssts[1]}));
+    ASSERT_EQ(version.GetLevels()[2].GetRuns().size(), 1);
+  }
+  /* The inputs of a compaction are removed by identity */
+  {
+    auto run = [&](std::vector<SSTInfo> infos) {
+      return std::make_shared<SortedRun>(infos, 4096, false);
+    };
+    Version version;
+    version.Append(0, run({ssts[1]}));
+    version.Append(1, run({ssts[0], ssts[2]}));
+    auto inputs = version.GetLevels()[0].GetRuns()[0]->GetSSTs();
+    auto target = version.GetLevels()[1].GetRuns()[0];
+    inputs.push_back(target->GetSSTs()[0]);
+    /* Another SSTable is merged into the target in the meantime */
+    version.Insert(1, run({ssts[1]}));
+    version.Remove(inputs);
+    ASSERT_TRUE(version.GetLevels()[0].GetRuns().empty());
+    auto& runs = version.GetLevels()[1].GetRuns();
+    ASSERT_EQ(runs.size(), 1);
+    ASSERT_EQ(runs[0]->SSTCount(), 2);
+    ASSERT_EQ(runs[0]->GetSSTs()[0]->GetSSTInfo().sst_id_, ssts[1].sst_id_);
+    ASSERT_EQ(runs[0]->GetSSTs()[1]->GetSSTInfo().sst_id_, ssts[2].sst_id_);
+  }
+  /* The SSTables form a sorted run */
+  uint32_t i = 0;
+  for (auto& info : ssts) {
+    SSTable sst(info, 4096, false);
+    sst.SetRemoveTag(true);
+    for (auto it = sst.Begin(); it.Valid(); it.Next(), i++) {
+      ParsedKey key(it.key());
+      ASSERT_EQ(key.user_key_, records[i].first);
+      ASSERT_EQ(key.seq_, 3);
+      ASSERT_EQ(it.value(), records[i].second);
+    }
+  }
+  ASSERT_EQ(i, N);
+}
+
+TEST(LSMTest, BlobTest) {
+  std::filesystem::create_directories("__tmpBlobTest");
+  uint32_t N = 1e4;
+  std::vector<std::pair<std::string, std::string>> records;
+  for (uint32_t i = 0; i < N; i++) {
+    /* Only the values of odd keys are separated */
+    records.emplace_back(fmt::format("{:08}", i),
+        std::string(i % 2 ? 200 : 50, 'a' + i % 26));
+  }
+  wing::ThreadPool pool(4);
+  FileNameGenerator gen("__tmpBlobTest/", 0);
+  BlobStore blobs("__tmpBlobTest/", true, 4096);
+  IngestionJob job(&gen, 4096, 256 * 1024, 4096, 10, false);
+  job.SetBlobs(&blobs, 100);
+  std::vector<std::shared_ptr<SSTable>> ssts;
+  std::set<size_t> old_files;
+  for (auto& info : job.Run(records, 3, &pool)) {
+    ASSERT_EQ(info.blob_files_.size(), 1);
+    old_files.insert(info.blob_files_[0]);
+    ssts.push_back(std::make_shared<SSTable>(
+        info, 4096, false, true, nullptr, nullptr, 0, &blobs));
+  }
+  ASSERT_GT(ssts.size(), 1);
+  uint32_t i = 0;
+  for (auto& sst : ssts) {
+    for (auto it = sst->Begin(); it.Valid(); it.Next(), i++) {
+      ParsedKey key(it.key());
+      ASSERT_EQ(key.type_, i % 2 ? RecordType::BlobIndex : RecordType::Value);
+      std::string value;
+      ASSERT_EQ(sst->Get(key.user_key_, 3, &value), GetResult::kFound);
+      ASSERT_EQ(value, records[i].second);
+    }
+  }
+  ASSERT_EQ(i, N);
+
+  /* A compaction relocates the values of the old blob files */
+  std::unique_ptr<SortedRun> compacted;
+  {
+    Compaction compaction(ssts, {}, 0, 1, nullptr, false);
+    CompactionJob compaction_job(&gen, 4096, 256 * 1024, 4096, 10, false);
+    compaction_job.SetBlobs(&blobs, 100, *old_files.rbegin() + 1);
+    auto outputs =
+        compaction_job.Run(CompactionInputIterator(compaction, std::nullopt));
+    ASSERT_GT(outputs.size(), 1);
+    std::set<size_t> new_files;
+    for (auto& info : outputs) {
+      ASSERT_EQ(info.blob_files_.size(), 1);
+      ASSERT_FALSE(old_files.count(info.blob_files_[0]));
+      new_files.insert(info.blob_files_[0]);
+    }
+    /* Each output has its own blob file */
+    ASSERT_EQ(new_files.size(), outputs.size());
+    compacted = std::make_unique<SortedRun>(
+        outputs, 4096, false, true, nullptr, nullptr, 0, &blobs);
+    compacted->SetRemoveTag(true);
+  }
+
+  /* Relocate the values to a new blob file, as a compaction does */
+  auto builder = blobs.NewBuilder(&gen);
+  auto [filename, id] = gen.Generate();
+  SSTableBuilder sst_builder(
+      std::make_unique<FileWriter>(
+          std::make_unique<SeqWriteFile>(filename, false), 4096),
+      4096, 10);
+  sst_builder.SetBlobBuilder(builder.get(), 100, *old_files.rbegin() + 1);
+  for (auto& sst : ssts) {
+    for (auto it = sst->Begin(); it.Valid(); it.Next()) {
+      sst_builder.Append(ParsedKey(it.key()), it.value());
+    }
+  }
+  builder->Finish();
+  sst_builder.Finish();
+  SSTInfo info;
+  info.count_ = sst_builder.count();
+  info.filename_ = filename;
+  info.index_offset_ = sst_builder.GetIndexOffset();
+  info.bloom_filter_offset_ = sst_builder.GetBloomFilterOffset();
+  info.size_ = sst_builder.size();
+  info.sst_id_ = id;
+  info.blob_files_ = sst_builder.GetBlobFiles();
+  ASSERT_EQ(info.blob_files_.size(), 1);
+  ASSERT_FALSE(old_files.count(info.blob_files_[0]));
+  SSTable sst(info, 4096, false, true, nullptr, nullptr, 0, &blobs);
+  sst.SetRemoveTag(true);
+  /* The old blob files are removed with the last SSTables referring to them */
+  for (auto& old : ssts) {
+    old->SetRemoveTag(true);
+  }
+  ssts.clear();
+  for (auto old : old_files) {
+    ASSERT_FALSE(std::filesystem::exists(blobs.FileName(old)));
+  }
+  for (i = 0; i < N; i++) {
+    std::string value;
+    ASSERT_EQ(sst.Get(records[i].first, 3, &value), GetResult::kFound);
+    ASSERT_EQ(value, records[i].second);
+    ASSERT_EQ(compacted->Get(records[i].first, 3, &value), GetResult::kFound);
+    ASSERT_EQ(value, records[i].second);
+  }
+  compacted.reset();
+
+  /* A blob file that no SSTable refers to is left by a crash */
+  auto stray = blobs.NewBuilder(&gen);
+  auto index = stray->Add("key", "value");
+  stray->Finish();
+  std::string value;
+  blobs.Get(index, &value);
+  ASSERT_EQ(value, "value");
+  ASSERT_EQ(blobs.RemoveObsoleteFiles({info.blob_files_[0]}), 1);
+  ASSERT_TRUE(std::filesystem::exists(blobs.FileName(info.blob_files_[0])));
+  ASSERT_FALSE(std::filesystem::exists(blobs.FileName(index.file_id_)));
+
+  /* The compactions of a database leave only the blob files in use */
+  Options options;
+  options.db_path = "__tmpBlobTest/db/";
+  options.compaction_strategy_name = "dynamic";
+  options.sst_file_size = 64 * 1024;
+  options.write_buffer_size = 64 * 1024;
+  options.level0_compaction_trigger = 2;
+  options.min_blob_size = 100;
+  options.blob_garbage_collection_age_cutoff = 1;
+  std::filesystem::create_directories(options.db_path);
+  auto lsm = DBImpl::Create(options);
+  for (uint32_t round = 0; round < 3; round++) {
+    for (i = 0; i < N; i++) {
+      lsm->Put(records[i].first, std::string(200, 'a' + (i + round) % 26));
+    }
+  }
+  lsm->WaitForFlushAndCompaction();
+  std::set<std::string> live;
+  for (auto& level : lsm->GetSV()->GetVersion()->GetLevels()) {
+    for (auto& run : level.GetRuns()) {
+      for (auto& sst : run->GetSSTs()) {
+        for (auto id : sst->GetSSTInfo().blob_files_) {
+          live.insert(fmt::format("{}.blob", id));
+        }
+      }
+    }
+  }
+  std::set<std::string> files;
+  for (auto& entry : std::filesystem::directory_iterator(options.db_path)) {
+    if (entry.path().extension() == ".blob") {
+      files.insert(entry.path().filename());
+    }
+  }
+  ASSERT_FALSE(files.empty());
+  ASSERT_EQ(files, live);
+  for (i = 0; i < N; i++) {
+    std::string value;
+    ASSERT_TRUE(lsm->Get(records[i].first, &value));
+    ASSERT_EQ(value, std::string(200, 'a' + (i + 2) % 26));
+  }
+  lsm.reset();
+  std::filesystem::remove_all("__tmpBlobTest");
+}
+
+TEST(LSMTest, EnvTest) {
+  Options options;
+  options.sst_file_size = 64 * 1024 * 1024;
+  options.db_write_buffer_size = 1024 * 1024;
+  /* No compaction */
+  options.compaction_strategy_name = "";
+  auto env = std::make_shared<Env>(options);
+  options.db_path = "__tmpEnvTest/a/";
+  std::filesystem::create_directories(options.db_path);
+  auto a = DBImpl::Create(options, env);
+  options.db_path = "__tmpEnvTest/b/";
+  std::filesystem::create_directories(options.db_path);
+  auto b = DBImpl::Create(options, env);
+  std::string value(1000, 'x');
+  b->Put("b", value);
+  /* a exceeds the budget long before its MemTable reaches sst_file_size */
+  for (uint32_t i = 0; i < 4000; i++) {
+    a->Put(fmt::format("{:08}", i), value);
+  }
+  a->WaitForFlushAndCompaction();
+  ASSERT_FALSE(a->GetSV()->GetVersion()->GetLevels().empty());
+  /* b is not flushed since its MemTable is the smaller one */
+  ASSERT_TRUE(b->GetSV()->GetVersion()->GetLevels().empty());
+  /* The flushed records are read from the SSTables */
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < 4000; i++) {
+    keys.push_back(fmt::format("{:08}", i));
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  for (auto& v : a->MultiGet(key_slices)) {
+    ASSERT_EQ(v, value);
+  }
+  ASSERT_LT(env->GetMutableMemoryUsage(), options.db_write_buffer_size);
+  ASSERT_EQ(env->GetMemoryUsage(),
+      a->GetMutableMemoryUsage() + b->GetMutableMemoryUsage());
+  a.reset();
+  b.reset();
+  ASSERT_EQ(env->GetMemoryUsage(), 0);
+  ASSERT_EQ(env->GetMutableMemoryUsage(), 0);
+  std::filesystem::remove_all("__tmpEnvTest");
+}
+
+TEST(LSMTest, EnvFlushRequestTest) {
+  Options options;
+  options.sst_file_size = 64 * 1024 * 1024;
+  options.db_write_buffer_size = 256 * 1024;
+  /* The flush requests find the immutable MemTables full. */
+  options.max_immutable_count = 1;
+  options.max_background_jobs = 1;
+  options.compaction_strategy_name = "";
+  auto env = std::make_shared<Env>(options);
+  std::vector<std::unique_ptr<DBImpl>> dbs;
+  for (uint32_t i = 0; i < 4; i++) {
+    options.db_path = fmt::format("__tmpEnvFlushRequestTest/{}/", i);
+    std::filesystem::create_directories(options.db_path);
+    dbs.push_back(DBImpl::Create(options, env));
+  }
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 8; t++) {
+    threads.emplace_back([&, t]() {
+      std::string value(500, 'x');
+      for (uint32_t i = 0; i < 10000; i++) {
+        dbs[(i + t) % dbs.size()]->Put(fmt::format("{}{:08}", t, i), value);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  /* The pending requests are served by the next writes and flushes. */
+  for (uint32_t i = 0; i < 100 && env->GetMutableMemoryUsage() >=
+                                      options.db_write_buffer_size / 8 * 7;
+       i++) {
+    for (auto& db : dbs) {
+      db->Put("z", "z");
+      db->WaitForFlushAndCompaction();
+    }
   }
-  // Read integers and strings.
-  {
-    auto buf = std::unique_ptr<char[]>(new char[writer.size()]);
-    ReadFile("__tmpLSMFileWriterTest", false).Read(buf.get(), writer.size(), 0);
-    std::mt19937_64 rgen(0x202403152244);
-    for (uint32_t i = 0, off = 0; i < write_n; i++) {
-      uint64_t ans = *reinterpret_cast<uint64_t*>(buf.get() + off);
-      off += sizeof(uint64_t);
-      ASSERT_EQ(ans, rgen());
-      std::uniform_int_distribution<> dis(1, 13);
-      size_t len = dis(rgen);
-      for (uint32_t i = 0; i < len; i++) {
-        ASSERT_EQ(rgen() % 256, (uint8_t)(buf[off]));
-        off += 1;
+  ASSERT_LT(env->GetMutableMemoryUsage(), options.db_write_buffer_size);
+  /* No record is lost by the flushes */
+  for (uint32_t t = 0; t < 8; t++) {
+    std::vector<std::string> keys;
+    for (uint32_t i = 0; i < 10000; i++) {
+      keys.push_back(fmt::format("{}{:08}", t, i));
+    }
+    for (uint32_t i = 0; i < dbs.size(); i++) {
+      std::vector<Slice> key_slices;
+      for (uint32_t j = (dbs.size() + i - t % dbs.size()) % dbs.size();
+           j < keys.size(); j += dbs.size()) {
+        key_slices.push_back(keys[j]);
+      }
+      for (auto& v : dbs[i]->MultiGet(key_slices)) {
+        ASSERT_EQ(v, std::string(500, 'x'));
       }
     }
   }
-  std::remove("__tmpLSMFileWriterTest");
+  dbs.clear();
+  ASSERT_EQ(env->GetMemoryUsage(), 0);
+  std::filesystem::remove_all("__tmpEnvFlushRequestTest");
 }
 
-TEST(LSMTest, BlockTest) {
-  FileWriter writer(
-      std::make_unique<SeqWriteFile>("__tmpLSMBlockTest", false), 4096);
-  BlockBuilder builder(16384, &writer);
-  uint32_t N = 512, klen = 5, vlen = 6;
-  auto kv = GenKVData(0x202403152328, N, klen, vlen);
-  /* Store the key-value pairs into the block */
-  std::sort(kv.begin(), kv.end());
-  for (uint32_t i = 0; i < N; i++) {
-    ASSERT_TRUE(builder.Append(
-        ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value()));
+TEST(LSMTest, ManifestTest) {
+  std::filesystem::create_directories("__tmpManifestTest");
+  std::vector<std::shared_ptr<SSTable>> ssts;
+  for (uint32_t i = 0; i < 6; i++) {
+    auto filename = fmt::format("__tmpManifestTest/{}.sst", i);
+    SSTableBuilder builder(
+        std::make_unique<FileWriter>(
+            std::make_unique<SeqWriteFile>(filename, false), 1 << 20),
+        4096, 10);
+    for (uint32_t j = 0; j < 10; j++) {
+      builder.Append(
+          ParsedKey(fmt::format("{:08}", i * 10 + j), 1, RecordType::Value),
+          "value");
+    }
+    builder.Finish();
+    SSTInfo info;
+    info.count_ = builder.count();
+    info.filename_ = filename;
+    info.index_offset_ = builder.GetIndexOffset();
+    info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+    info.size_ = builder.size();
+    info.sst_id_ = i;
+    ssts.push_back(std::make_shared<SSTable>(info, 4096, false));
   }
-  builder.Finish();
-  /* Flush the block data to disk */
-  writer.Flush();
-  /* Read the block from the file */
-  auto buf = std::unique_ptr<char[]>(new char[writer.size()]);
-  ReadFile("__tmpLSMBlockTest", false).Read(buf.get(), writer.size(), 0);
-  for (uint32_t i = 0; i < N; i++) {
-    BlockHandle handle;
-    handle.offset_ = 0;
-    handle.size_ = builder.size();
-    handle.count_ = builder.count();
-    BlockIterator it(buf.get(), handle);
-    it.Seek(kv[i].key(), 1);
-    for (uint32_t j = i; j < N; j++) {
-      ASSERT_TRUE(it.Valid());
-      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[j].key());
-      ASSERT_EQ(it.value(), kv[j].value());
-      it.Next();
+  auto run = [&](std::vector<size_t> ids) {
+    std::vector<std::shared_ptr<SSTable>> ret;
+    for (auto id : ids) {
+      ret.push_back(ssts[id]);
     }
-    ASSERT_FALSE(it.Valid());
+    return std::make_shared<SortedRun>(ret, 4096, false);
+  };
+  using Layout =
+      std::vector<std::pair<size_t, std::vector<std::vector<size_t>>>>;
+  auto layout = [](const Version& version) {
+    Layout ret;
+    for (auto& level : version.GetLevels()) {
+      ret.emplace_back(level.GetID(), std::vector<std::vector<size_t>>());
+      for (auto& run : level.GetRuns()) {
+        ret.back().second.emplace_back();
+        for (auto& sst : run->GetSSTs()) {
+          ret.back().second.back().push_back(sst->GetSSTInfo().sst_id_);
+        }
+      }
+    }
+    return ret;
+  };
+  auto info_layout = [](const std::vector<LevelInfo>& levels) {
+    Layout ret;
+    for (auto& level : levels) {
+      ret.emplace_back(level.id_, std::vector<std::vector<size_t>>());
+      for (auto& run : level.runs_) {
+        ret.back().second.emplace_back();
+        for (auto& info : run) {
+          ret.back().second.back().push_back(info.sst_id_);
+        }
+      }
+    }
+    return ret;
+  };
+  std::vector<std::shared_ptr<Version>> versions;
+  versions.push_back(std::make_shared<Version>());
+  /* An ingestion to L1 */
+  versions.push_back(std::make_shared<Version>(*versions.back()));
+  versions.back()->Append(1, run({0, 1, 2}));
+  /* A flush to L0 */
+  versions.push_back(std::make_shared<Version>(*versions.back()));
+  versions.back()->Append(0, run({3}));
+  /* A compaction of 3 and 1 into 4 and 5 */
+  std::vector<Level> levels;
+  levels.emplace_back(0);
+  levels.emplace_back(
+      1, std::vector<std::shared_ptr<SortedRun>>{run({0, 4, 5, 2})});
+  versions.push_back(std::make_shared<Version>(std::move(levels)));
+  auto filename = ManifestFileName("__tmpManifestTest", 1);
+  {
+    ManifestWriter writer(filename);
+    for (size_t i = 1; i < versions.size(); i++) {
+      auto edit = VersionEdit::Diff(*versions[i - 1], *versions[i]);
+      edit.seq_ = i;
+      writer.AddEdit(edit);
+    }
+    ASSERT_EQ(writer.count(), 3);
   }
-  std::remove("__tmpLSMBlockTest");
+  ASSERT_EQ(ParseManifestFileName("MANIFEST-1"), 1);
+  ASSERT_FALSE(ParseManifestFileName("MANIFEST-1.tmp").has_value());
+  auto replay = [&]() {
+    std::vector<LevelInfo> infos;
+    ManifestReader reader(filename);
+    VersionEdit edit;
+    while (reader.ReadEdit(&edit)) {
+      edit.Apply(&infos);
+    }
+    return std::make_pair(infos, edit.seq_);
+  };
+  auto [infos, seq] = replay();
+  ASSERT_EQ(info_layout(infos), layout(*versions[3]));
+  ASSERT_EQ(seq, 3);
+  /* The last edit is torn by a crash */
+  std::filesystem::resize_file(
+      filename, std::filesystem::file_size(filename) - 1);
+  std::tie(infos, seq) = replay();
+  ASSERT_EQ(info_layout(infos), layout(*versions[2]));
+  ASSERT_EQ(seq, 2);
+  versions.clear();
+  ssts.clear();
+  std::filesystem::remove_all("__tmpManifestTest");
 }
 
-TEST(LSMTest, SSTableTest) {
+TEST(LSMTest, MergeTest) {
+  auto enc = [](int64_t x) {
+    return std::string(reinterpret_cast<const char*>(&x), sizeof(x));
+  };
+  Int64AddOperator op;
+  std::vector<std::string> operands{enc(2), enc(3)};
+  ASSERT_EQ(MergeOperands(op, "k", nullptr, operands), enc(5));
+  auto ten = enc(10);
+  Slice base = ten;
+  ASSERT_EQ(MergeOperands(op, "k", &base, operands), enc(15));
+  ASSERT_THROW(op.Merge("k", nullptr, "bad"), wing::DBException);
+  /* Merge operands on a value, on nothing and on a deletion */
+  MemTable mt;
+  mt.Put("a", 1, enc(10));
+  mt.Merge("a", 2, enc(1));
+  mt.Merge("a", 3, enc(2));
+  mt.Merge("b", 4, enc(5));
+  mt.Del("c", 5);
+  mt.Merge("c", 6, enc(7));
+  std::string value;
+  operands.clear();
+  ASSERT_EQ(mt.Get("a", 3, &value, &operands), GetResult::kFound);
+  ASSERT_EQ(value, enc(10));
+  ASSERT_EQ(operands, (std::vector<std::string>{enc(2), enc(1)}));
+  operands.clear();
+  ASSERT_EQ(mt.Get("a", 2, &value, &operands), GetResult::kFound);
+  ASSERT_EQ(operands, std::vector<std::string>{enc(1)});
+  operands.clear();
+  ASSERT_EQ(mt.Get("b", 10, &value, &operands), GetResult::kNotFound);
+  ASSERT_EQ(operands, std::vector<std::string>{enc(5)});
+  operands.clear();
+  ASSERT_EQ(mt.Get("c", 10, &value, &operands), GetResult::kDelete);
+  ASSERT_EQ(operands, std::vector<std::string>{enc(7)});
+  ASSERT_THROW(mt.Get("a", 3, &value), wing::DBException);
+  /* The same records in an SSTable */
+  auto filename = "__tmpMergeTest";
   SSTableBuilder builder(
       std::make_unique<FileWriter>(
-          std::make_unique<SeqWriteFile>("__tmpLSMSSTableTest", false), 4096),
+          std::make_unique<SeqWriteFile>(filename, false), 1 << 20),
       4096, 10);
-  uint32_t klen = 9, vlen = 13, N = 1e5;
-  auto kv =
-      GenKVDataWithRandomLen(0x202403152328, N, {klen - 1, klen}, {1, vlen});
-  auto kv_notinsert =
-      GenKVDataWithRandomLen(0x202403220115, 5e6, {klen - 1, klen}, {1, vlen});
-  std::sort(kv.begin(), kv.end());
-  /* Store the sorted key-value pairs into the SSTable */
-  for (uint32_t i = 0; i < N; i++) {
-    builder.Append(ParsedKey(kv[i].key(), 1, RecordType::Value), kv[i].value());
-  }
-  /* Flush the SSTable data to disk */
+  builder.Append(ParsedKey("a", 3, RecordType::Merge), enc(2));
+  builder.Append(ParsedKey("a", 2, RecordType::Merge), enc(1));
+  builder.Append(ParsedKey("a", 1, RecordType::Value), enc(10));
+  builder.Append(ParsedKey("b", 4, RecordType::Merge), enc(5));
+  builder.Append(ParsedKey("c", 6, RecordType::Merge), enc(7));
+  builder.Append(ParsedKey("c", 5, RecordType::Deletion), "");
   builder.Finish();
-  DB_INFO("SSTable size: {} bytes", builder.size());
-  /* Read the SSTable from the file */
   SSTInfo info;
-  info.count_ = N;
-  info.size_ = builder.size();
-  info.filename_ = "__tmpLSMSSTableTest";
+  info.count_ = builder.count();
+  info.filename_ = filename;
   info.index_offset_ = builder.GetIndexOffset();
   info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+  info.size_ = builder.size();
   info.sst_id_ = 0;
-  SSTable sst(info, 4096, false);
-  /* Test SSTable::Get */
-  for (uint32_t i = 0; i < N; i++) {
-    std::string value;
-    ASSERT_EQ(sst.Get(kv[i].key(), 1, &value), GetResult::kFound);
-    ASSERT_EQ(value, kv[i].value());
-    ASSERT_EQ(sst.Get(kv[i].key(), 0, &value), GetResult::kNotFound);
+  {
+    SSTable sst(info, 4096, false);
+    operands.clear();
+    ASSERT_EQ(sst.Get("a", 3, &value, &operands), GetResult::kFound);
+    ASSERT_EQ(value, enc(10));
+    ASSERT_EQ(operands, (std::vector<std::string>{enc(2), enc(1)}));
+    operands.clear();
+    ASSERT_EQ(sst.Get("b", 10, &value, &operands), GetResult::kNotFound);
+    ASSERT_EQ(operands, std::vector<std::string>{enc(5)});
+    operands.clear();
+    ASSERT_EQ(sst.Get("c", 10, &value, &operands), GetResult::kDelete);
+    ASSERT_EQ(operands, std::vector<std::string>{enc(7)});
+    std::vector<KeyContext> contexts(3);
+    std::vector<KeyContext*> keys;
+    for (size_t i = 0; i < contexts.size(); i++) {
+      contexts[i].key_ = std::vector<Slice>{"a", "b", "c"}[i];
+      keys.push_back(&contexts[i]);
+    }
+    sst.MultiGet(keys, 10);
+    ASSERT_EQ(contexts[0].result_, GetResult::kFound);
+    Slice a_base = contexts[0].value_;
+    ASSERT_EQ(MergeOperands(op, "a", &a_base, contexts[0].operands_),
+        enc(13));
+    ASSERT_EQ(contexts[1].result_, GetResult::kNotFound);
+    ASSERT_EQ(MergeOperands(op, "b", nullptr, contexts[1].operands_), enc(5));
+    ASSERT_EQ(contexts[2].result_, GetResult::kDelete);
+    ASSERT_EQ(contexts[2].operands_, std::vector<std::string>{enc(7)});
   }
-  /* Test bloom filter */
-  wing::wing_testing::TestTimeout(
-      [&]() {
-        wing::StopWatch sw;
-        for (uint32_t i = 0; i < kv_notinsert.size(); i++) {
-          std::string value;
-          ASSERT_EQ(
-              sst.Get(kv_notinsert[i].key(), 1, &value), GetResult::kNotFound);
-        }
-        DB_INFO("Cost: {}s", sw.GetTimeInSeconds());
-      },
-      1000, "Did you utilize bloom filter? ");
-  /* Test SSTable::Seek */
-  for (uint32_t i = 0; i < 500; i++) {
-    size_t id = i * (N / 499);
-    auto it = sst.Seek(kv[id].key(), 1);
-    for (uint32_t j = id; j < N; j++) {
-      ASSERT_TRUE(it.Valid());
-      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[j].key());
-      ASSERT_EQ(it.value(), kv[j].value());
-      it.Next();
+  std::filesystem::remove(filename);
+  /* A compaction combines the operands of a key in each snapshot stripe */
+  MemTable many;
+  seq_t seq = 0;
+  many.Put("a", ++seq, enc(10));
+  for (uint32_t i = 0; i < 1000; i++) {
+    many.Merge("a", ++seq, enc(1));
+  }
+  for (uint32_t i = 0; i < 1000; i++) {
+    many.Merge("b", ++seq, enc(2));
+  }
+  many.Del("c", ++seq);
+  for (uint32_t i = 0; i < 100; i++) {
+    many.Merge("c", ++seq, enc(3));
+  }
+  seq_t snapshot = seq + 50;
+  for (uint32_t i = 0; i < 100; i++) {
+    many.Merge("d", ++seq, enc(1));
+  }
+  FileNameGenerator gen("__tmpMergeTest", 0);
+  CompactionJob job(&gen, 4096, 1 << 20, 4096, 10, false);
+  job.SetMergeOperator(&op);
+  job.SetSnapshots({snapshot});
+  SortedRun run(job.Run(many.Begin()), 4096, false);
+  run.SetRemoveTag(true);
+  std::vector<std::tuple<std::string, seq_t, RecordType, std::string>>
+      records;
+  for (auto it = run.Begin(); it.Valid(); it.Next()) {
+    ParsedKey key(it.key());
+    records.emplace_back(key.user_key_, key.seq_, key.type_, it.value());
+  }
+  std::vector<std::tuple<std::string, seq_t, RecordType, std::string>>
+      expected{{"a", 1001, RecordType::Value, enc(1010)},
+          {"b", 2001, RecordType::Merge, enc(2000)},
+          {"c", 2102, RecordType::Value, enc(300)},
+          {"d", seq, RecordType::Merge, enc(50)},
+          {"d", snapshot, RecordType::Merge, enc(50)}};
+  ASSERT_EQ(records, expected);
+  operands.clear();
+  ASSERT_EQ(run.Get("d", snapshot, &value, &operands), GetResult::kNotFound);
+  ASSERT_EQ(MergeOperands(op, "d", nullptr, operands), enc(50));
+  operands.clear();
+  ASSERT_EQ(run.Get("d", seq, &value, &operands), GetResult::kNotFound);
+  ASSERT_EQ(MergeOperands(op, "d", nullptr, operands), enc(100));
+}
+
+TEST(LSMTest, RangeFilterTest) {
+  /* 8-byte big-endian keys, so the key prefixes are the integers */
+  auto key = [](uint64_t x) {
+    x = __builtin_bswap64(x);
+    return std::string(reinterpret_cast<const char*>(&x), sizeof(x));
+  };
+  auto build = [&](uint32_t id, uint64_t begin, uint64_t end,
+                   bool range_del) {
+    auto filename = fmt::format("__tmpRangeFilterTest{}", id);
+    SSTableBuilder builder(
+        std::make_unique<FileWriter>(
+            std::make_unique<SeqWriteFile>(filename, false), 1 << 20),
+        4096, 10);
+    builder.SetRangeFilter(10);
+    for (uint64_t i = begin; i < end; i++) {
+      builder.Append(ParsedKey(key(i * 1000), 1, RecordType::Value), "v");
     }
-    ASSERT_FALSE(it.Valid());
+    if (range_del) {
+      builder.AddRangeTombstone(
+          RangeTombstone{key(begin * 1000), key(begin * 1000 + 10), 2});
+    }
+    builder.Finish();
+    SSTInfo info;
+    info.count_ = builder.count();
+    info.filename_ = filename;
+    info.index_offset_ = builder.GetIndexOffset();
+    info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
+    info.size_ = builder.size();
+    info.sst_id_ = id;
+    return std::make_shared<SSTable>(info, 4096, false);
+  };
+  auto sst = build(0, 0, 10000, false);
+  ASSERT_TRUE(sst->VerifyChecksums());
+  size_t skipped = 0;
+  for (uint64_t i = 0; i + 1 < 10000; i++) {
+    ASSERT_TRUE(sst->RangeMayMatch(key(i * 1000), key(i * 1000)));
+    ASSERT_TRUE(sst->RangeMayMatch(key(i * 1000 + 1), key(i * 1000 + 1000)));
+    skipped += !sst->RangeMayMatch(key(i * 1000 + 1), key(i * 1000 + 999));
   }
-  std::remove("__tmpLSMSSTableTest");
+  ASSERT_GE(skipped, 9800);
+  /* Out of the key range */
+  ASSERT_FALSE(sst->RangeMayMatch(key(10000000), key(20000000)));
+  /* The range tombstones may delete the keys of other SSTables */
+  auto sst_del = build(1, 20000, 30000, true);
+  /* Both the range filter and the range tombstones are checked */
+  ASSERT_TRUE(sst_del->VerifyChecksums());
+  ASSERT_TRUE(sst_del->RangeMayMatch(key(20000001), key(20000999)));
+  /* The runs without keys in the range are skipped */
+  std::vector<Level> levels;
+  levels.emplace_back(0,
+      std::vector<std::shared_ptr<SortedRun>>{
+          std::make_shared<SortedRun>(
+              std::vector<std::shared_ptr<SSTable>>{sst}, 4096, false),
+          std::make_shared<SortedRun>(
+              std::vector<std::shared_ptr<SSTable>>{sst_del}, 4096, false)});
+  Version version(std::move(levels));
+  auto runs = [](const Version& v) {
+    return v.GetLevels()[0].GetRuns().size();
+  };
+  ASSERT_EQ(runs(*version.FilterRange(key(5000000), key(5000000))), 1);
+  ASSERT_EQ(runs(*version.FilterRange(key(9999000), key(20000000))), 2);
+  ASSERT_EQ(runs(*version.FilterRange(key(0), key(-1))), 2);
+  ASSERT_EQ(runs(*version.FilterRange(key(40000000), key(50000000))), 0);
+  sst.reset();
+  sst_del.reset();
+  std::filesystem::remove("__tmpRangeFilterTest0");
+  std::filesystem::remove("__tmpRangeFilterTest1");
 }
 
-TEST(LSMTest, SortedRunTest) {
-  uint32_t klen = 9, vlen = 13, N = 3e6, fileN = 10;
-  auto kv =
-      GenKVDataWithRandomLen(0x202403191425, N, {klen - 1, klen}, {1, vlen});
-  std::sort(kv.begin(), kv.end());
-  /* Create 10 SSTables */
-  wing::StopWatch sw;
-  std::vector<SSTInfo> sst_infos;
+TEST(LSMTest, TableCacheTest) {
+  uint32_t N = 1000, fileN = 8;
+  std::vector<SSTInfo> infos;
   for (uint32_t i = 0; i < fileN; i++) {
-    auto L = (i) * (N / fileN);
-    auto R = std::min((i + 1) * (N / fileN), N);
+    auto filename = fmt::format("__tmpTableCacheTest{}", i);
     SSTableBuilder builder(
         std::make_unique<FileWriter>(
-            std::make_unique<SeqWriteFile>(
-                fmt::format("__tmpSortedRunTest{}", i), false),
-            1 << 20),
+            std::make_unique<SeqWriteFile>(filename, false), 1 << 20),
         4096, 10);
-    /* Build the SSTable */
-    for (uint32_t j = L; j < R; j++) {
+    for (uint32_t j = 0; j < N; j++) {
       builder.Append(
-          ParsedKey(kv[j].key(), 1, RecordType::Value), kv[j].value());
+          ParsedKey(fmt::format("{:08}", i * N + j), 1, RecordType::Value),
+          fmt::format("value{}", i * N + j));
     }
     builder.Finish();
-    /* Add the SSTable*/
     SSTInfo info;
     info.count_ = builder.count();
-    info.filename_ = fmt::format("__tmpSortedRunTest{}", i);
+    info.filename_ = filename;
     info.index_offset_ = builder.GetIndexOffset();
     info.bloom_filter_offset_ = builder.GetBloomFilterOffset();
     info.size_ = builder.size();
     info.sst_id_ = i;
-    sst_infos.emplace_back(info);
+    infos.push_back(info);
   }
-  DB_INFO("Create Sorted Run Cost: {}s", sw.GetTimeInSeconds());
-  sw.Reset();
-  SortedRun sr(sst_infos, 4096, false);
-  /* Test SortedRun::Get */
-  for (uint32_t i = 0; i < N; i++) {
+  Cache cache(CacheOptions{});
+  TableCache table_cache(3, 1 << 20);
+  {
+    auto run = std::make_shared<SortedRun>(infos, 4096, false, true, &cache,
+        nullptr, 256 * 1024, nullptr, &table_cache);
+    ASSERT_EQ(table_cache.count(), 3);
+    auto& ssts = run->GetSSTs();
+    /* An iterator keeps its SSTable open after it is evicted */
+    auto it = ssts[0]->Begin();
     std::string value;
-    ASSERT_EQ(sr.Get(kv[i].key(), 1, &value), GetResult::kFound);
-    ASSERT_EQ(value, kv[i].value());
-  }
-  DB_INFO("SortedRun::Get Cost: {}s", sw.GetTimeInSeconds());
-  sw.Reset();
-  /* Test SortedRun::Seek */
-  for (uint32_t i = 0; i < 500; i++) {
-    size_t step = (N / 499);
-    size_t id = i * step;
-    auto it = sr.Seek(kv[id].key(), 1);
-    for (uint32_t j = id; j < N && j < id + step * 10; j++) {
-      ASSERT_TRUE(it.Valid());
-      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[j].key());
-      ASSERT_EQ(it.value(), kv[j].value());
-      it.Next();
+    for (uint32_t i = 0; i < fileN * N; i += 7) {
+      ASSERT_EQ(ssts[i / N]->Get(fmt::format("{:08}", i), 1, &value),
+          GetResult::kFound);
+      ASSERT_EQ(value, fmt::format("value{}", i));
+      ASSERT_LE(table_cache.count(), 3);
     }
-  }
-  DB_INFO("Short Range Scan Cost: {}s", sw.GetTimeInSeconds());
-  sw.Reset();
-  /* Test SortedRun::Begin */
-  {
-    auto it = sr.Begin();
-    for (uint32_t i = 0; i < N; i++) {
+    for (uint32_t j = 0; j < N; j++, it.Next()) {
       ASSERT_TRUE(it.Valid());
-      ASSERT_EQ(ParsedKey(it.key()).user_key_, kv[i].key());
-      ASSERT_EQ(it.value(), kv[i].value());
-      it.Next();
+      ASSERT_EQ(ParsedKey(it.key()).user_key_, fmt::format("{:08}", j));
     }
     ASSERT_FALSE(it.Valid());
+    /* Pinned SSTables are not in the cache */
+    ssts[0]->SetPinned(true);
+    ssts[1]->SetPinned(true);
+    ssts[1]->Get(fmt::format("{:08}", N), 1, &value);
+    ASSERT_EQ(ssts[0]->GetPartitions().size(), 1);
+    ASSERT_LE(table_cache.count(), 3);
+    ssts[1]->SetPinned(false);
+    ASSERT_EQ(table_cache.count(), 3);
+    ASSERT_EQ(ssts[5]->Get(fmt::format("{:08}", 5 * N + 1), 1, &value),
+        GetResult::kFound);
   }
-  DB_INFO("Full Scan Cost: {}s", sw.GetTimeInSeconds());
-  /* Delete all SSTables */
-  for (uint32_t i = 0; i < fileN * 2; i++) {
-    std::remove(fmt::format("__tmpSortedRunTest{}", i).c_str());
+  ASSERT_EQ(table_cache.count(), 0);
+  ASSERT_EQ(table_cache.size(), 0);
+  /* The memory limit */
+  TableCache small_cache(100, 1);
+  {
+    auto run = std::make_shared<SortedRun>(infos, 4096, false, true, &cache,
+        nullptr, 256 * 1024, nullptr, &small_cache);
+    ASSERT_EQ(small_cache.count(), 1);
+  }
+  for (uint32_t i = 0; i < fileN; i++) {
+    std::filesystem::remove(fmt::format("__tmpTableCacheTest{}", i));
   }
 }
 
@@ -672,6 +2518,174 @@ TEST(LSMTest, CompactionBasicTest) {
 
 //////////////// LSM Tests
 
+TEST(LSMTest, DynamicLeveledCompactionPickerTest) {
+  std::filesystem::create_directories("__tmpDynamicLeveledTest");
+  FileNameGenerator gen("__tmpDynamicLeveledTest/", 0);
+  wing::ThreadPool pool(4);
+  IngestionJob job(&gen, 4096, 64 * 1024, 4096, 10, false);
+  /* A sorted run of keys in [begin, end). The SSTable del_sst has deletions. */
+  auto make_run = [&](uint32_t begin, uint32_t end, size_t del_sst = -1) {
+    std::vector<std::pair<std::string, std::string>> records;
+    for (uint32_t i = begin; i < end; i++) {
+      records.emplace_back(fmt::format("{:08}", i), std::string(92, 'v'));
+    }
+    auto ssts = job.Run(records, 1, &pool);
+    if (del_sst < ssts.size()) {
+      ssts[del_sst].num_deletions_ = ssts[del_sst].count_ / 2;
+    }
+    auto run = std::make_shared<SortedRun>(ssts, 4096, false);
+    run->SetRemoveTag(true);
+    return run;
+  };
+
+  /* A small database compacts L0 to the last level directly. */
+  {
+    DynamicLeveledCompactionPicker picker(4, 64 * 1024, 4, 5);
+    Version version;
+    for (uint32_t i = 0; i < 4; i++) {
+      version.Append(0, make_run(i * 100, i * 100 + 100));
+    }
+    auto targets = picker.GetTargetSizes(version);
+    ASSERT_EQ(targets, std::vector<size_t>(
+                           {0, 0, 0, 0, std::numeric_limits<size_t>::max()}));
+    auto compaction = picker.Get(&version);
+    ASSERT_TRUE(compaction != nullptr);
+    ASSERT_EQ(compaction->src_level(), 0);
+    ASSERT_EQ(compaction->target_level(), 4);
+    ASSERT_EQ(compaction->input_runs().size(), 4);
+    ASSERT_EQ(compaction->target_sorted_run(), nullptr);
+  }
+
+  /* The target sizes follow the size of the last level. */
+  auto bottom = make_run(0, 40000);
+  size_t S = bottom->size();
+  DynamicLeveledCompactionPicker picker(4, S / 20, 4, 5);
+  Version version;
+  version.Append(4, bottom);
+  auto targets = picker.GetTargetSizes(version);
+  ASSERT_EQ(targets[1], 0);
+  ASSERT_EQ(targets[2], S / 16);
+  ASSERT_EQ(targets[3], S / 4);
+  ASSERT_EQ(picker.Get(&version), nullptr);
+  /* L0 is compacted to the base level L2 */
+  auto version0 = version;
+  for (uint32_t i = 0; i < 4; i++) {
+    version0.Append(0, make_run(i * 100, i * 100 + 100));
+  }
+  auto compaction = picker.Get(&version0);
+  ASSERT_TRUE(compaction != nullptr);
+  ASSERT_EQ(compaction->src_level(), 0);
+  ASSERT_EQ(compaction->target_level(), 2);
+  /* L3 exceeds its target, and the SSTable with deletions is picked first. */
+  auto run = make_run(0, 15000, 2);
+  version.Append(3, run);
+  compaction = picker.Get(&version);
+  ASSERT_TRUE(compaction != nullptr);
+  ASSERT_EQ(compaction->src_level(), 3);
+  ASSERT_EQ(compaction->target_level(), 4);
+  ASSERT_EQ(compaction->input_ssts().size(), 1);
+  ASSERT_EQ(compaction->input_ssts()[0], run->GetSSTs()[2]);
+  ASSERT_EQ(compaction->target_sorted_run(), bottom);
+  /* The SSTables being compacted are skipped. */
+  run->GetSSTs()[2]->SetCompactionInProcess(true);
+  compaction = picker.Get(&version);
+  ASSERT_TRUE(compaction != nullptr);
+  ASSERT_NE(compaction->input_ssts()[0], run->GetSSTs()[2]);
+  run->GetSSTs()[2]->SetCompactionInProcess(false);
+  /* Nothing is merged into a target whose SSTables are being compacted. */
+  bottom->GetSSTs()[0]->SetCompactionInProcess(true);
+  ASSERT_EQ(picker.Get(&version), nullptr);
+  bottom->GetSSTs()[0]->SetCompactionInProcess(false);
+  ASSERT_GT(CompensatedSize(run->GetSSTs()[2]->GetSSTInfo()),
+      run->GetSSTs()[2]->GetSSTInfo().size_);
+
+  bottom.reset();
+  run.reset();
+  version = Version();
+  version0 = Version();
+  std::filesystem::remove_all("__tmpDynamicLeveledTest");
+}
+
+TEST(LSMTest, SplitKeyRangesTest) {
+  std::filesystem::create_directories("__tmpSplitKeyRangesTest");
+  FileNameGenerator gen("__tmpSplitKeyRangesTest/", 0);
+  wing::ThreadPool pool(4);
+  std::vector<std::pair<std::string, std::string>> records;
+  for (uint32_t i = 0; i < 40000; i++) {
+    records.emplace_back(fmt::format("{:08}", i), std::string(92, 'v'));
+  }
+  auto ssts = IngestionJob(&gen, 4096, 64 * 1024, 4096, 10, false)
+                  .Run(records, 1, &pool);
+  auto run = std::make_shared<SortedRun>(ssts, 4096, false);
+  run->SetRemoveTag(true);
+  Compaction compaction({}, {run}, 0, 1, nullptr, false);
+  CompactionJob job(&gen, 4096, 64 * 1024, 4096, 10, false);
+  /* The ranges have similar sizes, and they separate user keys */
+  auto boundaries = job.SplitKeyRanges(compaction, 4);
+  ASSERT_EQ(boundaries.size(), 3);
+  for (uint32_t i = 0; i < boundaries.size(); i++) {
+    ASSERT_EQ(boundaries[i].back(), '\0');
+    ASSERT_GT(boundaries[i], fmt::format("{:08}", 10000 * i + 5000));
+    ASSERT_LT(boundaries[i], fmt::format("{:08}", 10000 * i + 15000));
+  }
+  /* A single range has no boundary */
+  ASSERT_TRUE(job.SplitKeyRanges(compaction, 1).empty());
+  run.reset();
+  std::filesystem::remove_all("__tmpSplitKeyRangesTest");
+}
+
+TEST(LSMTest, SubcompactionTest) {
+  Options options;
+  options.db_path = "__tmpSubcompactionTest/";
+  options.compaction_strategy_name = "dynamic";
+  options.sst_file_size = 64 * 1024;
+  options.write_buffer_size = 64 * 1024;
+  options.level0_compaction_trigger = 2;
+  options.compaction_size_ratio = 4;
+  options.max_subcompactions = 4;
+  std::filesystem::create_directories(options.db_path);
+  auto lsm = DBImpl::Create(options);
+  uint32_t N = 50000;
+  std::vector<std::string> expected(N);
+  std::mt19937_64 rgen(0x202409171530);
+  for (uint32_t i = 0; i < 4 * N; i++) {
+    uint32_t id = rgen() % N;
+    expected[id] = fmt::format("{}-{}", i, std::string(rgen() % 64, 'v'));
+    lsm->Put(fmt::format("{:08}", id), expected[id]);
+  }
+  lsm->WaitForFlushAndCompaction();
+  /* The levels below L0 are sorted runs of disjoint SSTables */
+  size_t num_ssts = 0;
+  for (auto& level : lsm->GetSV()->GetVersion()->GetLevels()) {
+    if (level.GetID() == 0) {
+      continue;
+    }
+    ASSERT_LE(level.GetRuns().size(), 1);
+    for (auto& run : level.GetRuns()) {
+      auto& ssts = run->GetSSTs();
+      for (uint32_t i = 1; i < ssts.size(); i++) {
+        ASSERT_TRUE(ssts[i - 1]->GetLargestKey() < ssts[i]->GetSmallestKey());
+      }
+      num_ssts += ssts.size();
+    }
+  }
+  ASSERT_GT(num_ssts, 1);
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < N; i++) {
+    keys.push_back(fmt::format("{:08}", i));
+  }
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  auto values = lsm->MultiGet(key_slices);
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_EQ(values[i].has_value(), !expected[i].empty());
+    if (values[i]) {
+      ASSERT_EQ(*values[i], expected[i]);
+    }
+  }
+  lsm.reset();
+  std::filesystem::remove_all(options.db_path);
+}
+
 TEST(LSMTest, LSMBasicTest) {
   Options options;
   options.db_path = "__tmpLSMBasicTest/";
@@ -1134,6 +3148,51 @@ TEST(LSMTest, LSMDuplicateKeyTest) {
   }
 }
 
+TEST(LSMTest, LSMIngestTest) {
+  uint32_t N = 1e5;
+  std::vector<std::pair<std::string, std::string>> records;
+  for (uint32_t i = 0; i < N; i++) {
+    records.emplace_back(fmt::format("{:08}", (i * 7919) % N), "old");
+  }
+  records.emplace_back(fmt::format("{:08}", 5), "new");
+  Options options;
+  options.db_path = "__tmpLSMIngestTest/";
+  options.sst_file_size = 256 * 1024;
+  /* No compaction, so the ingested runs stay where they are placed */
+  options.compaction_strategy_name = "";
+  std::filesystem::create_directories(options.db_path);
+  auto lsm = DBImpl::Create(options);
+  lsm->Ingest(records);
+  ASSERT_EQ(lsm->CurrentSeq(), 1);
+  auto runs = lsm->GetSV()->GetVersion()->GetLevels()[0].GetRuns();
+  ASSERT_EQ(runs.size(), 1);
+  ASSERT_GT(runs[0]->SSTCount(), 1);
+  /* It overlaps the first one, so it is placed in L0 as the newest run. */
+  lsm->Ingest({{fmt::format("{:08}", 6), "newer"}, {"z", "1"}});
+  ASSERT_EQ(lsm->GetSV()->GetVersion()->GetLevels()[0].GetRuns().size(), 2);
+  std::vector<std::string> keys;
+  for (uint32_t i = 0; i < N; i++) {
+    keys.push_back(fmt::format("{:08}", i));
+  }
+  keys.push_back("z");
+  keys.push_back("zz");
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  auto values = lsm->MultiGet(key_slices);
+  for (uint32_t i = 0; i < N; i++) {
+    ASSERT_TRUE(values[i].has_value());
+    ASSERT_EQ(*values[i], i == 5 ? "new" : i == 6 ? "newer" : "old");
+  }
+  ASSERT_EQ(values[N], "1");
+  ASSERT_FALSE(values[N + 1].has_value());
+  /* The range tombstone in the MemTable is flushed before the ingestion. */
+  lsm->DeleteRange("y", "yz");
+  lsm->Ingest({{"y1", "2"}});
+  Slice y1 = "y1";
+  ASSERT_EQ(lsm->MultiGet({&y1, 1})[0], "2");
+  lsm.reset();
+  std::filesystem::remove_all(options.db_path);
+}
+
 TEST(LSMTest, LeveledCompactionTest) {
   Options options;
   options.sst_file_size = 1 << 20;